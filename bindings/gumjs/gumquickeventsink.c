@@ -8,17 +8,23 @@
 
 #include "gumquickvalue.h"
 
-#include <gum/gumspinlock.h>
 #include <string.h>
 
+typedef struct _GumQuickEventRing GumQuickEventRing;
+typedef struct _GumQuickEventRingCache GumQuickEventRingCache;
+
 struct _GumQuickJSEventSink
 {
   GObject parent;
 
-  GumSpinlock lock;
-  GArray * queue;
+  guint serial;
+  GumQuickEventRing * volatile rings;
   guint queue_capacity;
   guint queue_drain_interval;
+  gboolean compact;
+  volatile gint dropped;
+  guint dropped_reported;
+  guint64 * dropped_total;
 
   GumQuickCore * core;
   GMainContext * main_context;
@@ -28,6 +34,25 @@ struct _GumQuickJSEventSink
   GSource * source;
 };
 
+struct _GumQuickEventRing
+{
+  GumQuickEventRing * next;
+  GumThreadId thread_id;
+
+  volatile gint head;
+  volatile gint tail;
+  guint size;
+  GumAddress previous;
+  GumAddress drained_previous;
+  guint8 data[1];
+};
+
+struct _GumQuickEventRingCache
+{
+  guint sink_serial;
+  GumQuickEventRing * ring;
+};
+
 struct _GumQuickNativeEventSink
 {
   GObject parent;
@@ -45,11 +70,17 @@ static GumEventType gum_quick_js_event_sink_query_mask (GumEventSink * sink);
 static void gum_quick_js_event_sink_start (GumEventSink * sink);
 static void gum_quick_js_event_sink_process (GumEventSink * sink,
     const GumEvent * event, GumCpuContext * cpu_context);
+static GumQuickEventRing * gum_quick_js_event_sink_obtain_ring (
+    GumQuickJSEventSink * self);
 static void gum_quick_js_event_sink_flush (GumEventSink * sink);
 static void gum_quick_js_event_sink_stop (GumEventSink * sink);
 static gboolean gum_quick_js_event_sink_stop_when_idle (
     GumQuickJSEventSink * self);
 static gboolean gum_quick_js_event_sink_drain (GumQuickJSEventSink * self);
+static void gum_quick_event_ring_drain (GumQuickEventRing * self,
+    GByteArray * buffer, gboolean compact, GHashTable * frequencies);
+static void gum_quick_count_call (GHashTable * frequencies,
+    const GumEvent * ev);
 
 static void gum_quick_native_event_sink_iface_init (gpointer g_iface,
     gpointer iface_data);
@@ -72,6 +103,10 @@ G_DEFINE_TYPE_EXTENDED (GumQuickNativeEventSink,
                         G_IMPLEMENT_INTERFACE (GUM_TYPE_EVENT_SINK,
                             gum_quick_native_event_sink_iface_init))
 
+static GPrivate gum_quick_event_ring_cache_private =
+    G_PRIVATE_INIT (g_free);
+static volatile gint gum_quick_js_event_sink_next_serial = 1;
+
 GumEventSink *
 gum_quick_event_sink_new (JSContext * ctx,
                           const GumQuickEventSinkOptions * options)
@@ -94,10 +129,10 @@ gum_quick_event_sink_new (JSContext * ctx,
 
     sink = g_object_new (GUM_QUICK_TYPE_JS_EVENT_SINK, NULL);
 
-    sink->queue = g_array_sized_new (FALSE, FALSE, sizeof (GumEvent),
-        options->queue_capacity);
     sink->queue_capacity = options->queue_capacity;
     sink->queue_drain_interval = options->queue_drain_interval;
+    sink->compact = options->compact;
+    sink->dropped_total = options->dropped_events;
 
     g_object_ref (options->core->script);
     sink->core = options->core;
@@ -136,7 +171,7 @@ gum_quick_js_event_sink_iface_init (gpointer g_iface,
 static void
 gum_quick_js_event_sink_init (GumQuickJSEventSink * self)
 {
-  gum_spinlock_init (&self->lock);
+  self->serial = g_atomic_int_add (&gum_quick_js_event_sink_next_serial, 1);
 }
 
 static void
@@ -177,10 +212,15 @@ static void
 gum_quick_js_event_sink_finalize (GObject * obj)
 {
   GumQuickJSEventSink * self = GUM_QUICK_JS_EVENT_SINK (obj);
+  GumQuickEventRing * ring, * next;
 
   g_assert (self->source == NULL);
 
-  g_array_free (self->queue, TRUE);
+  for (ring = self->rings; ring != NULL; ring = next)
+  {
+    next = ring->next;
+    g_free (ring);
+  }
 
   G_OBJECT_CLASS (gum_quick_js_event_sink_parent_class)->finalize (obj);
 }
@@ -212,11 +252,98 @@ gum_quick_js_event_sink_process (GumEventSink * sink,
                                  GumCpuContext * cpu_context)
 {
   GumQuickJSEventSink * self = GUM_QUICK_JS_EVENT_SINK_CAST (sink);
+  GumQuickEventRing * ring;
+  guint8 record[GUM_COMPACT_EVENT_MAX_SIZE];
+  const guint8 * data;
+  GumAddress previous;
+  guint n, head, tail, available, first;
+
+  ring = gum_quick_js_event_sink_obtain_ring (self);
+
+  if (self->compact)
+  {
+    previous = ring->previous;
+    n = gum_event_encode_compact (event, &previous, record);
+    data = record;
+  }
+  else
+  {
+    n = sizeof (GumEvent);
+    data = (const guint8 *) event;
+  }
+
+  head = g_atomic_int_get (&ring->head);
+  tail = ring->tail;
+  available = (head > tail) ? head - tail - 1 : ring->size - tail + head - 1;
+  if (n > available)
+  {
+    g_atomic_int_inc (&self->dropped);
+    return;
+  }
+
+  first = MIN (n, ring->size - tail);
+  memcpy (ring->data + tail, data, first);
+  if (first != n)
+    memcpy (ring->data, data + first, n - first);
+
+  if (self->compact)
+    ring->previous = previous;
 
-  gum_spinlock_acquire (&self->lock);
-  if (self->queue->len != self->queue_capacity)
-    g_array_append_val (self->queue, *event);
-  gum_spinlock_release (&self->lock);
+  g_atomic_int_set (&ring->tail, (tail + n) % ring->size);
+}
+
+static GumQuickEventRing *
+gum_quick_js_event_sink_obtain_ring (GumQuickJSEventSink * self)
+{
+  GumQuickEventRingCache * cache;
+  GumThreadId thread_id;
+  GumQuickEventRing * ring;
+
+  cache = g_private_get (&gum_quick_event_ring_cache_private);
+  if (cache == NULL)
+  {
+    cache = g_new0 (GumQuickEventRingCache, 1);
+    g_private_set (&gum_quick_event_ring_cache_private, cache);
+  }
+  else if (cache->sink_serial == self->serial)
+  {
+    return cache->ring;
+  }
+
+  thread_id = gum_process_get_current_thread_id ();
+
+  for (ring = g_atomic_pointer_get (&self->rings);
+      ring != NULL;
+      ring = ring->next)
+  {
+    if (ring->thread_id == thread_id)
+      break;
+  }
+
+  if (ring == NULL)
+  {
+    guint size = (self->queue_capacity * sizeof (GumEvent)) + 1;
+
+    ring = g_malloc (G_STRUCT_OFFSET (GumQuickEventRing, data) + size);
+    ring->thread_id = thread_id;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->size = size;
+    ring->previous = 0;
+    ring->drained_previous = 0;
+
+    do
+    {
+      ring->next = g_atomic_pointer_get (&self->rings);
+    }
+    while (!g_atomic_pointer_compare_and_exchange (&self->rings, ring->next,
+        ring));
+  }
+
+  cache->sink_serial = self->serial;
+  cache->ring = ring;
+
+  return ring;
 }
 
 static void
@@ -272,60 +399,62 @@ static gboolean
 gum_quick_js_event_sink_drain (GumQuickJSEventSink * self)
 {
   GumQuickCore * core = self->core;
-  JSContext * ctx = core->ctx;
+  JSContext * ctx;
+  GumQuickEventRing * ring;
+  guint dropped;
+  GByteArray * buffer;
+  GHashTable * frequencies;
+  gsize size;
   gpointer buffer_data;
   JSValue buffer_val;
-  guint len, size;
   GumQuickScope scope;
 
   if (core == NULL)
     return FALSE;
+  ctx = core->ctx;
 
-  len = self->queue->len;
-  if (len == 0)
-    return TRUE;
-  size = len * sizeof (GumEvent);
+  dropped = g_atomic_int_get (&self->dropped);
+  if (self->dropped_total != NULL)
+    *self->dropped_total += dropped - self->dropped_reported;
+  self->dropped_reported = dropped;
 
-  buffer_data = g_memdup (self->queue->data, size);
+  buffer = g_byte_array_new ();
+  frequencies = !JS_IsNull (self->on_call_summary)
+      ? g_hash_table_new (NULL, NULL)
+      : NULL;
 
-  gum_spinlock_acquire (&self->lock);
-  g_array_remove_range (self->queue, 0, len);
-  gum_spinlock_release (&self->lock);
+  for (ring = g_atomic_pointer_get (&self->rings);
+      ring != NULL;
+      ring = ring->next)
+  {
+    gum_quick_event_ring_drain (ring, buffer, self->compact, frequencies);
+  }
+
+  size = buffer->len;
+  if (size == 0)
+  {
+    if (frequencies != NULL)
+      g_hash_table_unref (frequencies);
+    g_byte_array_unref (buffer);
+    return TRUE;
+  }
+
+  buffer_data = g_byte_array_free (buffer, FALSE);
 
   _gum_quick_scope_enter (&scope, core);
 
   buffer_val = JS_NewArrayBuffer (ctx, buffer_data, size,
       _gum_quick_array_buffer_free, buffer_data, FALSE);
 
-  if (!JS_IsNull (self->on_call_summary))
+  if (frequencies != NULL)
   {
     JSValue summary;
-    GHashTable * frequencies;
-    GumCallEvent * ev;
-    guint i;
     GHashTableIter iter;
     gpointer target, count;
     gchar target_str[32];
 
     summary = JS_NewObject (ctx);
 
-    frequencies = g_hash_table_new (NULL, NULL);
-
-    ev = buffer_data;
-    for (i = 0; i != len; i++)
-    {
-      if (ev->type == GUM_CALL)
-      {
-        gsize n;
-
-        n = GPOINTER_TO_SIZE (g_hash_table_lookup (frequencies, ev->target));
-        n++;
-        g_hash_table_insert (frequencies, ev->target, GSIZE_TO_POINTER (n));
-      }
-
-      ev++;
-    }
-
     g_hash_table_iter_init (&iter, frequencies);
     while (g_hash_table_iter_next (&iter, &target, &count))
     {
@@ -358,6 +487,87 @@ gum_quick_js_event_sink_drain (GumQuickJSEventSink * self)
   return TRUE;
 }
 
+/*
+ * Compact chunks have to be decoded to learn the address that the next chunk
+ * is relative to, so calls are counted during that same pass.
+ */
+static void
+gum_quick_event_ring_drain (GumQuickEventRing * self,
+                            GByteArray * buffer,
+                            gboolean compact,
+                            GHashTable * frequencies)
+{
+  guint head, tail, start, n;
+
+  head = self->head;
+  tail = g_atomic_int_get (&self->tail);
+  if (head == tail)
+    return;
+
+  if (compact)
+  {
+    guint8 base[GUM_COMPACT_EVENT_MAX_SIZE];
+
+    g_byte_array_append (buffer, base,
+        gum_event_encode_compact_base (self->drained_previous, base));
+  }
+
+  start = buffer->len;
+
+  if (tail > head)
+  {
+    g_byte_array_append (buffer, self->data + head, tail - head);
+  }
+  else
+  {
+    g_byte_array_append (buffer, self->data + head, self->size - head);
+    g_byte_array_append (buffer, self->data, tail);
+  }
+
+  g_atomic_int_set (&self->head, tail);
+
+  if (compact)
+  {
+    const guint8 * cursor = buffer->data + start;
+    const guint8 * end = buffer->data + buffer->len;
+    GumEvent ev;
+
+    while (cursor != end)
+    {
+      n = gum_event_decode_compact (cursor, end - cursor,
+          &self->drained_previous, &ev);
+      if (n == 0)
+        break;
+      cursor += n;
+
+      if (frequencies != NULL)
+        gum_quick_count_call (frequencies, &ev);
+    }
+  }
+  else if (frequencies != NULL)
+  {
+    const GumEvent * ev = (const GumEvent *) (buffer->data + start);
+    const GumEvent * end = (const GumEvent *) (buffer->data + buffer->len);
+
+    for (; ev != end; ev++)
+      gum_quick_count_call (frequencies, ev);
+  }
+}
+
+static void
+gum_quick_count_call (GHashTable * frequencies,
+                      const GumEvent * ev)
+{
+  gsize n;
+
+  if (ev->type != GUM_CALL)
+    return;
+
+  n = GPOINTER_TO_SIZE (g_hash_table_lookup (frequencies, ev->call.target));
+  n++;
+  g_hash_table_insert (frequencies, ev->call.target, GSIZE_TO_POINTER (n));
+}
+
 static void
 gum_quick_native_event_sink_class_init (GumQuickNativeEventSinkClass * klass)
 {
@@ -39,6 +39,8 @@ struct _GumQuickEventSinkOptions
 
   guint queue_capacity;
   guint queue_drain_interval;
+  guint64 * dropped_events;
+  gboolean compact;
   JSValue on_receive;
   JSValue on_call_summary;
 
@@ -158,6 +158,7 @@ static gboolean gum_quick_interceptor_on_flush_timer_tick (
     GumQuickInterceptor * self);
 
 GUMJS_DECLARE_FUNCTION (gumjs_interceptor_attach)
+GUMJS_DECLARE_FUNCTION (gumjs_interceptor_attach_many)
 static void gum_quick_invocation_listener_destroy (
     GumQuickInvocationListener * listener);
 static void gum_quick_interceptor_detach (GumQuickInterceptor * self,
@@ -282,6 +283,7 @@ static void gum_quick_interceptor_release_invocation_retval (
 static const JSCFunctionListEntry gumjs_interceptor_entries[] =
 {
   JS_CFUNC_DEF ("_attach", 3, gumjs_interceptor_attach),
+  JS_CFUNC_DEF ("_attachMany", 3, gumjs_interceptor_attach_many),
   JS_CFUNC_DEF ("detachAll", 0, gumjs_interceptor_detach_all),
   JS_CFUNC_DEF ("_replace", 0, gumjs_interceptor_replace),
   JS_CFUNC_DEF ("revert", 0, gumjs_interceptor_revert),
@@ -611,6 +613,148 @@ propagate_exception:
   }
 }
 
+GUMJS_DEFINE_FUNCTION (gumjs_interceptor_attach_many)
+{
+  JSValue targets_val = args->elements[0];
+  JSValue cb_val = args->elements[1];
+  JSValue data_val = args->elements[2];
+  GumQuickInterceptor * self;
+  JSValue on_enter_js, on_leave_js;
+  GumQuickCHook on_enter_c, on_leave_c;
+  guint n, i;
+  gpointer * targets = NULL;
+  GumQuickInvocationListener * listener = NULL;
+  gpointer listener_function_data;
+  GumAttachReturn * results = NULL;
+  guint n_attached;
+
+  self = gumjs_get_parent_module (core);
+
+  if (!_gum_quick_args_parse (args, "AF*{onEnter?,onLeave?}", &targets_val,
+      &on_enter_js, &on_enter_c,
+      &on_leave_js, &on_leave_c))
+    goto propagate_exception;
+
+  if (!_gum_quick_array_get_length (ctx, targets_val, core, &n))
+    goto propagate_exception;
+
+  targets = g_new (gpointer, n);
+  for (i = 0; i != n; i++)
+  {
+    JSValue val;
+    gboolean valid;
+
+    val = JS_GetPropertyUint32 (ctx, targets_val, i);
+    valid = _gum_quick_native_pointer_get (ctx, val, core, &targets[i]);
+    JS_FreeValue (ctx, val);
+
+    if (!valid)
+      goto propagate_exception;
+  }
+
+  if (!JS_IsNull (on_enter_js) || !JS_IsNull (on_leave_js))
+  {
+    GumQuickJSCallListener * l;
+
+    l = g_object_new (GUM_QUICK_TYPE_JS_CALL_LISTENER, NULL);
+    l->on_enter = JS_DupValue (ctx, on_enter_js);
+    l->on_leave = JS_DupValue (ctx, on_leave_js);
+
+    listener = GUM_QUICK_INVOCATION_LISTENER (l);
+  }
+  else if (on_enter_c != NULL || on_leave_c != NULL)
+  {
+    GumQuickCCallListener * l;
+
+    l = g_object_new (GUM_QUICK_TYPE_C_CALL_LISTENER, NULL);
+    l->on_enter = on_enter_c;
+    l->on_leave = on_leave_c;
+
+    listener = GUM_QUICK_INVOCATION_LISTENER (l);
+  }
+  else
+  {
+    goto expected_callback;
+  }
+
+  if (!JS_IsUndefined (data_val))
+  {
+    if (!_gum_quick_native_pointer_get (ctx, data_val, core,
+        &listener_function_data))
+      goto propagate_exception;
+  }
+  else
+  {
+    listener_function_data = NULL;
+  }
+
+  listener->parent = self;
+
+  results = g_new (GumAttachReturn, n);
+
+  n_attached = gum_interceptor_attach_many (self->interceptor,
+      (const gpointer *) targets, n, GUM_INVOCATION_LISTENER (listener),
+      listener_function_data, results);
+
+  if (n_attached != n)
+    goto unable_to_attach;
+
+  listener->wrapper = JS_NewObjectClass (ctx, self->invocation_listener_class);
+  JS_SetOpaque (listener->wrapper, listener);
+  JS_DefinePropertyValue (ctx, listener->wrapper,
+      GUM_QUICK_CORE_ATOM (core, resource),
+      JS_DupValue (ctx, cb_val),
+      0);
+
+  g_hash_table_add (self->invocation_listeners, listener);
+
+  g_free (results);
+  g_free (targets);
+
+  return JS_DupValue (ctx, listener->wrapper);
+
+unable_to_attach:
+  {
+    gum_interceptor_detach (self->interceptor,
+        GUM_INVOCATION_LISTENER (listener));
+
+    for (i = 0; results[i] == GUM_ATTACH_OK; i++)
+      ;
+
+    switch (results[i])
+    {
+      case GUM_ATTACH_WRONG_SIGNATURE:
+        _gum_quick_throw (ctx, "unable to intercept function at %p; "
+            "please file a bug", targets[i]);
+        break;
+      case GUM_ATTACH_ALREADY_ATTACHED:
+        _gum_quick_throw (ctx, "already attached to function at %p",
+            targets[i]);
+        break;
+      case GUM_ATTACH_POLICY_VIOLATION:
+        _gum_quick_throw_literal (ctx, "not permitted by code-signing policy");
+        break;
+      default:
+        g_assert_not_reached ();
+    }
+
+    goto propagate_exception;
+  }
+expected_callback:
+  {
+    _gum_quick_throw_literal (ctx, "expected at least one callback");
+    goto propagate_exception;
+  }
+propagate_exception:
+  {
+    g_clear_object (&listener);
+    g_free (results);
+    g_free (targets);
+
+    return JS_EXCEPTION;
+  }
+}
+
 static void
 gum_quick_invocation_listener_destroy (GumQuickInvocationListener * listener)
 {
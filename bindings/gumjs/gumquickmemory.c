@@ -54,7 +54,10 @@ struct _GumMemoryPatchContext
 struct _GumMemoryScanContext
 {
   GumMemoryRange range;
+  GArray * ranges;
+  guint threads;
   GumMatchPattern * pattern;
+  GumMatchPatternSet * pattern_set;
   JSValue on_match;
   JSValue on_error;
   JSValue on_complete;
@@ -140,6 +143,7 @@ GUMJS_DECLARE_FUNCTION (gumjs_memory_alloc_utf8_string)
 GUMJS_DECLARE_FUNCTION (gumjs_memory_alloc_utf16_string)
 
 GUMJS_DECLARE_FUNCTION (gumjs_memory_scan)
+GUMJS_DECLARE_FUNCTION (gumjs_memory_scan_ranges)
 static void gum_memory_scan_context_free (GumMemoryScanContext * ctx);
 static void gum_memory_scan_context_run (GumMemoryScanContext * self);
 static gboolean gum_memory_scan_context_emit_match (GumAddress address,
@@ -147,6 +151,15 @@ static gboolean gum_memory_scan_context_emit_match (GumAddress address,
 GUMJS_DECLARE_FUNCTION (gumjs_memory_scan_sync)
 static gboolean gum_append_match (GumAddress address, gsize size,
     GumMemoryScanSyncContext * sc);
+GUMJS_DECLARE_FUNCTION (gumjs_memory_scan_patterns)
+static gboolean gum_memory_scan_context_emit_pattern_set_match (
+    GumAddress address, gsize size, guint pattern_index,
+    GumMemoryScanContext * self);
+GUMJS_DECLARE_FUNCTION (gumjs_memory_scan_patterns_sync)
+static gboolean gum_append_pattern_set_match (GumAddress address, gsize size,
+    guint pattern_index, GumMemoryScanSyncContext * sc);
+static gboolean gum_parse_pattern_set (JSContext * ctx, JSValue patterns_val,
+    GumQuickCore * core, GumMatchPatternSet ** set);
 
 GUMJS_DECLARE_FUNCTION (gumjs_memory_access_monitor_enable)
 GUMJS_DECLARE_FUNCTION (gumjs_memory_access_monitor_disable)
@@ -197,7 +210,10 @@ static const JSCFunctionListEntry gumjs_memory_entries[] =
   JS_CFUNC_DEF ("allocUtf16String", 0, gumjs_memory_alloc_utf16_string),
 
   JS_CFUNC_DEF ("scan", 0, gumjs_memory_scan),
+  JS_CFUNC_DEF ("scanRanges", 0, gumjs_memory_scan_ranges),
   JS_CFUNC_DEF ("scanSync", 0, gumjs_memory_scan_sync),
+  JS_CFUNC_DEF ("scanPatterns", 0, gumjs_memory_scan_patterns),
+  JS_CFUNC_DEF ("scanPatternsSync", 0, gumjs_memory_scan_patterns_sync),
 };
 
 static const JSCFunctionListEntry gumjs_memory_access_monitor_entries[] =
@@ -938,7 +954,45 @@ GUMJS_DEFINE_FUNCTION (gumjs_memory_scan)
     return JS_EXCEPTION;
   sc.range.base_address = GUM_ADDRESS (address);
   sc.range.size = size;
+  sc.ranges = NULL;
+  sc.threads = 0;
+  sc.pattern = gum_match_pattern_new_from_string (match_str);
+  sc.pattern_set = NULL;
+  sc.result = GUM_QUICK_MATCH_CONTINUE;
+  sc.ctx = ctx;
+  sc.core = core;
+
+  if (sc.pattern == NULL)
+    return _gum_quick_throw_literal (ctx, "invalid match pattern");
+
+  JS_DupValue (ctx, sc.on_match);
+  JS_DupValue (ctx, sc.on_error);
+  JS_DupValue (ctx, sc.on_complete);
+
+  _gum_quick_core_pin (core);
+  _gum_quick_core_push_job (core,
+      (GumScriptJobFunc) gum_memory_scan_context_run,
+      g_slice_dup (GumMemoryScanContext, &sc),
+      (GDestroyNotify) gum_memory_scan_context_free);
+
+  return JS_UNDEFINED;
+}
+
+GUMJS_DEFINE_FUNCTION (gumjs_memory_scan_ranges)
+{
+  GumMemoryScanContext sc;
+  GArray * ranges;
+  const gchar * match_str;
+
+  sc.threads = 0;
+  if (!_gum_quick_args_parse (args, "RsF{onMatch,onError?,onComplete}|u",
+      &ranges, &match_str, &sc.on_match, &sc.on_error, &sc.on_complete,
+      &sc.threads))
+    return JS_EXCEPTION;
+  sc.range.base_address = 0;
+  sc.range.size = 0;
   sc.pattern = gum_match_pattern_new_from_string (match_str);
+  sc.pattern_set = NULL;
   sc.result = GUM_QUICK_MATCH_CONTINUE;
   sc.ctx = ctx;
   sc.core = core;
@@ -946,6 +1000,10 @@ GUMJS_DEFINE_FUNCTION (gumjs_memory_scan)
   if (sc.pattern == NULL)
     return _gum_quick_throw_literal (ctx, "invalid match pattern");
 
+  sc.ranges = g_array_sized_new (FALSE, FALSE, sizeof (GumMemoryRange),
+      ranges->len);
+  g_array_append_vals (sc.ranges, ranges->data, ranges->len);
+
   JS_DupValue (ctx, sc.on_match);
   JS_DupValue (ctx, sc.on_error);
   JS_DupValue (ctx, sc.on_complete);
@@ -975,7 +1033,12 @@ gum_memory_scan_context_free (GumMemoryScanContext * self)
   _gum_quick_core_unpin (core);
   _gum_quick_scope_leave (&scope);
 
-  gum_match_pattern_free (self->pattern);
+  if (self->pattern != NULL)
+    gum_match_pattern_free (self->pattern);
+  if (self->pattern_set != NULL)
+    gum_match_pattern_set_free (self->pattern_set);
+  if (self->ranges != NULL)
+    g_array_free (self->ranges, TRUE);
 
   g_slice_free (GumMemoryScanContext, self);
 }
@@ -991,8 +1054,23 @@ gum_memory_scan_context_run (GumMemoryScanContext * self)
 
   if (gum_exceptor_try (exceptor, &exceptor_scope))
   {
-    gum_memory_scan (&self->range, self->pattern,
-        (GumMemoryScanMatchFunc) gum_memory_scan_context_emit_match, self);
+    if (self->pattern_set != NULL)
+    {
+      gum_memory_scan_pattern_set (&self->range, self->pattern_set,
+          (GumMemoryScanPatternSetMatchFunc)
+          gum_memory_scan_context_emit_pattern_set_match, self);
+    }
+    else if (self->ranges != NULL)
+    {
+      gum_memory_scan_ranges ((const GumMemoryRange *) self->ranges->data,
+          self->ranges->len, self->pattern, self->threads,
+          (GumMemoryScanMatchFunc) gum_memory_scan_context_emit_match, self);
+    }
+    else
+    {
+      gum_memory_scan (&self->range, self->pattern,
+          (GumMemoryScanMatchFunc) gum_memory_scan_context_emit_match, self);
+    }
   }
 
   _gum_quick_scope_enter (&script_scope, core);
@@ -1121,6 +1199,190 @@ gum_append_match (GumAddress address,
   return TRUE;
 }
 
+GUMJS_DEFINE_FUNCTION (gumjs_memory_scan_patterns)
+{
+  GumMemoryScanContext sc;
+  gpointer address;
+  gsize size;
+  JSValue patterns_val;
+
+  if (!_gum_quick_args_parse (args, "pZAF{onMatch,onError?,onComplete}",
+      &address, &size, &patterns_val, &sc.on_match, &sc.on_error,
+      &sc.on_complete))
+    return JS_EXCEPTION;
+
+  if (!gum_parse_pattern_set (ctx, patterns_val, core, &sc.pattern_set))
+    return JS_EXCEPTION;
+
+  sc.range.base_address = GUM_ADDRESS (address);
+  sc.range.size = size;
+  sc.ranges = NULL;
+  sc.threads = 0;
+  sc.pattern = NULL;
+  sc.result = GUM_QUICK_MATCH_CONTINUE;
+  sc.ctx = ctx;
+  sc.core = core;
+
+  JS_DupValue (ctx, sc.on_match);
+  JS_DupValue (ctx, sc.on_error);
+  JS_DupValue (ctx, sc.on_complete);
+
+  _gum_quick_core_pin (core);
+  _gum_quick_core_push_job (core,
+      (GumScriptJobFunc) gum_memory_scan_context_run,
+      g_slice_dup (GumMemoryScanContext, &sc),
+      (GDestroyNotify) gum_memory_scan_context_free);
+
+  return JS_UNDEFINED;
+}
+
+static gboolean
+gum_memory_scan_context_emit_pattern_set_match (GumAddress address,
+                                                gsize size,
+                                                guint pattern_index,
+                                                GumMemoryScanContext * self)
+{
+  gboolean proceed;
+  JSContext * ctx = self->ctx;
+  GumQuickCore * core = self->core;
+  GumQuickScope scope;
+  JSValue argv[3];
+  JSValue result;
+
+  _gum_quick_scope_enter (&scope, core);
+
+  argv[0] = _gum_quick_native_pointer_new (ctx, GSIZE_TO_POINTER (address),
+      core);
+  argv[1] = JS_NewUint32 (ctx, size);
+  argv[2] = JS_NewUint32 (ctx, pattern_index);
+
+  result = _gum_quick_scope_call (&scope, self->on_match, JS_UNDEFINED,
+      G_N_ELEMENTS (argv), argv);
+
+  JS_FreeValue (ctx, argv[0]);
+
+  proceed = _gum_quick_process_match_result (ctx, &result, &self->result);
+
+  _gum_quick_scope_leave (&scope);
+
+  return proceed;
+}
+
+GUMJS_DEFINE_FUNCTION (gumjs_memory_scan_patterns_sync)
+{
+  JSValue result;
+  gpointer address;
+  gsize size;
+  JSValue patterns_val;
+  GumMemoryRange range;
+  GumMatchPatternSet * set;
+  GumExceptorScope scope;
+
+  if (!_gum_quick_args_parse (args, "pZA", &address, &size, &patterns_val))
+    return JS_EXCEPTION;
+
+  if (!gum_parse_pattern_set (ctx, patterns_val, core, &set))
+    return JS_EXCEPTION;
+
+  range.base_address = GUM_ADDRESS (address);
+  range.size = size;
+
+  result = JS_NewArray (ctx);
+
+  if (gum_exceptor_try (core->exceptor, &scope))
+  {
+    GumMemoryScanSyncContext sc;
+
+    sc.matches = result;
+    sc.index = 0;
+    sc.ctx = ctx;
+    sc.core = core;
+
+    gum_memory_scan_pattern_set (&range, set,
+        (GumMemoryScanPatternSetMatchFunc) gum_append_pattern_set_match, &sc);
+  }
+
+  gum_match_pattern_set_free (set);
+
+  if (gum_exceptor_catch (core->exceptor, &scope))
+  {
+    JS_FreeValue (ctx, result);
+    result = _gum_quick_throw_native (ctx, &scope.exception, core);
+  }
+
+  return result;
+}
+
+static gboolean
+gum_append_pattern_set_match (GumAddress address,
+                              gsize size,
+                              guint pattern_index,
+                              GumMemoryScanSyncContext * sc)
+{
+  JSContext * ctx = sc->ctx;
+  GumQuickCore * core = sc->core;
+  JSValue m;
+
+  m = JS_NewObject (ctx);
+  JS_DefinePropertyValue (ctx, m, GUM_QUICK_CORE_ATOM (core, address),
+      _gum_quick_native_pointer_new (ctx, GSIZE_TO_POINTER (address), core),
+      JS_PROP_C_W_E);
+  JS_DefinePropertyValue (ctx, m, GUM_QUICK_CORE_ATOM (core, size),
+      JS_NewUint32 (ctx, size),
+      JS_PROP_C_W_E);
+  JS_DefinePropertyValueStr (ctx, m, "pattern",
+      JS_NewUint32 (ctx, pattern_index),
+      JS_PROP_C_W_E);
+
+  JS_DefinePropertyValueUint32 (ctx, sc->matches, sc->index, m, JS_PROP_C_W_E);
+  sc->index++;
+
+  return TRUE;
+}
+
+static gboolean
+gum_parse_pattern_set (JSContext * ctx,
+                       JSValue patterns_val,
+                       GumQuickCore * core,
+                       GumMatchPatternSet ** set)
+{
+  guint n, i;
+  GPtrArray * match_strs;
+
+  if (!_gum_quick_array_get_length (ctx, patterns_val, core, &n))
+    return FALSE;
+
+  match_strs = g_ptr_array_new_full (n, (GDestroyNotify) g_free);
+  for (i = 0; i != n; i++)
+  {
+    JSValue val;
+    const char * str;
+
+    val = JS_GetPropertyUint32 (ctx, patterns_val, i);
+    str = JS_ToCString (ctx, val);
+    JS_FreeValue (ctx, val);
+    if (str == NULL)
+    {
+      g_ptr_array_unref (match_strs);
+      return FALSE;
+    }
+
+    g_ptr_array_add (match_strs, g_strdup (str));
+    JS_FreeCString (ctx, str);
+  }
+
+  *set = gum_match_pattern_set_new_from_strings (
+      (const gchar * const *) match_strs->pdata, match_strs->len);
+  g_ptr_array_unref (match_strs);
+  if (*set == NULL)
+  {
+    _gum_quick_throw_literal (ctx, "invalid match pattern");
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
 GUMJS_DEFINE_FUNCTION (gumjs_memory_access_monitor_enable)
 {
   GumQuickMemory * self;
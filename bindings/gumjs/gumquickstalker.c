@@ -19,6 +19,7 @@ typedef struct _GumQuickTransformerClass GumQuickTransformerClass;
 typedef struct _GumQuickIterator GumQuickIterator;
 typedef struct _GumQuickCallout GumQuickCallout;
 typedef struct _GumQuickCallProbe GumQuickCallProbe;
+typedef struct _GumQuickStatsContext GumQuickStatsContext;
 
 struct _GumQuickTransformer
 {
@@ -69,6 +70,13 @@ struct _GumQuickCallProbe
   GumQuickStalker * parent;
 };
 
+struct _GumQuickStatsContext
+{
+  JSContext * ctx;
+  JSValue result;
+  guint index;
+};
+
 struct _GumQuickProbeArgs
 {
   JSValue wrapper;
@@ -86,8 +94,11 @@ GUMJS_DECLARE_SETTER (gumjs_stalker_set_queue_capacity)
 GUMJS_DECLARE_GETTER (gumjs_stalker_get_queue_drain_interval)
 GUMJS_DECLARE_SETTER (gumjs_stalker_set_queue_drain_interval)
 
+GUMJS_DECLARE_GETTER (gumjs_stalker_get_dropped_events)
+
 GUMJS_DECLARE_FUNCTION (gumjs_stalker_flush)
 GUMJS_DECLARE_FUNCTION (gumjs_stalker_garbage_collect)
+GUMJS_DECLARE_FUNCTION (gumjs_stalker_query_stats)
 GUMJS_DECLARE_FUNCTION (gumjs_stalker_exclude)
 GUMJS_DECLARE_FUNCTION (gumjs_stalker_follow)
 GUMJS_DECLARE_FUNCTION (gumjs_stalker_unfollow)
@@ -163,6 +174,8 @@ static GumQuickProbeArgs * gum_quick_stalker_obtain_probe_args (
 static void gum_quick_stalker_release_probe_args (GumQuickStalker * self,
     GumQuickProbeArgs * args);
 
+static gboolean gum_quick_emit_stats (const GumStalkerStats * stats,
+    GumQuickStatsContext * sc);
 static JSValue gum_encode_pointer (JSContext * ctx, gpointer value,
     gboolean stringify, GumQuickCore * core);
 
@@ -174,8 +187,10 @@ static const JSCFunctionListEntry gumjs_stalker_entries[] =
       gumjs_stalker_set_queue_capacity),
   JS_CGETSET_DEF ("queueDrainInterval", gumjs_stalker_get_queue_drain_interval,
       gumjs_stalker_set_queue_drain_interval),
+  JS_CGETSET_DEF ("droppedEvents", gumjs_stalker_get_dropped_events, NULL),
   JS_CFUNC_DEF ("flush", 0, gumjs_stalker_flush),
   JS_CFUNC_DEF ("garbageCollect", 0, gumjs_stalker_garbage_collect),
+  JS_CFUNC_DEF ("queryStats", 0, gumjs_stalker_query_stats),
   JS_CFUNC_DEF ("_exclude", 0, gumjs_stalker_exclude),
   JS_CFUNC_DEF ("_follow", 0, gumjs_stalker_follow),
   JS_CFUNC_DEF ("unfollow", 0, gumjs_stalker_unfollow),
@@ -241,6 +256,7 @@ _gum_quick_stalker_init (GumQuickStalker * self,
   self->stalker = NULL;
   self->queue_capacity = 16384;
   self->queue_drain_interval = 250;
+  self->dropped_events = 0;
 
   self->flush_timer = NULL;
 
@@ -464,6 +480,13 @@ GUMJS_DEFINE_SETTER (gumjs_stalker_set_queue_drain_interval)
   return JS_UNDEFINED;
 }
 
+GUMJS_DEFINE_GETTER (gumjs_stalker_get_dropped_events)
+{
+  GumQuickStalker * self = gumjs_get_parent_module (core);
+
+  return JS_NewInt64 (ctx, self->dropped_events);
+}
+
 GUMJS_DEFINE_FUNCTION (gumjs_stalker_flush)
 {
   GumStalker * stalker =
@@ -484,6 +507,76 @@ GUMJS_DEFINE_FUNCTION (gumjs_stalker_garbage_collect)
   return JS_UNDEFINED;
 }
 
+GUMJS_DEFINE_FUNCTION (gumjs_stalker_query_stats)
+{
+  GumStalker * stalker;
+  GumQuickStatsContext sc;
+
+  stalker = _gum_quick_stalker_get (gumjs_get_parent_module (core));
+
+  sc.ctx = ctx;
+  sc.result = JS_NewArray (ctx);
+  sc.index = 0;
+
+  gum_stalker_query_stats (stalker,
+      (GumFoundStalkerStatsFunc) gum_quick_emit_stats, &sc);
+
+  return sc.result;
+}
+
+static gboolean
+gum_quick_emit_stats (const GumStalkerStats * stats,
+                      GumQuickStatsContext * sc)
+{
+  JSContext * ctx = sc->ctx;
+  JSValue s, gates;
+  guint i;
+
+  s = JS_NewObject (ctx);
+
+  JS_DefinePropertyValueStr (ctx, s, "threadId",
+      JS_NewInt64 (ctx, stats->thread_id), JS_PROP_C_W_E);
+  JS_DefinePropertyValueStr (ctx, s, "blocksCompiled",
+      JS_NewInt64 (ctx, stats->blocks_compiled), JS_PROP_C_W_E);
+  JS_DefinePropertyValueStr (ctx, s, "blocksRecompiled",
+      JS_NewInt64 (ctx, stats->blocks_recompiled), JS_PROP_C_W_E);
+  JS_DefinePropertyValueStr (ctx, s, "tracesFormed",
+      JS_NewInt64 (ctx, stats->traces_formed), JS_PROP_C_W_E);
+  JS_DefinePropertyValueStr (ctx, s, "snapshotComparisons",
+      JS_NewInt64 (ctx, stats->snapshot_comparisons), JS_PROP_C_W_E);
+  JS_DefinePropertyValueStr (ctx, s, "codeBytes",
+      JS_NewInt64 (ctx, stats->code_bytes), JS_PROP_C_W_E);
+  JS_DefinePropertyValueStr (ctx, s, "dataBytes",
+      JS_NewInt64 (ctx, stats->data_bytes), JS_PROP_C_W_E);
+  JS_DefinePropertyValueStr (ctx, s, "icHits",
+      JS_NewInt64 (ctx, stats->ic_hits), JS_PROP_C_W_E);
+  JS_DefinePropertyValueStr (ctx, s, "icMisses",
+      JS_NewInt64 (ctx, stats->ic_misses), JS_PROP_C_W_E);
+  JS_DefinePropertyValueStr (ctx, s, "backpatches",
+      JS_NewInt64 (ctx, stats->backpatches), JS_PROP_C_W_E);
+  JS_DefinePropertyValueStr (ctx, s, "cacheFlushes",
+      JS_NewInt64 (ctx, stats->cache_flushes), JS_PROP_C_W_E);
+  JS_DefinePropertyValueStr (ctx, s, "evictedBlocks",
+      JS_NewInt64 (ctx, stats->evicted_blocks), JS_PROP_C_W_E);
+  JS_DefinePropertyValueStr (ctx, s, "evictedBytes",
+      JS_NewInt64 (ctx, stats->evicted_bytes), JS_PROP_C_W_E);
+
+  gates = JS_NewObject (ctx);
+  for (i = 0; i != stats->num_entry_gates; i++)
+  {
+    const GumStalkerEntryGateStats * gate = &stats->entry_gates[i];
+
+    JS_DefinePropertyValueStr (ctx, gates, gate->name,
+        JS_NewInt64 (ctx, gate->hits), JS_PROP_C_W_E);
+  }
+  JS_DefinePropertyValueStr (ctx, s, "entryGates", gates, JS_PROP_C_W_E);
+
+  JS_DefinePropertyValueUint32 (ctx, sc->result, sc->index++, s,
+      JS_PROP_C_W_E);
+
+  return TRUE;
+}
+
 GUMJS_DEFINE_FUNCTION (gumjs_stalker_exclude)
 {
   GumStalker * stalker;
@@ -523,10 +616,12 @@ GUMJS_DEFINE_FUNCTION (gumjs_stalker_follow)
   so.main_context = gum_script_scheduler_get_js_context (core->scheduler);
   so.queue_capacity = parent->queue_capacity;
   so.queue_drain_interval = parent->queue_drain_interval;
+  so.dropped_events = &parent->dropped_events;
 
-  if (!_gum_quick_args_parse (args, "ZF*?uF?F?pp", &thread_id,
+  if (!_gum_quick_args_parse (args, "ZF*?uF?F?ppt", &thread_id,
       &transformer_callback_js, &transformer_callback_c, &so.event_mask,
-      &so.on_receive, &so.on_call_summary, &so.on_event, &user_data))
+      &so.on_receive, &so.on_call_summary, &so.on_event, &user_data,
+      &so.compact))
     return JS_EXCEPTION;
 
   so.user_data = user_data;
@@ -25,6 +25,7 @@ struct _GumQuickStalker
   GumStalker * stalker;
   guint queue_capacity;
   guint queue_drain_interval;
+  guint64 dropped_events;
 
   GSource * flush_timer;
 
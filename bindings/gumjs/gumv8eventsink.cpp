@@ -22,6 +22,9 @@ struct _GumV8JSEventSink
   GArray * queue;
   guint queue_capacity;
   guint queue_drain_interval;
+  guint dropped;
+  guint64 * dropped_total;
+  gboolean compact;
 
   GumV8Core * core;
   GMainContext * main_context;
@@ -52,6 +55,8 @@ static void gum_v8_js_event_sink_flush (GumEventSink * sink);
 static void gum_v8_js_event_sink_stop (GumEventSink * sink);
 static gboolean gum_v8_js_event_sink_stop_when_idle (GumV8JSEventSink * self);
 static gboolean gum_v8_js_event_sink_drain (GumV8JSEventSink * self);
+static gpointer gum_v8_js_event_sink_encode_compact (const GumEvent * events,
+    guint count, guint * size);
 
 static void gum_v8_native_event_sink_iface_init (gpointer g_iface,
     gpointer iface_data);
@@ -98,6 +103,8 @@ gum_v8_event_sink_new (const GumV8EventSinkOptions * options)
         options->queue_capacity);
     sink->queue_capacity = options->queue_capacity;
     sink->queue_drain_interval = options->queue_drain_interval;
+    sink->dropped_total = options->dropped_events;
+    sink->compact = options->compact;
 
     g_object_ref (options->core->script);
     sink->core = options->core;
@@ -219,6 +226,8 @@ gum_v8_js_event_sink_process (GumEventSink * sink,
   gum_spinlock_acquire (&self->lock);
   if (self->queue->len != self->queue_capacity)
     g_array_append_val (self->queue, *event);
+  else
+    self->dropped++;
   gum_spinlock_release (&self->lock);
 }
 
@@ -290,6 +299,14 @@ gum_v8_js_event_sink_drain (GumV8JSEventSink * self)
     gum_spinlock_release (&self->lock);
   }
 
+  if (self->dropped_total != NULL)
+  {
+    gum_spinlock_acquire (&self->lock);
+    *self->dropped_total += self->dropped;
+    self->dropped = 0;
+    gum_spinlock_release (&self->lock);
+  }
+
   if (buffer != NULL)
   {
     GHashTable * frequencies = NULL;
@@ -348,6 +365,13 @@ gum_v8_js_event_sink_drain (GumV8JSEventSink * self)
 
     if (self->on_receive != nullptr)
     {
+      if (self->compact)
+      {
+        auto events = (const GumEvent *) buffer;
+        buffer = gum_v8_js_event_sink_encode_compact (events, len, &size);
+        g_free ((gpointer) events);
+      }
+
       auto on_receive = Local<Function>::New (isolate, *self->on_receive);
       Local<Value> argv[] = {
         _gum_v8_array_buffer_new_take (isolate, g_steal_pointer (&buffer),
@@ -364,6 +388,26 @@ gum_v8_js_event_sink_drain (GumV8JSEventSink * self)
   return TRUE;
 }
 
+static gpointer
+gum_v8_js_event_sink_encode_compact (const GumEvent * events,
+                                     guint count,
+                                     guint * size)
+{
+  auto buffer = g_byte_array_sized_new (count * 4);
+  GumAddress previous = 0;
+
+  for (guint i = 0; i != count; i++)
+  {
+    guint8 record[GUM_COMPACT_EVENT_MAX_SIZE];
+    gsize n = gum_event_encode_compact (&events[i], &previous, record);
+    g_byte_array_append (buffer, record, n);
+  }
+
+  *size = buffer->len;
+
+  return g_byte_array_free (buffer, FALSE);
+}
+
 static void
 gum_v8_native_event_sink_class_init (GumV8NativeEventSinkClass * klass)
 {
@@ -33,6 +33,8 @@ struct GumV8EventSinkOptions
 
   guint queue_capacity;
   guint queue_drain_interval;
+  guint64 * dropped_events;
+  gboolean compact;
   v8::Local<v8::Function> on_receive;
   v8::Local<v8::Function> on_call_summary;
 
@@ -141,6 +141,7 @@ static gboolean gum_v8_interceptor_on_flush_timer_tick (
     GumV8Interceptor * self);
 
 GUMJS_DECLARE_FUNCTION (gumjs_interceptor_attach)
+GUMJS_DECLARE_FUNCTION (gumjs_interceptor_attach_many)
 static void gum_v8_invocation_listener_destroy (
     GumV8InvocationListener * listener);
 GUMJS_DECLARE_FUNCTION (gumjs_interceptor_detach_all)
@@ -265,6 +266,7 @@ static void gum_v8_interceptor_release_invocation_return_value (
 static const GumV8Function gumjs_interceptor_functions[] =
 {
   { "_attach", gumjs_interceptor_attach },
+  { "_attachMany", gumjs_interceptor_attach_many },
   { "detachAll", gumjs_interceptor_detach_all },
   { "_replace", gumjs_interceptor_replace },
   { "revert", gumjs_interceptor_revert },
@@ -676,6 +678,130 @@ GUMJS_DEFINE_FUNCTION (gumjs_interceptor_attach)
   }
 }
 
+GUMJS_DEFINE_FUNCTION (gumjs_interceptor_attach_many)
+{
+  Local<Array> targets_val;
+  Local<Function> on_enter_js, on_leave_js;
+  GumV8CHook on_enter_c, on_leave_c;
+  if (!_gum_v8_args_parse (args, "AF*{onEnter?,onLeave?}", &targets_val,
+      &on_enter_js, &on_enter_c,
+      &on_leave_js, &on_leave_c))
+  {
+    return;
+  }
+
+  auto context = isolate->GetCurrentContext ();
+
+  uint32_t n = targets_val->Length ();
+  auto targets = g_new (gpointer, n);
+  for (uint32_t i = 0; i != n; i++)
+  {
+    Local<Value> val;
+    if (!targets_val->Get (context, i).ToLocal (&val) ||
+        !_gum_v8_native_pointer_get (val, &targets[i], core))
+    {
+      g_free (targets);
+      return;
+    }
+  }
+
+  gpointer listener_function_data;
+  auto data_val = info[2];
+  if (!data_val->IsUndefined ())
+  {
+    if (!_gum_v8_native_pointer_get (data_val, &listener_function_data, core))
+    {
+      g_free (targets);
+      return;
+    }
+  }
+  else
+  {
+    listener_function_data = NULL;
+  }
+
+  GumV8InvocationListener * listener;
+  if (!on_enter_js.IsEmpty () || !on_leave_js.IsEmpty ())
+  {
+    auto l = GUM_V8_JS_CALL_LISTENER (
+        g_object_new (GUM_V8_TYPE_JS_CALL_LISTENER, NULL));
+    if (!on_enter_js.IsEmpty ())
+      l->on_enter = new GumPersistent<Function>::type (isolate, on_enter_js);
+    if (!on_leave_js.IsEmpty ())
+      l->on_leave = new GumPersistent<Function>::type (isolate, on_leave_js);
+
+    listener = GUM_V8_INVOCATION_LISTENER (l);
+  }
+  else if (on_enter_c != NULL || on_leave_c != NULL)
+  {
+    auto l = GUM_V8_C_CALL_LISTENER (
+        g_object_new (GUM_V8_TYPE_C_CALL_LISTENER, NULL));
+    l->on_enter = on_enter_c;
+    l->on_leave = on_leave_c;
+
+    listener = GUM_V8_INVOCATION_LISTENER (l);
+  }
+  else
+  {
+    _gum_v8_throw_ascii_literal (isolate, "expected at least one callback");
+    g_free (targets);
+    return;
+  }
+
+  listener->resource =
+      new GumPersistent<Object>::type (isolate, info[1].As<Object> ());
+  listener->module = module;
+
+  auto results = g_new (GumAttachReturn, n);
+
+  auto n_attached = gum_interceptor_attach_many (module->interceptor,
+      (const gpointer *) targets, n, GUM_INVOCATION_LISTENER (listener),
+      listener_function_data, results);
+
+  if (n_attached == n)
+  {
+    auto listener_template_value (Local<Object>::New (isolate,
+        *module->invocation_listener_value));
+    auto listener_value (listener_template_value->Clone ());
+    listener_value->SetAlignedPointerInInternalField (0, listener);
+
+    g_hash_table_add (module->invocation_listeners, listener);
+
+    info.GetReturnValue ().Set (listener_value);
+  }
+  else
+  {
+    gum_interceptor_detach (module->interceptor,
+        GUM_INVOCATION_LISTENER (listener));
+    g_object_unref (listener);
+
+    guint i;
+    for (i = 0; results[i] == GUM_ATTACH_OK; i++)
+      ;
+
+    switch (results[i])
+    {
+      case GUM_ATTACH_WRONG_SIGNATURE:
+        _gum_v8_throw_ascii (isolate, "unable to intercept function at %p; "
+            "please file a bug", targets[i]);
+        break;
+      case GUM_ATTACH_ALREADY_ATTACHED:
+        _gum_v8_throw_ascii (isolate, "already attached to function at %p",
+            targets[i]);
+        break;
+      case GUM_ATTACH_POLICY_VIOLATION:
+        _gum_v8_throw_ascii_literal (isolate,
+            "not permitted by code-signing policy");
+        break;
+      default:
+        g_assert_not_reached ();
+    }
+  }
+
+  g_free (results);
+  g_free (targets);
+}
+
 static void
 gum_v8_invocation_listener_destroy (GumV8InvocationListener * listener)
 {
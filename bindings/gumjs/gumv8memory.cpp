@@ -55,7 +55,10 @@ struct GumMemoryPatchContext
 struct GumMemoryScanContext
 {
   GumMemoryRange range;
+  GArray * ranges;
+  guint threads;
   GumMatchPattern * pattern;
+  GumMatchPatternSet * pattern_set;
   GumPersistent<Function>::type * on_match;
   GumPersistent<Function>::type * on_error;
   GumPersistent<Function>::type * on_complete;
@@ -134,6 +137,7 @@ GUMJS_DECLARE_FUNCTION (gumjs_memory_alloc_utf8_string)
 GUMJS_DECLARE_FUNCTION (gumjs_memory_alloc_utf16_string)
 
 GUMJS_DECLARE_FUNCTION (gumjs_memory_scan)
+GUMJS_DECLARE_FUNCTION (gumjs_memory_scan_ranges)
 static void gum_memory_scan_context_free (GumMemoryScanContext * self);
 static void gum_memory_scan_context_run (GumMemoryScanContext * self);
 static gboolean gum_memory_scan_context_emit_match (GumAddress address,
@@ -141,6 +145,15 @@ static gboolean gum_memory_scan_context_emit_match (GumAddress address,
 GUMJS_DECLARE_FUNCTION (gumjs_memory_scan_sync)
 static gboolean gum_append_match (GumAddress address, gsize size,
     GumMemoryScanSyncContext * ctx);
+GUMJS_DECLARE_FUNCTION (gumjs_memory_scan_patterns)
+static gboolean gum_memory_scan_context_emit_pattern_set_match (
+    GumAddress address, gsize size, guint pattern_index,
+    GumMemoryScanContext * self);
+GUMJS_DECLARE_FUNCTION (gumjs_memory_scan_patterns_sync)
+static gboolean gum_append_pattern_set_match (GumAddress address, gsize size,
+    guint pattern_index, GumMemoryScanSyncContext * ctx);
+static GumMatchPatternSet * gum_parse_pattern_set (Local<Array> patterns_val,
+    GumV8Core * core);
 
 GUMJS_DECLARE_FUNCTION (gumjs_memory_access_monitor_enable)
 GUMJS_DECLARE_FUNCTION (gumjs_memory_access_monitor_disable)
@@ -184,7 +197,10 @@ static const GumV8Function gumjs_memory_functions[] =
   { "allocUtf16String", gumjs_memory_alloc_utf16_string },
 
   { "scan", gumjs_memory_scan },
+  { "scanRanges", gumjs_memory_scan_ranges },
   { "scanSync", gumjs_memory_scan_sync },
+  { "scanPatterns", gumjs_memory_scan_patterns },
+  { "scanPatternsSync", gumjs_memory_scan_patterns_sync },
 
   { NULL, NULL }
 };
@@ -946,12 +962,55 @@ GUMJS_DEFINE_FUNCTION (gumjs_memory_scan)
   }
 }
 
+GUMJS_DEFINE_FUNCTION (gumjs_memory_scan_ranges)
+{
+  GArray * ranges;
+  gchar * match_str;
+  Local<Function> on_match, on_error, on_complete;
+  guint threads = 0;
+  if (!_gum_v8_args_parse (args, "RsF{onMatch,onError?,onComplete}|u",
+      &ranges, &match_str, &on_match, &on_error, &on_complete, &threads))
+    return;
+
+  auto pattern = gum_match_pattern_new_from_string (match_str);
+
+  g_free (match_str);
+
+  if (pattern != NULL)
+  {
+    auto ctx = g_slice_new0 (GumMemoryScanContext);
+    ctx->ranges = ranges;
+    ctx->threads = threads;
+    ctx->pattern = pattern;
+    ctx->on_match = new GumPersistent<Function>::type (isolate, on_match);
+    if (!on_error.IsEmpty ())
+      ctx->on_error = new GumPersistent<Function>::type (isolate, on_error);
+    ctx->on_complete = new GumPersistent<Function>::type (isolate, on_complete);
+    ctx->core = core;
+
+    _gum_v8_core_pin (core);
+    _gum_v8_core_push_job (core, (GumScriptJobFunc) gum_memory_scan_context_run,
+        ctx, (GDestroyNotify) gum_memory_scan_context_free);
+  }
+  else
+  {
+    g_array_free (ranges, TRUE);
+
+    _gum_v8_throw_ascii_literal (isolate, "invalid match pattern");
+  }
+}
+
 static void
 gum_memory_scan_context_free (GumMemoryScanContext * self)
 {
   auto core = self->core;
 
-  gum_match_pattern_free (self->pattern);
+  if (self->pattern != NULL)
+    gum_match_pattern_free (self->pattern);
+  if (self->pattern_set != NULL)
+    gum_match_pattern_set_free (self->pattern_set);
+  if (self->ranges != NULL)
+    g_array_free (self->ranges, TRUE);
 
   {
     ScriptScope script_scope (core->script);
@@ -981,8 +1040,23 @@ gum_memory_scan_context_run (GumMemoryScanContext * self)
 
   if (gum_exceptor_try (exceptor, &scope))
   {
-    gum_memory_scan (&self->range, self->pattern,
-        (GumMemoryScanMatchFunc) gum_memory_scan_context_emit_match, self);
+    if (self->pattern_set != NULL)
+    {
+      gum_memory_scan_pattern_set (&self->range, self->pattern_set,
+          (GumMemoryScanPatternSetMatchFunc)
+          gum_memory_scan_context_emit_pattern_set_match, self);
+    }
+    else if (self->ranges != NULL)
+    {
+      gum_memory_scan_ranges ((const GumMemoryRange *) self->ranges->data,
+          self->ranges->len, self->pattern, self->threads,
+          (GumMemoryScanMatchFunc) gum_memory_scan_context_emit_match, self);
+    }
+    else
+    {
+      gum_memory_scan (&self->range, self->pattern,
+          (GumMemoryScanMatchFunc) gum_memory_scan_context_emit_match, self);
+    }
   }
 
   if (gum_exceptor_catch (exceptor, &scope) && self->on_error != nullptr)
@@ -1103,6 +1177,156 @@ gum_append_match (GumAddress address,
   return TRUE;
 }
 
+GUMJS_DEFINE_FUNCTION (gumjs_memory_scan_patterns)
+{
+  gpointer address;
+  gsize size;
+  Local<Array> patterns_val;
+  Local<Function> on_match, on_error, on_complete;
+  if (!_gum_v8_args_parse (args, "pZAF{onMatch,onError?,onComplete}",
+      &address, &size, &patterns_val, &on_match, &on_error, &on_complete))
+    return;
+
+  auto set = gum_parse_pattern_set (patterns_val, core);
+  if (set == NULL)
+    return;
+
+  auto ctx = g_slice_new0 (GumMemoryScanContext);
+  ctx->range.base_address = GUM_ADDRESS (address);
+  ctx->range.size = size;
+  ctx->pattern_set = set;
+  ctx->on_match = new GumPersistent<Function>::type (isolate, on_match);
+  if (!on_error.IsEmpty ())
+    ctx->on_error = new GumPersistent<Function>::type (isolate, on_error);
+  ctx->on_complete = new GumPersistent<Function>::type (isolate, on_complete);
+  ctx->core = core;
+
+  _gum_v8_core_pin (core);
+  _gum_v8_core_push_job (core, (GumScriptJobFunc) gum_memory_scan_context_run,
+      ctx, (GDestroyNotify) gum_memory_scan_context_free);
+}
+
+static gboolean
+gum_memory_scan_context_emit_pattern_set_match (GumAddress address,
+                                                gsize size,
+                                                guint pattern_index,
+                                                GumMemoryScanContext * self)
+{
+  ScriptScope scope (self->core->script);
+  auto isolate = self->core->isolate;
+  auto context = isolate->GetCurrentContext ();
+
+  gboolean proceed = TRUE;
+  auto on_match = Local<Function>::New (isolate, *self->on_match);
+  auto recv = Undefined (isolate);
+  Local<Value> argv[] = {
+    _gum_v8_native_pointer_new (GSIZE_TO_POINTER (address), self->core),
+    Integer::NewFromUnsigned (isolate, size),
+    Integer::NewFromUnsigned (isolate, pattern_index)
+  };
+  Local<Value> result;
+  if (on_match->Call (context, recv, G_N_ELEMENTS (argv), argv)
+      .ToLocal (&result) && result->IsString ())
+  {
+    String::Utf8Value str (isolate, result);
+    proceed = strcmp (*str, "stop") != 0;
+  }
+
+  return proceed;
+}
+
+GUMJS_DEFINE_FUNCTION (gumjs_memory_scan_patterns_sync)
+{
+  gpointer address;
+  gsize size;
+  Local<Array> patterns_val;
+  if (!_gum_v8_args_parse (args, "pZA", &address, &size, &patterns_val))
+    return;
+
+  auto set = gum_parse_pattern_set (patterns_val, core);
+  if (set == NULL)
+    return;
+
+  GumMemoryRange range;
+  range.base_address = GUM_ADDRESS (address);
+  range.size = size;
+
+  GumMemoryScanSyncContext ctx;
+  ctx.matches = Array::New (isolate);
+  ctx.core = core;
+
+  GumExceptorScope scope;
+
+  if (gum_exceptor_try (core->exceptor, &scope))
+  {
+    gum_memory_scan_pattern_set (&range, set,
+        (GumMemoryScanPatternSetMatchFunc) gum_append_pattern_set_match, &ctx);
+  }
+
+  gum_match_pattern_set_free (set);
+
+  if (gum_exceptor_catch (core->exceptor, &scope))
+  {
+    _gum_v8_throw_native (&scope.exception, core);
+  }
+  else
+  {
+    info.GetReturnValue ().Set (ctx.matches);
+  }
+}
+
+static gboolean
+gum_append_pattern_set_match (GumAddress address,
+                              gsize size,
+                              guint pattern_index,
+                              GumMemoryScanSyncContext * ctx)
+{
+  GumV8Core * core = ctx->core;
+
+  auto match = Object::New (core->isolate);
+  _gum_v8_object_set_pointer (match, "address", address, core);
+  _gum_v8_object_set_uint (match, "size", size, core);
+  _gum_v8_object_set_uint (match, "pattern", pattern_index, core);
+  ctx->matches->Set (core->isolate->GetCurrentContext (),
+      ctx->matches->Length (), match).ToChecked ();
+
+  return TRUE;
+}
+
+static GumMatchPatternSet *
+gum_parse_pattern_set (Local<Array> patterns_val,
+                       GumV8Core * core)
+{
+  auto isolate = core->isolate;
+  auto context = isolate->GetCurrentContext ();
+
+  uint32_t n = patterns_val->Length ();
+  auto match_strs = g_ptr_array_new_full (n, g_free);
+  for (uint32_t i = 0; i != n; i++)
+  {
+    Local<Value> val;
+    if (!patterns_val->Get (context, i).ToLocal (&val) || !val->IsString ())
+    {
+      _gum_v8_throw_ascii_literal (isolate, "expected an array of strings");
+      g_ptr_array_unref (match_strs);
+      return NULL;
+    }
+
+    String::Utf8Value str_val (isolate, val);
+    g_ptr_array_add (match_strs, g_strdup (*str_val));
+  }
+
+  auto set = gum_match_pattern_set_new_from_strings (
+      (const gchar * const *) match_strs->pdata, match_strs->len);
+
+  g_ptr_array_unref (match_strs);
+
+  if (set == NULL)
+    _gum_v8_throw_ascii_literal (isolate, "invalid match pattern");
+
+  return set;
+}
+
 #ifdef _MSC_VER
 # pragma warning (pop)
 #endif
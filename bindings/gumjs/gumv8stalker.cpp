@@ -68,6 +68,13 @@ struct GumV8CallProbe
   GumV8Stalker * module;
 };
 
+struct GumV8StalkerStatsContext
+{
+  Local<Array> result;
+
+  GumV8Core * core;
+};
+
 class GumV8SystemErrorPreservationScope
 {
 public:
@@ -96,8 +103,11 @@ GUMJS_DECLARE_SETTER (gumjs_stalker_set_queue_capacity)
 GUMJS_DECLARE_GETTER (gumjs_stalker_get_queue_drain_interval)
 GUMJS_DECLARE_SETTER (gumjs_stalker_set_queue_drain_interval)
 
+GUMJS_DECLARE_GETTER (gumjs_stalker_get_dropped_events)
+
 GUMJS_DECLARE_FUNCTION (gumjs_stalker_flush)
 GUMJS_DECLARE_FUNCTION (gumjs_stalker_garbage_collect)
+GUMJS_DECLARE_FUNCTION (gumjs_stalker_query_stats)
 GUMJS_DECLARE_FUNCTION (gumjs_stalker_exclude)
 GUMJS_DECLARE_FUNCTION (gumjs_stalker_follow)
 GUMJS_DECLARE_FUNCTION (gumjs_stalker_unfollow)
@@ -172,6 +182,8 @@ static GumV8InstructionValue * gum_v8_stalker_obtain_instruction (
 static void gum_v8_stalker_release_instruction (GumV8Stalker * self,
     GumV8InstructionValue * value);
 
+static gboolean gum_append_stats (const GumStalkerStats * stats,
+    GumV8StalkerStatsContext * sc);
 static Local<Value> gum_make_pointer (gpointer value, gboolean stringify,
     GumV8Core * core);
 
@@ -192,6 +204,7 @@ static const GumV8Property gumjs_stalker_values[] =
     gumjs_stalker_get_queue_drain_interval,
     gumjs_stalker_set_queue_drain_interval
   },
+  { "droppedEvents", gumjs_stalker_get_dropped_events, NULL },
 
   { NULL, NULL, NULL }
 };
@@ -200,6 +213,7 @@ static const GumV8Function gumjs_stalker_functions[] =
 {
   { "flush", gumjs_stalker_flush },
   { "garbageCollect", gumjs_stalker_garbage_collect },
+  { "queryStats", gumjs_stalker_query_stats },
   { "_exclude", gumjs_stalker_exclude },
   { "_follow", gumjs_stalker_follow },
   { "unfollow", gumjs_stalker_unfollow },
@@ -245,6 +259,7 @@ _gum_v8_stalker_init (GumV8Stalker * self,
   self->stalker = NULL;
   self->queue_capacity = 16384;
   self->queue_drain_interval = 250;
+  self->dropped_events = 0;
 
   self->flush_timer = NULL;
 
@@ -506,6 +521,11 @@ GUMJS_DEFINE_SETTER (gumjs_stalker_set_queue_drain_interval)
   module->queue_drain_interval = interval;
 }
 
+GUMJS_DEFINE_GETTER (gumjs_stalker_get_dropped_events)
+{
+  info.GetReturnValue ().Set ((double) module->dropped_events);
+}
+
 GUMJS_DEFINE_FUNCTION (gumjs_stalker_flush)
 {
   auto stalker = _gum_v8_stalker_get (module);
@@ -520,6 +540,71 @@ GUMJS_DEFINE_FUNCTION (gumjs_stalker_garbage_collect)
   gum_stalker_garbage_collect (stalker);
 }
 
+GUMJS_DEFINE_FUNCTION (gumjs_stalker_query_stats)
+{
+  auto stalker = _gum_v8_stalker_get (module);
+
+  GumV8StalkerStatsContext sc;
+  sc.result = Array::New (isolate);
+  sc.core = core;
+
+  gum_stalker_query_stats (stalker,
+      (GumFoundStalkerStatsFunc) gum_append_stats, &sc);
+
+  info.GetReturnValue ().Set (sc.result);
+}
+
+static gboolean
+gum_append_stats (const GumStalkerStats * stats,
+                  GumV8StalkerStatsContext * sc)
+{
+  auto core = sc->core;
+  auto isolate = core->isolate;
+
+  auto s = Object::New (isolate);
+  _gum_v8_object_set (s, "threadId",
+      Number::New (isolate, stats->thread_id), core);
+  _gum_v8_object_set (s, "blocksCompiled",
+      Number::New (isolate, (double) stats->blocks_compiled), core);
+  _gum_v8_object_set (s, "blocksRecompiled",
+      Number::New (isolate, (double) stats->blocks_recompiled), core);
+  _gum_v8_object_set (s, "tracesFormed",
+      Number::New (isolate, (double) stats->traces_formed), core);
+  _gum_v8_object_set (s, "snapshotComparisons",
+      Number::New (isolate, (double) stats->snapshot_comparisons), core);
+  _gum_v8_object_set (s, "codeBytes",
+      Number::New (isolate, (double) stats->code_bytes), core);
+  _gum_v8_object_set (s, "dataBytes",
+      Number::New (isolate, (double) stats->data_bytes), core);
+  _gum_v8_object_set (s, "icHits",
+      Number::New (isolate, (double) stats->ic_hits), core);
+  _gum_v8_object_set (s, "icMisses",
+      Number::New (isolate, (double) stats->ic_misses), core);
+  _gum_v8_object_set (s, "backpatches",
+      Number::New (isolate, (double) stats->backpatches), core);
+  _gum_v8_object_set (s, "cacheFlushes",
+      Number::New (isolate, (double) stats->cache_flushes), core);
+  _gum_v8_object_set (s, "evictedBlocks",
+      Number::New (isolate, (double) stats->evicted_blocks), core);
+  _gum_v8_object_set (s, "evictedBytes",
+      Number::New (isolate, (double) stats->evicted_bytes), core);
+
+  auto gates = Object::New (isolate);
+  for (guint i = 0; i != stats->num_entry_gates; i++)
+  {
+    auto gate = &stats->entry_gates[i];
+
+    _gum_v8_object_set (gates, gate->name,
+        Number::New (isolate, (double) gate->hits), core);
+  }
+  _gum_v8_object_set (s, "entryGates", gates, core);
+
+  sc->result->Set (isolate->GetCurrentContext (),
+      sc->result->Length (), s).ToChecked ();
+
+  return TRUE;
+}
+
 GUMJS_DEFINE_FUNCTION (gumjs_stalker_exclude)
 {
   auto stalker = _gum_v8_stalker_get (module);
@@ -550,13 +635,14 @@ GUMJS_DEFINE_FUNCTION (gumjs_stalker_follow)
   so.main_context = gum_script_scheduler_get_js_context (core->scheduler);
   so.queue_capacity = module->queue_capacity;
   so.queue_drain_interval = module->queue_drain_interval;
+  so.dropped_events = &module->dropped_events;
 
   gpointer user_data;
 
-  if (!_gum_v8_args_parse (args, "ZF*?uF?F?pp", &thread_id,
+  if (!_gum_v8_args_parse (args, "ZF*?uF?F?ppt", &thread_id,
       &transformer_callback_js, &transformer_callback_c,
       &so.event_mask, &so.on_receive, &so.on_call_summary,
-      &so.on_event, &user_data))
+      &so.on_event, &user_data, &so.compact))
     return;
 
   so.user_data = user_data;
@@ -23,6 +23,7 @@ struct GumV8Stalker
   GumStalker * stalker;
   guint queue_capacity;
   guint queue_drain_interval;
+  guint64 dropped_events;
 
   GSource * flush_timer;
 
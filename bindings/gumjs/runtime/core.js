@@ -386,6 +386,13 @@ Object.defineProperties(Interceptor, {
       return Interceptor._attach(target, callbacks, data);
     }
   },
+  attachMany: {
+    enumerable: true,
+    value: function (targets, callbacks, data) {
+      targets.forEach(target => Memory._checkCodePointer(target));
+      return Interceptor._attachMany(targets, callbacks, data);
+    }
+  },
   replace: {
     enumerable: true,
     value: function (target, replacement, data) {
@@ -436,6 +443,7 @@ Object.defineProperties(Stalker, {
         onCallSummary = null,
         onEvent = NULL,
         data = NULL,
+        compact = false,
       } = options;
 
       if (events === null || typeof events !== 'object')
@@ -456,7 +464,7 @@ Object.defineProperties(Stalker, {
         return enabled ? (result | value) : result;
       }, 0);
 
-      Stalker._follow(threadId, transform, eventMask, onReceive, onCallSummary, onEvent, data);
+      Stalker._follow(threadId, transform, eventMask, onReceive, onCallSummary, onEvent, data, compact);
     }
   },
   parse: {
@@ -464,14 +472,119 @@ Object.defineProperties(Stalker, {
     value: function (events, options = {}) {
       const {
         annotate = true,
-        stringify = false
+        stringify = false,
+        compact = false
       } = options;
 
+      if (compact)
+        return parseCompactStalkerEvents(events, annotate, stringify);
+
       return Stalker._parse(events, annotate, stringify);
     }
   }
 });
 
+const compactStalkerEventName = [null, 'call', 'ret', 'exec', 'block', 'compile'];
+
+function parseCompactStalkerEvents(events, annotate, stringify) {
+  const bytes = new Uint8Array(events);
+  const length = bytes.length;
+  const result = [];
+  let offset = 0;
+  let previous = NULL;
+
+  function readUleb128() {
+    let value = 0;
+    let shift = 0;
+    let big = null;
+
+    while (true) {
+      if (offset === length)
+        throw new Error('invalid compact event stream');
+      const byte = bytes[offset++];
+      const bits = byte & 0x7f;
+
+      if (big !== null)
+        big = big.or(ptr(bits).shl(shift));
+      else if (shift <= 42)
+        value += bits * Math.pow(2, shift);
+      else
+        big = ptr(value).or(ptr(bits).shl(shift));
+
+      if ((byte & 0x80) === 0)
+        return (big !== null) ? big : value;
+
+      shift += 7;
+    }
+  }
+
+  function readAddress() {
+    const zigzag = readUleb128();
+
+    if (typeof zigzag === 'number') {
+      if (zigzag % 2 === 0)
+        previous = previous.add(zigzag / 2);
+      else
+        previous = previous.sub((zigzag + 1) / 2);
+    } else {
+      const magnitude = zigzag.shr(1);
+      if (zigzag.and(1).isNull())
+        previous = previous.add(magnitude);
+      else
+        previous = previous.sub(magnitude).sub(1);
+    }
+
+    return previous;
+  }
+
+  function encodePointer(value) {
+    return stringify ? value.toString() : value;
+  }
+
+  while (offset !== length) {
+    const tag = bytes[offset++];
+    const name = compactStalkerEventName[tag];
+    if (name === undefined)
+      throw new Error('invalid compact event stream');
+
+    const row = [];
+    if (annotate && name !== null)
+      row.push(name);
+
+    switch (tag) {
+      case 0: {
+        const base = readUleb128();
+        previous = (typeof base === 'number') ? ptr(base) : base;
+        break;
+      }
+      case 1:
+      case 2: {
+        const location = readAddress();
+        const target = readAddress();
+        const depth = readUleb128();
+        row.push(encodePointer(location), encodePointer(target),
+            (depth % 2 === 0) ? depth / 2 : -(depth + 1) / 2);
+        break;
+      }
+      case 3:
+        row.push(encodePointer(readAddress()));
+        break;
+      case 4:
+      case 5: {
+        const start = readAddress();
+        previous = start.add(readUleb128());
+        row.push(encodePointer(start), encodePointer(previous));
+        break;
+      }
+    }
+
+    if (tag !== 0)
+      result.push(row);
+  }
+
+  return result;
+}
+
 Object.defineProperty(Instruction, 'parse', {
   enumerable: true,
   value: function (target) {
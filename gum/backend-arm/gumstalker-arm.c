@@ -789,6 +789,85 @@ gum_stalker_set_trust_threshold (GumStalker * self,
   self->trust_threshold = trust_threshold;
 }
 
+guint
+gum_stalker_get_ic_entries (GumStalker * self)
+{
+  return 0;
+}
+
+void
+gum_stalker_set_ic_entries (GumStalker * self,
+                            guint ic_entries)
+{
+}
+
+gboolean
+gum_stalker_get_ic_hit_counting_enabled (GumStalker * self)
+{
+  return FALSE;
+}
+
+void
+gum_stalker_set_ic_hit_counting_enabled (GumStalker * self,
+                                         gboolean enabled)
+{
+}
+
+gsize
+gum_stalker_get_cache_budget (GumStalker * self)
+{
+  return 0;
+}
+
+void
+gum_stalker_set_cache_budget (GumStalker * self,
+                              gsize budget)
+{
+}
+
+void
+gum_stalker_query_stats (GumStalker * self,
+                         GumFoundStalkerStatsFunc func,
+                         gpointer user_data)
+{
+}
+
+gboolean
+gum_stalker_get_trace_formation_enabled (GumStalker * self)
+{
+  return FALSE;
+}
+
+void
+gum_stalker_set_trace_formation_enabled (GumStalker * self,
+                                         gboolean enabled)
+{
+}
+
+guint
+gum_stalker_get_trace_hotness_threshold (GumStalker * self)
+{
+  return 0;
+}
+
+void
+gum_stalker_set_trace_hotness_threshold (GumStalker * self,
+                                         guint threshold)
+{
+}
+
+gboolean
+gum_stalker_get_page_write_tracking_enabled (GumStalker * self)
+{
+  return FALSE;
+}
+
+void
+gum_stalker_set_page_write_tracking_enabled (GumStalker * self,
+                                             gboolean enabled)
+{
+}
+
 void
 gum_stalker_flush (GumStalker * self)
 {
@@ -1180,6 +1259,20 @@ gum_stalker_prefetch (GumStalker * self,
   block->recycle_count = recycle_count;
 }
 
+GBytes *
+gum_stalker_export_blocks (GumStalker * self,
+                           GumThreadId thread_id)
+{
+  return NULL;
+}
+
+gboolean
+gum_stalker_replay_blocks (GumStalker * self,
+                           GBytes * blocks)
+{
+  return FALSE;
+}
+
 void
 gum_stalker_invalidate (GumStalker * self,
                         gconstpointer address)
@@ -28,6 +28,8 @@
 #define GUM_DATA_SLAB_SIZE_DYNAMIC  (GUM_CODE_SLAB_SIZE_DYNAMIC / 5)
 #define GUM_SCRATCH_SLAB_SIZE       16384
 #define GUM_EXEC_BLOCK_MIN_CAPACITY 1024
+#define GUM_IC_ENTRY_MAX_SIZE       64
+#define GUM_MAX_TRACE_SEGMENTS      8
 
 #define GUM_STACK_ALIGNMENT                16
 #define GUM_INVALIDATE_TRAMPOLINE_MAX_SIZE 24
@@ -45,12 +47,15 @@ typedef struct _GumInvalidateContext GumInvalidateContext;
 typedef struct _GumCallProbe GumCallProbe;
 
 typedef struct _GumExecCtx GumExecCtx;
+typedef struct _GumEntryGateHits GumEntryGateHits;
 typedef void (* GumExecHelperWriteFunc) (GumExecCtx * ctx, GumArm64Writer * cw);
 typedef gpointer (GUM_THUNK * GumExecCtxReplaceCurrentBlockFunc) (
     GumExecCtx * ctx, gpointer start_address);
 
 typedef struct _GumExecBlock GumExecBlock;
 typedef guint GumExecBlockFlags;
+typedef struct _GumTrace GumTrace;
+typedef struct _GumTraceSegment GumTraceSegment;
 
 typedef struct _GumExecFrame GumExecFrame;
 
@@ -101,6 +106,10 @@ struct _GumStalker
 
   GArray * exclusions;
   gint trust_threshold;
+  guint ic_entries;
+  gboolean ic_hit_counting_enabled;
+  volatile gboolean trace_formation_enabled;
+  guint trace_hotness_threshold;
   volatile gboolean any_probes_attached;
   volatile gint last_probe_id;
   GumSpinlock probe_lock;
@@ -145,6 +154,27 @@ struct _GumCallProbe
   GDestroyNotify user_notify;
 };
 
+struct _GumEntryGateHits
+{
+  guint64 call_imm;
+  guint64 call_reg;
+  guint64 post_call_invoke;
+  guint64 excluded_call_imm;
+  guint64 excluded_call_reg;
+  guint64 ret;
+
+  guint64 jmp_imm;
+  guint64 jmp_reg;
+
+  guint64 jmp_cond_cc;
+  guint64 jmp_cond_cbz;
+  guint64 jmp_cond_cbnz;
+  guint64 jmp_cond_tbz;
+  guint64 jmp_cond_tbnz;
+
+  guint64 jmp_continuation;
+};
+
 struct _GumExecCtx
 {
   volatile gint state;
@@ -182,10 +212,23 @@ struct _GumExecCtx
   gpointer infect_thunk;
   GumAddress infect_body;
 
+  guint ic_entries;
+  gboolean count_ic_hits;
+  gsize ic_hits;
+  gsize ic_misses;
+  gsize block_min_capacity;
+
   GumSpinlock code_lock;
   GumCodeSlab * code_slab;
   GumDataSlab * data_slab;
   GumCodeSlab * scratch_slab;
+  guint traces_formed;
+  guint64 blocks_compiled;
+  guint64 blocks_recompiled;
+  gsize code_bytes;
+  gsize data_bytes;
+  guint64 backpatches_applied;
+  GumEntryGateHits entrygate_hits;
   GumMetalHashTable * mappings;
   gpointer last_prolog_minimal;
   gpointer last_epilog_minimal;
@@ -208,6 +251,8 @@ struct _GumExecBlock
   GumExecCtx * ctx;
   GumCodeSlab * code_slab;
   GumExecBlock * storage_block;
+  GumTrace * trace;
+  GumExecBlock * folded_into;
 
   guint8 * real_start;
   guint8 * code_start;
@@ -218,6 +263,7 @@ struct _GumExecBlock
 
   GumExecBlockFlags flags;
   gint recycle_count;
+  guint exec_count;
 };
 
 enum _GumExecBlockFlags
@@ -225,6 +271,22 @@ enum _GumExecBlockFlags
   GUM_EXEC_BLOCK_ACTIVATION_TARGET = 1 << 0,
 };
 
+struct _GumTraceSegment
+{
+  guint8 * real_start;
+  GumAddress code_start;
+  GumExecBlock * block;
+};
+
+struct _GumTrace
+{
+  GumTraceSegment segments[GUM_MAX_TRACE_SEGMENTS];
+  guint num_segments;
+  guint num_internal_branches;
+  guint head_size;
+  guint8 * next;
+};
+
 struct _GumExecFrame
 {
   gpointer real_address;
@@ -272,6 +334,7 @@ struct _GumGeneratorContext
   gpointer continuation_real_address;
   GumPrologType opened_prolog;
   gint exclusive_load_offset;
+  GumTrace * trace;
 };
 
 struct _GumInstruction
@@ -337,6 +400,8 @@ G_GNUC_INTERNAL gpointer _gum_stalker_do_deactivate (GumStalker * self,
     gpointer ret_addr);
 static gboolean gum_stalker_do_invalidate (GumExecCtx * ctx,
     gconstpointer address, GumActivation * activation);
+static gboolean gum_stalker_do_invalidate_block (GumExecCtx * ctx,
+    GumExecBlock * block, GumActivation * activation);
 static void gum_stalker_try_invalidate_block_owned_by_thread (
     GumThreadId thread_id, GumCpuContext * cpu_context, gpointer user_data);
 
@@ -364,6 +429,7 @@ static GumExecCtx * gum_exec_ctx_new (GumStalker * self, GumThreadId thread_id,
     GumStalkerTransformer * transformer, GumEventSink * sink);
 static void gum_exec_ctx_free (GumExecCtx * ctx);
 static void gum_exec_ctx_dispose (GumExecCtx * ctx);
+static void gum_exec_ctx_clear_blocks (GumExecCtx * ctx);
 static GumCodeSlab * gum_exec_ctx_add_code_slab (GumExecCtx * ctx,
     GumCodeSlab * code_slab);
 static GumDataSlab * gum_exec_ctx_add_data_slab (GumExecCtx * ctx,
@@ -377,6 +443,10 @@ static gboolean gum_exec_ctx_maybe_unfollow (GumExecCtx * ctx,
 static void gum_exec_ctx_unfollow (GumExecCtx * ctx, gpointer resume_at);
 static gboolean gum_exec_ctx_has_executed (GumExecCtx * ctx);
 static gboolean gum_exec_ctx_contains (GumExecCtx * ctx, gconstpointer address);
+static void gum_exec_ctx_query_stats (GumExecCtx * ctx,
+    GumStalkerStats * stats);
+static void gum_stalker_stats_add_entry_gate (GumStalkerStats * stats,
+    const gchar * name, guint64 hits);
 static gpointer gum_exec_ctx_switch_block (GumExecCtx * ctx,
     gpointer start_address);
 static void gum_exec_ctx_begin_call (GumExecCtx * ctx, gpointer ret_addr);
@@ -386,9 +456,17 @@ static GumExecBlock * gum_exec_ctx_obtain_block_for (GumExecCtx * ctx,
     gpointer real_address, gpointer * code_address);
 static void gum_exec_ctx_recompile_block (GumExecCtx * ctx,
     GumExecBlock * block);
+static void gum_exec_ctx_count_execution (GumExecCtx * ctx,
+    GumExecBlock * block);
+static void gum_exec_ctx_maybe_form_trace (GumExecCtx * ctx,
+    GumExecBlock * block);
+static gboolean gum_exec_ctx_may_extend_trace (GumExecCtx * ctx,
+    const GumTrace * trace, gconstpointer address);
+static const GumTraceSegment * gum_trace_find_segment (const GumTrace * trace,
+    gconstpointer real_start);
 static void gum_exec_ctx_compile_block (GumExecCtx * ctx, GumExecBlock * block,
     gconstpointer input_code, gpointer output_code, GumAddress output_pc,
-    guint * input_size, guint * output_size);
+    GumTrace * trace, guint * input_size, guint * output_size);
 static void gum_exec_ctx_maybe_emit_compile_event (GumExecCtx * ctx,
     GumExecBlock * block);
 
@@ -467,7 +545,10 @@ static GumExecBlock * gum_exec_block_new (GumExecCtx * ctx);
 static void gum_exec_block_clear (GumExecBlock * block);
 static gconstpointer gum_exec_block_check_address_for_exclusion (
     GumExecBlock * block, gconstpointer address);
+static gboolean gum_exec_block_trace_is_unmodified (GumExecBlock * block);
 static void gum_exec_block_commit (GumExecBlock * block);
+static void gum_exec_block_redirect (GumExecBlock * block,
+    GumExecBlock * storage_block);
 static void gum_exec_block_invalidate (GumExecBlock * block);
 static gpointer gum_exec_block_get_snapshot_start (GumExecBlock * block);
 static GumCalloutEntry * gum_exec_block_get_last_callout_entry (
@@ -491,6 +572,15 @@ static void gum_exec_block_write_call_invoke_code (GumExecBlock * block,
 static void gum_exec_block_write_jmp_transfer_code (GumExecBlock * block,
     const GumBranchTarget * target, GumExecCtxReplaceCurrentBlockFunc func,
     GumGeneratorContext * gc);
+static void gum_exec_block_write_trace_branch_code (GumExecBlock * block,
+    const GumBranchTarget * target, GumGeneratorContext * gc);
+static void gum_exec_block_write_trace_edge_code (GumExecBlock * block,
+    const GumBranchTarget * target, GumExecCtxReplaceCurrentBlockFunc func,
+    GumGeneratorContext * gc);
+static void gum_exec_block_put_trace_cond_branch (GumGeneratorContext * gc,
+    gboolean if_taken, gconstpointer label_id);
+static void gum_exec_ctx_write_inline_cache_hit_increment (GumExecCtx * ctx,
+    arm64_reg address_reg, arm64_reg value_reg, GumArm64Writer * cw);
 static void gum_exec_block_write_jmp_to_block_start (GumExecBlock * block,
     gpointer block_start);
 static void gum_exec_block_write_ret_transfer_code (GumExecBlock * block,
@@ -543,6 +633,7 @@ static gsize gum_slab_available (GumSlab * self);
 static gpointer gum_slab_start (GumSlab * self);
 static gpointer gum_slab_end (GumSlab * self);
 static gpointer gum_slab_cursor (GumSlab * self);
+static gsize gum_slab_footprint (GumSlab * self);
 static gpointer gum_slab_reserve (GumSlab * self, gsize size);
 static gpointer gum_slab_try_reserve (GumSlab * self, gsize size);
 
@@ -586,6 +677,11 @@ gum_stalker_init (GumStalker * self)
 
   self->exclusions = g_array_new (FALSE, FALSE, sizeof (GumMemoryRange));
   self->trust_threshold = 1;
+  self->ic_entries = 2;
+  self->ic_hit_counting_enabled = FALSE;
+
+  self->trace_formation_enabled = FALSE;
+  self->trace_hotness_threshold = 32;
 
   gum_spinlock_init (&self->probe_lock);
   self->probe_target_by_id = g_hash_table_new_full (NULL, NULL, NULL, NULL);
@@ -712,6 +808,120 @@ gum_stalker_set_trust_threshold (GumStalker * self,
   self->trust_threshold = trust_threshold;
 }
 
+guint
+gum_stalker_get_ic_entries (GumStalker * self)
+{
+  return self->ic_entries;
+}
+
+void
+gum_stalker_set_ic_entries (GumStalker * self,
+                            guint ic_entries)
+{
+  g_return_if_fail (ic_entries >= 2 &&
+      ic_entries <= GUM_STALKER_MAX_IC_ENTRIES);
+
+  self->ic_entries = ic_entries;
+}
+
+gboolean
+gum_stalker_get_ic_hit_counting_enabled (GumStalker * self)
+{
+  return self->ic_hit_counting_enabled;
+}
+
+void
+gum_stalker_set_ic_hit_counting_enabled (GumStalker * self,
+                                         gboolean enabled)
+{
+  self->ic_hit_counting_enabled = enabled;
+}
+
+gsize
+gum_stalker_get_cache_budget (GumStalker * self)
+{
+  return 0;
+}
+
+void
+gum_stalker_set_cache_budget (GumStalker * self,
+                              gsize budget)
+{
+}
+
+void
+gum_stalker_query_stats (GumStalker * self,
+                         GumFoundStalkerStatsFunc func,
+                         gpointer user_data)
+{
+  GArray * snapshot;
+  GSList * cur;
+  guint i;
+
+  snapshot = g_array_new (FALSE, TRUE, sizeof (GumStalkerStats));
+
+  GUM_STALKER_LOCK (self);
+
+  for (cur = self->contexts; cur != NULL; cur = cur->next)
+  {
+    GumExecCtx * ctx = cur->data;
+
+    g_array_set_size (snapshot, snapshot->len + 1);
+    gum_exec_ctx_query_stats (ctx,
+        &g_array_index (snapshot, GumStalkerStats, snapshot->len - 1));
+  }
+
+  GUM_STALKER_UNLOCK (self);
+
+  for (i = 0; i != snapshot->len; i++)
+  {
+    if (!func (&g_array_index (snapshot, GumStalkerStats, i), user_data))
+      break;
+  }
+
+  g_array_free (snapshot, TRUE);
+}
+
+gboolean
+gum_stalker_get_trace_formation_enabled (GumStalker * self)
+{
+  return self->trace_formation_enabled;
+}
+
+void
+gum_stalker_set_trace_formation_enabled (GumStalker * self,
+                                         gboolean enabled)
+{
+  self->trace_formation_enabled = enabled;
+}
+
+guint
+gum_stalker_get_trace_hotness_threshold (GumStalker * self)
+{
+  return self->trace_hotness_threshold;
+}
+
+void
+gum_stalker_set_trace_hotness_threshold (GumStalker * self,
+                                         guint threshold)
+{
+  g_return_if_fail (threshold >= 1);
+
+  self->trace_hotness_threshold = threshold;
+}
+
+gboolean
+gum_stalker_get_page_write_tracking_enabled (GumStalker * self)
+{
+  return FALSE;
+}
+
+void
+gum_stalker_set_page_write_tracking_enabled (GumStalker * self,
+                                             gboolean enabled)
+{
+}
+
 void
 gum_stalker_flush (GumStalker * self)
 {
@@ -1110,6 +1320,20 @@ gum_stalker_prefetch (GumStalker * self,
   block->recycle_count = recycle_count;
 }
 
+GBytes *
+gum_stalker_export_blocks (GumStalker * self,
+                           GumThreadId thread_id)
+{
+  return NULL;
+}
+
+gboolean
+gum_stalker_replay_blocks (GumStalker * self,
+                           GBytes * blocks)
+{
+  return FALSE;
+}
+
 void
 gum_stalker_invalidate (GumStalker * self,
                         gconstpointer address)
@@ -1181,27 +1405,50 @@ gum_stalker_do_invalidate (GumExecCtx * ctx,
                            gconstpointer address,
                            GumActivation * activation)
 {
-  GumInvalidateContext ic;
-
-  ic.is_executing_target_block = FALSE;
+  gboolean is_done = TRUE;
+  GumExecBlock * block;
 
   gum_spinlock_acquire (&ctx->code_lock);
 
-  if ((ic.block = gum_metal_hash_table_lookup (ctx->mappings, address)) != NULL)
+  if ((block = gum_metal_hash_table_lookup (ctx->mappings, address)) != NULL)
   {
-    if (ctx == activation->ctx)
-    {
-      gum_exec_block_invalidate (ic.block);
-    }
-    else
+    GumExecBlock * head = block->folded_into;
+
+    is_done = gum_stalker_do_invalidate_block (ctx, block, activation);
+
+    /* The trace carries its own copy of the block. */
+    if (head != NULL &&
+        !gum_stalker_do_invalidate_block (ctx, head, activation))
     {
-      gum_process_modify_thread (ctx->thread_id,
-          gum_stalker_try_invalidate_block_owned_by_thread, &ic);
+      is_done = FALSE;
     }
   }
 
   gum_spinlock_release (&ctx->code_lock);
 
+  return is_done;
+}
+
+static gboolean
+gum_stalker_do_invalidate_block (GumExecCtx * ctx,
+                                 GumExecBlock * block,
+                                 GumActivation * activation)
+{
+  GumInvalidateContext ic;
+
+  ic.block = block;
+  ic.is_executing_target_block = FALSE;
+
+  if (ctx == activation->ctx)
+  {
+    gum_exec_block_invalidate (block);
+  }
+  else
+  {
+    gum_process_modify_thread (ctx->thread_id,
+        gum_stalker_try_invalidate_block_owned_by_thread, &ic);
+  }
+
   return !ic.is_executing_target_block;
 }
 
@@ -1522,6 +1769,11 @@ gum_exec_ctx_new (GumStalker * stalker,
   ctx->thunks = base + stalker->thunks_offset;
   ctx->infect_thunk = ctx->thunks;
 
+  ctx->ic_entries = stalker->ic_entries;
+  ctx->count_ic_hits = stalker->ic_hit_counting_enabled;
+  ctx->block_min_capacity = GUM_EXEC_BLOCK_MIN_CAPACITY +
+      ((ctx->ic_entries - 2) * GUM_IC_ENTRY_MAX_SIZE);
+
   gum_spinlock_init (&ctx->code_lock);
 
   code_slab = (GumCodeSlab *) (base + stalker->code_slab_offset);
@@ -1606,6 +1858,14 @@ gum_exec_ctx_dispose (GumExecCtx * ctx)
     gum_stalker_thaw (stalker, gum_slab_start (slab), slab->offset);
   }
 
+  gum_exec_ctx_clear_blocks (ctx);
+}
+
+static void
+gum_exec_ctx_clear_blocks (GumExecCtx * ctx)
+{
+  GumSlab * slab;
+
   for (slab = &ctx->data_slab->slab; slab != NULL; slab = slab->next)
   {
     GumExecBlock * blocks;
@@ -1639,6 +1899,7 @@ gum_exec_ctx_add_data_slab (GumExecCtx * ctx,
 {
   data_slab->slab.next = &ctx->data_slab->slab;
   ctx->data_slab = data_slab;
+  ctx->data_bytes += gum_slab_footprint (&data_slab->slab);
   return data_slab;
 }
 
@@ -1733,6 +1994,16 @@ gum_exec_ctx_may_now_backpatch (GumExecCtx * ctx,
   if (target_block->recycle_count < ctx->stalker->trust_threshold)
     return FALSE;
 
+  /*
+   * Keep dispatching to blocks that are still being profiled, as that's the
+   * only place their executions get counted.
+   */
+  if (ctx->stalker->trace_formation_enabled &&
+      target_block->exec_count < ctx->stalker->trace_hotness_threshold)
+  {
+    return FALSE;
+  }
+
   return TRUE;
 }
 
@@ -1751,11 +2022,15 @@ static guint total_transitions = 0;
     { \
       if (counters_enabled) \
         total_##name##s++; \
+      ctx->entrygate_hits.name++; \
       \
       return gum_exec_ctx_switch_block (ctx, start_address); \
     }
 #define GUM_PRINT_ENTRYGATE_COUNTER(name) \
     g_printerr ("\t" G_STRINGIFY (name) "s: %u\n", total_##name##s)
+#define GUM_COLLECT_ENTRYGATE_HITS(name) \
+    gum_stalker_stats_add_entry_gate (stats, G_STRINGIFY (name), \
+        ctx->entrygate_hits.name)
 
 GUM_DEFINE_ENTRYGATE (call_imm)
 GUM_DEFINE_ENTRYGATE (call_reg)
@@ -1775,6 +2050,58 @@ GUM_DEFINE_ENTRYGATE (jmp_cond_tbnz)
 
 GUM_DEFINE_ENTRYGATE (jmp_continuation)
 
+static void
+gum_exec_ctx_query_stats (GumExecCtx * ctx,
+                          GumStalkerStats * stats)
+{
+  stats->thread_id = ctx->thread_id;
+
+  stats->blocks_compiled = ctx->blocks_compiled;
+  stats->blocks_recompiled = ctx->blocks_recompiled;
+  stats->traces_formed = ctx->traces_formed;
+
+  stats->code_bytes = ctx->code_bytes;
+  stats->data_bytes = ctx->data_bytes;
+
+  stats->ic_hits = ctx->ic_hits;
+  stats->ic_misses = ctx->ic_misses;
+  stats->backpatches = ctx->backpatches_applied;
+
+  stats->num_entry_gates = 0;
+
+  GUM_COLLECT_ENTRYGATE_HITS (call_imm);
+  GUM_COLLECT_ENTRYGATE_HITS (call_reg);
+  GUM_COLLECT_ENTRYGATE_HITS (post_call_invoke);
+  GUM_COLLECT_ENTRYGATE_HITS (excluded_call_imm);
+  GUM_COLLECT_ENTRYGATE_HITS (excluded_call_reg);
+  GUM_COLLECT_ENTRYGATE_HITS (ret);
+
+  GUM_COLLECT_ENTRYGATE_HITS (jmp_imm);
+  GUM_COLLECT_ENTRYGATE_HITS (jmp_reg);
+
+  GUM_COLLECT_ENTRYGATE_HITS (jmp_cond_cc);
+  GUM_COLLECT_ENTRYGATE_HITS (jmp_cond_cbz);
+  GUM_COLLECT_ENTRYGATE_HITS (jmp_cond_cbnz);
+  GUM_COLLECT_ENTRYGATE_HITS (jmp_cond_tbz);
+  GUM_COLLECT_ENTRYGATE_HITS (jmp_cond_tbnz);
+
+  GUM_COLLECT_ENTRYGATE_HITS (jmp_continuation);
+}
+
+static void
+gum_stalker_stats_add_entry_gate (GumStalkerStats * stats,
+                                  const gchar * name,
+                                  guint64 hits)
+{
+  GumStalkerEntryGateStats * gate;
+
+  g_assert (stats->num_entry_gates != GUM_STALKER_MAX_ENTRY_GATES);
+
+  gate = &stats->entry_gates[stats->num_entry_gates++];
+  gate->name = name;
+  gate->hits = hits;
+}
+
 static gpointer
 gum_exec_ctx_switch_block (GumExecCtx * ctx,
                            gpointer start_address)
@@ -1872,8 +2199,9 @@ gum_exec_ctx_obtain_block_for (GumExecCtx * ctx,
 
     still_up_to_date =
         (trust_threshold >= 0 && block->recycle_count >= trust_threshold) ||
-        memcmp (block->real_start, gum_exec_block_get_snapshot_start (block),
-            block->real_size) == 0;
+        (memcmp (block->real_start, gum_exec_block_get_snapshot_start (block),
+            block->real_size) == 0 &&
+            gum_exec_block_trace_is_unmodified (block));
 
     gum_spinlock_release (&ctx->code_lock);
 
@@ -1881,6 +2209,9 @@ gum_exec_ctx_obtain_block_for (GumExecCtx * ctx,
     {
       if (trust_threshold > 0)
         block->recycle_count++;
+
+      if (ctx->stalker->trace_formation_enabled)
+        gum_exec_ctx_count_execution (ctx, block);
     }
     else
     {
@@ -1892,8 +2223,10 @@ gum_exec_ctx_obtain_block_for (GumExecCtx * ctx,
     block = gum_exec_block_new (ctx);
     block->real_start = real_address;
     gum_exec_ctx_compile_block (ctx, block, real_address, block->code_start,
-        GUM_ADDRESS (block->code_start), &block->real_size, &block->code_size);
+        GUM_ADDRESS (block->code_start), NULL, &block->real_size,
+        &block->code_size);
     gum_exec_block_commit (block);
+    ctx->blocks_compiled++;
 
     gum_metal_hash_table_insert (ctx->mappings, real_address, block);
 
@@ -1920,18 +2253,24 @@ gum_exec_ctx_recompile_block (GumExecCtx * ctx,
 
   gum_spinlock_acquire (&ctx->code_lock);
 
+  ctx->blocks_recompiled++;
+
   gum_stalker_thaw (stalker, internal_code, block->capacity);
 
   if (block->storage_block != NULL)
     gum_exec_block_clear (block->storage_block);
   gum_exec_block_clear (block);
 
+  /* The trace carries a copy of the old code, so it has to go as well. */
+  if (block->folded_into != NULL)
+    gum_exec_block_invalidate (block->folded_into);
+
   slab = block->code_slab;
   block->code_slab = ctx->scratch_slab;
   scratch_base = ctx->scratch_slab->slab.data;
 
   gum_exec_ctx_compile_block (ctx, block, block->real_start, scratch_base,
-      GUM_ADDRESS (internal_code), &input_size, &output_size);
+      GUM_ADDRESS (internal_code), NULL, &input_size, &output_size);
 
   block->code_slab = slab;
 
@@ -1954,49 +2293,170 @@ gum_exec_ctx_recompile_block (GumExecCtx * ctx,
   else
   {
     GumExecBlock * storage_block;
-    GumArm64Writer * cw = &ctx->code_writer;
-    GumAddress external_code_address;
 
     storage_block = gum_exec_block_new (ctx);
     storage_block->real_start = block->real_start;
     gum_exec_ctx_compile_block (ctx, block, block->real_start,
         storage_block->code_start, GUM_ADDRESS (storage_block->code_start),
-        &storage_block->real_size, &storage_block->code_size);
+        NULL, &storage_block->real_size, &storage_block->code_size);
     gum_exec_block_commit (storage_block);
 
-    block->storage_block = storage_block;
+    gum_exec_block_redirect (block, storage_block);
+  }
 
-    gum_stalker_thaw (stalker, internal_code, block->capacity);
-    gum_arm64_writer_reset (cw, internal_code);
+  gum_spinlock_release (&ctx->code_lock);
 
-    external_code_address = GUM_ADDRESS (storage_block->code_start);
-    if (gum_arm64_writer_can_branch_directly_between (cw,
-        GUM_ADDRESS (internal_code), external_code_address))
-    {
-      gum_arm64_writer_put_b_imm (cw, external_code_address);
-      gum_arm64_writer_put_b_imm (cw, external_code_address + sizeof (guint32));
-    }
-    else
-    {
-      gconstpointer already_saved = cw->code + 1;
+  gum_exec_ctx_maybe_emit_compile_event (ctx, block);
+}
 
-      gum_arm64_writer_put_b_label (cw, already_saved);
-      gum_arm64_writer_put_stp_reg_reg_reg_offset (cw, ARM64_REG_X16,
-          ARM64_REG_X17, ARM64_REG_SP, -(16 + GUM_RED_ZONE_SIZE),
-          GUM_INDEX_PRE_ADJUST);
-      gum_arm64_writer_put_label (cw, already_saved);
-      gum_arm64_writer_put_ldr_reg_address (cw, ARM64_REG_X16,
-          external_code_address);
-      gum_arm64_writer_put_br_reg_no_auth (cw, ARM64_REG_X16);
-    }
+static void
+gum_exec_ctx_count_execution (GumExecCtx * ctx,
+                              GumExecBlock * block)
+{
+  const gint trust_threshold = ctx->stalker->trust_threshold;
+  const guint hotness_threshold = ctx->stalker->trace_hotness_threshold;
 
-    gum_arm64_writer_flush (cw);
-    gum_stalker_freeze (stalker, internal_code, block->capacity);
+  /*
+   * Only trusted blocks are counted, as their edges would otherwise have been
+   * backpatched, and we stop once a block is hot so it gets linked as usual.
+   */
+  if (trust_threshold < 0 || block->recycle_count < trust_threshold ||
+      block->exec_count >= hotness_threshold)
+  {
+    return;
   }
 
+  block->exec_count++;
+
+  if (block->exec_count == hotness_threshold)
+    gum_exec_ctx_maybe_form_trace (ctx, block);
+}
+
+static void
+gum_exec_ctx_maybe_form_trace (GumExecCtx * ctx,
+                               GumExecBlock * block)
+{
+  GumStalker * stalker = ctx->stalker;
+  GumExecBlock * storage_block;
+  GumTrace * trace;
+  guint i;
+
+  if (!stalker->trace_formation_enabled || stalker->any_probes_attached)
+    return;
+
+  if (block->storage_block != NULL ||
+      (block->flags & GUM_EXEC_BLOCK_ACTIVATION_TARGET) != 0 ||
+      g_atomic_int_get (&ctx->state) != GUM_EXEC_CTX_ACTIVE)
+  {
+    return;
+  }
+
+  gum_spinlock_acquire (&ctx->code_lock);
+
+  trace = gum_malloc (sizeof (GumTrace));
+
+  storage_block = gum_exec_block_new (ctx);
+  storage_block->real_start = block->real_start;
+  gum_exec_ctx_compile_block (ctx, storage_block, block->real_start,
+      storage_block->code_start, GUM_ADDRESS (storage_block->code_start),
+      trace, &storage_block->real_size, &storage_block->code_size);
+
+  /* Nothing to gain, so leave the code uncommitted for the next block. */
+  if (trace->num_segments == 1 && trace->num_internal_branches == 0)
+  {
+    gum_exec_block_clear (storage_block);
+    gum_free (trace);
+
+    gum_spinlock_release (&ctx->code_lock);
+
+    return;
+  }
+
+  gum_exec_block_commit (storage_block);
+
+  block->trace = trace;
+  ctx->traces_formed++;
+
+  for (i = 1; i != trace->num_segments; i++)
+    trace->segments[i].block->folded_into = block;
+
+  gum_exec_block_redirect (block, storage_block);
+
   gum_spinlock_release (&ctx->code_lock);
+}
 
-  gum_exec_ctx_maybe_emit_compile_event (ctx, block);
+static gboolean
+gum_exec_ctx_may_extend_trace (GumExecCtx * ctx,
+                               const GumTrace * trace,
+                               gconstpointer address)
+{
+  GumStalker * stalker = ctx->stalker;
+  GumExecBlock * successor;
+  const guint8 * start, * end;
+  guint i;
+
+  if (trace->num_segments == GUM_MAX_TRACE_SEGMENTS)
+    return FALSE;
+
+  successor = gum_metal_hash_table_lookup (ctx->mappings, address);
+  if (successor == NULL)
+    return FALSE;
+
+  /* Each block is folded into at most one trace, to keep invalidation O(1). */
+  if (successor->folded_into != NULL ||
+      (successor->flags & GUM_EXEC_BLOCK_ACTIVATION_TARGET) != 0)
+  {
+    return FALSE;
+  }
+
+  /*
+   * The head just became hot, and as neither of them has been linked until
+   * then, a successor executed at least half as often is on the same path.
+   */
+  if (successor->exec_count < MAX (stalker->trace_hotness_threshold / 2, 1))
+    return FALSE;
+
+  /*
+   * Segments share one writer without flushing in between, as that would
+   * drop literal pools in the middle of the code, so their labels must not
+   * collide.
+   */
+  start = successor->real_start;
+  end = start + successor->real_size;
+  for (i = 0; i != trace->num_segments; i++)
+  {
+    const GumExecBlock * segment_block = trace->segments[i].block;
+
+    if (start < segment_block->real_start + segment_block->real_size &&
+        segment_block->real_start < end)
+    {
+      return FALSE;
+    }
+  }
+
+  /*
+   * We compile the successor from its live code, so make sure that is still
+   * what it was trusted with. Without a snapshot it is trusted regardless.
+   */
+  return stalker->trust_threshold == 0 ||
+      memcmp (successor->real_start,
+          gum_exec_block_get_snapshot_start (successor),
+          successor->real_size) == 0;
+}
+
+static const GumTraceSegment *
+gum_trace_find_segment (const GumTrace * trace,
+                        gconstpointer real_start)
+{
+  guint i;
+
+  for (i = 0; i != trace->num_segments; i++)
+  {
+    if (trace->segments[i].real_start == real_start)
+      return &trace->segments[i];
+  }
+
+  return NULL;
 }
 
 static void
@@ -2005,6 +2465,7 @@ gum_exec_ctx_compile_block (GumExecCtx * ctx,
                             gconstpointer input_code,
                             gpointer output_code,
                             GumAddress output_pc,
+                            GumTrace * trace,
                             guint * input_size,
                             guint * output_size)
 {
@@ -2027,6 +2488,7 @@ gum_exec_ctx_compile_block (GumExecCtx * ctx,
   gc.continuation_real_address = NULL;
   gc.opened_prolog = GUM_PROLOG_NONE;
   gc.exclusive_load_offset = GUM_INSTRUCTION_OFFSET_NONE;
+  gc.trace = trace;
 
   iterator.exec_context = ctx;
   iterator.exec_block = block;
@@ -2043,12 +2505,73 @@ gum_exec_ctx_compile_block (GumExecCtx * ctx,
   gum_arm64_writer_put_ldp_reg_reg_reg_offset (cw, ARM64_REG_X16, ARM64_REG_X17,
       ARM64_REG_SP, 16 + GUM_RED_ZONE_SIZE, GUM_INDEX_POST_ADJUST);
 
+  if (trace != NULL)
+  {
+    GumTraceSegment * head = &trace->segments[0];
+
+    /* Internal branches arrive with X16 and X17 already restored. */
+    head->real_start = (guint8 *) input_code;
+    head->code_start = cw->pc;
+    head->block = gum_metal_hash_table_lookup (ctx->mappings, input_code);
+    gum_arm64_writer_put_label (cw, head);
+
+    trace->num_segments = 1;
+    trace->num_internal_branches = 0;
+    trace->head_size = 0;
+    trace->next = NULL;
+  }
+
   gum_exec_block_maybe_write_call_probe_code (block, &gc);
 
   ctx->pending_calls++;
   ctx->transform_block_impl (ctx->transformer, &iterator, &output);
   ctx->pending_calls--;
 
+  *input_size = rl->input_cur - rl->input_start;
+
+  if (trace != NULL)
+    trace->head_size = *input_size;
+
+  while (trace != NULL && trace->next != NULL)
+  {
+    GumTraceSegment * segment;
+    guint8 * next = trace->next;
+
+    trace->next = NULL;
+
+    /*
+     * The branch into the next segment was elided, so if we're out of space
+     * it is the one that needs a transfer.
+     */
+    if (gc.continuation_real_address != NULL ||
+        gum_stalker_iterator_is_out_of_space (&iterator))
+    {
+      gc.continuation_real_address = next;
+      break;
+    }
+
+    segment = &trace->segments[trace->num_segments++];
+    segment->real_start = next;
+    segment->code_start = cw->pc;
+    segment->block = gum_metal_hash_table_lookup (ctx->mappings, next);
+    gum_arm64_writer_put_label (cw, segment);
+
+    gum_arm64_relocator_reset (rl, next, cw);
+
+    gum_ensure_code_readable (next, ctx->stalker->page_size);
+
+    gc.instruction = NULL;
+
+    iterator.instruction.ci = NULL;
+    iterator.instruction.start = NULL;
+    iterator.instruction.end = NULL;
+    iterator.requirements = GUM_REQUIRE_NOTHING;
+
+    ctx->pending_calls++;
+    ctx->transform_block_impl (ctx->transformer, &iterator, &output);
+    ctx->pending_calls--;
+  }
+
   if (gc.continuation_real_address != NULL)
   {
     GumBranchTarget continue_target = { 0, };
@@ -2065,7 +2588,6 @@ gum_exec_ctx_compile_block (GumExecCtx * ctx,
   if (!all_labels_resolved)
     g_error ("Failed to resolve labels");
 
-  *input_size = rl->input_cur - rl->input_start;
   *output_size = gum_arm64_writer_offset (cw);
 }
 
@@ -2156,8 +2678,19 @@ gum_stalker_iterator_next (GumStalkerIterator * self,
 
   if (is_first_instruction && (self->exec_context->sink_mask & GUM_BLOCK) != 0)
   {
-    gum_exec_block_write_block_event_code (self->exec_block, gc,
-        GUM_CODE_INTERRUPTIBLE);
+    GumExecBlock * block = self->exec_block;
+
+    /* Within a trace, each segment reports the block it was folded from. */
+    if (gc->trace != NULL)
+    {
+      GumExecBlock * segment_block =
+          gc->trace->segments[gc->trace->num_segments - 1].block;
+
+      if (segment_block != NULL)
+        block = segment_block;
+    }
+
+    gum_exec_block_write_block_event_code (block, gc, GUM_CODE_INTERRUPTIBLE);
   }
 
   if (insn != NULL)
@@ -2170,17 +2703,24 @@ static gboolean
 gum_stalker_iterator_is_out_of_space (GumStalkerIterator * self)
 {
   GumExecBlock * block = self->exec_block;
+  GumGeneratorContext * gc = self->generator_context;
   GumSlab * slab = &block->code_slab->slab;
   gsize capacity, snapshot_size;
+  guint real_size;
 
   capacity = (guint8 *) gum_slab_end (slab) -
-      (guint8 *) gum_arm64_writer_cur (self->generator_context->code_writer);
+      (guint8 *) gum_arm64_writer_cur (gc->code_writer);
+
+  /* Only the head of a trace is snapshotted. */
+  if (gc->trace != NULL && gc->trace->num_segments > 1)
+    real_size = gc->trace->head_size;
+  else
+    real_size = gc->instruction->end - block->real_start;
 
   snapshot_size = gum_stalker_snapshot_space_needed_for (
-      self->exec_context->stalker,
-      self->generator_context->instruction->end - block->real_start);
+      self->exec_context->stalker, real_size);
 
-  return capacity < GUM_EXEC_BLOCK_MIN_CAPACITY + snapshot_size;
+  return capacity < self->exec_context->block_min_capacity + snapshot_size;
 }
 
 void
@@ -3048,13 +3588,13 @@ gum_exec_ctx_handle_misaligned_stack_in_jmp_transfer_ic (
   gconstpointer prolog_start;
 
   num_pop_x0_x1_found = 0;
-  for (cursor = insn + 1; num_pop_x0_x1_found != 2; cursor++)
+  for (cursor = insn + 1; num_pop_x0_x1_found != ctx->ic_entries; cursor++)
   {
     if (*cursor == 0xa8c107e0)
       num_pop_x0_x1_found++;
   }
 
-  prolog_start = cursor + 1 + (4 * 2) + 2;
+  prolog_start = cursor + 1 + (4 * ctx->ic_entries) + 2;
   cpu_context->pc = GPOINTER_TO_SIZE (prolog_start);
 
   gum_exec_ctx_align_stack_temporarily (ctx, cpu_context);
@@ -3066,6 +3606,8 @@ gum_exec_ctx_handle_misaligned_stack_in_call_invoke_ic (
     GumCpuContext * cpu_context)
 {
   const guint32 * insn = GSIZE_TO_POINTER (cpu_context->pc);
+  const guint32 jump_across_ic_entries =
+      0x14000000 | (1 + (4 * ctx->ic_entries)); /* b across the entries */
   gboolean jump_across_ic_entries_found;
   const guint32 * cursor;
   gconstpointer prolog_start;
@@ -3073,11 +3615,11 @@ gum_exec_ctx_handle_misaligned_stack_in_call_invoke_ic (
   jump_across_ic_entries_found = FALSE;
   for (cursor = insn + 2; !jump_across_ic_entries_found; cursor++)
   {
-    if (*cursor == 0x14000009)
+    if (*cursor == jump_across_ic_entries)
       jump_across_ic_entries_found = TRUE;
   }
 
-  prolog_start = cursor + (4 * 2) + 3;
+  prolog_start = cursor + (4 * ctx->ic_entries) + 3;
   cpu_context->pc = GPOINTER_TO_SIZE (prolog_start);
 
   gum_exec_ctx_align_stack_temporarily (ctx, cpu_context);
@@ -3143,7 +3685,7 @@ gum_exec_block_new (GumExecCtx * ctx)
   gsize code_available;
 
   code_available = gum_slab_available (&code_slab->slab);
-  if (code_available < GUM_EXEC_BLOCK_MIN_CAPACITY)
+  if (code_available < ctx->block_min_capacity)
   {
     GumAddressSpec data_spec;
 
@@ -3193,6 +3735,47 @@ gum_exec_block_clear (GumExecBlock * block)
   block->last_callout_offset = 0;
 
   block->storage_block = NULL;
+
+  if (block->trace != NULL)
+  {
+    GumTrace * trace = block->trace;
+    guint i;
+
+    for (i = 1; i != trace->num_segments; i++)
+    {
+      GumExecBlock * folded = trace->segments[i].block;
+
+      if (folded->folded_into == block)
+        folded->folded_into = NULL;
+    }
+
+    gum_free (trace);
+    block->trace = NULL;
+  }
+}
+
+static gboolean
+gum_exec_block_trace_is_unmodified (GumExecBlock * block)
+{
+  const GumTrace * trace = block->trace;
+  guint i;
+
+  if (trace == NULL)
+    return TRUE;
+
+  /* The head is only compared by our caller. */
+  for (i = 1; i != trace->num_segments; i++)
+  {
+    GumExecBlock * folded = trace->segments[i].block;
+
+    if (memcmp (folded->real_start,
+        gum_exec_block_get_snapshot_start (folded), folded->real_size) != 0)
+    {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
 }
 
 static gconstpointer
@@ -3224,10 +3807,51 @@ gum_exec_block_commit (GumExecBlock * block)
   block->capacity = block->code_size + snapshot_size;
 
   gum_slab_reserve (&block->code_slab->slab, block->capacity);
+  block->ctx->code_bytes += block->capacity;
 
   gum_stalker_freeze (stalker, block->code_start, block->code_size);
 }
 
+static void
+gum_exec_block_redirect (GumExecBlock * block,
+                         GumExecBlock * storage_block)
+{
+  GumExecCtx * ctx = block->ctx;
+  GumStalker * stalker = ctx->stalker;
+  GumArm64Writer * cw = &ctx->code_writer;
+  guint8 * internal_code = block->code_start;
+  GumAddress external_code_address;
+
+  block->storage_block = storage_block;
+
+  gum_stalker_thaw (stalker, internal_code, block->capacity);
+  gum_arm64_writer_reset (cw, internal_code);
+
+  external_code_address = GUM_ADDRESS (storage_block->code_start);
+  if (gum_arm64_writer_can_branch_directly_between (cw,
+      GUM_ADDRESS (internal_code), external_code_address))
+  {
+    gum_arm64_writer_put_b_imm (cw, external_code_address);
+    gum_arm64_writer_put_b_imm (cw, external_code_address + sizeof (guint32));
+  }
+  else
+  {
+    gconstpointer already_saved = cw->code + 1;
+
+    gum_arm64_writer_put_b_label (cw, already_saved);
+    gum_arm64_writer_put_stp_reg_reg_reg_offset (cw, ARM64_REG_X16,
+        ARM64_REG_X17, ARM64_REG_SP, -(16 + GUM_RED_ZONE_SIZE),
+        GUM_INDEX_PRE_ADJUST);
+    gum_arm64_writer_put_label (cw, already_saved);
+    gum_arm64_writer_put_ldr_reg_address (cw, ARM64_REG_X16,
+        external_code_address);
+    gum_arm64_writer_put_br_reg_no_auth (cw, ARM64_REG_X16);
+  }
+
+  gum_arm64_writer_flush (cw);
+  gum_stalker_freeze (stalker, internal_code, block->capacity);
+}
+
 static void
 gum_exec_block_invalidate (GumExecBlock * block)
 {
@@ -3301,6 +3925,8 @@ gum_exec_block_backpatch_call (GumExecBlock * block,
 
     gum_spinlock_acquire (&ctx->code_lock);
 
+    ctx->backpatches_applied++;
+
     gum_stalker_thaw (stalker, code_start, code_max_size);
     gum_arm64_writer_reset (cw, code_start);
 
@@ -3368,6 +3994,8 @@ gum_exec_block_backpatch_jmp (GumExecBlock * block,
 
     gum_spinlock_acquire (&ctx->code_lock);
 
+    ctx->backpatches_applied++;
+
     gum_stalker_thaw (stalker, code_start, code_max_size);
     gum_arm64_writer_reset (cw, code_start);
 
@@ -3408,6 +4036,8 @@ gum_exec_block_backpatch_ret (GumExecBlock * block,
 
     gum_spinlock_acquire (&ctx->code_lock);
 
+    ctx->backpatches_applied++;
+
     gum_stalker_thaw (stalker, code_start, code_max_size);
     gum_arm64_writer_reset (cw, code_start);
 
@@ -3438,17 +4068,27 @@ gum_exec_block_backpatch_inline_cache (GumExecBlock * block,
 
   ctx = block->ctx;
 
+  ctx->ic_misses++;
+
   if (gum_exec_ctx_may_now_backpatch (ctx, block))
   {
-    guint offset = (ic_entries[0] == NULL) ? 0 : 2;
+    guint offset;
+
+    for (offset = 0; offset != ctx->ic_entries * 2; offset += 2)
+    {
+      if (ic_entries[offset + 0] == NULL)
+        break;
+    }
 
-    if (ic_entries[offset + 0] == NULL)
+    if (offset != ctx->ic_entries * 2)
     {
       GumStalker * stalker = ctx->stalker;
       const gsize ic_slot_size = 2 * sizeof (gpointer);
 
       gum_spinlock_acquire (&ctx->code_lock);
 
+      ctx->backpatches_applied++;
+
       gum_stalker_thaw (stalker, ic_entries + offset, ic_slot_size);
 
       ic_entries[offset + 0] = block->real_start;
@@ -3556,6 +4196,13 @@ gum_exec_block_virtualize_branch_insn (GumExecBlock * block,
 
       gum_arm64_relocator_skip_one (gc->relocator);
 
+      if (gc->trace != NULL && target.reg == ARM64_REG_INVALID &&
+          gc->exclusive_load_offset == GUM_INSTRUCTION_OFFSET_NONE)
+      {
+        gum_exec_block_write_trace_branch_code (block, &target, gc);
+        break;
+      }
+
       is_false =
           GUINT_TO_POINTER ((GPOINTER_TO_UINT (insn->start) << 16) | 0xbeef);
 
@@ -3823,10 +4470,9 @@ gum_exec_block_write_call_invoke_code (GumExecBlock * block,
   GumPrologType second_prolog;
   GumExecCtxReplaceCurrentBlockFunc entry_func;
   gconstpointer perform_stack_push = cw->code + 1;
-  gconstpointer try_second = cw->code + 2;
-  gconstpointer jump_to_cached = cw->code + 3;
-  gconstpointer resolve_dynamically = cw->code + 4;
-  gconstpointer keep_this_blr = cw->code + 5;
+  gconstpointer jump_to_cached = cw->code + 2;
+  gconstpointer resolve_dynamically = cw->code + 3;
+  gconstpointer keep_this_blr = cw->code + 4;
   GumAddress ret_real_address, ret_code_address;
 
   can_backpatch_statically =
@@ -3835,9 +4481,10 @@ gum_exec_block_write_call_invoke_code (GumExecBlock * block,
 
   if (trust_threshold >= 0 && !can_backpatch_statically)
   {
-    arm64_reg call_target_reg, candidate_reg;
-    guint ic1_real_ref, ic1_code_ref;
-    guint ic2_real_ref, ic2_code_ref;
+    arm64_reg call_target_reg, candidate_reg, scratch_reg;
+    guint ic_real_refs[GUM_STALKER_MAX_IC_ENTRIES];
+    guint ic_code_refs[GUM_STALKER_MAX_IC_ENTRIES];
+    guint i;
 
     if (opened_prolog == GUM_PROLOG_NONE)
     {
@@ -3884,31 +4531,43 @@ gum_exec_block_write_call_invoke_code (GumExecBlock * block,
       candidate_reg = ARM64_REG_X17;
     }
 
+    /*
+     * Both X16 and X17 get restored by the target block, and LR is reloaded
+     * before jumping there, so the hit path may use them as scratch.
+     */
+    scratch_reg = (candidate_reg == ARM64_REG_X16)
+        ? ARM64_REG_X17
+        : ARM64_REG_X16;
+
     gum_arm64_writer_put_mov_reg_reg (cw, call_target_reg, target->reg);
     if ((stalker->cpu_features & GUM_CPU_PTRAUTH) != 0)
       gum_arm64_writer_put_xpaci_reg (cw, call_target_reg);
 
-    ic1_real_ref = gum_arm64_writer_put_ldr_reg_ref (cw, candidate_reg);
-    gum_arm64_writer_put_sub_reg_reg_reg (cw, candidate_reg, candidate_reg,
-        call_target_reg);
-    gum_arm64_writer_put_cbnz_reg_label (cw, candidate_reg, try_second);
-    ic1_code_ref = gum_arm64_writer_put_ldr_reg_ref (cw, candidate_reg);
-    gum_arm64_writer_put_b_label (cw, jump_to_cached);
-
-    gum_arm64_writer_put_label (cw, try_second);
-    ic2_real_ref = gum_arm64_writer_put_ldr_reg_ref (cw, candidate_reg);
-    gum_arm64_writer_put_sub_reg_reg_reg (cw, candidate_reg, candidate_reg,
-        call_target_reg);
-    gum_arm64_writer_put_cbnz_reg_label (cw, candidate_reg,
-        resolve_dynamically);
-    ic2_code_ref = gum_arm64_writer_put_ldr_reg_ref (cw, candidate_reg);
-    gum_arm64_writer_put_b_label (cw, jump_to_cached);
+    for (i = 0; i != ctx->ic_entries; i++)
+    {
+      gconstpointer try_next = cw->code + 1;
+      const gboolean is_last = i == ctx->ic_entries - 1;
+
+      ic_real_refs[i] = gum_arm64_writer_put_ldr_reg_ref (cw, candidate_reg);
+      gum_arm64_writer_put_sub_reg_reg_reg (cw, candidate_reg, candidate_reg,
+          call_target_reg);
+      gum_arm64_writer_put_cbnz_reg_label (cw, candidate_reg,
+          is_last ? resolve_dynamically : try_next);
+      ic_code_refs[i] = gum_arm64_writer_put_ldr_reg_ref (cw, candidate_reg);
+      gum_exec_ctx_write_inline_cache_hit_increment (ctx, ARM64_REG_LR,
+          scratch_reg, cw);
+      gum_arm64_writer_put_b_label (cw, jump_to_cached);
+
+      if (!is_last)
+        gum_arm64_writer_put_label (cw, try_next);
+    }
 
     ic_entries = gum_arm64_writer_cur (cw);
-    gum_arm64_writer_put_ldr_reg_value (cw, ic1_real_ref, 0);
-    gum_arm64_writer_put_ldr_reg_value (cw, ic1_code_ref, 0);
-    gum_arm64_writer_put_ldr_reg_value (cw, ic2_real_ref, 0);
-    gum_arm64_writer_put_ldr_reg_value (cw, ic2_code_ref, 0);
+    for (i = 0; i != ctx->ic_entries; i++)
+    {
+      gum_arm64_writer_put_ldr_reg_value (cw, ic_real_refs[i], 0);
+      gum_arm64_writer_put_ldr_reg_value (cw, ic_code_refs[i], 0);
+    }
 
     gum_arm64_writer_put_label (cw, jump_to_cached);
     ic_load_real_address_ref =
@@ -4093,11 +4752,12 @@ gum_exec_block_write_jmp_transfer_code (GumExecBlock * block,
 
   if (trust_threshold >= 0 && !can_backpatch_statically)
   {
-    gconstpointer try_second = cw->code + 1;
-    gconstpointer resolve_dynamically = cw->code + 2;
+    GumExecCtx * ctx = block->ctx;
+    gconstpointer resolve_dynamically = cw->code + 1;
     arm64_reg jmp_target_reg, candidate_reg;
-    guint ic1_real_ref, ic1_code_ref;
-    guint ic2_real_ref, ic2_code_ref;
+    guint ic_real_refs[GUM_STALKER_MAX_IC_ENTRIES];
+    guint ic_code_refs[GUM_STALKER_MAX_IC_ENTRIES];
+    guint i;
 
     if (opened_prolog != GUM_PROLOG_NONE)
       gum_exec_block_close_prolog (block, gc);
@@ -4124,29 +4784,32 @@ gum_exec_block_write_jmp_transfer_code (GumExecBlock * block,
     if ((stalker->cpu_features & GUM_CPU_PTRAUTH) != 0)
       gum_arm64_writer_put_xpaci_reg (cw, jmp_target_reg);
 
-    ic1_real_ref = gum_arm64_writer_put_ldr_reg_ref (cw, candidate_reg);
-    gum_arm64_writer_put_sub_reg_reg_reg (cw, candidate_reg, candidate_reg,
-        jmp_target_reg);
-    gum_arm64_writer_put_cbnz_reg_label (cw, candidate_reg, try_second);
-    ic1_code_ref = gum_arm64_writer_put_ldr_reg_ref (cw, candidate_reg);
-    gum_arm64_writer_put_pop_reg_reg (cw, ARM64_REG_X0, ARM64_REG_X1);
-    gum_arm64_writer_put_br_reg_no_auth (cw, candidate_reg);
+    for (i = 0; i != ctx->ic_entries; i++)
+    {
+      gconstpointer try_next = cw->code + 1;
+      const gboolean is_last = i == ctx->ic_entries - 1;
+
+      ic_real_refs[i] = gum_arm64_writer_put_ldr_reg_ref (cw, candidate_reg);
+      gum_arm64_writer_put_sub_reg_reg_reg (cw, candidate_reg, candidate_reg,
+          jmp_target_reg);
+      gum_arm64_writer_put_cbnz_reg_label (cw, candidate_reg,
+          is_last ? resolve_dynamically : try_next);
+      ic_code_refs[i] = gum_arm64_writer_put_ldr_reg_ref (cw, candidate_reg);
+      gum_exec_ctx_write_inline_cache_hit_increment (ctx, ARM64_REG_X0,
+          ARM64_REG_X1, cw);
+      gum_arm64_writer_put_pop_reg_reg (cw, ARM64_REG_X0, ARM64_REG_X1);
+      gum_arm64_writer_put_br_reg_no_auth (cw, candidate_reg);
 
-    gum_arm64_writer_put_label (cw, try_second);
-    ic2_real_ref = gum_arm64_writer_put_ldr_reg_ref (cw, candidate_reg);
-    gum_arm64_writer_put_sub_reg_reg_reg (cw, candidate_reg, candidate_reg,
-        jmp_target_reg);
-    gum_arm64_writer_put_cbnz_reg_label (cw, candidate_reg,
-        resolve_dynamically);
-    ic2_code_ref = gum_arm64_writer_put_ldr_reg_ref (cw, candidate_reg);
-    gum_arm64_writer_put_pop_reg_reg (cw, ARM64_REG_X0, ARM64_REG_X1);
-    gum_arm64_writer_put_br_reg_no_auth (cw, candidate_reg);
+      if (!is_last)
+        gum_arm64_writer_put_label (cw, try_next);
+    }
 
     ic_entries = gum_arm64_writer_cur (cw);
-    gum_arm64_writer_put_ldr_reg_value (cw, ic1_real_ref, 0);
-    gum_arm64_writer_put_ldr_reg_value (cw, ic1_code_ref, 0);
-    gum_arm64_writer_put_ldr_reg_value (cw, ic2_real_ref, 0);
-    gum_arm64_writer_put_ldr_reg_value (cw, ic2_code_ref, 0);
+    for (i = 0; i != ctx->ic_entries; i++)
+    {
+      gum_arm64_writer_put_ldr_reg_value (cw, ic_real_refs[i], 0);
+      gum_arm64_writer_put_ldr_reg_value (cw, ic_code_refs[i], 0);
+    }
 
     gum_arm64_writer_put_label (cw, resolve_dynamically);
     gum_arm64_writer_put_pop_reg_reg (cw, ARM64_REG_X0, ARM64_REG_X1);
@@ -4194,6 +4857,192 @@ gum_exec_block_write_jmp_transfer_code (GumExecBlock * block,
   gum_exec_block_write_exec_generated_code (cw, block->ctx);
 }
 
+static void
+gum_exec_block_write_trace_branch_code (GumExecBlock * block,
+                                        const GumBranchTarget * target,
+                                        GumGeneratorContext * gc)
+{
+  GumExecCtx * ctx = block->ctx;
+  GumTrace * trace = gc->trace;
+  GumArm64Writer * cw = gc->code_writer;
+  GumInstruction * insn = gc->instruction;
+  const guint id = insn->ci->id;
+  const arm64_cc cc = insn->ci->detail->arm64.cc;
+  GumExecCtxReplaceCurrentBlockFunc func;
+  GumBranchTarget fall_through = { 0, };
+  const GumBranchTarget * first, * second;
+  const GumTraceSegment * taken_segment, * fall_through_segment;
+  const GumTraceSegment * first_segment;
+  GumExecBlock * taken_block, * fall_through_block;
+  gboolean prefer_taken;
+
+  gum_exec_block_close_prolog (block, gc);
+
+  switch (id)
+  {
+    case ARM64_INS_B:
+      if (cc == ARM64_CC_INVALID)
+      {
+        gum_exec_block_write_trace_edge_code (block, target,
+            GUM_ENTRYGATE (jmp_imm), gc);
+        return;
+      }
+      func = GUM_ENTRYGATE (jmp_cond_cc);
+      break;
+    case ARM64_INS_CBZ:
+      func = GUM_ENTRYGATE (jmp_cond_cbz);
+      break;
+    case ARM64_INS_CBNZ:
+      func = GUM_ENTRYGATE (jmp_cond_cbnz);
+      break;
+    case ARM64_INS_TBZ:
+      func = GUM_ENTRYGATE (jmp_cond_tbz);
+      break;
+    case ARM64_INS_TBNZ:
+      func = GUM_ENTRYGATE (jmp_cond_tbnz);
+      break;
+    default:
+      func = NULL;
+      g_assert_not_reached ();
+  }
+
+  fall_through.absolute_address = insn->end;
+  fall_through.reg = ARM64_REG_INVALID;
+
+  /*
+   * Lay out the hotter edge last so the trace can carry straight on into it,
+   * favoring backward branches when there is no profile to go on.
+   */
+  taken_segment = gum_trace_find_segment (trace, target->absolute_address);
+  fall_through_segment = gum_trace_find_segment (trace, insn->end);
+  taken_block = gum_metal_hash_table_lookup (ctx->mappings,
+      target->absolute_address);
+  fall_through_block = gum_metal_hash_table_lookup (ctx->mappings, insn->end);
+
+  if (taken_segment != NULL)
+    prefer_taken = FALSE;
+  else if (fall_through_segment != NULL)
+    prefer_taken = TRUE;
+  else if (taken_block == NULL || fall_through_block == NULL)
+    prefer_taken = taken_block != NULL;
+  else if (taken_block->exec_count != fall_through_block->exec_count)
+    prefer_taken = taken_block->exec_count > fall_through_block->exec_count;
+  else
+    prefer_taken = (guint8 *) target->absolute_address < insn->start;
+
+  if (prefer_taken)
+  {
+    first = &fall_through;
+    first_segment = fall_through_segment;
+    second = target;
+  }
+  else
+  {
+    first = target;
+    first_segment = taken_segment;
+    second = &fall_through;
+  }
+
+  if (first_segment != NULL)
+  {
+    gum_exec_block_put_trace_cond_branch (gc, !prefer_taken, first_segment);
+    trace->num_internal_branches++;
+  }
+  else
+  {
+    gconstpointer take_second = cw->code + 1;
+
+    gum_exec_block_put_trace_cond_branch (gc, prefer_taken, take_second);
+    gum_exec_block_write_jmp_transfer_code (block, first, func, gc);
+    gum_arm64_writer_put_label (cw, take_second);
+  }
+
+  gum_exec_block_write_trace_edge_code (block, second, func, gc);
+}
+
+static void
+gum_exec_block_write_trace_edge_code (GumExecBlock * block,
+                                      const GumBranchTarget * target,
+                                      GumExecCtxReplaceCurrentBlockFunc func,
+                                      GumGeneratorContext * gc)
+{
+  GumTrace * trace = gc->trace;
+  const GumTraceSegment * segment;
+
+  segment = gum_trace_find_segment (trace, target->absolute_address);
+  if (segment != NULL)
+  {
+    gum_arm64_writer_put_b_label (gc->code_writer, segment);
+    trace->num_internal_branches++;
+    return;
+  }
+
+  if (gum_exec_ctx_may_extend_trace (block->ctx, trace,
+      target->absolute_address))
+  {
+    trace->next = target->absolute_address;
+    return;
+  }
+
+  gum_exec_block_write_jmp_transfer_code (block, target, func, gc);
+}
+
+static void
+gum_exec_block_put_trace_cond_branch (GumGeneratorContext * gc,
+                                      gboolean if_taken,
+                                      gconstpointer label_id)
+{
+  GumArm64Writer * cw = gc->code_writer;
+  const cs_insn * ci = gc->instruction->ci;
+  const cs_arm64 * arm64 = &ci->detail->arm64;
+  const cs_arm64_op * op = &arm64->operands[0];
+  const arm64_cc cc = arm64->cc;
+
+  switch (ci->id)
+  {
+    case ARM64_INS_B:
+      gum_arm64_writer_put_b_cond_label (cw,
+          if_taken ? cc : cc + 2 * (cc % 2) - 1, label_id);
+      break;
+    case ARM64_INS_CBZ:
+    case ARM64_INS_CBNZ:
+      if ((ci->id == ARM64_INS_CBZ) == if_taken)
+        gum_arm64_writer_put_cbz_reg_label (cw, op->reg, label_id);
+      else
+        gum_arm64_writer_put_cbnz_reg_label (cw, op->reg, label_id);
+      break;
+    case ARM64_INS_TBZ:
+    case ARM64_INS_TBNZ:
+    {
+      const guint bit = arm64->operands[1].imm;
+
+      if ((ci->id == ARM64_INS_TBZ) == if_taken)
+        gum_arm64_writer_put_tbz_reg_imm_label (cw, op->reg, bit, label_id);
+      else
+        gum_arm64_writer_put_tbnz_reg_imm_label (cw, op->reg, bit, label_id);
+      break;
+    }
+    default:
+      g_assert_not_reached ();
+  }
+}
+
+static void
+gum_exec_ctx_write_inline_cache_hit_increment (GumExecCtx * ctx,
+                                               arm64_reg address_reg,
+                                               arm64_reg value_reg,
+                                               GumArm64Writer * cw)
+{
+  if (!ctx->count_ic_hits)
+    return;
+
+  gum_arm64_writer_put_ldr_reg_address (cw, address_reg,
+      GUM_ADDRESS (&ctx->ic_hits));
+  gum_arm64_writer_put_ldr_reg_reg_offset (cw, value_reg, address_reg, 0);
+  gum_arm64_writer_put_add_reg_reg_imm (cw, value_reg, value_reg, 1);
+  gum_arm64_writer_put_str_reg_reg_offset (cw, value_reg, address_reg, 0);
+}
+
 static void
 gum_exec_block_write_jmp_to_block_start (GumExecBlock * block,
                                          gpointer block_start)
@@ -4631,6 +5480,12 @@ gum_slab_cursor (GumSlab * self)
   return self->data + self->offset;
 }
 
+static gsize
+gum_slab_footprint (GumSlab * self)
+{
+  return (self->data - (guint8 *) self) + self->size;
+}
+
 static gpointer
 gum_slab_reserve (GumSlab * self,
                   gsize size)
@@ -252,6 +252,48 @@ gum_memory_is_readable (gconstpointer address,
   return is_readable;
 }
 
+gboolean
+gum_memory_query_protection (gconstpointer address,
+                             GumPageProtection * prot)
+{
+  mach_port_t self;
+  mach_vm_address_t region_address;
+  mach_vm_size_t region_size;
+  natural_t depth;
+  vm_region_submap_info_data_64_t info;
+  mach_msg_type_number_t info_count;
+  kern_return_t kr;
+
+  self = mach_task_self ();
+
+  region_address = GPOINTER_TO_SIZE (address);
+  depth = 0;
+
+  while (TRUE)
+  {
+    info_count = VM_REGION_SUBMAP_INFO_COUNT_64;
+    kr = mach_vm_region_recurse (self, &region_address, &region_size, &depth,
+        (vm_region_recurse_info_t) &info, &info_count);
+    if (kr != KERN_SUCCESS)
+      return FALSE;
+
+    if (info.is_submap)
+    {
+      depth++;
+      continue;
+    }
+
+    break;
+  }
+
+  if (region_address > GPOINTER_TO_SIZE (address))
+    return FALSE;
+
+  *prot = gum_page_protection_from_mach (info.protection);
+
+  return TRUE;
+}
+
 guint8 *
 gum_memory_read (gconstpointer address,
                  gsize len,
@@ -450,6 +492,8 @@ gum_try_mprotect (gpointer address,
   kr = gum_mach_vm_protect (mach_task_self (),
       GPOINTER_TO_SIZE (aligned_address), aligned_size, FALSE, mach_prot);
 
+  _gum_memory_note_map_change ();
+
   return kr == KERN_SUCCESS;
 }
 
@@ -519,6 +563,8 @@ gum_free_pages (gpointer mem)
 
   kr = mach_vm_deallocate (mach_task_self (), address, size);
   g_assert (kr == KERN_SUCCESS);
+
+  _gum_memory_note_map_change ();
 }
 
 gpointer
@@ -574,6 +620,8 @@ gum_allocate_page_aligned (gpointer address,
   if (result == MAP_FAILED)
     return NULL;
 
+  _gum_memory_note_map_change ();
+
 #if defined (HAVE_IOS) && !defined (HAVE_I386)
   {
     gboolean need_checkra1n_quirk;
@@ -680,7 +728,13 @@ gboolean
 gum_memory_free (gpointer address,
                  gsize size)
 {
-  return munmap (address, size) == 0;
+  gboolean success;
+
+  success = munmap (address, size) == 0;
+
+  _gum_memory_note_map_change ();
+
+  return success;
 }
 
 gboolean
@@ -11,6 +11,7 @@
 #include "gumdarwinsymbolicator.h"
 
 #include <mach-o/dyld.h>
+#include <string.h>
 
 #define GUM_TYPE_SYMBOL_CACHE_INVALIDATOR \
     (gum_symbol_cache_invalidator_get_type ())
@@ -108,6 +109,41 @@ gum_symbol_details_from_address (gpointer address,
   return success;
 }
 
+guint
+gum_symbol_details_from_addresses (const gpointer * addresses,
+                                   guint n_addresses,
+                                   GumDebugSymbolDetails * details)
+{
+  guint n_resolved, i;
+  GumDarwinSymbolicator * symbolicator;
+
+  memset (details, 0, n_addresses * sizeof (GumDebugSymbolDetails));
+
+  if ((symbolicator = gum_try_obtain_symbolicator ()) == NULL)
+    return 0;
+
+  n_resolved = 0;
+
+  for (i = 0; i != n_addresses; i++)
+  {
+    GumDebugSymbolDetails * d = &details[i];
+
+    if (gum_darwin_symbolicator_details_from_address (symbolicator,
+        GUM_ADDRESS (addresses[i]), d))
+    {
+      n_resolved++;
+    }
+    else
+    {
+      memset (d, 0, sizeof (GumDebugSymbolDetails));
+    }
+  }
+
+  g_object_unref (symbolicator);
+
+  return n_resolved;
+}
+
 gchar *
 gum_symbol_name_from_address (gpointer address)
 {
@@ -184,6 +220,11 @@ gum_load_symbols (const gchar * path)
   return FALSE;
 }
 
+void
+gum_set_symbol_index_directory (const gchar * path)
+{
+}
+
 static GArray *
 gum_pointer_array_new_empty (void)
 {
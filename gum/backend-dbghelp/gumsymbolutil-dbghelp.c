@@ -88,6 +88,28 @@ gum_symbol_details_from_address (gpointer address,
   return (has_sym_info || has_file_info);
 }
 
+guint
+gum_symbol_details_from_addresses (const gpointer * addresses,
+                                   guint n_addresses,
+                                   GumDebugSymbolDetails * details)
+{
+  guint n_resolved, i;
+
+  n_resolved = 0;
+
+  for (i = 0; i != n_addresses; i++)
+  {
+    GumDebugSymbolDetails * d = &details[i];
+
+    if (gum_symbol_details_from_address (addresses[i], d))
+      n_resolved++;
+    else
+      memset (d, 0, sizeof (GumDebugSymbolDetails));
+  }
+
+  return n_resolved;
+}
+
 gchar *
 gum_symbol_name_from_address (gpointer address)
 {
@@ -182,6 +204,11 @@ beach:
   return success;
 }
 
+void
+gum_set_symbol_index_directory (const gchar * path)
+{
+}
+
 static BOOL CALLBACK
 enum_functions_callback (SYMBOL_INFO * sym_info,
                          gulong symbol_size,
@@ -20,6 +20,7 @@
 #endif
 
 #include <fcntl.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
@@ -964,6 +965,50 @@ gum_elf_module_has_interp (GumElfModule * self)
   return FALSE;
 }
 
+gchar *
+gum_elf_module_get_build_id (GumElfModule * self)
+{
+  Elf_Scn * scn;
+
+  scn = NULL;
+  while ((scn = elf_nextscn (self->elf, scn)) != NULL)
+  {
+    GElf_Shdr shdr;
+    Elf_Data * data;
+    size_t offset, name_offset, desc_offset;
+    GElf_Nhdr nhdr;
+
+    if (gelf_getshdr (scn, &shdr) == NULL || shdr.sh_type != SHT_NOTE)
+      continue;
+
+    data = elf_getdata (scn, NULL);
+    if (data == NULL)
+      continue;
+
+    offset = 0;
+    while ((offset = gelf_getnote (data, offset, &nhdr, &name_offset,
+        &desc_offset)) != 0)
+    {
+      const gchar * name = (const gchar *) data->d_buf + name_offset;
+      const guint8 * desc = (const guint8 *) data->d_buf + desc_offset;
+      GString * id;
+      guint i;
+
+      if (nhdr.n_type != NT_GNU_BUILD_ID || nhdr.n_namesz != 4 ||
+          memcmp (name, "GNU", 4) != 0 || nhdr.n_descsz == 0)
+        continue;
+
+      id = g_string_sized_new (2 * nhdr.n_descsz);
+      for (i = 0; i != nhdr.n_descsz; i++)
+        g_string_append_printf (id, "%02x", desc[i]);
+
+      return g_string_free (id, FALSE);
+    }
+  }
+
+  return NULL;
+}
+
 static gboolean
 gum_maybe_extract_from_apk (const gchar * path,
                             gpointer * file_data,
@@ -135,6 +135,7 @@ GUM_API gboolean gum_elf_module_find_section_header_by_type (
     GumElfModule * self, GumElfSectionHeaderType type, Elf_Scn ** scn,
     GElf_Shdr * shdr);
 GUM_API gboolean gum_elf_module_has_interp (GumElfModule * self);
+GUM_API gchar * gum_elf_module_get_build_id (GumElfModule * self);
 
 G_END_DECLS
 
@@ -12,6 +12,9 @@
 
 #include <dlfcn.h>
 #include <dwarf.h>
+#ifndef HAVE_ANDROID
+# include <link.h>
+#endif
 #ifdef __clang__
 # pragma clang diagnostic push
 # pragma clang diagnostic ignored "-Wtypedef-redefinition"
@@ -20,17 +23,32 @@
 #ifdef __clang__
 # pragma clang diagnostic pop
 #endif
+#include <string.h>
 #include <strings.h>
 
-#define GUM_MAX_CACHE_AGE (0.5)
+#define GUM_MAX_CACHE_AGE_MSEC 500
+#define GUM_GENERATION_CHECK_INTERVAL_MSEC 50
+
+#define GUM_SYMBOL_INDEX_MAGIC   0x49535947
+#define GUM_SYMBOL_INDEX_VERSION 1
 
 typedef struct _GumModuleEntry GumModuleEntry;
+typedef struct _GumSymbolCache GumSymbolCache;
+typedef struct _GumRetiredObject GumRetiredObject;
+typedef struct _GumRefreshOperation GumRefreshOperation;
+typedef struct _GumModuleGeneration GumModuleGeneration;
+typedef struct _GumSymbolIndexHeader GumSymbolIndexHeader;
+typedef struct _GumSymbolIndexEntry GumSymbolIndexEntry;
+
+typedef struct _GumDwarfIndex GumDwarfIndex;
+typedef struct _GumDwarfUnit GumDwarfUnit;
+typedef struct _GumDwarfRange GumDwarfRange;
+typedef struct _GumDwarfSymbolEntry GumDwarfSymbolEntry;
+typedef struct _GumDwarfLineEntry GumDwarfLineEntry;
+typedef struct _GumCollectSymbolsOperation GumCollectSymbolsOperation;
 
 typedef struct _GumNearestSymbolDetails GumNearestSymbolDetails;
-typedef struct _GumDwarfSymbolDetails GumDwarfSymbolDetails;
-typedef struct _GumDwarfSourceDetails GumDwarfSourceDetails;
-typedef struct _GumFindCuDieOperation GumFindCuDieOperation;
-typedef struct _GumFindSymbolOperation GumFindSymbolOperation;
+typedef struct _GumAddressSlot GumAddressSlot;
 
 typedef struct _GumCuDieDetails GumCuDieDetails;
 typedef struct _GumDieDetails GumDieDetails;
@@ -42,41 +60,131 @@ typedef gboolean (* GumFoundDieFunc) (const GumDieDetails * details,
 
 struct _GumModuleEntry
 {
+  GumAddress base_address;
   GumElfModule * module;
   Dwarf_Debug dbg;
-  gboolean collected;
+  GumDwarfIndex * volatile index;
+  GArray * symbols;
+  GStringChunk * symbol_names;
+  GMappedFile * symbol_index;
 };
 
-struct _GumNearestSymbolDetails
+/*
+ * Published snapshot of the ELF symbol tables. Once published it is never
+ * modified: refreshing builds a copy and swaps the global pointer, and the
+ * previous snapshot is reclaimed once no reader may still be using it.
+ */
+struct _GumSymbolCache
 {
-  const gchar * name;
-  gpointer address;
+  GHashTable * function_addresses;
+  GHashTable * address_symbols;
 };
 
-struct _GumDwarfSymbolDetails
+struct _GumRetiredObject
 {
-  gchar * name;
+  gpointer data;
+  GDestroyNotify destroy;
+  guint epoch;
+};
+
+struct _GumRefreshOperation
+{
+  GHashTable * module_entries;
+  GHashTable * loaded;
+  GPtrArray * pending;
+  GPtrArray * unloaded;
+};
+
+struct _GumModuleGeneration
+{
+  guint adds;
+  guint subs;
+  gboolean known;
+};
+
+/*
+ * On-disk index of a module's function symbols, named after its build-id:
+ * a header, followed by the entries, followed by the NUL-terminated names.
+ * Addresses are relative to the module base so the file survives ASLR.
+ */
+struct _GumSymbolIndexHeader
+{
+  guint32 magic;
+  guint32 version;
+  guint32 n_symbols;
+  guint32 strings_size;
+};
+
+struct _GumSymbolIndexEntry
+{
+  guint64 address;
+  guint64 size;
+  guint32 name_offset;
+  guint32 section_header_index;
+  guint8 type;
+  guint8 bind;
+  guint8 padding[6];
+};
+
+/*
+ * Address index built the first time a module's debug info is consulted.
+ * The CU ranges are gathered up front, while each CU's symbols and line
+ * table are only decoded the first time an address resolves to it.
+ */
+struct _GumDwarfIndex
+{
+  GArray * units;
+  GArray * ranges;
+  GStringChunk * strings;
+};
+
+struct _GumDwarfUnit
+{
+  Dwarf_Off die_offset;
+  volatile gint indexed;
+  GArray * symbols;
+  GArray * lines;
+};
+
+struct _GumDwarfRange
+{
+  Dwarf_Addr start;
+  Dwarf_Addr end;
+  guint unit_index;
+};
+
+struct _GumDwarfSymbolEntry
+{
+  Dwarf_Addr address;
+  const gchar * name;
   guint line_number;
+  guint order;
 };
 
-struct _GumDwarfSourceDetails
+struct _GumDwarfLineEntry
 {
-  gchar * path;
+  Dwarf_Addr address;
+  const gchar * path;
   guint line_number;
+  guint order;
 };
 
-struct _GumFindCuDieOperation
+struct _GumCollectSymbolsOperation
 {
-  Dwarf_Addr needle;
-  gboolean found;
-  Dwarf_Off cu_die_offset;
+  GArray * symbols;
+  GStringChunk * strings;
 };
 
-struct _GumFindSymbolOperation
+struct _GumNearestSymbolDetails
+{
+  const gchar * name;
+  gpointer address;
+};
+
+struct _GumAddressSlot
 {
-  GumAddress needle;
-  GumDwarfSymbolDetails * symbol;
-  GumAddress closest_address;
+  gpointer address;
+  guint index;
 };
 
 struct _GumCuDieDetails
@@ -94,6 +202,8 @@ struct _GumDieDetails
   Dwarf_Debug dbg;
 };
 
+static gboolean gum_resolve_symbol_details (gpointer address,
+    GumDebugSymbolDetails * details);
 static gboolean gum_find_nearest_symbol_by_address (gpointer address,
     GumNearestSymbolDetails * nearest);
 static GumModuleEntry * gum_module_entry_from_address (gpointer address,
@@ -102,31 +212,71 @@ static GumModuleEntry * gum_module_entry_from_path_and_base (const gchar * path,
     GumAddress base_address);
 static Dwarf_Addr gum_module_entry_virtual_address_to_file (
     GumModuleEntry * self, gpointer address);
+static GumDwarfUnit * gum_module_entry_find_unit (GumModuleEntry * self,
+    Dwarf_Addr address);
+
+static GumModuleEntry * gum_module_entry_new (const gchar * path,
+    GumAddress base_address);
+static void gum_module_entry_free (GumModuleEntry * entry);
+static GHashTable * gum_module_entries_copy (GHashTable * entries);
 
 static GHashTable * gum_get_function_addresses (void);
 static GHashTable * gum_get_address_symbols (void);
-static void gum_maybe_refresh_symbol_caches (void);
-static gboolean gum_collect_module_functions (const GumModuleDetails * details,
-    gpointer user_data);
+static GumSymbolCache * gum_get_symbol_cache (void);
+static gboolean gum_refresh_symbol_caches_after_miss (void);
+static void gum_maybe_refresh_symbol_caches (gboolean after_miss);
+static void gum_refresh_symbol_caches (void);
+static gboolean gum_collect_module_entry (const GumModuleDetails * details,
+    GumRefreshOperation * op);
+static void gum_remove_unloaded_module_entries (GumRefreshOperation * op);
+static void gum_module_entry_load_symbols (GumModuleEntry * self);
+static gboolean gum_module_entry_map_symbol_index (GumModuleEntry * self,
+    const gchar * path);
+static void gum_module_entry_save_symbol_index (GumModuleEntry * self,
+    const gchar * path);
 static gboolean gum_collect_symbol_if_function (
-    const GumElfSymbolDetails * details, gpointer user_data);
+    const GumElfSymbolDetails * details, GumModuleEntry * entry);
+static gboolean gum_query_module_generation (
+    GumModuleGeneration * generation);
+#ifndef HAVE_ANDROID
+static int gum_read_module_generation (struct dl_phdr_info * info,
+    size_t size, void * data);
+#endif
+
+static GumSymbolCache * gum_symbol_cache_new (void);
+static GumSymbolCache * gum_symbol_cache_copy (const GumSymbolCache * cache);
+static void gum_symbol_cache_free (GumSymbolCache * cache);
+static void gum_symbol_cache_add_symbols (GumSymbolCache * self,
+    GArray * symbols);
+
+static guint gum_symbol_util_read_begin (void);
+static void gum_symbol_util_read_end (guint token);
+static void gum_symbol_util_publish (gpointer * location, gpointer data,
+    GDestroyNotify destroy);
+static void gum_symbol_util_retire (gpointer data, GDestroyNotify destroy);
+static void gum_symbol_util_reclaim (gboolean all);
 
 static void gum_symbol_util_ensure_initialized (void);
 static void gum_symbol_util_deinitialize (void);
 
 static void gum_on_dwarf_error (Dwarf_Error error, Dwarf_Ptr errarg);
 
-static Dwarf_Die gum_find_cu_die_by_virtual_address (Dwarf_Debug dbg,
-    Dwarf_Addr address);
-static gboolean gum_store_cu_die_offset_if_containing_address (
-    const GumCuDieDetails * details, GumFindCuDieOperation * op);
-static gboolean gum_find_symbol_by_virtual_address (Dwarf_Debug dbg,
-    Dwarf_Die cu_die, Dwarf_Addr address, GumDwarfSymbolDetails * details);
-static gboolean gum_collect_die_if_closest_so_far (
-    const GumDieDetails * details, GumFindSymbolOperation * op);
-static gboolean gum_find_line_by_virtual_address (Dwarf_Debug dbg,
-    Dwarf_Die cu_die, Dwarf_Addr address, guint symbol_line_number,
-    GumDwarfSourceDetails * details);
+static GumDwarfIndex * gum_dwarf_index_new (Dwarf_Debug dbg);
+static void gum_dwarf_index_free (GumDwarfIndex * index);
+static gboolean gum_dwarf_index_add_unit (const GumCuDieDetails * details,
+    GumDwarfIndex * index);
+static void gum_dwarf_index_add_range (GumDwarfIndex * self, Dwarf_Addr start,
+    Dwarf_Addr end, guint unit_index);
+static void gum_dwarf_unit_build (GumDwarfUnit * self, Dwarf_Debug dbg,
+    GStringChunk * strings);
+static gboolean gum_collect_symbol_if_named (const GumDieDetails * details,
+    GumCollectSymbolsOperation * op);
+static void gum_collect_unit_lines (Dwarf_Debug dbg, Dwarf_Die cu_die,
+    GStringChunk * strings, GArray * lines);
+static const GumDwarfSymbolEntry * gum_dwarf_unit_find_symbol (
+    GumDwarfUnit * self, Dwarf_Addr address);
+static const GumDwarfLineEntry * gum_dwarf_unit_find_line (GumDwarfUnit * self,
+    Dwarf_Addr address, guint symbol_line_number);
 
 static void gum_enumerate_cu_dies (Dwarf_Debug dbg, gboolean is_info,
     GumFoundCuDieFunc func, gpointer user_data);
@@ -136,7 +286,7 @@ static gboolean gum_enumerate_dies_recurse (Dwarf_Debug dbg, Dwarf_Die die,
     GumFoundDieFunc func, gpointer user_data);
 
 static gboolean gum_read_die_name (Dwarf_Debug dbg, Dwarf_Die die,
-    gchar ** name);
+    GStringChunk * strings, const gchar ** name);
 static gboolean gum_read_attribute_location (Dwarf_Debug dbg, Dwarf_Die die,
     Dwarf_Half id, Dwarf_Addr * address);
 static gboolean gum_read_attribute_address (Dwarf_Debug dbg, Dwarf_Die die,
@@ -147,133 +297,223 @@ static gboolean gum_read_attribute_uint (Dwarf_Debug dbg, Dwarf_Die die,
     Dwarf_Half id, Dwarf_Unsigned * value);
 
 static gint gum_compare_pointers (gconstpointer a, gconstpointer b);
+static gint gum_compare_address_slots (const GumAddressSlot * a,
+    const GumAddressSlot * b);
+static gint gum_compare_dwarf_ranges (const GumDwarfRange * a,
+    const GumDwarfRange * b);
+static gint gum_compare_dwarf_symbols (const GumDwarfSymbolEntry * a,
+    const GumDwarfSymbolEntry * b);
+static gint gum_compare_dwarf_lines (const GumDwarfLineEntry * a,
+    const GumDwarfLineEntry * b);
 
+/*
+ * Readers never take a lock. They register in one of two counters selected
+ * by the current epoch, and writers (serialized by the gum_symbol_util lock)
+ * publish new tables by swapping pointers. The epoch only advances once the
+ * previous epoch has no readers left, and whatever a writer replaced is freed
+ * once every reader from its retirement epoch is gone.
+ */
 G_LOCK_DEFINE_STATIC (gum_symbol_util);
+G_LOCK_DEFINE_STATIC (gum_dwarf_index);
 static GHashTable * gum_module_entries = NULL;
-static GHashTable * gum_function_addresses = NULL;
-static GHashTable * gum_address_symbols = NULL;
-static GTimer * gum_cache_timer = NULL;
+static GumSymbolCache * gum_symbol_cache = NULL;
+static guint gum_cache_deadline = 0;
+static guint gum_generation_deadline = 0;
+static guint gum_module_adds = 0;
+static guint gum_module_subs = 0;
+static guint gum_symbol_epoch = 0;
+static gint gum_symbol_readers[2] = { 0, 0 };
+static GSList * gum_retired_objects = NULL;
+static gchar * gum_symbol_index_directory = NULL;
 
 gboolean
 gum_symbol_details_from_address (gpointer address,
                                  GumDebugSymbolDetails * details)
 {
   gboolean success;
+  guint read_token;
+
+  gum_symbol_util_ensure_initialized ();
+
+  read_token = gum_symbol_util_read_begin ();
+
+  success = gum_resolve_symbol_details (address, details);
+
+  gum_symbol_util_read_end (read_token);
+
+  return success;
+}
+
+guint
+gum_symbol_details_from_addresses (const gpointer * addresses,
+                                   guint n_addresses,
+                                   GumDebugSymbolDetails * details)
+{
+  guint n_resolved, i;
+  GArray * slots;
+  const GumDebugSymbolDetails * previous_details;
+  gboolean previous_success;
+  guint read_token;
+
+  slots = g_array_sized_new (FALSE, FALSE, sizeof (GumAddressSlot),
+      n_addresses);
+  for (i = 0; i != n_addresses; i++)
+  {
+    GumAddressSlot slot;
+
+    slot.address = addresses[i];
+    slot.index = i;
+    g_array_append_val (slots, slot);
+  }
+
+  /*
+   * Resolving in address order keeps consecutive lookups within the same
+   * module and CU, and lets repeated addresses (common in profiles) share
+   * a single lookup. The whole batch runs inside one read-side section.
+   */
+  g_array_sort (slots, (GCompareFunc) gum_compare_address_slots);
+
+  n_resolved = 0;
+  previous_details = NULL;
+  previous_success = FALSE;
+
+  gum_symbol_util_ensure_initialized ();
+
+  read_token = gum_symbol_util_read_begin ();
+
+  for (i = 0; i != n_addresses; i++)
+  {
+    const GumAddressSlot * slot = &g_array_index (slots, GumAddressSlot, i);
+    GumDebugSymbolDetails * d = &details[slot->index];
+    gboolean success;
+
+    if (previous_details != NULL &&
+        GUM_ADDRESS (slot->address) == previous_details->address)
+    {
+      memcpy (d, previous_details, sizeof (GumDebugSymbolDetails));
+      success = previous_success;
+    }
+    else
+    {
+      success = gum_resolve_symbol_details (slot->address, d);
+      if (!success)
+      {
+        memset (d, 0, sizeof (GumDebugSymbolDetails));
+        d->address = GUM_ADDRESS (slot->address);
+      }
+
+      previous_details = d;
+      previous_success = success;
+    }
+
+    if (success)
+      n_resolved++;
+  }
+
+  gum_symbol_util_read_end (read_token);
+
+  g_array_free (slots, TRUE);
+
+  return n_resolved;
+}
+
+static gboolean
+gum_resolve_symbol_details (gpointer address,
+                            GumDebugSymbolDetails * details)
+{
   GumModuleEntry * entry;
   GumNearestSymbolDetails nearest;
   Dwarf_Addr file_address;
-  Dwarf_Die cu_die;
-  GumDwarfSymbolDetails symbol;
-  GumDwarfSourceDetails source;
-
-  success = FALSE;
-
-  G_LOCK (gum_symbol_util);
+  GumDwarfUnit * unit;
+  const GumDwarfSymbolEntry * symbol;
+  const GumDwarfLineEntry * line;
+  gsize offset;
 
   entry = gum_module_entry_from_address (address, &nearest);
   if (entry == NULL)
-    goto entry_not_found;
+    return FALSE;
   if (entry->dbg == NULL)
     goto no_debug_info;
 
   file_address = gum_module_entry_virtual_address_to_file (entry, address);
 
-  cu_die = gum_find_cu_die_by_virtual_address (entry->dbg, file_address);
-  if (cu_die == NULL)
-    goto cu_die_not_found;
+  unit = gum_module_entry_find_unit (entry, file_address);
+  if (unit == NULL)
+    goto no_debug_info;
 
-  if (!gum_find_symbol_by_virtual_address (entry->dbg, cu_die, file_address,
-      &symbol))
-    goto symbol_not_found;
+  symbol = gum_dwarf_unit_find_symbol (unit, file_address);
+  if (symbol == NULL)
+    goto no_debug_info;
 
-  if (!gum_find_line_by_virtual_address (entry->dbg, cu_die, file_address,
-      symbol.line_number, &source))
-    goto line_not_found;
+  line = gum_dwarf_unit_find_line (unit, file_address, symbol->line_number);
+  if (line == NULL)
+    goto no_debug_info;
 
   details->address = GUM_ADDRESS (address);
 
   g_strlcpy (details->module_name, entry->module->name,
       sizeof (details->module_name));
-  g_strlcpy (details->symbol_name, symbol.name, sizeof (details->symbol_name));
-
-  g_strlcpy (details->file_name, source.path, sizeof (details->file_name));
-  details->line_number = source.line_number;
-
-  success = TRUE;
-
-  g_free (source.path);
-
-line_not_found:
-  g_free (symbol.name);
-
-symbol_not_found:
-  dwarf_dealloc (entry->dbg, cu_die, DW_DLA_DIE);
-
-cu_die_not_found:
-  if (!success)
-    goto no_debug_info;
+  g_strlcpy (details->symbol_name, symbol->name, sizeof (details->symbol_name));
 
-entry_not_found:
-  G_UNLOCK (gum_symbol_util);
+  g_strlcpy (details->file_name, line->path, sizeof (details->file_name));
+  details->line_number = line->line_number;
 
-  return success;
+  return TRUE;
 
 no_debug_info:
-  {
-    gsize offset;
+  details->address = GUM_ADDRESS (address);
 
-    details->address = GUM_ADDRESS (address);
+  g_strlcpy (details->module_name, entry->module->name,
+      sizeof (details->module_name));
 
-    g_strlcpy (details->module_name, entry->module->name,
-        sizeof (details->module_name));
+  if (nearest.name == NULL)
+    gum_find_nearest_symbol_by_address (address, &nearest);
 
-    if (nearest.name == NULL)
-      gum_find_nearest_symbol_by_address (address, &nearest);
+  if (nearest.name != NULL)
+  {
+    offset = GPOINTER_TO_SIZE (address) - GPOINTER_TO_SIZE (nearest.address);
 
-    if (nearest.name != NULL)
+    if (offset == 0)
     {
-      offset = GPOINTER_TO_SIZE (address) - GPOINTER_TO_SIZE (nearest.address);
-
-      if (offset == 0)
-      {
-        g_strlcpy (details->symbol_name, nearest.name,
-            sizeof (details->symbol_name));
-      }
-      else
-      {
-        g_snprintf (details->symbol_name, sizeof (details->symbol_name),
-            "%s+0x%" G_GSIZE_MODIFIER "x", nearest.name, offset);
-      }
+      g_strlcpy (details->symbol_name, nearest.name,
+          sizeof (details->symbol_name));
     }
     else
     {
-      offset = details->address - entry->module->base_address;
-
       g_snprintf (details->symbol_name, sizeof (details->symbol_name),
-          "0x%" G_GSIZE_MODIFIER "x", offset);
+          "%s+0x%" G_GSIZE_MODIFIER "x", nearest.name, offset);
     }
+  }
+  else
+  {
+    offset = details->address - entry->module->base_address;
 
-    details->file_name[0] = '\0';
-    details->line_number = 0;
+    g_snprintf (details->symbol_name, sizeof (details->symbol_name),
+        "0x%" G_GSIZE_MODIFIER "x", offset);
+  }
 
-    G_UNLOCK (gum_symbol_util);
+  details->file_name[0] = '\0';
+  details->line_number = 0;
 
-    return TRUE;
-  }
+  return TRUE;
 }
 
 gchar *
 gum_symbol_name_from_address (gpointer address)
 {
-  GumDwarfSymbolDetails symbol;
+  gchar * name;
   GumModuleEntry * entry;
   GumNearestSymbolDetails nearest;
   Dwarf_Addr file_address;
-  Dwarf_Die cu_die;
+  GumDwarfUnit * unit;
+  const GumDwarfSymbolEntry * symbol;
+  guint read_token;
 
-  symbol.name = NULL;
+  name = NULL;
 
-  G_LOCK (gum_symbol_util);
+  gum_symbol_util_ensure_initialized ();
+
+  read_token = gum_symbol_util_read_begin ();
 
   entry = gum_module_entry_from_address (address, &nearest);
   if (entry == NULL)
@@ -283,23 +523,20 @@ gum_symbol_name_from_address (gpointer address)
 
   file_address = gum_module_entry_virtual_address_to_file (entry, address);
 
-  cu_die = gum_find_cu_die_by_virtual_address (entry->dbg, file_address);
-  if (cu_die == NULL)
-    goto cu_die_not_found;
-
-  gum_find_symbol_by_virtual_address (entry->dbg, cu_die, file_address,
-      &symbol);
-
-  dwarf_dealloc (entry->dbg, cu_die, DW_DLA_DIE);
+  unit = gum_module_entry_find_unit (entry, file_address);
+  if (unit == NULL)
+    goto no_debug_info;
 
-cu_die_not_found:
-  if (symbol.name == NULL)
+  symbol = gum_dwarf_unit_find_symbol (unit, file_address);
+  if (symbol == NULL)
     goto no_debug_info;
 
+  name = g_strdup (symbol->name);
+
 entry_not_found:
-  G_UNLOCK (gum_symbol_util);
+  gum_symbol_util_read_end (read_token);
 
-  return symbol.name;
+  return name;
 
 no_debug_info:
   {
@@ -314,11 +551,11 @@ no_debug_info:
 
       if (offset == 0)
       {
-        symbol.name = g_strdup (nearest.name);
+        name = g_strdup (nearest.name);
       }
       else
       {
-        symbol.name = g_strdup_printf ("%s+0x%" G_GSIZE_MODIFIER "x",
+        name = g_strdup_printf ("%s+0x%" G_GSIZE_MODIFIER "x",
             nearest.name, offset);
       }
     }
@@ -326,12 +563,12 @@ no_debug_info:
     {
       offset = GPOINTER_TO_SIZE (address) - entry->module->base_address;
 
-      symbol.name = g_strdup_printf ("0x%" G_GSIZE_MODIFIER "x", offset);
+      name = g_strdup_printf ("0x%" G_GSIZE_MODIFIER "x", offset);
     }
 
-    G_UNLOCK (gum_symbol_util);
+    gum_symbol_util_read_end (read_token);
 
-    return symbol.name;
+    return name;
   }
 }
 
@@ -340,19 +577,24 @@ gum_find_function (const gchar * name)
 {
   gpointer address;
   GArray * addresses;
+  guint read_token;
 
   address = NULL;
 
-  G_LOCK (gum_symbol_util);
+  gum_symbol_util_ensure_initialized ();
+
+  read_token = gum_symbol_util_read_begin ();
 
   addresses = g_hash_table_lookup (gum_get_function_addresses (), name);
+  if (addresses == NULL && gum_refresh_symbol_caches_after_miss ())
+    addresses = g_hash_table_lookup (gum_get_function_addresses (), name);
 
   if (addresses != NULL)
   {
     address = g_array_index (addresses, gpointer, 0);
   }
 
-  G_UNLOCK (gum_symbol_util);
+  gum_symbol_util_read_end (read_token);
 
   return address;
 }
@@ -399,19 +641,24 @@ GArray *
 gum_find_functions_named (const gchar * name)
 {
   GArray * result, * addresses;
+  guint read_token;
 
   result = g_array_new (FALSE, FALSE, sizeof (gpointer));
 
-  G_LOCK (gum_symbol_util);
+  gum_symbol_util_ensure_initialized ();
+
+  read_token = gum_symbol_util_read_begin ();
 
   addresses = g_hash_table_lookup (gum_get_function_addresses (), name);
+  if (addresses == NULL && gum_refresh_symbol_caches_after_miss ())
+    addresses = g_hash_table_lookup (gum_get_function_addresses (), name);
 
   if (addresses != NULL)
   {
     g_array_append_vals (result, addresses->data, addresses->len);
   }
 
-  G_UNLOCK (gum_symbol_util);
+  gum_symbol_util_read_end (read_token);
 
   return result;
 }
@@ -425,12 +672,15 @@ gum_find_functions_matching (const gchar * str)
   GHashTableIter iter;
   const gchar * name;
   GArray * addresses;
+  guint read_token;
 
   matches = g_array_new (FALSE, FALSE, sizeof (gpointer));
   seen = g_hash_table_new (NULL, NULL);
   pspec = g_pattern_spec_new (str);
 
-  G_LOCK (gum_symbol_util);
+  gum_symbol_util_ensure_initialized ();
+
+  read_token = gum_symbol_util_read_begin ();
 
   g_hash_table_iter_init (&iter, gum_get_function_addresses ());
   while (g_hash_table_iter_next (&iter, (gpointer *) &name,
@@ -456,7 +706,7 @@ gum_find_functions_matching (const gchar * str)
     }
   }
 
-  G_UNLOCK (gum_symbol_util);
+  gum_symbol_util_read_end (read_token);
 
   g_array_sort (matches, gum_compare_pointers);
 
@@ -472,6 +722,19 @@ gum_load_symbols (const gchar * path)
   return FALSE;
 }
 
+void
+gum_set_symbol_index_directory (const gchar * path)
+{
+  gum_symbol_util_ensure_initialized ();
+
+  G_LOCK (gum_symbol_util);
+
+  g_free (gum_symbol_index_directory);
+  gum_symbol_index_directory = g_strdup (path);
+
+  G_UNLOCK (gum_symbol_util);
+}
+
 static GumModuleEntry *
 gum_module_entry_from_address (gpointer address,
                                GumNearestSymbolDetails * nearest)
@@ -515,15 +778,59 @@ gum_module_entry_from_path_and_base (const gchar * path,
                                      GumAddress base_address)
 {
   GumModuleEntry * entry;
-  GumElfModule * module;
-  Dwarf_Debug dbg = NULL;
-  Dwarf_Error error = NULL;
 
-  gum_symbol_util_ensure_initialized ();
+  entry = g_hash_table_lookup (g_atomic_pointer_get (&gum_module_entries),
+      path);
+  if (entry != NULL && entry->base_address == base_address)
+    goto have_entry;
+
+  G_LOCK (gum_symbol_util);
 
   entry = g_hash_table_lookup (gum_module_entries, path);
-  if (entry != NULL)
-    goto have_entry;
+  if (entry != NULL && entry->base_address != base_address)
+  {
+    /*
+     * The module was unloaded and something got loaded at the same path.
+     * A refresh replaces the stale entry and its symbols.
+     */
+    gum_refresh_symbol_caches ();
+    entry = g_hash_table_lookup (gum_module_entries, path);
+    if (entry != NULL && entry->base_address != base_address)
+      goto stale_entry;
+  }
+  if (entry == NULL)
+  {
+    GHashTable * entries;
+
+    entry = gum_module_entry_new (path, base_address);
+
+    entries = gum_module_entries_copy (gum_module_entries);
+    g_hash_table_insert (entries, g_strdup (path), entry);
+    gum_symbol_util_publish ((gpointer *) &gum_module_entries, entries,
+        (GDestroyNotify) g_hash_table_unref);
+  }
+
+  G_UNLOCK (gum_symbol_util);
+
+have_entry:
+  return (entry->module != NULL) ? entry : NULL;
+
+stale_entry:
+  {
+    G_UNLOCK (gum_symbol_util);
+
+    return NULL;
+  }
+}
+
+static GumModuleEntry *
+gum_module_entry_new (const gchar * path,
+                      GumAddress base_address)
+{
+  GumModuleEntry * entry;
+  GumElfModule * module;
+  Dwarf_Debug dbg = NULL;
+  Dwarf_Error error = NULL;
 
   module = gum_elf_module_new_from_memory (path, base_address);
 
@@ -536,14 +843,35 @@ gum_module_entry_from_path_and_base (const gchar * path,
   }
 
   entry = g_slice_new (GumModuleEntry);
+  entry->base_address = base_address;
   entry->module = module;
   entry->dbg = dbg;
-  entry->collected = FALSE;
+  entry->index = NULL;
+  entry->symbols = NULL;
+  entry->symbol_names = NULL;
+  entry->symbol_index = NULL;
 
-  g_hash_table_insert (gum_module_entries, g_strdup (path), entry);
+  return entry;
+}
 
-have_entry:
-  return (entry->module != NULL) ? entry : NULL;
+static GHashTable *
+gum_module_entries_copy (GHashTable * entries)
+{
+  GHashTable * result;
+  GHashTableIter iter;
+  const gchar * path;
+  GumModuleEntry * entry;
+
+  result = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  g_hash_table_iter_init (&iter, entries);
+  while (g_hash_table_iter_next (&iter, (gpointer *) &path,
+      (gpointer *) &entry))
+  {
+    g_hash_table_insert (result, g_strdup (path), entry);
+  }
+
+  return result;
 }
 
 static Dwarf_Addr
@@ -554,177 +882,843 @@ gum_module_entry_virtual_address_to_file (GumModuleEntry * self,
       (GUM_ADDRESS (address) - self->module->base_address);
 }
 
+static GumDwarfUnit *
+gum_module_entry_find_unit (GumModuleEntry * self,
+                            Dwarf_Addr address)
+{
+  GumDwarfIndex * index;
+  GArray * ranges;
+  const GumDwarfRange * range;
+  GumDwarfUnit * unit;
+  guint lo, hi;
+
+  index = g_atomic_pointer_get (&self->index);
+  if (index == NULL)
+  {
+    G_LOCK (gum_dwarf_index);
+
+    index = self->index;
+    if (index == NULL)
+    {
+      index = gum_dwarf_index_new (self->dbg);
+      g_atomic_pointer_set (&self->index, index);
+    }
+
+    G_UNLOCK (gum_dwarf_index);
+  }
+  ranges = index->ranges;
+
+  lo = 0;
+  hi = ranges->len;
+  while (lo != hi)
+  {
+    guint mid = lo + ((hi - lo) / 2);
+
+    if (g_array_index (ranges, GumDwarfRange, mid).start <= address)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  if (lo == 0)
+    return NULL;
+
+  range = &g_array_index (ranges, GumDwarfRange, lo - 1);
+  if (address >= range->end)
+    return NULL;
+
+  unit = &g_array_index (index->units, GumDwarfUnit, range->unit_index);
+  if (!g_atomic_int_get (&unit->indexed))
+  {
+    G_LOCK (gum_dwarf_index);
+
+    if (!unit->indexed)
+      gum_dwarf_unit_build (unit, self->dbg, index->strings);
+
+    G_UNLOCK (gum_dwarf_index);
+  }
+
+  return unit;
+}
+
 static void
 gum_module_entry_free (GumModuleEntry * entry)
 {
+  if (entry->index != NULL)
+    gum_dwarf_index_free (entry->index);
+
   if (entry->dbg != NULL)
     dwarf_finish (entry->dbg, NULL);
 
   if (entry->module != NULL)
     g_object_unref (entry->module);
 
+  if (entry->symbols != NULL)
+    g_array_free (entry->symbols, TRUE);
+
+  if (entry->symbol_names != NULL)
+    g_string_chunk_free (entry->symbol_names);
+
+  if (entry->symbol_index != NULL)
+    g_mapped_file_unref (entry->symbol_index);
+
   g_slice_free (GumModuleEntry, entry);
 }
 
 static GHashTable *
 gum_get_function_addresses (void)
 {
-  gum_maybe_refresh_symbol_caches ();
-  return gum_function_addresses;
+  return gum_get_symbol_cache ()->function_addresses;
 }
 
 static GHashTable *
 gum_get_address_symbols (void)
 {
-  gum_maybe_refresh_symbol_caches ();
-  return gum_address_symbols;
+  return gum_get_symbol_cache ()->address_symbols;
 }
 
-static void
-gum_maybe_refresh_symbol_caches (void)
+static GumSymbolCache *
+gum_get_symbol_cache (void)
 {
-  gboolean need_update;
+  gum_maybe_refresh_symbol_caches (FALSE);
 
-  gum_symbol_util_ensure_initialized ();
+  return g_atomic_pointer_get (&gum_symbol_cache);
+}
 
-  if (gum_cache_timer == NULL)
-  {
-    gum_cache_timer = g_timer_new ();
+/*
+ * A name may belong to a module loaded since the generation was last checked,
+ * so a lookup that comes up empty checks right away. Returns whether there is
+ * a newer snapshot to retry the lookup on.
+ */
+static gboolean
+gum_refresh_symbol_caches_after_miss (void)
+{
+  GumSymbolCache * cache;
+
+  cache = g_atomic_pointer_get (&gum_symbol_cache);
+
+  gum_maybe_refresh_symbol_caches (TRUE);
+
+  return g_atomic_pointer_get (&gum_symbol_cache) != cache;
+}
+
+static void
+gum_maybe_refresh_symbol_caches (gboolean after_miss)
+{
+  GumModuleGeneration generation;
+  guint now;
+
+  if (g_atomic_pointer_get (&gum_symbol_cache) == NULL)
+  {
+    G_LOCK (gum_symbol_util);
+
+    if (gum_symbol_cache == NULL)
+      gum_refresh_symbol_caches ();
+
+    G_UNLOCK (gum_symbol_util);
+
+    return;
+  }
+
+  now = (guint) (g_get_monotonic_time () / 1000);
 
-    need_update = TRUE;
+  /*
+   * Querying the generation takes the loader lock, so it is only done every
+   * so often, and loads and unloads are noticed with that much delay unless
+   * a lookup misses.
+   */
+  if (!after_miss &&
+      (gint) (now - (guint) g_atomic_int_get (&gum_generation_deadline)) < 0)
+  {
+    return;
+  }
+  g_atomic_int_set (&gum_generation_deadline,
+      now + GUM_GENERATION_CHECK_INTERVAL_MSEC);
+
+  if (gum_query_module_generation (&generation))
+  {
+    if (generation.adds == (guint) g_atomic_int_get (&gum_module_adds) &&
+        generation.subs == (guint) g_atomic_int_get (&gum_module_subs))
+    {
+      return;
+    }
   }
   else
   {
-    need_update = g_timer_elapsed (gum_cache_timer, NULL) >= GUM_MAX_CACHE_AGE;
+    if ((gint) (now - (guint) g_atomic_int_get (&gum_cache_deadline)) < 0)
+      return;
   }
 
-  if (need_update)
+  /* Keep serving the current snapshot if another thread is refreshing it. */
+  if (!G_TRYLOCK (gum_symbol_util))
+    return;
+
+  gum_refresh_symbol_caches ();
+
+  G_UNLOCK (gum_symbol_util);
+}
+
+static void
+gum_refresh_symbol_caches (void)
+{
+  GumModuleGeneration generation;
+  gboolean generation_known;
+  GumRefreshOperation op;
+  guint i;
+
+  /*
+   * Sample the counters before enumerating, so that anything loaded or
+   * unloaded while we are at it triggers another pass.
+   */
+  generation_known = gum_query_module_generation (&generation);
+
+  op.module_entries = NULL;
+  op.loaded = g_hash_table_new (NULL, NULL);
+  op.pending = g_ptr_array_new ();
+  op.unloaded = g_ptr_array_new ();
+
+  gum_process_enumerate_modules (
+      (GumFoundModuleFunc) gum_collect_module_entry, &op);
+
+  if (generation_known && generation.subs != gum_module_subs &&
+      gum_symbol_cache != NULL)
   {
-    gum_process_enumerate_modules (gum_collect_module_functions, NULL);
+    gum_remove_unloaded_module_entries (&op);
   }
+
+  if (op.module_entries != NULL)
+  {
+    gum_symbol_util_publish ((gpointer *) &gum_module_entries,
+        op.module_entries, (GDestroyNotify) g_hash_table_unref);
+  }
+
+  if (op.unloaded->len != 0 || gum_symbol_cache == NULL)
+  {
+    GumSymbolCache * cache;
+    GHashTableIter iter;
+    GumModuleEntry * entry;
+
+    cache = gum_symbol_cache_new ();
+
+    g_hash_table_iter_init (&iter, gum_module_entries);
+    while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+    {
+      if (entry->symbols != NULL)
+        gum_symbol_cache_add_symbols (cache, entry->symbols);
+    }
+
+    gum_symbol_util_publish ((gpointer *) &gum_symbol_cache, cache,
+        (GDestroyNotify) gum_symbol_cache_free);
+  }
+  else if (op.pending->len != 0)
+  {
+    GumSymbolCache * cache;
+
+    cache = gum_symbol_cache_copy (gum_symbol_cache);
+
+    for (i = 0; i != op.pending->len; i++)
+    {
+      GumModuleEntry * entry = g_ptr_array_index (op.pending, i);
+
+      gum_symbol_cache_add_symbols (cache, entry->symbols);
+    }
+
+    gum_symbol_util_publish ((gpointer *) &gum_symbol_cache, cache,
+        (GDestroyNotify) gum_symbol_cache_free);
+  }
+
+  /*
+   * The previous snapshot may reference symbols owned by the unloaded
+   * entries, so they can only be retired once it has been replaced.
+   */
+  for (i = 0; i != op.unloaded->len; i++)
+  {
+    gum_symbol_util_retire (g_ptr_array_index (op.unloaded, i),
+        (GDestroyNotify) gum_module_entry_free);
+  }
+  if (op.unloaded->len != 0)
+    gum_symbol_util_reclaim (FALSE);
+
+  g_ptr_array_unref (op.unloaded);
+  g_ptr_array_unref (op.pending);
+  g_hash_table_unref (op.loaded);
+
+  if (generation_known)
+  {
+    g_atomic_int_set (&gum_module_adds, generation.adds);
+    g_atomic_int_set (&gum_module_subs, generation.subs);
+  }
+
+  g_atomic_int_set (&gum_cache_deadline,
+      (guint) (g_get_monotonic_time () / 1000) + GUM_MAX_CACHE_AGE_MSEC);
 }
 
 static gboolean
-gum_collect_module_functions (const GumModuleDetails * details,
-                              gpointer user_data)
+gum_collect_module_entry (const GumModuleDetails * details,
+                          GumRefreshOperation * op)
 {
+  GHashTable * entries;
   GumModuleEntry * entry;
 
-  entry = gum_module_entry_from_path_and_base (details->path,
-      details->range->base_address);
-  if (entry == NULL || entry->collected)
-    return TRUE;
+  entries = (op->module_entries != NULL)
+      ? op->module_entries
+      : gum_module_entries;
+
+  entry = g_hash_table_lookup (entries, details->path);
+  if (entry != NULL && entry->base_address != details->range->base_address)
+  {
+    /* Unloaded and loaded again, possibly a different file at that path. */
+    g_ptr_array_add (op->unloaded, entry);
+    entry = NULL;
+  }
+  if (entry == NULL)
+  {
+    entry = gum_module_entry_new (details->path,
+        details->range->base_address);
+
+    if (op->module_entries == NULL)
+      op->module_entries = gum_module_entries_copy (gum_module_entries);
+    g_hash_table_insert (op->module_entries, g_strdup (details->path), entry);
+  }
+
+  g_hash_table_add (op->loaded, entry);
+
+  if (entry->module != NULL && entry->symbols == NULL)
+  {
+    gum_module_entry_load_symbols (entry);
+
+    g_ptr_array_add (op->pending, entry);
+  }
+
+  return TRUE;
+}
+
+static void
+gum_remove_unloaded_module_entries (GumRefreshOperation * op)
+{
+  GHashTable * entries;
+  GHashTableIter iter;
+  GumModuleEntry * entry;
+  guint n_replaced;
+
+  entries = (op->module_entries != NULL)
+      ? op->module_entries
+      : gum_module_entries;
+
+  n_replaced = op->unloaded->len;
+
+  g_hash_table_iter_init (&iter, entries);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+  {
+    if (!g_hash_table_contains (op->loaded, entry))
+      g_ptr_array_add (op->unloaded, entry);
+  }
+
+  if (op->unloaded->len == n_replaced)
+    return;
+
+  if (op->module_entries == NULL)
+    op->module_entries = gum_module_entries_copy (gum_module_entries);
+
+  g_hash_table_iter_init (&iter, op->module_entries);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+  {
+    if (!g_hash_table_contains (op->loaded, entry))
+      g_hash_table_iter_remove (&iter);
+  }
+}
+
+static void
+gum_module_entry_load_symbols (GumModuleEntry * self)
+{
+  gchar * build_id, * index_path;
+
+  build_id = NULL;
+  index_path = NULL;
+
+  if (gum_symbol_index_directory != NULL)
+  {
+    build_id = gum_elf_module_get_build_id (self->module);
+    if (build_id != NULL)
+    {
+      index_path = g_strconcat (gum_symbol_index_directory, G_DIR_SEPARATOR_S,
+          build_id, ".symidx", NULL);
+
+      if (gum_module_entry_map_symbol_index (self, index_path))
+        goto beach;
+    }
+  }
+
+  self->symbols = g_array_new (FALSE, FALSE, sizeof (GumElfSymbolDetails));
+  self->symbol_names = g_string_chunk_new (4096);
+
+  gum_elf_module_enumerate_dynamic_symbols (self->module,
+      (GumElfFoundSymbolFunc) gum_collect_symbol_if_function, self);
+
+  gum_elf_module_enumerate_symbols (self->module,
+      (GumElfFoundSymbolFunc) gum_collect_symbol_if_function, self);
+
+  if (index_path != NULL)
+    gum_module_entry_save_symbol_index (self, index_path);
+
+beach:
+  g_free (index_path);
+  g_free (build_id);
+}
+
+static gboolean
+gum_module_entry_map_symbol_index (GumModuleEntry * self,
+                                   const gchar * path)
+{
+  GMappedFile * file;
+  const guint8 * data;
+  gsize size;
+  const GumSymbolIndexHeader * header;
+  const GumSymbolIndexEntry * entries;
+  const gchar * strings;
+  GArray * symbols;
+  guint i;
+
+  file = g_mapped_file_new (path, FALSE, NULL);
+  if (file == NULL)
+    return FALSE;
+
+  data = (const guint8 *) g_mapped_file_get_contents (file);
+  size = g_mapped_file_get_length (file);
+
+  if (size < sizeof (GumSymbolIndexHeader))
+    goto invalid_file;
+  header = (const GumSymbolIndexHeader *) data;
 
-  gum_elf_module_enumerate_dynamic_symbols (entry->module,
-      gum_collect_symbol_if_function, NULL);
+  if (header->magic != GUM_SYMBOL_INDEX_MAGIC ||
+      header->version != GUM_SYMBOL_INDEX_VERSION)
+    goto invalid_file;
 
-  gum_elf_module_enumerate_symbols (entry->module,
-      gum_collect_symbol_if_function, NULL);
+  if (header->n_symbols > (size - sizeof (GumSymbolIndexHeader)) /
+      sizeof (GumSymbolIndexEntry))
+    goto invalid_file;
 
-  entry->collected = TRUE;
+  if (header->strings_size != size - sizeof (GumSymbolIndexHeader) -
+      (header->n_symbols * sizeof (GumSymbolIndexEntry)))
+    goto invalid_file;
+
+  entries = (const GumSymbolIndexEntry *) (header + 1);
+  strings = (const gchar *) (entries + header->n_symbols);
+
+  if (header->strings_size == 0 || strings[header->strings_size - 1] != '\0')
+    goto invalid_file;
+
+  symbols = g_array_sized_new (FALSE, FALSE, sizeof (GumElfSymbolDetails),
+      header->n_symbols);
+
+  for (i = 0; i != header->n_symbols; i++)
+  {
+    const GumSymbolIndexEntry * e = &entries[i];
+    GumElfSymbolDetails symbol;
+
+    if (e->name_offset >= header->strings_size)
+      goto invalid_entry;
+
+    symbol.name = strings + e->name_offset;
+    symbol.address = self->module->base_address + e->address;
+    symbol.size = e->size;
+    symbol.type = e->type;
+    symbol.bind = e->bind;
+    symbol.section_header_index = e->section_header_index;
+
+    g_array_append_val (symbols, symbol);
+  }
+
+  self->symbols = symbols;
+  self->symbol_index = file;
 
   return TRUE;
+
+invalid_entry:
+  {
+    g_array_free (symbols, TRUE);
+    goto invalid_file;
+  }
+invalid_file:
+  {
+    g_mapped_file_unref (file);
+    return FALSE;
+  }
+}
+
+static void
+gum_module_entry_save_symbol_index (GumModuleEntry * self,
+                                    const gchar * path)
+{
+  GArray * symbols = self->symbols;
+  GumSymbolIndexHeader header;
+  GByteArray * buffer;
+  GString * strings;
+  gchar * dir;
+  guint i;
+
+  buffer = g_byte_array_sized_new (sizeof (GumSymbolIndexHeader) +
+      (symbols->len * sizeof (GumSymbolIndexEntry)));
+  g_byte_array_set_size (buffer, sizeof (GumSymbolIndexHeader));
+
+  strings = g_string_new (NULL);
+
+  for (i = 0; i != symbols->len; i++)
+  {
+    const GumElfSymbolDetails * symbol =
+        &g_array_index (symbols, GumElfSymbolDetails, i);
+    GumSymbolIndexEntry e = { 0, };
+
+    e.address = symbol->address - self->module->base_address;
+    e.size = symbol->size;
+    e.name_offset = strings->len;
+    e.section_header_index = symbol->section_header_index;
+    e.type = symbol->type;
+    e.bind = symbol->bind;
+
+    g_string_append_len (strings, symbol->name, strlen (symbol->name) + 1);
+
+    g_byte_array_append (buffer, (const guint8 *) &e, sizeof (e));
+  }
+  if (strings->len == 0)
+    g_string_append_c (strings, '\0');
+
+  header.magic = GUM_SYMBOL_INDEX_MAGIC;
+  header.version = GUM_SYMBOL_INDEX_VERSION;
+  header.n_symbols = symbols->len;
+  header.strings_size = strings->len;
+  memcpy (buffer->data, &header, sizeof (header));
+
+  g_byte_array_append (buffer, (const guint8 *) strings->str, strings->len);
+
+  /* Best effort: a failed write just means parsing the ELF again next time. */
+  dir = g_path_get_dirname (path);
+  if (g_mkdir_with_parents (dir, 0755) == 0)
+    g_file_set_contents (path, (const gchar *) buffer->data, buffer->len, NULL);
+  g_free (dir);
+
+  g_string_free (strings, TRUE);
+  g_byte_array_unref (buffer);
 }
 
 static gboolean
 gum_collect_symbol_if_function (const GumElfSymbolDetails * details,
-                                gpointer user_data)
+                                GumModuleEntry * entry)
 {
-  const gchar * name;
-  gpointer address;
-  GArray * addresses;
-  gboolean already_collected;
-  GumElfSymbolDetails * address_symbol;
+  GumElfSymbolDetails symbol;
 
   if (details->section_header_index == SHN_UNDEF || details->type != STT_FUNC)
     return TRUE;
 
-  name = details->name;
-  address = GSIZE_TO_POINTER (details->address);
+  symbol.name = g_string_chunk_insert_const (entry->symbol_names,
+      details->name);
+  symbol.address = details->address;
+  symbol.size = details->size;
+  symbol.type = details->type;
+  symbol.bind = details->bind;
+  symbol.section_header_index = details->section_header_index;
+
+  g_array_append_val (entry->symbols, symbol);
+
+  return TRUE;
+}
+
+static gboolean
+gum_query_module_generation (GumModuleGeneration * generation)
+{
+#ifndef HAVE_ANDROID
+  generation->known = FALSE;
+
+  dl_iterate_phdr (gum_read_module_generation, generation);
+
+  return generation->known;
+#else
+  return FALSE;
+#endif
+}
+
+#ifndef HAVE_ANDROID
 
-  already_collected = FALSE;
+static int
+gum_read_module_generation (struct dl_phdr_info * info,
+                            size_t size,
+                            void * data)
+{
+  GumModuleGeneration * generation = data;
 
-  addresses = g_hash_table_lookup (gum_function_addresses, name);
-  if (addresses == NULL)
+  if (size >= (gsize) G_STRUCT_OFFSET (struct dl_phdr_info, dlpi_subs) +
+      sizeof (info->dlpi_subs))
   {
-    addresses = g_array_sized_new (FALSE, FALSE, sizeof (gpointer), 1);
-    g_hash_table_insert (gum_function_addresses, g_strdup (name), addresses);
+    generation->adds = info->dlpi_adds;
+    generation->subs = info->dlpi_subs;
+    generation->known = TRUE;
   }
-  else
+
+  return 1;
+}
+
+#endif
+
+static GumSymbolCache *
+gum_symbol_cache_new (void)
+{
+  GumSymbolCache * cache;
+
+  cache = g_slice_new (GumSymbolCache);
+  cache->function_addresses = g_hash_table_new_full (g_str_hash, g_str_equal,
+      g_free, (GDestroyNotify) g_array_unref);
+  cache->address_symbols = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  return cache;
+}
+
+static GumSymbolCache *
+gum_symbol_cache_copy (const GumSymbolCache * cache)
+{
+  GumSymbolCache * result;
+  GHashTableIter iter;
+  gpointer key, value;
+
+  result = gum_symbol_cache_new ();
+
+  g_hash_table_iter_init (&iter, cache->function_addresses);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+  {
+    g_hash_table_insert (result->function_addresses, g_strdup (key),
+        g_array_ref (value));
+  }
+
+  g_hash_table_iter_init (&iter, cache->address_symbols);
+  while (g_hash_table_iter_next (&iter, &key, &value))
+    g_hash_table_insert (result->address_symbols, key, value);
+
+  return result;
+}
+
+static void
+gum_symbol_cache_free (GumSymbolCache * cache)
+{
+  g_hash_table_unref (cache->address_symbols);
+  g_hash_table_unref (cache->function_addresses);
+
+  g_slice_free (GumSymbolCache, cache);
+}
+
+static void
+gum_symbol_cache_add_symbols (GumSymbolCache * self,
+                              GArray * symbols)
+{
+  guint i;
+
+  for (i = 0; i != symbols->len; i++)
   {
-    guint i;
+    GumElfSymbolDetails * symbol =
+        &g_array_index (symbols, GumElfSymbolDetails, i);
+    gpointer address;
+    GArray * addresses;
+
+    address = GSIZE_TO_POINTER (symbol->address);
 
-    for (i = 0; i != addresses->len; i++)
+    addresses = g_hash_table_lookup (self->function_addresses, symbol->name);
+    if (addresses == NULL)
+    {
+      addresses = g_array_sized_new (FALSE, FALSE, sizeof (gpointer), 1);
+      g_array_append_val (addresses, address);
+      g_hash_table_insert (self->function_addresses, g_strdup (symbol->name),
+          addresses);
+    }
+    else
     {
-      if (g_array_index (addresses, gpointer, i) == address)
+      gboolean already_collected;
+      guint j;
+
+      already_collected = FALSE;
+
+      for (j = 0; j != addresses->len; j++)
       {
-        already_collected = TRUE;
-        break;
+        if (g_array_index (addresses, gpointer, j) == address)
+        {
+          already_collected = TRUE;
+          break;
+        }
+      }
+
+      /* The array may be shared with published snapshots, so copy it. */
+      if (!already_collected)
+      {
+        GArray * updated;
+
+        updated = g_array_sized_new (FALSE, FALSE, sizeof (gpointer),
+            addresses->len + 1);
+        g_array_append_vals (updated, addresses->data, addresses->len);
+        g_array_append_val (updated, address);
+        g_hash_table_insert (self->function_addresses,
+            g_strdup (symbol->name), updated);
       }
     }
+
+    if (!g_hash_table_contains (self->address_symbols, address))
+      g_hash_table_insert (self->address_symbols, address, symbol);
   }
+}
 
-  if (!already_collected)
-    g_array_append_val (addresses, address);
+static guint
+gum_symbol_util_read_begin (void)
+{
+  guint epoch;
 
-  address_symbol = g_hash_table_lookup (gum_address_symbols, address);
-  if (address_symbol == NULL)
+  while (TRUE)
   {
-    address_symbol = g_slice_new (GumElfSymbolDetails);
-    address_symbol->name = g_strdup (name);
-    address_symbol->address = details->address;
-    address_symbol->size = details->size;
-    address_symbol->type = details->type;
-    address_symbol->bind = details->bind;
-    address_symbol->section_header_index = details->section_header_index;
-    g_hash_table_insert (gum_address_symbols, address, address_symbol);
+    epoch = g_atomic_int_get (&gum_symbol_epoch);
+
+    g_atomic_int_inc (&gum_symbol_readers[epoch & 1]);
+
+    if (g_atomic_int_get (&gum_symbol_epoch) == epoch)
+      break;
+
+    g_atomic_int_dec_and_test (&gum_symbol_readers[epoch & 1]);
   }
-    
-  return TRUE;
+
+  return epoch & 1;
 }
 
 static void
-gum_function_addresses_free (GArray * addresses)
+gum_symbol_util_read_end (guint token)
 {
-  g_array_free (addresses, TRUE);
+  g_atomic_int_dec_and_test (&gum_symbol_readers[token]);
 }
 
 static void
-gum_address_symbols_value_free (GumElfSymbolDetails * details)
+gum_symbol_util_publish (gpointer * location,
+                         gpointer data,
+                         GDestroyNotify destroy)
 {
-  g_free ((gpointer) details->name);
-  g_slice_free (GumElfSymbolDetails, details);
+  gpointer previous;
+
+  previous = *location;
+
+  g_atomic_pointer_set (location, data);
+
+  if (previous != NULL)
+    gum_symbol_util_retire (previous, destroy);
+
+  gum_symbol_util_reclaim (FALSE);
+}
+
+static void
+gum_symbol_util_retire (gpointer data,
+                        GDestroyNotify destroy)
+{
+  GumRetiredObject * retired;
+
+  retired = g_slice_new (GumRetiredObject);
+  retired->data = data;
+  retired->destroy = destroy;
+  retired->epoch = gum_symbol_epoch;
+
+  gum_retired_objects = g_slist_prepend (gum_retired_objects, retired);
+}
+
+static void
+gum_symbol_util_reclaim (gboolean all)
+{
+  guint epoch;
+  GSList * cur, * next, * remaining;
+
+  /*
+   * Only advance once the readers of the previous epoch are gone, so that
+   * at most two epochs ever have readers in flight.
+   */
+  epoch = gum_symbol_epoch;
+  if (g_atomic_int_get (&gum_symbol_readers[(epoch + 1) & 1]) == 0)
+  {
+    epoch++;
+    g_atomic_int_set (&gum_symbol_epoch, epoch);
+  }
+
+  remaining = NULL;
+
+  for (cur = gum_retired_objects; cur != NULL; cur = next)
+  {
+    GumRetiredObject * retired = cur->data;
+    guint age;
+    gboolean reclaimable;
+
+    next = cur->next;
+
+    age = epoch - retired->epoch;
+    if (all || age >= 2)
+    {
+      reclaimable = TRUE;
+    }
+    else if (age == 1)
+    {
+      reclaimable =
+          g_atomic_int_get (&gum_symbol_readers[retired->epoch & 1]) == 0;
+    }
+    else
+    {
+      reclaimable = FALSE;
+    }
+
+    if (reclaimable)
+    {
+      retired->destroy (retired->data);
+      g_slice_free (GumRetiredObject, retired);
+
+      g_slist_free_1 (cur);
+    }
+    else
+    {
+      cur->next = remaining;
+      remaining = cur;
+    }
+  }
+
+  gum_retired_objects = remaining;
 }
 
 static void
 gum_symbol_util_ensure_initialized (void)
 {
-  if (gum_module_entries != NULL)
+  if (g_atomic_pointer_get (&gum_module_entries) != NULL)
     return;
 
-  gum_module_entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
-      (GDestroyNotify) gum_module_entry_free);
-  gum_function_addresses = g_hash_table_new_full (g_str_hash, g_str_equal,
-      g_free, (GDestroyNotify) gum_function_addresses_free);
-  gum_address_symbols = g_hash_table_new_full (g_direct_hash, g_direct_equal,
-      NULL, (GDestroyNotify) gum_address_symbols_value_free);
+  G_LOCK (gum_symbol_util);
+
+  if (gum_module_entries == NULL)
+  {
+    g_atomic_pointer_set (&gum_module_entries,
+        g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL));
+
+    _gum_register_destructor (gum_symbol_util_deinitialize);
+  }
 
-  _gum_register_destructor (gum_symbol_util_deinitialize);
+  G_UNLOCK (gum_symbol_util);
 }
 
 static void
 gum_symbol_util_deinitialize (void)
 {
-  g_clear_pointer (&gum_cache_timer, g_timer_destroy);
+  GHashTableIter iter;
+  gpointer value;
 
-  g_hash_table_unref (gum_address_symbols);
-  gum_address_symbols = NULL;
+  gum_symbol_util_reclaim (TRUE);
 
-  g_hash_table_unref (gum_function_addresses);
-  gum_function_addresses = NULL;
+  g_clear_pointer (&gum_symbol_cache, gum_symbol_cache_free);
+
+  g_hash_table_iter_init (&iter, gum_module_entries);
+  while (g_hash_table_iter_next (&iter, NULL, &value))
+    gum_module_entry_free (value);
 
   g_hash_table_unref (gum_module_entries);
   gum_module_entries = NULL;
+
+  g_clear_pointer (&gum_symbol_index_directory, g_free);
+
+  gum_cache_deadline = 0;
+  gum_generation_deadline = 0;
+  gum_module_adds = 0;
+  gum_module_subs = 0;
 }
 
 static void
@@ -733,110 +1727,171 @@ gum_on_dwarf_error (Dwarf_Error error,
 {
 }
 
-static Dwarf_Die
-gum_find_cu_die_by_virtual_address (Dwarf_Debug dbg,
-                                    Dwarf_Addr address)
+static GumDwarfIndex *
+gum_dwarf_index_new (Dwarf_Debug dbg)
 {
-  Dwarf_Die result;
-  GumFindCuDieOperation op;
+  GumDwarfIndex * index;
 
-  op.needle = address;
-  op.found = FALSE;
-  op.cu_die_offset = 0;
+  index = g_slice_new (GumDwarfIndex);
+  index->units = g_array_new (FALSE, FALSE, sizeof (GumDwarfUnit));
+  index->ranges = g_array_new (FALSE, FALSE, sizeof (GumDwarfRange));
+  index->strings = g_string_chunk_new (4096);
 
   gum_enumerate_cu_dies (dbg, TRUE,
-      (GumFoundCuDieFunc) gum_store_cu_die_offset_if_containing_address, &op);
+      (GumFoundCuDieFunc) gum_dwarf_index_add_unit, index);
 
-  if (!op.found)
-    return NULL;
+  g_array_sort (index->ranges, (GCompareFunc) gum_compare_dwarf_ranges);
 
-  result = NULL;
-  dwarf_offdie (dbg, op.cu_die_offset, &result, NULL);
+  return index;
+}
 
-  return result;
+static void
+gum_dwarf_index_free (GumDwarfIndex * index)
+{
+  guint i;
+
+  for (i = 0; i != index->units->len; i++)
+  {
+    GumDwarfUnit * unit = &g_array_index (index->units, GumDwarfUnit, i);
+
+    if (unit->symbols != NULL)
+      g_array_free (unit->symbols, TRUE);
+    if (unit->lines != NULL)
+      g_array_free (unit->lines, TRUE);
+  }
+  g_array_free (index->units, TRUE);
+
+  g_array_free (index->ranges, TRUE);
+
+  g_string_chunk_free (index->strings);
+
+  g_slice_free (GumDwarfIndex, index);
 }
 
 static gboolean
-gum_store_cu_die_offset_if_containing_address (const GumCuDieDetails * details,
-                                               GumFindCuDieOperation * op)
+gum_dwarf_index_add_unit (const GumCuDieDetails * details,
+                          GumDwarfIndex * index)
 {
   Dwarf_Debug dbg = details->dbg;
   Dwarf_Die die = details->cu_die;
+  GumDwarfUnit unit;
+  guint unit_index;
   Dwarf_Off ranges_offset;
-  Dwarf_Ranges * ranges;
-  Dwarf_Signed range_count, range_index;
+  Dwarf_Addr low_pc, high_pc;
+  Dwarf_Half high_pc_form;
+  enum Dwarf_Form_Class high_pc_class;
 
-  if (!gum_read_attribute_offset (dbg, die, DW_AT_ranges, &ranges_offset))
-    goto skip;
+  if (dwarf_dieoffset (die, &unit.die_offset, NULL) != DW_DLV_OK)
+    return TRUE;
+  unit.indexed = FALSE;
+  unit.symbols = NULL;
+  unit.lines = NULL;
 
-  if (dwarf_get_ranges_a (dbg, ranges_offset, die, &ranges, &range_count, NULL,
-      NULL) != DW_DLV_OK)
-    goto skip;
+  unit_index = index->units->len;
+  g_array_append_val (index->units, unit);
 
-  for (range_index = 0; range_index < range_count; range_index++)
+  if (gum_read_attribute_offset (dbg, die, DW_AT_ranges, &ranges_offset))
   {
-    Dwarf_Ranges * range = &ranges[range_index];
+    Dwarf_Ranges * ranges;
+    Dwarf_Signed range_count, range_index;
 
-    if (range->dwr_type != DW_RANGES_ENTRY)
-      break;
+    if (dwarf_get_ranges_a (dbg, ranges_offset, die, &ranges, &range_count,
+        NULL, NULL) != DW_DLV_OK)
+      return TRUE;
 
-    if (op->needle >= range->dwr_addr1 && op->needle < range->dwr_addr2)
+    for (range_index = 0; range_index < range_count; range_index++)
     {
-      op->found = TRUE;
-      dwarf_dieoffset (die, &op->cu_die_offset, NULL);
+      Dwarf_Ranges * range = &ranges[range_index];
 
-      break;
+      if (range->dwr_type != DW_RANGES_ENTRY)
+        break;
+
+      gum_dwarf_index_add_range (index, range->dwr_addr1, range->dwr_addr2,
+          unit_index);
     }
+
+    dwarf_ranges_dealloc (dbg, ranges, range_count);
   }
+  else if (dwarf_lowpc (die, &low_pc, NULL) == DW_DLV_OK &&
+      dwarf_highpc_b (die, &high_pc, &high_pc_form, &high_pc_class, NULL)
+      == DW_DLV_OK)
+  {
+    if (high_pc_class == DW_FORM_CLASS_CONSTANT)
+      high_pc += low_pc;
 
-  dwarf_ranges_dealloc (dbg, ranges, range_count);
+    gum_dwarf_index_add_range (index, low_pc, high_pc, unit_index);
+  }
 
-skip:
-  return !op->found;
+  return TRUE;
 }
 
-static gboolean
-gum_find_symbol_by_virtual_address (Dwarf_Debug dbg,
-                                    Dwarf_Die cu_die,
-                                    Dwarf_Addr address,
-                                    GumDwarfSymbolDetails * details)
+static void
+gum_dwarf_index_add_range (GumDwarfIndex * self,
+                           Dwarf_Addr start,
+                           Dwarf_Addr end,
+                           guint unit_index)
 {
-  GumFindSymbolOperation op;
+  GumDwarfRange range;
 
-  details->name = NULL;
-  details->line_number = 0;
+  if (start >= end)
+    return;
+
+  range.start = start;
+  range.end = end;
+  range.unit_index = unit_index;
+
+  g_array_append_val (self->ranges, range);
+}
+
+static void
+gum_dwarf_unit_build (GumDwarfUnit * self,
+                      Dwarf_Debug dbg,
+                      GStringChunk * strings)
+{
+  Dwarf_Die cu_die;
+  GumCollectSymbolsOperation op;
 
-  op.needle = address;
-  op.symbol = details;
-  op.closest_address = 0;
+  self->symbols = g_array_new (FALSE, FALSE, sizeof (GumDwarfSymbolEntry));
+  self->lines = g_array_new (FALSE, FALSE, sizeof (GumDwarfLineEntry));
+
+  cu_die = NULL;
+  if (dwarf_offdie (dbg, self->die_offset, &cu_die, NULL) != DW_DLV_OK)
+    goto beach;
+
+  op.symbols = self->symbols;
+  op.strings = strings;
 
   gum_enumerate_dies (dbg, cu_die,
-      (GumFoundDieFunc) gum_collect_die_if_closest_so_far, &op);
+      (GumFoundDieFunc) gum_collect_symbol_if_named, &op);
+  g_array_sort (self->symbols, (GCompareFunc) gum_compare_dwarf_symbols);
+
+  gum_collect_unit_lines (dbg, cu_die, strings, self->lines);
+  g_array_sort (self->lines, (GCompareFunc) gum_compare_dwarf_lines);
 
-  return details->name != NULL;
+  dwarf_dealloc (dbg, cu_die, DW_DLA_DIE);
+
+beach:
+  g_atomic_int_set (&self->indexed, TRUE);
 }
 
 static gboolean
-gum_collect_die_if_closest_so_far (const GumDieDetails * details,
-                                   GumFindSymbolOperation * op)
+gum_collect_symbol_if_named (const GumDieDetails * details,
+                             GumCollectSymbolsOperation * op)
 {
   Dwarf_Debug dbg = details->dbg;
   Dwarf_Die die = details->die;
-  GumDwarfSymbolDetails * symbol = op->symbol;
-  Dwarf_Half tag;
-  Dwarf_Addr address;
+  GumDwarfSymbolEntry symbol;
+  Dwarf_Unsigned line_number;
 
-  if (dwarf_tag (die, &tag, NULL) != DW_DLV_OK)
-    return TRUE;
-
-  if (tag == DW_TAG_subprogram)
+  if (details->tag == DW_TAG_subprogram)
   {
-    if (!gum_read_attribute_address (dbg, die, DW_AT_low_pc, &address))
+    if (!gum_read_attribute_address (dbg, die, DW_AT_low_pc, &symbol.address))
       return TRUE;
   }
-  else if (tag == DW_TAG_variable)
+  else if (details->tag == DW_TAG_variable)
   {
-    if (!gum_read_attribute_location (dbg, die, DW_AT_location, &address))
+    if (!gum_read_attribute_location (dbg, die, DW_AT_location,
+        &symbol.address))
       return TRUE;
   }
   else
@@ -844,80 +1899,125 @@ gum_collect_die_if_closest_so_far (const GumDieDetails * details,
     return TRUE;
   }
 
-  if (op->needle < address)
+  if (!gum_read_die_name (dbg, die, op->strings, &symbol.name))
     return TRUE;
 
-  if (op->closest_address == 0 ||
-      (op->needle - address) < (op->needle - op->closest_address))
-  {
-    Dwarf_Unsigned line_number;
-
-    op->closest_address = address;
+  if (gum_read_attribute_uint (dbg, die, DW_AT_decl_line, &line_number))
+    symbol.line_number = line_number;
+  else
+    symbol.line_number = 0;
 
-    g_clear_pointer (&symbol->name, g_free);
-    gum_read_die_name (dbg, die, &symbol->name);
+  symbol.order = op->symbols->len;
 
-    if (gum_read_attribute_uint (dbg, die, DW_AT_decl_line, &line_number))
-    {
-      symbol->line_number = line_number;
-    }
-  }
+  g_array_append_val (op->symbols, symbol);
 
   return TRUE;
 }
 
-static gboolean
-gum_find_line_by_virtual_address (Dwarf_Debug dbg,
-                                  Dwarf_Die cu_die,
-                                  Dwarf_Addr address,
-                                  guint symbol_line_number,
-                                  GumDwarfSourceDetails * details)
+static void
+gum_collect_unit_lines (Dwarf_Debug dbg,
+                        Dwarf_Die cu_die,
+                        GStringChunk * strings,
+                        GArray * lines)
 {
-  gboolean success;
-  Dwarf_Line * lines;
+  Dwarf_Line * raw_lines;
   Dwarf_Signed line_count, line_index;
 
-  if (dwarf_srclines (cu_die, &lines, &line_count, NULL) != DW_DLV_OK)
-    return FALSE;
-
-  success = FALSE;
+  if (dwarf_srclines (cu_die, &raw_lines, &line_count, NULL) != DW_DLV_OK)
+    return;
 
   for (line_index = 0; line_index != line_count; line_index++)
   {
-    Dwarf_Line line = lines[line_index];
-    Dwarf_Addr line_address;
+    Dwarf_Line raw_line = raw_lines[line_index];
+    GumDwarfLineEntry line;
+    Dwarf_Unsigned line_number;
+    char * path;
 
-    if (dwarf_lineaddr (line, &line_address, NULL) != DW_DLV_OK)
+    if (dwarf_lineaddr (raw_line, &line.address, NULL) != DW_DLV_OK)
       continue;
 
-    if (line_address >= address)
-    {
-      Dwarf_Unsigned line_number;
-      char * path;
+    if (dwarf_lineno (raw_line, &line_number, NULL) != DW_DLV_OK)
+      continue;
 
-      if (dwarf_lineno (line, &line_number, NULL) != DW_DLV_OK)
-        continue;
+    if (dwarf_linesrc (raw_line, &path, NULL) != DW_DLV_OK)
+      continue;
 
-      if (line_number < symbol_line_number)
-        continue;
+    line.path = g_string_chunk_insert_const (strings, path);
+    line.line_number = line_number;
+    line.order = lines->len;
 
-      if (dwarf_linesrc (line, &path, NULL) != DW_DLV_OK)
-        continue;
+    dwarf_dealloc (dbg, path, DW_DLA_STRING);
 
-      details->path = g_strdup (path);
-      details->line_number = line_number;
+    g_array_append_val (lines, line);
+  }
 
-      success = TRUE;
+  dwarf_srclines_dealloc (dbg, raw_lines, line_count);
+}
 
-      dwarf_dealloc (dbg, path, DW_DLA_STRING);
+static const GumDwarfSymbolEntry *
+gum_dwarf_unit_find_symbol (GumDwarfUnit * self,
+                            Dwarf_Addr address)
+{
+  GArray * symbols = self->symbols;
+  const GumDwarfSymbolEntry * symbol;
+  guint lo, hi;
 
-      break;
-    }
+  lo = 0;
+  hi = symbols->len;
+  while (lo != hi)
+  {
+    guint mid = lo + ((hi - lo) / 2);
+
+    if (g_array_index (symbols, GumDwarfSymbolEntry, mid).address <= address)
+      lo = mid + 1;
+    else
+      hi = mid;
   }
+  if (lo == 0)
+    return NULL;
 
-  dwarf_srclines_dealloc (dbg, lines, line_count);
+  symbol = &g_array_index (symbols, GumDwarfSymbolEntry, lo - 1);
 
-  return success;
+  /* Several DIEs may share an address; the first one declared wins. */
+  while (symbol != &g_array_index (symbols, GumDwarfSymbolEntry, 0) &&
+      (symbol - 1)->address == symbol->address)
+  {
+    symbol--;
+  }
+
+  return symbol;
+}
+
+static const GumDwarfLineEntry *
+gum_dwarf_unit_find_line (GumDwarfUnit * self,
+                          Dwarf_Addr address,
+                          guint symbol_line_number)
+{
+  GArray * lines = self->lines;
+  guint lo, hi, i;
+
+  lo = 0;
+  hi = lines->len;
+  while (lo != hi)
+  {
+    guint mid = lo + ((hi - lo) / 2);
+
+    if (g_array_index (lines, GumDwarfLineEntry, mid).address < address)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  for (i = lo; i != lines->len; i++)
+  {
+    const GumDwarfLineEntry * line =
+        &g_array_index (lines, GumDwarfLineEntry, i);
+
+    if (line->line_number >= symbol_line_number)
+      return line;
+  }
+
+  return NULL;
 }
 
 static void
@@ -1020,14 +2120,15 @@ gum_enumerate_dies_recurse (Dwarf_Debug dbg,
 static gboolean
 gum_read_die_name (Dwarf_Debug dbg,
                    Dwarf_Die die,
-                   gchar ** name)
+                   GStringChunk * strings,
+                   const gchar ** name)
 {
   char * str;
 
   if (dwarf_diename (die, &str, NULL) != DW_DLV_OK)
     return FALSE;
 
-  *name = g_strdup (str);
+  *name = g_string_chunk_insert_const (strings, str);
 
   dwarf_dealloc (dbg, str, DW_DLA_STRING);
 
@@ -1178,3 +2279,45 @@ gum_compare_pointers (gconstpointer a,
 {
   return *((gconstpointer *) a) - *((gconstpointer *) b);
 }
+
+static gint
+gum_compare_address_slots (const GumAddressSlot * a,
+                           const GumAddressSlot * b)
+{
+  if (a->address != b->address)
+    return (GPOINTER_TO_SIZE (a->address) < GPOINTER_TO_SIZE (b->address))
+        ? -1 : 1;
+
+  return (a->index < b->index) ? -1 : (a->index > b->index) ? 1 : 0;
+}
+
+static gint
+gum_compare_dwarf_ranges (const GumDwarfRange * a,
+                          const GumDwarfRange * b)
+{
+  if (a->start != b->start)
+    return (a->start < b->start) ? -1 : 1;
+
+  return (a->unit_index < b->unit_index) ? -1 :
+      (a->unit_index > b->unit_index) ? 1 : 0;
+}
+
+static gint
+gum_compare_dwarf_symbols (const GumDwarfSymbolEntry * a,
+                           const GumDwarfSymbolEntry * b)
+{
+  if (a->address != b->address)
+    return (a->address < b->address) ? -1 : 1;
+
+  return (a->order < b->order) ? -1 : (a->order > b->order) ? 1 : 0;
+}
+
+static gint
+gum_compare_dwarf_lines (const GumDwarfLineEntry * a,
+                         const GumDwarfLineEntry * b)
+{
+  if (a->address != b->address)
+    return (a->address < b->address) ? -1 : 1;
+
+  return (a->order < b->order) ? -1 : (a->order > b->order) ? 1 : 0;
+}
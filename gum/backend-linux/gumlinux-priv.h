@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2026 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#ifndef __GUM_LINUX_PRIV_H__
+#define __GUM_LINUX_PRIV_H__
+
+#include "gummemory.h"
+
+#include <limits.h>
+#include <sys/types.h>
+
+#define GUM_MAPS_LINE_SIZE (1024 + PATH_MAX)
+#define GUM_MAPS_BUFFER_SIZE (2 * GUM_MAPS_LINE_SIZE)
+
+G_BEGIN_DECLS
+
+typedef struct _GumProcMapsIter GumProcMapsIter;
+typedef struct _GumProcMapsEntry GumProcMapsEntry;
+
+struct _GumProcMapsIter
+{
+  gint fd;
+  gchar * read_cursor;
+  gchar * write_cursor;
+  gboolean in_long_line;
+  gchar buffer[GUM_MAPS_BUFFER_SIZE];
+};
+
+struct _GumProcMapsEntry
+{
+  GumAddress start;
+  GumAddress end;
+  const gchar * perms;
+  guint64 offset;
+  guint64 inode;
+  const gchar * path;
+};
+
+G_GNUC_INTERNAL void gum_proc_maps_iter_init_for_self (GumProcMapsIter * iter);
+G_GNUC_INTERNAL void gum_proc_maps_iter_init_for_pid (GumProcMapsIter * iter,
+    pid_t pid);
+G_GNUC_INTERNAL void gum_proc_maps_iter_destroy (GumProcMapsIter * iter);
+G_GNUC_INTERNAL gboolean gum_proc_maps_iter_next (GumProcMapsIter * iter,
+    GumProcMapsEntry * entry);
+
+G_GNUC_INTERNAL GumPageProtection gum_page_protection_from_proc_perms_string (
+    const gchar * perms);
+
+G_END_DECLS
+
+#endif
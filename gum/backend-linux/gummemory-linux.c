@@ -6,14 +6,32 @@
 
 #include "gummemory.h"
 
+#include "gumexceptor.h"
+#include "gumlinux-priv.h"
 #include "gummemory-priv.h"
 #include "valgrind.h"
 
-#include <stdio.h>
+#include <errno.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#define GUM_MAX_TRANSFER_PAGES 64
+
+typedef enum _GumTransferDirection GumTransferDirection;
+
+enum _GumTransferDirection
+{
+  GUM_TRANSFER_READ,
+  GUM_TRANSFER_WRITE
+};
+
+static gboolean gum_memory_copy_guarded (gpointer dst, gconstpointer src,
+    gsize size);
+static gssize gum_memory_transfer (GumTransferDirection direction,
+    gpointer address, gpointer buffer, gsize len);
 static gboolean gum_memory_get_protection (gconstpointer address, gsize n,
     gsize * size, GumPageProtection * prot);
 
@@ -30,6 +48,15 @@ gum_memory_is_readable (gconstpointer address,
   return size >= len && (prot & GUM_PAGE_READ) != 0;
 }
 
+gboolean
+gum_memory_query_protection (gconstpointer address,
+                             GumPageProtection * prot)
+{
+  gsize size;
+
+  return gum_memory_get_protection (address, 1, &size, prot);
+}
+
 static gboolean
 gum_memory_is_writable (gconstpointer address,
                         gsize len)
@@ -50,16 +77,67 @@ gum_memory_read (gconstpointer address,
 {
   guint8 * result = NULL;
   gsize result_len = 0;
-  gsize size;
-  GumPageProtection prot;
+  gsize page_size;
 
-  if (gum_memory_get_protection (address, len, &size, &prot)
-      && (prot & GUM_PAGE_READ) != 0)
+  page_size = gum_query_page_size ();
+
+  /*
+   * Grow the buffer as data arrives rather than trusting len upfront, as
+   * callers probing unknown memory tend to ask for far more than is mapped.
+   */
+  while (result_len != len)
   {
-    result_len = MIN (len, size);
-    result = g_memdup (address, result_len);
+    const guint8 * cursor = (const guint8 *) address + result_len;
+    gsize chunk_size, size, page_end;
+    GumPageProtection prot;
+    gssize n;
+
+    chunk_size = MIN (len - result_len, GUM_MAX_TRANSFER_PAGES * page_size);
+    result = g_realloc (result, result_len + chunk_size);
+
+    n = gum_memory_transfer (GUM_TRANSFER_READ, (gpointer) cursor,
+        result + result_len, chunk_size);
+    if (n == -1)
+    {
+      if (gum_memory_get_protection (cursor, len - result_len, &size, &prot)
+          && (prot & GUM_PAGE_READ) != 0)
+      {
+        size = MIN (len - result_len, size);
+        result = g_realloc (result, result_len + size);
+        if (gum_memory_copy_guarded (result + result_len, cursor, size))
+          result_len += size;
+      }
+
+      break;
+    }
+
+    result_len += n;
+    if ((gsize) n == chunk_size)
+      continue;
+
+    /*
+     * Mappings such as device memory refuse process_vm_readv() even though
+     * they are readable, so consult the maps for the page that failed.
+     */
+    cursor += n;
+    page_end = (GPOINTER_TO_SIZE (cursor) & ~(page_size - 1)) + page_size;
+    size = MIN (page_end - GPOINTER_TO_SIZE (cursor), len - result_len);
+
+    if (!gum_memory_get_protection (cursor, 1, NULL, &prot) ||
+        (prot & GUM_PAGE_READ) == 0)
+      break;
+
+    result = g_realloc (result, result_len + size);
+    if (!gum_memory_copy_guarded (result + result_len, cursor, size))
+      break;
+    result_len += size;
   }
 
+  if (result_len != 0)
+    result = g_realloc (result, result_len);
+  else
+    g_clear_pointer (&result, g_free);
+
   if (n_bytes_read != NULL)
     *n_bytes_read = result_len;
 
@@ -71,17 +149,148 @@ gum_memory_write (gpointer address,
                   const guint8 * bytes,
                   gsize len)
 {
-  gboolean success = FALSE;
+  gboolean checked;
+  gsize page_size;
+  gssize n;
+
+  if (len == 0)
+    return TRUE;
+
+  page_size = gum_query_page_size ();
+
+  /*
+   * process_vm_writev() stops at the first page it cannot write, by which
+   * point the pages before it have already been modified. Make sure all of
+   * them are writable before touching any, so that a failed write leaves
+   * memory as it was. Within a single page the transfer is all or nothing.
+   */
+  checked = (GPOINTER_TO_SIZE (address) & ~(page_size - 1)) !=
+      ((GPOINTER_TO_SIZE (address) + len - 1) & ~(page_size - 1));
+  if (checked && !gum_memory_is_writable (address, len))
+    return FALSE;
+
+  n = gum_memory_transfer (GUM_TRANSFER_WRITE, address, (gpointer) bytes, len);
+  if (n != -1 && (gsize) n == len)
+    return TRUE;
+  if (n == -1)
+    n = 0;
+
+  /*
+   * Mappings such as device memory refuse process_vm_writev() even though
+   * they are writable, so write the rest directly if the maps allow it.
+   */
+  if (!checked && !gum_memory_is_writable (address, len))
+    return FALSE;
+
+  memcpy ((guint8 *) address + n, bytes + n, len - n);
 
-  if (gum_memory_is_writable (address, len))
+  return TRUE;
+}
+
+static gboolean
+gum_memory_copy_guarded (gpointer dst,
+                         gconstpointer src,
+                         gsize size)
+{
+  GumExceptor * exceptor;
+  GumExceptorScope scope;
+  gboolean success;
+
+  exceptor = gum_exceptor_obtain ();
+
+  if (gum_exceptor_try (exceptor, &scope))
   {
-    memcpy (address, bytes, len);
-    success = TRUE;
+    memcpy (dst, src, size);
   }
 
+  success = !gum_exceptor_catch (exceptor, &scope);
+
+  g_object_unref (exceptor);
+
   return success;
 }
 
+/*
+ * Copies between our own address space and the buffer through
+ * process_vm_readv() and process_vm_writev(), which fail gracefully on pages
+ * that are unmapped or lack the required protection, so there is no need to
+ * consult /proc/self/maps. Remote pages each get their own iovec, as the
+ * kernel only reports partial transfers at iovec granularity.
+ *
+ * Returns the number of bytes transferred, or -1 if the system calls are not
+ * available to us, e.g. due to an old kernel or a seccomp policy.
+ */
+static gssize
+gum_memory_transfer (GumTransferDirection direction,
+                     gpointer address,
+                     gpointer buffer,
+                     gsize len)
+{
+#if defined (__NR_process_vm_readv) && defined (__NR_process_vm_writev)
+  static gboolean supported = TRUE;
+  pid_t pid;
+  gsize page_size, offset;
+
+  if (!supported)
+    return -1;
+
+  pid = getpid ();
+  page_size = gum_query_page_size ();
+
+  offset = 0;
+  while (offset != len)
+  {
+    struct iovec local, remote[GUM_MAX_TRANSFER_PAGES];
+    gsize cursor, chunk_size;
+    guint n;
+    glong res;
+
+    cursor = GPOINTER_TO_SIZE (address) + offset;
+    chunk_size = 0;
+    for (n = 0; n != GUM_MAX_TRANSFER_PAGES && offset + chunk_size != len; n++)
+    {
+      gsize page_end, size;
+
+      page_end = (cursor & ~(page_size - 1)) + page_size;
+      size = MIN (page_end - cursor, len - offset - chunk_size);
+
+      remote[n].iov_base = GSIZE_TO_POINTER (cursor);
+      remote[n].iov_len = size;
+
+      cursor += size;
+      chunk_size += size;
+    }
+
+    local.iov_base = (guint8 *) buffer + offset;
+    local.iov_len = chunk_size;
+
+    res = syscall ((direction == GUM_TRANSFER_READ)
+        ? __NR_process_vm_readv
+        : __NR_process_vm_writev,
+        pid, &local, 1, remote, n, 0);
+    if (res == -1)
+    {
+      if (errno == ENOSYS || errno == EPERM)
+      {
+        supported = FALSE;
+        return -1;
+      }
+
+      break;
+    }
+
+    offset += res;
+
+    if ((gsize) res != chunk_size)
+      break;
+  }
+
+  return offset;
+#else
+  return -1;
+#endif
+}
+
 gboolean
 gum_try_mprotect (gpointer address,
                   gsize size,
@@ -104,6 +313,8 @@ gum_try_mprotect (gpointer address,
 
   result = mprotect (aligned_address, aligned_size, posix_prot);
 
+  _gum_memory_note_map_change ();
+
   return result == 0;
 }
 
@@ -127,8 +338,9 @@ gum_memory_get_protection (gconstpointer address,
                            GumPageProtection * prot)
 {
   gboolean success;
-  FILE * fp;
-  gchar line[1024 + 1];
+  GumProcMapsIter iter;
+  GumProcMapsEntry entry;
+  GumAddress start, end, cursor;
 
   if (size == NULL || prot == NULL)
   {
@@ -140,76 +352,55 @@ gum_memory_get_protection (gconstpointer address,
         (prot != NULL) ? prot : &ignored_prot);
   }
 
-  if (n > 1)
-  {
-    gsize page_size, start_page, end_page, cur_page;
-
-    page_size = gum_query_page_size ();
-
-    start_page = GPOINTER_TO_SIZE (address) & ~(page_size - 1);
-    end_page = (GPOINTER_TO_SIZE (address) + n - 1) & ~(page_size - 1);
-
-    success = gum_memory_get_protection (GSIZE_TO_POINTER (start_page), 1, NULL,
-        prot);
-    if (success)
-    {
-      *size = page_size - (GPOINTER_TO_SIZE (address) - start_page);
-      for (cur_page = start_page + page_size;
-          cur_page != end_page + page_size;
-          cur_page += page_size)
-      {
-        GumPageProtection cur_prot;
-
-        if (gum_memory_get_protection (GSIZE_TO_POINTER (cur_page), 1, NULL,
-            &cur_prot) && (cur_prot != GUM_PAGE_NO_ACCESS ||
-            *prot == GUM_PAGE_NO_ACCESS))
-        {
-          *size += page_size;
-          *prot &= cur_prot;
-        }
-        else
-        {
-          break;
-        }
-      }
-      *size = MIN (*size, n);
-    }
-
-    return success;
-  }
-
   success = FALSE;
   *size = 0;
   *prot = GUM_PAGE_NO_ACCESS;
 
-  fp = fopen ("/proc/self/maps", "r");
-  g_assert (fp != NULL);
+  start = GUM_ADDRESS (address);
+  end = start + MAX (n, 1);
+  cursor = start;
+
+  /*
+   * The iterator does not allocate, so this is safe to use from places where
+   * the heap may be in an inconsistent state, such as Stalker's block
+   * compilation.
+   */
+  gum_proc_maps_iter_init_for_self (&iter);
 
-  while (fgets (line, sizeof (line), fp) != NULL)
+  while (cursor < end && gum_proc_maps_iter_next (&iter, &entry))
   {
-    gpointer start, end;
-    gchar protection[16];
+    GumPageProtection cur_prot;
 
-    sscanf (line, "%p-%p %s ", &start, &end, protection);
+    if (entry.end <= start)
+      continue;
 
-    if (start > address)
-      break;
-    else if (address >= start && address + n - 1 < end)
+    cur_prot = gum_page_protection_from_proc_perms_string (entry.perms);
+
+    if (!success)
     {
+      if (entry.start > start)
+        break;
+
       success = TRUE;
-      *size = 1;
-      if (protection[0] == 'r')
-        *prot |= GUM_PAGE_READ;
-      if (protection[1] == 'w')
-        *prot |= GUM_PAGE_WRITE;
-      if (protection[2] == 'x')
-        *prot |= GUM_PAGE_EXECUTE;
-      break;
+      *prot = cur_prot;
     }
+    else
+    {
+      if (entry.start != cursor)
+        break;
+      if (cur_prot == GUM_PAGE_NO_ACCESS && *prot != GUM_PAGE_NO_ACCESS)
+        break;
+
+      *prot &= cur_prot;
+    }
+
+    cursor = entry.end;
   }
 
-  fclose (fp);
+  gum_proc_maps_iter_destroy (&iter);
+
+  if (success)
+    *size = (n > 1) ? MIN (cursor - start, n) : 1;
 
   return success;
 }
-
@@ -10,11 +10,13 @@
 #include "gum-init.h"
 #include "gumandroid.h"
 #include "gumlinux.h"
+#include "gumlinux-priv.h"
 #include "gummodulemap.h"
 #include "valgrind.h"
 
 #include <dlfcn.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -41,7 +43,6 @@
 # include <sys/user.h>
 #endif
 
-#define GUM_MAPS_LINE_SIZE (1024 + PATH_MAX)
 #define GUM_PSR_THUMB 0x20
 
 #if defined (HAVE_I386)
@@ -235,7 +236,10 @@ static gboolean gum_emit_executable_module_by_name (
     const GumModuleDetails * details, gpointer user_data);
 
 static void gum_linux_named_range_free (GumLinuxNamedRange * range);
-static gboolean gum_try_translate_vdso_name (gchar * name);
+static gboolean gum_try_translate_vdso_name (const gchar ** name);
+static const gchar * gum_basename_view (const gchar * path);
+static gboolean gum_proc_maps_parse_line (gchar * line,
+    GumProcMapsEntry * entry);
 static void * gum_module_get_handle (const gchar * module_name);
 static void * gum_module_get_symbol (void * module, const gchar * symbol_name);
 
@@ -264,8 +268,6 @@ static GumElfModule * gum_open_elf_module (const gchar * name);
 
 static gboolean gum_thread_read_state (GumThreadId tid, GumThreadState * state);
 static GumThreadState gum_thread_state_from_proc_status_character (gchar c);
-static GumPageProtection gum_page_protection_from_proc_perms_string (
-    const gchar * perms);
 
 static gssize gum_get_regs (pid_t pid, GumRegs * regs);
 static gssize gum_set_regs (pid_t pid, const GumRegs * regs);
@@ -800,7 +802,6 @@ gum_emit_module_from_phdr (struct dl_phdr_info * info,
   GumAddress base_address;
   GumLinuxNamedRange * named_range;
   const gchar * path;
-  gchar * name;
   GumModuleDetails details;
   GumMemoryRange range;
   gboolean carry_on;
@@ -821,9 +822,7 @@ gum_emit_module_from_phdr (struct dl_phdr_info * info,
   if (is_special_module)
     return 0;
 
-  name = g_path_get_basename (path);
-
-  details.name = name;
+  details.name = gum_basename_view (path);
   details.range = &range;
   details.path = path;
 
@@ -864,8 +863,6 @@ gum_emit_module_from_phdr (struct dl_phdr_info * info,
 
   ctx->index++;
 
-  g_free (name);
-
   return carry_on ? 0 : 1;
 }
 
@@ -1008,192 +1005,127 @@ void
 gum_linux_enumerate_modules_using_proc_maps (GumFoundModuleFunc func,
                                              gpointer user_data)
 {
-  FILE * fp;
-  const guint line_size = GUM_MAPS_LINE_SIZE;
-  gchar * line, * path, * next_path;
+  GumProcMapsIter iter;
+  GumProcMapsEntry entry;
+  gchar path[PATH_MAX];
   gboolean carry_on = TRUE;
-  gboolean got_line = FALSE;
-
-  fp = fopen ("/proc/self/maps", "r");
-  g_assert (fp != NULL);
+  gboolean got_entry = FALSE;
 
-  line = g_malloc (line_size);
+  gum_proc_maps_iter_init_for_self (&iter);
 
-  path = g_malloc (PATH_MAX);
-  next_path = g_malloc (PATH_MAX);
-
-  do
+  while (carry_on && (got_entry || gum_proc_maps_iter_next (&iter, &entry)))
   {
     const guint8 elf_magic[] = { 0x7f, 'E', 'L', 'F' };
     GumModuleDetails details;
     GumMemoryRange range;
-    GumAddress end;
-    gchar perms[5] = { 0, };
-    gint n;
     gboolean is_vdso, readable, shared;
-    gchar * name;
 
-    if (!got_line)
-    {
-      if (fgets (line, line_size, fp) == NULL)
-        break;
-    }
-    else
-    {
-      got_line = FALSE;
-    }
+    got_entry = FALSE;
 
-    n = sscanf (line,
-        "%" G_GINT64_MODIFIER "x-%" G_GINT64_MODIFIER "x "
-        "%4c "
-        "%*x %*s %*d "
-        "%[^\n]",
-        &range.base_address, &end,
-        perms,
-        path);
-    if (n == 3)
+    if (entry.path[0] == '\0')
       continue;
-    g_assert (n == 4);
 
-    is_vdso = gum_try_translate_vdso_name (path);
+    is_vdso = gum_try_translate_vdso_name (&entry.path);
 
-    readable = perms[0] == 'r';
-    shared = perms[3] == 's';
+    readable = entry.perms[0] == 'r';
+    shared = entry.perms[3] == 's';
     if (!readable || shared)
       continue;
-    else if ((path[0] != '/' && !is_vdso) || g_str_has_prefix (path, "/dev/"))
+    else if ((entry.path[0] != '/' && !is_vdso) ||
+        g_str_has_prefix (entry.path, "/dev/"))
       continue;
-    else if (RUNNING_ON_VALGRIND && strstr (path, "/valgrind/") != NULL)
+    else if (RUNNING_ON_VALGRIND && strstr (entry.path, "/valgrind/") != NULL)
       continue;
-    else if (memcmp (GSIZE_TO_POINTER (range.base_address), elf_magic,
+    else if (memcmp (GSIZE_TO_POINTER (entry.start), elf_magic,
         sizeof (elf_magic)) != 0)
       continue;
 
-    name = g_path_get_basename (path);
+    /* The module spans several lines, so keep its path around. */
+    g_strlcpy (path, entry.path, sizeof (path));
 
-    range.size = end - range.base_address;
+    range.base_address = entry.start;
+    range.size = entry.end - entry.start;
 
-    details.name = name;
+    details.name = gum_basename_view (path);
     details.range = &range;
     details.path = path;
 
-    while (fgets (line, line_size, fp) != NULL)
+    while (gum_proc_maps_iter_next (&iter, &entry))
     {
-      n = sscanf (line,
-          "%*x-%" G_GINT64_MODIFIER "x %*c%*c%*c%*c %*x %*s %*d %[^\n]",
-          &end,
-          next_path);
-      if (n == 1)
-      {
+      const gchar * name = entry.path;
+
+      /* Leave entry.path as is, as the outer loop may pick it up next. */
+      if (name[0] == '\0')
+        continue;
+      else if (name[0] == '[' && !gum_try_translate_vdso_name (&name))
         continue;
-      }
-      else if (n == 2 && next_path[0] == '[')
-      {
-        if (!gum_try_translate_vdso_name (next_path))
-          continue;
-      }
 
-      if (n == 2 && strcmp (next_path, path) == 0)
+      if (strcmp (name, path) == 0)
       {
-        range.size = end - range.base_address;
+        range.size = entry.end - range.base_address;
       }
       else
       {
-        got_line = TRUE;
+        got_entry = TRUE;
         break;
       }
     }
 
     carry_on = func (&details, user_data);
-
-    g_free (name);
   }
-  while (carry_on);
 
-  g_free (path);
-  g_free (next_path);
-
-  g_free (line);
-
-  fclose (fp);
+  gum_proc_maps_iter_destroy (&iter);
 }
 
 GHashTable *
 gum_linux_collect_named_ranges (void)
 {
   GHashTable * result;
-  FILE * fp;
-  const guint line_size = GUM_MAPS_LINE_SIZE;
-  gchar * line, * name, * next_name;
-  gboolean carry_on = TRUE;
-  gboolean got_line = FALSE;
+  GumProcMapsIter iter;
+  GumProcMapsEntry entry;
+  gchar name[PATH_MAX];
+  gboolean got_entry = FALSE;
 
   result = g_hash_table_new_full (NULL, NULL, NULL,
       (GDestroyNotify) gum_linux_named_range_free);
 
-  fp = fopen ("/proc/self/maps", "r");
-  g_assert (fp != NULL);
+  gum_proc_maps_iter_init_for_self (&iter);
 
-  line = g_malloc (line_size);
-
-  name = g_malloc (PATH_MAX);
-  next_name = g_malloc (PATH_MAX);
-
-  do
+  while (got_entry || gum_proc_maps_iter_next (&iter, &entry))
   {
-    GumAddress start, end;
+    GumAddress start;
     gsize size;
-    gint n;
     GumLinuxNamedRange * range;
 
-    if (!got_line)
-    {
-      if (fgets (line, line_size, fp) == NULL)
-        break;
-    }
-    else
-    {
-      got_line = FALSE;
-    }
+    got_entry = FALSE;
 
-    n = sscanf (line,
-        "%" G_GINT64_MODIFIER "x-%" G_GINT64_MODIFIER "x "
-        "%*4c "
-        "%*x %*s %*d "
-        "%[^\n]",
-        &start, &end,
-        name);
-    if (n == 2)
+    if (entry.path[0] == '\0')
       continue;
-    g_assert (n == 3);
 
-    gum_try_translate_vdso_name (name);
+    gum_try_translate_vdso_name (&entry.path);
+
+    g_strlcpy (name, entry.path, sizeof (name));
 
-    size = end - start;
+    start = entry.start;
+    size = entry.end - start;
 
-    while (fgets (line, line_size, fp) != NULL)
+    while (gum_proc_maps_iter_next (&iter, &entry))
     {
-      n = sscanf (line,
-          "%*x-%" G_GINT64_MODIFIER "x %*c%*c%*c%*c %*x %*s %*d %[^\n]",
-          &end,
-          next_name);
-      if (n == 1)
-      {
+      const gchar * next_name = entry.path;
+
+      if (next_name[0] == '\0')
+        continue;
+      else if (next_name[0] == '[' &&
+          !gum_try_translate_vdso_name (&next_name))
         continue;
-      }
-      else if (n == 2 && next_name[0] == '[')
-      {
-        if (!gum_try_translate_vdso_name (next_name))
-          continue;
-      }
 
-      if (n == 2 && strcmp (next_name, name) == 0)
+      if (strcmp (next_name, name) == 0)
       {
-        size = end - start;
+        size = entry.end - start;
       }
       else
       {
-        got_line = TRUE;
+        got_entry = TRUE;
         break;
       }
     }
@@ -1206,14 +1138,8 @@ gum_linux_collect_named_ranges (void)
 
     g_hash_table_insert (result, range->base, range);
   }
-  while (carry_on);
 
-  g_free (name);
-  g_free (next_name);
-
-  g_free (line);
-
-  fclose (fp);
+  gum_proc_maps_iter_destroy (&iter);
 
   return result;
 }
@@ -1227,17 +1153,27 @@ gum_linux_named_range_free (GumLinuxNamedRange * range)
 }
 
 static gboolean
-gum_try_translate_vdso_name (gchar * name)
+gum_try_translate_vdso_name (const gchar ** name)
 {
-  if (strcmp (name, "[vdso]") == 0)
+  if (strcmp (*name, "[vdso]") == 0)
   {
-    strcpy (name, "linux-vdso.so.1");
+    *name = "linux-vdso.so.1";
     return TRUE;
   }
 
   return FALSE;
 }
 
+static const gchar *
+gum_basename_view (const gchar * path)
+{
+  const gchar * last_slash;
+
+  last_slash = strrchr (path, '/');
+
+  return (last_slash != NULL) ? last_slash + 1 : path;
+}
+
 void
 _gum_process_enumerate_ranges (GumPageProtection prot,
                                GumFoundRangeFunc func,
@@ -1252,51 +1188,29 @@ gum_linux_enumerate_ranges (pid_t pid,
                             GumFoundRangeFunc func,
                             gpointer user_data)
 {
-  gchar * maps_path;
-  FILE * fp;
-  const guint line_size = GUM_MAPS_LINE_SIZE;
-  gchar * line;
+  GumProcMapsIter iter;
+  GumProcMapsEntry entry;
   gboolean carry_on = TRUE;
 
-  maps_path = g_strdup_printf ("/proc/%d/maps", pid);
-
-  fp = fopen (maps_path, "r");
-  g_assert (fp != NULL);
-
-  g_free (maps_path);
+  gum_proc_maps_iter_init_for_pid (&iter, pid);
 
-  line = g_malloc (line_size);
-
-  while (carry_on && fgets (line, line_size, fp) != NULL)
+  while (carry_on && gum_proc_maps_iter_next (&iter, &entry))
   {
     GumRangeDetails details;
     GumMemoryRange range;
     GumFileMapping file;
-    GumAddress end;
-    gchar perms[5] = { 0, };
-    guint64 inode;
-    gint length;
-
-    sscanf (line,
-        "%" G_GINT64_MODIFIER "x-%" G_GINT64_MODIFIER "x "
-        "%4c "
-        "%" G_GINT64_MODIFIER "x %*s %" G_GINT64_MODIFIER "d"
-        "%n",
-        &range.base_address, &end,
-        perms,
-        &file.offset, &inode,
-        &length);
-
-    range.size = end - range.base_address;
+
+    range.base_address = entry.start;
+    range.size = entry.end - entry.start;
 
     details.file = NULL;
-    if (inode != 0)
+    if (entry.inode != 0)
     {
-      file.path = strchr (line + length, '/');
+      file.path = strchr (entry.path, '/');
       if (file.path != NULL)
       {
-        *strchr (file.path, '\n') = '\0';
         details.file = &file;
+        file.offset = entry.offset;
         file.size = 0; /* TODO */
 
         if (RUNNING_ON_VALGRIND && strstr (file.path, "/valgrind/") != NULL)
@@ -1305,7 +1219,8 @@ gum_linux_enumerate_ranges (pid_t pid,
     }
 
     details.range = &range;
-    details.protection = gum_page_protection_from_proc_perms_string (perms);
+    details.protection =
+        gum_page_protection_from_proc_perms_string (entry.perms);
 
     if ((details.protection & prot) == prot)
     {
@@ -1313,9 +1228,129 @@ gum_linux_enumerate_ranges (pid_t pid,
     }
   }
 
-  g_free (line);
+  gum_proc_maps_iter_destroy (&iter);
+}
 
-  fclose (fp);
+/*
+ * Streams /proc/$pid/maps through a fixed buffer, tokenizing each line in
+ * place. The strings in an entry point into the buffer and are only valid
+ * until the next call to gum_proc_maps_iter_next(). Nothing is allocated, so
+ * this is cheap enough to run from timers and safe to use while the heap is
+ * in an inconsistent state.
+ */
+void
+gum_proc_maps_iter_init_for_self (GumProcMapsIter * iter)
+{
+  gum_proc_maps_iter_init_for_pid (iter, getpid ());
+}
+
+void
+gum_proc_maps_iter_init_for_pid (GumProcMapsIter * iter,
+                                 pid_t pid)
+{
+  gchar path[32];
+
+  g_snprintf (path, sizeof (path), "/proc/%d/maps", pid);
+
+  iter->fd = open (path, O_RDONLY | O_CLOEXEC);
+  g_assert (iter->fd != -1);
+
+  iter->read_cursor = iter->buffer;
+  iter->write_cursor = iter->buffer;
+  iter->in_long_line = FALSE;
+}
+
+void
+gum_proc_maps_iter_destroy (GumProcMapsIter * iter)
+{
+  close (iter->fd);
+}
+
+gboolean
+gum_proc_maps_iter_next (GumProcMapsIter * self,
+                         GumProcMapsEntry * entry)
+{
+  gchar * line, * line_end;
+
+  while (TRUE)
+  {
+    while ((line_end = memchr (self->read_cursor, '\n',
+        self->write_cursor - self->read_cursor)) == NULL)
+    {
+      gsize pending;
+      gssize n;
+
+      pending = self->write_cursor - self->read_cursor;
+      if (pending == sizeof (self->buffer))
+      {
+        /* Too long to hold, so drop it rather than end the iteration. */
+        self->in_long_line = TRUE;
+        pending = 0;
+        self->read_cursor = self->write_cursor;
+      }
+
+      memmove (self->buffer, self->read_cursor, pending);
+      self->read_cursor = self->buffer;
+      self->write_cursor = self->buffer + pending;
+
+      n = read (self->fd, self->write_cursor,
+          self->buffer + sizeof (self->buffer) - self->write_cursor);
+      if (n <= 0)
+        return FALSE;
+      self->write_cursor += n;
+    }
+
+    line = self->read_cursor;
+    *line_end = '\0';
+    self->read_cursor = line_end + 1;
+
+    if (self->in_long_line)
+      self->in_long_line = FALSE;
+    else if (gum_proc_maps_parse_line (line, entry))
+      return TRUE;
+  }
+}
+
+static gboolean
+gum_proc_maps_parse_line (gchar * line,
+                          GumProcMapsEntry * entry)
+{
+  gchar * cursor, * end;
+
+  entry->start = g_ascii_strtoull (line, &end, 16);
+  if (end == line || *end != '-')
+    return FALSE;
+
+  cursor = end + 1;
+  entry->end = g_ascii_strtoull (cursor, &end, 16);
+  if (end == cursor || *end != ' ')
+    return FALSE;
+
+  entry->perms = end + 1;
+  cursor = strchr (end + 1, ' ');
+  if (cursor == NULL)
+    return FALSE;
+  *cursor++ = '\0';
+
+  entry->offset = g_ascii_strtoull (cursor, &end, 16);
+  if (end == cursor || *end != ' ')
+    return FALSE;
+
+  /* Skip the device. */
+  cursor = strchr (end + 1, ' ');
+  if (cursor == NULL)
+    return FALSE;
+  cursor++;
+
+  entry->inode = g_ascii_strtoull (cursor, &end, 10);
+  if (end == cursor)
+    return FALSE;
+
+  while (*end == ' ')
+    end++;
+  entry->path = end;
+
+  return TRUE;
 }
 
 void
@@ -2515,7 +2550,7 @@ gum_thread_state_from_proc_status_character (gchar c)
   }
 }
 
-static GumPageProtection
+GumPageProtection
 gum_page_protection_from_proc_perms_string (const gchar * perms)
 {
   GumPageProtection prot = GUM_PAGE_NO_ACCESS;
@@ -256,15 +256,25 @@ gum_allocate_page_aligned (gpointer address,
   gpointer result;
 
   result = mmap (address, size, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (result == MAP_FAILED)
+    return NULL;
+
+  _gum_memory_note_map_change ();
 
-  return (result != MAP_FAILED) ? result : NULL;
+  return result;
 }
 
 gboolean
 gum_memory_free (gpointer address,
                  gsize size)
 {
-  return munmap (address, size) == 0;
+  gboolean success;
+
+  success = munmap (address, size) == 0;
+
+  _gum_memory_note_map_change ();
+
+  return success;
 }
 
 gboolean
@@ -32,6 +32,15 @@ gum_memory_is_readable (gconstpointer address,
   return size >= len && (prot & GUM_PAGE_READ) != 0;
 }
 
+gboolean
+gum_memory_query_protection (gconstpointer address,
+                             GumPageProtection * prot)
+{
+  gsize size;
+
+  return gum_memory_get_protection (address, 1, &size, prot);
+}
+
 static gboolean
 gum_memory_is_writable (gconstpointer address,
                         gsize len)
@@ -161,6 +170,8 @@ gum_try_mprotect (gpointer address,
     close (fd);
   }
 
+  _gum_memory_note_map_change ();
+
   return result == 0;
 }
 
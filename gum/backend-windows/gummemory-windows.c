@@ -49,6 +49,13 @@ gum_memory_is_readable (gconstpointer address,
   return (prot & GUM_PAGE_READ) != 0;
 }
 
+gboolean
+gum_memory_query_protection (gconstpointer address,
+                             GumPageProtection * prot)
+{
+  return gum_memory_get_protection (address, 1, prot);
+}
+
 guint8 *
 gum_memory_read (gconstpointer address,
                  gsize len,
@@ -111,10 +118,15 @@ gum_try_mprotect (gpointer address,
                   GumPageProtection prot)
 {
   DWORD win_prot, old_protect;
+  BOOL success;
 
   win_prot = gum_page_protection_to_windows (prot);
 
-  return VirtualProtect (address, size, win_prot, &old_protect);
+  success = VirtualProtect (address, size, win_prot, &old_protect);
+
+  _gum_memory_note_map_change ();
+
+  return success;
 }
 
 void
@@ -165,7 +177,7 @@ gum_free_pages (gpointer mem)
 {
   BOOL success;
 
-  success = VirtualFree (mem, 0, MEM_RELEASE);
+  success = gum_memory_free (mem, 0);
   g_assert (success);
 }
 
@@ -214,6 +226,8 @@ gum_memory_allocate (gpointer address,
       break;
   }
 
+  _gum_memory_note_map_change ();
+
   return base;
 }
 
@@ -263,6 +277,8 @@ gum_memory_allocate_near (const GumAddressSpec * spec,
   }
   while (result == NULL);
 
+  _gum_memory_note_map_change ();
+
   return result;
 }
 
@@ -284,6 +300,8 @@ gum_virtual_alloc (gpointer address,
     result = VirtualAlloc (NULL, size, allocation_type, page_protection);
   }
 
+  _gum_memory_note_map_change ();
+
   return result;
 }
 
@@ -291,14 +309,20 @@ gboolean
 gum_memory_free (gpointer address,
                  gsize size)
 {
-  return VirtualFree (address, 0, MEM_RELEASE);
+  BOOL success;
+
+  success = VirtualFree (address, 0, MEM_RELEASE);
+
+  _gum_memory_note_map_change ();
+
+  return success;
 }
 
 gboolean
 gum_memory_release (gpointer address,
                     gsize size)
 {
-  return VirtualFree (address, size, MEM_DECOMMIT);
+  return gum_memory_decommit (address, size);
 }
 
 gboolean
@@ -306,15 +330,27 @@ gum_memory_commit (gpointer address,
                    gsize size,
                    GumPageProtection prot)
 {
-  return VirtualAlloc (address, size, MEM_COMMIT,
-      gum_page_protection_to_windows (prot)) != NULL;
+  gpointer result;
+
+  result = VirtualAlloc (address, size, MEM_COMMIT,
+      gum_page_protection_to_windows (prot));
+
+  _gum_memory_note_map_change ();
+
+  return result != NULL;
 }
 
 gboolean
 gum_memory_decommit (gpointer address,
                      gsize size)
 {
-  return VirtualFree (address, size, MEM_DECOMMIT);
+  BOOL success;
+
+  success = VirtualFree (address, size, MEM_DECOMMIT);
+
+  _gum_memory_note_map_change ();
+
+  return success;
 }
 
 static gboolean
@@ -8,6 +8,7 @@
 
 #include "gumstalker.h"
 
+#include "gummetalarray.h"
 #include "gummetalhash.h"
 #include "gumx86reader.h"
 #include "gumx86writer.h"
@@ -15,9 +16,7 @@
 #include "gumx86relocator.h"
 #include "gumspinlock.h"
 #include "gumtls.h"
-#ifdef HAVE_WINDOWS
-# include "gumexceptor.h"
-#endif
+#include "gumexceptor.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -33,7 +32,14 @@
 #define GUM_DATA_SLAB_SIZE_INITIAL  (GUM_CODE_SLAB_SIZE_INITIAL / 5)
 #define GUM_DATA_SLAB_SIZE_DYNAMIC  (GUM_CODE_SLAB_SIZE_DYNAMIC / 5)
 #define GUM_SCRATCH_SLAB_SIZE       16384
+#define GUM_TRACKED_PAGE_MAX_WRITE_FAULTS 8
 #define GUM_EXEC_BLOCK_MIN_CAPACITY 1024
+#define GUM_IC_ENTRY_MAX_SIZE       72
+#define GUM_MAX_TRACE_SEGMENTS      8
+
+#define GUM_BLOCK_SET_MAGIC   0x4b4c4253
+#define GUM_BLOCK_SET_VERSION 1
+#define GUM_BLOCK_SET_MAX_BACKPATCHES (64 * 1024)
 
 #if GLIB_SIZEOF_VOID_P == 4
 # define GUM_INVALIDATE_TRAMPOLINE_SIZE            16
@@ -56,8 +62,15 @@ typedef struct _GumDisinfectContext GumDisinfectContext;
 typedef struct _GumActivation GumActivation;
 typedef struct _GumInvalidateContext GumInvalidateContext;
 typedef struct _GumCallProbe GumCallProbe;
+typedef struct _GumTrackedPage GumTrackedPage;
+typedef guint GumBlockSetEntryType;
+typedef struct _GumBlockSetHeader GumBlockSetHeader;
+typedef struct _GumBlockSetEntry GumBlockSetEntry;
+typedef struct _GumExportedBlock GumExportedBlock;
+typedef struct _GumBackpatchRecord GumBackpatchRecord;
 
 typedef struct _GumExecCtx GumExecCtx;
+typedef struct _GumEntryGateHits GumEntryGateHits;
 typedef guint GumExecCtxMode;
 typedef void (* GumExecHelperWriteFunc) (GumExecCtx * ctx, GumX86Writer * cw);
 typedef gpointer (GUM_THUNK * GumExecCtxReplaceCurrentBlockFunc) (
@@ -65,6 +78,8 @@ typedef gpointer (GUM_THUNK * GumExecCtxReplaceCurrentBlockFunc) (
 
 typedef struct _GumExecBlock GumExecBlock;
 typedef guint GumExecBlockFlags;
+typedef struct _GumTrace GumTrace;
+typedef struct _GumTraceSegment GumTraceSegment;
 
 typedef struct _GumExecFrame GumExecFrame;
 
@@ -123,6 +138,16 @@ struct _GumStalker
 
   GArray * exclusions;
   gint trust_threshold;
+  guint ic_entries;
+  gboolean ic_hit_counting_enabled;
+  gsize cache_budget;
+  volatile gboolean trace_formation_enabled;
+  guint trace_hotness_threshold;
+  volatile gboolean page_write_tracking_enabled;
+  GumExceptor * page_write_exceptor;
+  GumSpinlock tracked_page_lock;
+  GumMetalHashTable * tracked_pages;
+  volatile gint page_writes;
   volatile gboolean any_probes_attached;
   volatile gint last_probe_id;
   GumSpinlock probe_lock;
@@ -174,6 +199,88 @@ struct _GumCallProbe
   GDestroyNotify user_notify;
 };
 
+struct _GumTrackedPage
+{
+  GumPageProtection protection;
+  gboolean write_protected;
+  guint write_faults;
+};
+
+enum _GumBlockSetEntryType
+{
+  GUM_BLOCK_SET_ENTRY_BLOCK,
+  GUM_BLOCK_SET_ENTRY_CALL,
+  GUM_BLOCK_SET_ENTRY_JMP,
+  GUM_BLOCK_SET_ENTRY_RET,
+  GUM_BLOCK_SET_ENTRY_INLINE_CACHE
+};
+
+struct _GumBlockSetHeader
+{
+  guint32 magic;
+  guint32 version;
+  guint32 n_entries;
+  guint32 reserved;
+};
+
+struct _GumBlockSetEntry
+{
+  guint8 type;
+  guint8 opened_prolog;
+  guint16 reserved;
+  gint32 recycle_count;
+  guint32 from_code_size;
+  guint32 code_offset;
+  guint32 ret_code_offset;
+  guint32 padding;
+  guint64 from;
+  guint64 to;
+  guint64 ret_real_address;
+};
+
+struct _GumExportedBlock
+{
+  guint8 * real_start;
+  guint8 * code_start;
+  guint code_size;
+  gint recycle_count;
+};
+
+struct _GumBackpatchRecord
+{
+  GumBlockSetEntryType type;
+  GumPrologType opened_prolog;
+  guint8 * code_start;
+  gpointer target;
+  gpointer ret_real_address;
+  guint8 * ret_code_address;
+};
+
+struct _GumEntryGateHits
+{
+#if GLIB_SIZEOF_VOID_P == 4 && !defined (HAVE_QNX)
+  guint64 sysenter_slow_path;
+#endif
+
+  guint64 call_imm;
+  guint64 call_reg;
+  guint64 call_mem;
+  guint64 post_call_invoke;
+  guint64 excluded_call_imm;
+  guint64 ret_slow_path;
+
+  guint64 jmp_imm;
+  guint64 jmp_mem;
+  guint64 jmp_reg;
+
+  guint64 jmp_cond_imm;
+  guint64 jmp_cond_mem;
+  guint64 jmp_cond_reg;
+  guint64 jmp_cond_jcxz;
+
+  guint64 jmp_continuation;
+};
+
 struct _GumExecCtx
 {
   volatile gint state;
@@ -219,11 +326,32 @@ struct _GumExecCtx
   gpointer infect_thunk;
   GumAddress infect_body;
 
+  guint ic_entries;
+  gboolean count_ic_hits;
+  gsize ic_hits;
+  gsize ic_misses;
+  gsize block_min_capacity;
+
   GumSpinlock code_lock;
   GumCodeSlab * code_slab;
   GumDataSlab * data_slab;
   GumCodeSlab * scratch_slab;
+  GumCodeSlab * retired_code_slab;
+  GumDataSlab * retired_data_slab;
+  gsize cache_size;
+  guint64 cache_flushes;
+  guint64 evicted_blocks;
+  guint64 evicted_bytes;
+  guint traces_formed;
+  guint64 blocks_compiled;
+  guint64 blocks_recompiled;
+  guint64 snapshot_comparisons;
+  gsize code_bytes;
+  gsize data_bytes;
+  guint64 backpatches_applied;
+  GumEntryGateHits entrygate_hits;
   GumMetalHashTable * mappings;
+  GumMetalArray backpatches;
   gpointer last_prolog_minimal;
   gpointer last_epilog_minimal;
   gpointer last_prolog_full;
@@ -252,6 +380,8 @@ struct _GumExecBlock
   GumExecCtx * ctx;
   GumCodeSlab * code_slab;
   GumExecBlock * storage_block;
+  GumTrace * trace;
+  GumExecBlock * folded_into;
 
   guint8 * real_start;
   guint8 * code_start;
@@ -262,6 +392,8 @@ struct _GumExecBlock
 
   GumExecBlockFlags flags;
   gint recycle_count;
+  guint exec_count;
+  gint page_writes;
 };
 
 enum _GumExecBlockFlags
@@ -269,6 +401,22 @@ enum _GumExecBlockFlags
   GUM_EXEC_BLOCK_ACTIVATION_TARGET = 1 << 0,
 };
 
+struct _GumTraceSegment
+{
+  guint8 * real_start;
+  GumAddress code_start;
+  GumExecBlock * block;
+};
+
+struct _GumTrace
+{
+  GumTraceSegment segments[GUM_MAX_TRACE_SEGMENTS];
+  guint num_segments;
+  guint num_internal_branches;
+  guint head_size;
+  guint8 * next;
+};
+
 struct _GumExecFrame
 {
   gpointer real_address;
@@ -317,6 +465,7 @@ struct _GumGeneratorContext
   gpointer continuation_real_address;
   GumPrologType opened_prolog;
   guint accumulated_stack_delta;
+  GumTrace * trace;
 };
 
 struct _GumInstruction
@@ -385,14 +534,25 @@ G_GNUC_INTERNAL void _gum_stalker_do_activate (GumStalker * self,
     gconstpointer target, gpointer * ret_addr_ptr);
 G_GNUC_INTERNAL void _gum_stalker_do_deactivate (GumStalker * self,
     gpointer * ret_addr_ptr);
+static gint gum_compare_exported_blocks (gconstpointer a, gconstpointer b);
+static const GumExportedBlock * gum_find_exported_block (
+    GumMetalArray * blocks, gconstpointer code_address);
 static gboolean gum_stalker_do_invalidate (GumExecCtx * ctx,
     gconstpointer address, GumActivation * activation);
+static gboolean gum_stalker_do_invalidate_block (GumExecCtx * ctx,
+    GumExecBlock * block, GumActivation * activation);
 static void gum_stalker_try_invalidate_block_owned_by_thread (
     GumThreadId thread_id, GumCpuContext * cpu_context, gpointer user_data);
 
 static GumCallProbe * gum_call_probe_ref (GumCallProbe * probe);
 static void gum_call_probe_unref (GumCallProbe * probe);
 
+static gboolean gum_stalker_write_protect (GumStalker * self,
+    gconstpointer address, gsize size);
+static void gum_stalker_unprotect_tracked_pages (GumStalker * self);
+static gboolean gum_stalker_on_tracked_page_write (
+    GumExceptionDetails * details, gpointer user_data);
+
 static GumExecCtx * gum_stalker_create_exec_ctx (GumStalker * self,
     GumThreadId thread_id, GumStalkerTransformer * transformer,
     GumEventSink * sink);
@@ -415,6 +575,15 @@ static GumCodeSlab * gum_exec_ctx_add_code_slab (GumExecCtx * ctx,
     GumCodeSlab * code_slab);
 static GumDataSlab * gum_exec_ctx_add_data_slab (GumExecCtx * ctx,
     GumDataSlab * data_slab);
+static void gum_exec_ctx_clear_blocks (GumExecCtx * ctx);
+static void gum_exec_ctx_free_slabs (GumExecCtx * ctx, GumCodeSlab * code_slab,
+    GumDataSlab * data_slab);
+static gboolean gum_exec_ctx_is_initial_slab (GumExecCtx * ctx,
+    GumSlab * slab);
+static void gum_exec_ctx_maybe_flush_code_cache (GumExecCtx * ctx,
+    gpointer real_address);
+static void gum_exec_ctx_flush_code_cache (GumExecCtx * ctx);
+static void gum_exec_ctx_free_retired_slabs (GumExecCtx * ctx);
 static void gum_exec_ctx_compute_code_address_spec (GumExecCtx * ctx,
     gsize slab_size, GumAddressSpec * spec);
 static void gum_exec_ctx_compute_data_address_spec (GumExecCtx * ctx,
@@ -424,16 +593,38 @@ static gboolean gum_exec_ctx_maybe_unfollow (GumExecCtx * ctx,
 static void gum_exec_ctx_unfollow (GumExecCtx * ctx, gpointer resume_at);
 static gboolean gum_exec_ctx_has_executed (GumExecCtx * ctx);
 static gboolean gum_exec_ctx_contains (GumExecCtx * ctx, gconstpointer address);
+static gboolean gum_exec_ctx_is_retired (GumExecCtx * ctx,
+    gconstpointer address);
 static gpointer GUM_THUNK gum_exec_ctx_switch_block (GumExecCtx * ctx,
     gpointer start_address);
+static void gum_exec_ctx_query_stats (GumExecCtx * ctx,
+    GumStalkerStats * stats);
+static void gum_stalker_stats_add_entry_gate (GumStalkerStats * stats,
+    const gchar * name, guint64 hits);
 
 static GumExecBlock * gum_exec_ctx_obtain_block_for (GumExecCtx * ctx,
     gpointer real_address, gpointer * code_address);
 static void gum_exec_ctx_recompile_block (GumExecCtx * ctx,
     GumExecBlock * block);
+static void gum_exec_ctx_count_execution (GumExecCtx * ctx,
+    GumExecBlock * block);
+static void gum_exec_ctx_maybe_form_trace (GumExecCtx * ctx,
+    GumExecBlock * block);
+static gboolean gum_exec_ctx_may_extend_trace (GumExecCtx * ctx,
+    const GumTrace * trace, gconstpointer address);
+static const GumTraceSegment * gum_trace_find_segment (const GumTrace * trace,
+    gconstpointer real_start);
+static void gum_exec_ctx_record_backpatch (GumExecCtx * ctx,
+    GumBlockSetEntryType type, gpointer code_start, GumExecBlock * target,
+    GumPrologType opened_prolog, gpointer ret_real_address,
+    gpointer ret_code_address);
+static void gum_exec_ctx_forget_backpatches_within (GumExecCtx * ctx,
+    gconstpointer start, gsize size);
+static void gum_exec_ctx_replay_backpatch (GumExecCtx * ctx,
+    const GumBlockSetEntry * entry);
 static void gum_exec_ctx_compile_block (GumExecCtx * ctx, GumExecBlock * block,
     gconstpointer input_code, gpointer output_code, GumAddress output_pc,
-    guint * input_size, guint * output_size);
+    GumTrace * trace, guint * input_size, guint * output_size);
 static void gum_exec_ctx_maybe_emit_compile_event (GumExecCtx * ctx,
     GumExecBlock * block);
 
@@ -489,6 +680,8 @@ static void gum_exec_ctx_load_real_register_from_ic_frame_into (
 
 static GumExecBlock * gum_exec_block_new (GumExecCtx * ctx);
 static void gum_exec_block_clear (GumExecBlock * block);
+static gboolean gum_exec_block_trace_is_unmodified (GumExecBlock * block);
+static gboolean gum_exec_block_is_unmodified (GumExecBlock * block);
 static void gum_exec_block_commit (GumExecBlock * block);
 static void gum_exec_block_invalidate (GumExecBlock * block);
 static gpointer gum_exec_block_get_snapshot_start (GumExecBlock * block);
@@ -504,6 +697,10 @@ static void gum_exec_block_backpatch_jmp (GumExecBlock * block,
     gpointer code_start, GumPrologType opened_prolog);
 static void gum_exec_block_backpatch_ret (GumExecBlock * block,
     gpointer code_start);
+static void gum_exec_block_backpatch_inline_cache (GumExecBlock * block,
+    gpointer * ic_entries);
+static void gum_exec_block_handle_inline_cache_miss (GumExecBlock * block,
+    gpointer * ic_entries);
 
 static GumVirtualizationRequirements gum_exec_block_virtualize_branch_insn (
     GumExecBlock * block, GumGeneratorContext * gc);
@@ -522,6 +719,15 @@ static void gum_exec_block_write_call_invoke_code (GumExecBlock * block,
 static void gum_exec_block_write_jmp_transfer_code (GumExecBlock * block,
     const GumBranchTarget * target, GumExecCtxReplaceCurrentBlockFunc func,
     GumGeneratorContext * gc);
+static void gum_exec_block_write_trace_branch_code (GumExecBlock * block,
+    const GumBranchTarget * target, GumGeneratorContext * gc);
+static void gum_exec_block_write_trace_edge_code (GumExecBlock * block,
+    const GumBranchTarget * target, GumExecCtxReplaceCurrentBlockFunc func,
+    gboolean may_extend, GumGeneratorContext * gc);
+static gpointer * gum_exec_block_write_inline_cache_entries (
+    GumExecBlock * block, GumGeneratorContext * gc);
+static void gum_exec_block_write_inline_cache_lookup (GumExecBlock * block,
+    gpointer * ic_entries, GumGeneratorContext * gc);
 static void gum_exec_block_write_ret_transfer_code (GumExecBlock * block,
     GumGeneratorContext * gc);
 static void gum_exec_block_write_single_step_transfer_code (
@@ -575,6 +781,8 @@ static gsize gum_slab_available (GumSlab * self);
 static gpointer gum_slab_start (GumSlab * self);
 static gpointer gum_slab_end (GumSlab * self);
 static gpointer gum_slab_cursor (GumSlab * self);
+static gsize gum_slab_footprint (GumSlab * self);
+static gboolean gum_slab_list_contains (GumSlab * self, gconstpointer address);
 static gpointer gum_slab_reserve (GumSlab * self, gsize size);
 static gpointer gum_slab_try_reserve (GumSlab * self, gsize size);
 
@@ -633,6 +841,17 @@ gum_stalker_init (GumStalker * self)
 
   self->exclusions = g_array_new (FALSE, FALSE, sizeof (GumMemoryRange));
   self->trust_threshold = 1;
+  self->ic_entries = 2;
+  self->ic_hit_counting_enabled = FALSE;
+
+  self->trace_formation_enabled = FALSE;
+  self->trace_hotness_threshold = 32;
+
+  self->page_write_tracking_enabled = FALSE;
+  gum_spinlock_init (&self->tracked_page_lock);
+  self->tracked_pages = gum_metal_hash_table_new_full (NULL, NULL, NULL,
+      gum_free);
+  self->page_writes = 1;
 
   gum_spinlock_init (&self->probe_lock);
   self->probe_target_by_id = g_hash_table_new_full (NULL, NULL, NULL, NULL);
@@ -743,9 +962,11 @@ gum_stalker_init (GumStalker * self)
 static void
 gum_stalker_dispose (GObject * object)
 {
-#ifdef HAVE_WINDOWS
   GumStalker * self = GUM_STALKER (object);
 
+  gum_stalker_set_page_write_tracking_enabled (self, FALSE);
+
+#ifdef HAVE_WINDOWS
   if (self->exceptor != NULL)
   {
     gum_exceptor_remove (self->exceptor, gum_stalker_on_exception, self);
@@ -769,6 +990,8 @@ gum_stalker_finalize (GObject * object)
   g_hash_table_unref (self->probe_array_by_address);
   g_hash_table_unref (self->probe_target_by_id);
 
+  gum_metal_hash_table_unref (self->tracked_pages);
+
   g_array_free (self->exclusions, TRUE);
 
   g_assert (self->contexts == NULL);
@@ -822,6 +1045,143 @@ gum_stalker_set_trust_threshold (GumStalker * self,
   self->trust_threshold = trust_threshold;
 }
 
+guint
+gum_stalker_get_ic_entries (GumStalker * self)
+{
+  return self->ic_entries;
+}
+
+void
+gum_stalker_set_ic_entries (GumStalker * self,
+                            guint ic_entries)
+{
+  g_return_if_fail (ic_entries >= 2 &&
+      ic_entries <= GUM_STALKER_MAX_IC_ENTRIES);
+
+  self->ic_entries = ic_entries;
+}
+
+gboolean
+gum_stalker_get_ic_hit_counting_enabled (GumStalker * self)
+{
+  return self->ic_hit_counting_enabled;
+}
+
+void
+gum_stalker_set_ic_hit_counting_enabled (GumStalker * self,
+                                         gboolean enabled)
+{
+  self->ic_hit_counting_enabled = enabled;
+}
+
+gsize
+gum_stalker_get_cache_budget (GumStalker * self)
+{
+  return self->cache_budget;
+}
+
+void
+gum_stalker_set_cache_budget (GumStalker * self,
+                              gsize budget)
+{
+  self->cache_budget = budget;
+}
+
+void
+gum_stalker_query_stats (GumStalker * self,
+                         GumFoundStalkerStatsFunc func,
+                         gpointer user_data)
+{
+  GArray * snapshot;
+  GSList * cur;
+  guint i;
+
+  snapshot = g_array_new (FALSE, TRUE, sizeof (GumStalkerStats));
+
+  GUM_STALKER_LOCK (self);
+
+  for (cur = self->contexts; cur != NULL; cur = cur->next)
+  {
+    GumExecCtx * ctx = cur->data;
+
+    g_array_set_size (snapshot, snapshot->len + 1);
+    gum_exec_ctx_query_stats (ctx,
+        &g_array_index (snapshot, GumStalkerStats, snapshot->len - 1));
+  }
+
+  GUM_STALKER_UNLOCK (self);
+
+  for (i = 0; i != snapshot->len; i++)
+  {
+    if (!func (&g_array_index (snapshot, GumStalkerStats, i), user_data))
+      break;
+  }
+
+  g_array_free (snapshot, TRUE);
+}
+
+gboolean
+gum_stalker_get_page_write_tracking_enabled (GumStalker * self)
+{
+  return self->page_write_tracking_enabled;
+}
+
+void
+gum_stalker_set_page_write_tracking_enabled (GumStalker * self,
+                                             gboolean enabled)
+{
+  if (enabled == self->page_write_tracking_enabled)
+    return;
+
+  if (enabled)
+  {
+    self->page_write_exceptor = gum_exceptor_obtain ();
+    gum_exceptor_add (self->page_write_exceptor,
+        gum_stalker_on_tracked_page_write, self);
+
+    self->page_write_tracking_enabled = TRUE;
+  }
+  else
+  {
+    self->page_write_tracking_enabled = FALSE;
+
+    gum_stalker_unprotect_tracked_pages (self);
+
+    gum_exceptor_remove (self->page_write_exceptor,
+        gum_stalker_on_tracked_page_write, self);
+    g_object_unref (self->page_write_exceptor);
+    self->page_write_exceptor = NULL;
+  }
+}
+
+gboolean
+gum_stalker_get_trace_formation_enabled (GumStalker * self)
+{
+  return self->trace_formation_enabled;
+}
+
+void
+gum_stalker_set_trace_formation_enabled (GumStalker * self,
+                                         gboolean enabled)
+{
+  self->trace_formation_enabled = enabled;
+}
+
+guint
+gum_stalker_get_trace_hotness_threshold (GumStalker * self)
+{
+  return self->trace_hotness_threshold;
+}
+
+void
+gum_stalker_set_trace_hotness_threshold (GumStalker * self,
+                                         guint threshold)
+{
+  g_return_if_fail (threshold >= 1);
+
+  self->trace_hotness_threshold = threshold;
+}
+
 void
 gum_stalker_flush (GumStalker * self)
 {
@@ -1332,6 +1692,227 @@ gum_stalker_prefetch (GumStalker * self,
   block->recycle_count = recycle_count;
 }
 
+GBytes *
+gum_stalker_export_blocks (GumStalker * self,
+                           GumThreadId thread_id)
+{
+  GumActivation activation;
+  GumExecCtx * ctx;
+  GumMetalArray blocks, backpatches;
+  GumMetalHashTableIter iter;
+  GumExecBlock * block;
+  GByteArray * result;
+  GumBlockSetHeader header;
+  guint n_entries, i;
+
+  gum_stalker_maybe_deactivate (self, &activation);
+
+  ctx = gum_stalker_find_exec_ctx_by_thread_id (self, thread_id);
+  if (ctx == NULL)
+  {
+    gum_stalker_maybe_reactivate (self, &activation);
+    return NULL;
+  }
+
+  gum_metal_array_init (&blocks, sizeof (GumExportedBlock));
+  gum_metal_array_init (&backpatches, sizeof (GumBackpatchRecord));
+
+  /*
+   * The thread may be running while we take this snapshot, so only use metal
+   * allocations while holding its code lock.
+   */
+  gum_spinlock_acquire (&ctx->code_lock);
+
+  gum_metal_array_ensure_capacity (&blocks,
+      gum_metal_hash_table_size (ctx->mappings));
+  gum_metal_hash_table_iter_init (&iter, ctx->mappings);
+  while (gum_metal_hash_table_iter_next (&iter, NULL, (gpointer *) &block))
+  {
+    GumExportedBlock * b = gum_metal_array_append (&blocks);
+
+    b->real_start = block->real_start;
+    b->code_start = block->code_start;
+    b->code_size = (block->storage_block == NULL) ? block->code_size : 0;
+    b->recycle_count = block->recycle_count;
+  }
+
+  if (ctx->backpatches.length != 0)
+  {
+    gum_metal_array_ensure_capacity (&backpatches, ctx->backpatches.length);
+    memcpy (backpatches.data, ctx->backpatches.data,
+        ctx->backpatches.length * sizeof (GumBackpatchRecord));
+    backpatches.length = ctx->backpatches.length;
+  }
+
+  gum_spinlock_release (&ctx->code_lock);
+
+  gum_stalker_maybe_reactivate (self, &activation);
+
+  qsort (blocks.data, blocks.length, sizeof (GumExportedBlock),
+      gum_compare_exported_blocks);
+
+  result = g_byte_array_sized_new (sizeof (GumBlockSetHeader) +
+      ((blocks.length + backpatches.length) * sizeof (GumBlockSetEntry)));
+  g_byte_array_set_size (result, sizeof (GumBlockSetHeader));
+
+  n_entries = 0;
+
+  for (i = 0; i != blocks.length; i++)
+  {
+    const GumExportedBlock * b = gum_metal_array_element_at (&blocks, i);
+    GumBlockSetEntry e = { 0, };
+
+    e.type = GUM_BLOCK_SET_ENTRY_BLOCK;
+    e.recycle_count = b->recycle_count;
+    e.from_code_size = b->code_size;
+    e.from = GUM_ADDRESS (b->real_start);
+
+    g_byte_array_append (result, (const guint8 *) &e, sizeof (e));
+    n_entries++;
+  }
+
+  for (i = 0; i != backpatches.length; i++)
+  {
+    const GumBackpatchRecord * r = gum_metal_array_element_at (&backpatches, i);
+    const GumExportedBlock * from;
+    GumBlockSetEntry e = { 0, };
+
+    from = gum_find_exported_block (&blocks, r->code_start);
+    if (from == NULL)
+      continue;
+
+    e.type = r->type;
+    e.opened_prolog = r->opened_prolog;
+    e.from_code_size = from->code_size;
+    e.code_offset = r->code_start - from->code_start;
+    e.from = GUM_ADDRESS (from->real_start);
+    e.to = GUM_ADDRESS (r->target);
+
+    if (r->type == GUM_BLOCK_SET_ENTRY_CALL)
+    {
+      if (r->ret_code_address < r->code_start ||
+          r->ret_code_address > from->code_start + from->code_size)
+      {
+        continue;
+      }
+
+      e.ret_code_offset = r->ret_code_address - from->code_start;
+      e.ret_real_address = GUM_ADDRESS (r->ret_real_address);
+    }
+
+    g_byte_array_append (result, (const guint8 *) &e, sizeof (e));
+    n_entries++;
+  }
+
+  gum_metal_array_free (&backpatches);
+  gum_metal_array_free (&blocks);
+
+  header.magic = GUM_BLOCK_SET_MAGIC;
+  header.version = GUM_BLOCK_SET_VERSION;
+  header.n_entries = n_entries;
+  header.reserved = 0;
+  memcpy (result->data, &header, sizeof (header));
+
+  return g_byte_array_free_to_bytes (result);
+}
+
+gboolean
+gum_stalker_replay_blocks (GumStalker * self,
+                           GBytes * blocks)
+{
+  GumExecCtx * ctx;
+  const guint8 * data;
+  gsize size;
+  GumBlockSetHeader header;
+  const GumBlockSetEntry * entries;
+  guint i;
+
+  ctx = gum_stalker_get_exec_ctx (self);
+  g_assert (ctx != NULL);
+
+  data = g_bytes_get_data (blocks, &size);
+  if (size < sizeof (header))
+    return FALSE;
+  memcpy (&header, data, sizeof (header));
+
+  if (header.magic != GUM_BLOCK_SET_MAGIC ||
+      header.version != GUM_BLOCK_SET_VERSION)
+  {
+    return FALSE;
+  }
+
+  if ((size - sizeof (header)) / sizeof (GumBlockSetEntry) < header.n_entries)
+    return FALSE;
+
+  entries = (const GumBlockSetEntry *) (data + sizeof (header));
+
+  /*
+   * Compile every block first, so that both ends of each backpatch are in
+   * place and trusted by the time we get to them.
+   */
+  for (i = 0; i != header.n_entries; i++)
+  {
+    const GumBlockSetEntry * e = &entries[i];
+    GumExecBlock * block;
+    gpointer code_address;
+
+    if (e->type != GUM_BLOCK_SET_ENTRY_BLOCK)
+      continue;
+
+    block = gum_exec_ctx_obtain_block_for (ctx, GSIZE_TO_POINTER (e->from),
+        &code_address);
+    block->recycle_count = MAX (block->recycle_count, e->recycle_count);
+  }
+
+  for (i = 0; i != header.n_entries; i++)
+  {
+    const GumBlockSetEntry * e = &entries[i];
+
+    if (e->type != GUM_BLOCK_SET_ENTRY_BLOCK)
+      gum_exec_ctx_replay_backpatch (ctx, e);
+  }
+
+  return TRUE;
+}
+
+static gint
+gum_compare_exported_blocks (gconstpointer a,
+                             gconstpointer b)
+{
+  const GumExportedBlock * lhs = a;
+  const GumExportedBlock * rhs = b;
+
+  if (lhs->code_start < rhs->code_start)
+    return -1;
+  if (lhs->code_start > rhs->code_start)
+    return 1;
+  return 0;
+}
+
+static const GumExportedBlock *
+gum_find_exported_block (GumMetalArray * blocks,
+                         gconstpointer code_address)
+{
+  guint lo, hi;
+
+  lo = 0;
+  hi = blocks->length;
+  while (lo != hi)
+  {
+    guint mid = lo + ((hi - lo) / 2);
+    const GumExportedBlock * b = gum_metal_array_element_at (blocks, mid);
+
+    if ((const guint8 *) code_address < b->code_start)
+      hi = mid;
+    else if ((const guint8 *) code_address >= b->code_start + b->code_size)
+      lo = mid + 1;
+    else
+      return b;
+  }
+
+  return NULL;
+}
+
 void
 gum_stalker_invalidate (GumStalker * self,
                         gconstpointer address)
@@ -1403,27 +1984,50 @@ gum_stalker_do_invalidate (GumExecCtx * ctx,
                            gconstpointer address,
                            GumActivation * activation)
 {
-  GumInvalidateContext ic;
-
-  ic.is_executing_target_block = FALSE;
+  gboolean is_done = TRUE;
+  GumExecBlock * block;
 
   gum_spinlock_acquire (&ctx->code_lock);
 
-  if ((ic.block = gum_metal_hash_table_lookup (ctx->mappings, address)) != NULL)
+  if ((block = gum_metal_hash_table_lookup (ctx->mappings, address)) != NULL)
   {
-    if (ctx == activation->ctx)
-    {
-      gum_exec_block_invalidate (ic.block);
-    }
-    else
+    GumExecBlock * head = block->folded_into;
+
+    is_done = gum_stalker_do_invalidate_block (ctx, block, activation);
+
+    /* The trace carries its own copy of the block. */
+    if (head != NULL &&
+        !gum_stalker_do_invalidate_block (ctx, head, activation))
     {
-      gum_process_modify_thread (ctx->thread_id,
-          gum_stalker_try_invalidate_block_owned_by_thread, &ic);
+      is_done = FALSE;
     }
   }
 
   gum_spinlock_release (&ctx->code_lock);
 
+  return is_done;
+}
+
+static gboolean
+gum_stalker_do_invalidate_block (GumExecCtx * ctx,
+                                 GumExecBlock * block,
+                                 GumActivation * activation)
+{
+  GumInvalidateContext ic;
+
+  ic.block = block;
+  ic.is_executing_target_block = FALSE;
+
+  if (ctx == activation->ctx)
+  {
+    gum_exec_block_invalidate (block);
+  }
+  else
+  {
+    gum_process_modify_thread (ctx->thread_id,
+        gum_stalker_try_invalidate_block_owned_by_thread, &ic);
+  }
+
   return !ic.is_executing_target_block;
 }
 
@@ -1582,6 +2186,148 @@ gum_call_probe_unref (GumCallProbe * probe)
   }
 }
 
+static gboolean
+gum_stalker_write_protect (GumStalker * self,
+                           gconstpointer address,
+                           gsize size)
+{
+  const gsize page_size = self->page_size;
+  gboolean is_tracked = TRUE;
+  gsize page, last_page;
+
+  page = GPOINTER_TO_SIZE (address) & ~(page_size - 1);
+  last_page = (GPOINTER_TO_SIZE (address) + size - 1) & ~(page_size - 1);
+
+  gum_spinlock_acquire (&self->tracked_page_lock);
+
+  for (; page <= last_page; page += page_size)
+  {
+    gpointer base = GSIZE_TO_POINTER (page);
+    GumTrackedPage * tracked;
+
+    tracked = gum_metal_hash_table_lookup (self->tracked_pages, base);
+    if (tracked != NULL && tracked->write_protected)
+      continue;
+
+    /* Stop fighting over pages that are written to all the time. */
+    if (tracked != NULL &&
+        tracked->write_faults >= GUM_TRACKED_PAGE_MAX_WRITE_FAULTS)
+    {
+      is_tracked = FALSE;
+      break;
+    }
+
+    /*
+     * The owner may have changed the protection since we last restored it,
+     * so look it up again before taking write access away.
+     */
+    if (tracked == NULL || (tracked->protection & GUM_PAGE_WRITE) != 0)
+    {
+      GumPageProtection prot;
+
+      if (!gum_memory_query_protection (base, &prot))
+      {
+        is_tracked = FALSE;
+        break;
+      }
+
+      if (tracked == NULL)
+      {
+        tracked = gum_malloc (sizeof (GumTrackedPage));
+        tracked->write_protected = FALSE;
+        tracked->write_faults = 0;
+        gum_metal_hash_table_insert (self->tracked_pages, base, tracked);
+      }
+      tracked->protection = prot;
+    }
+
+    /*
+     * Pages that aren't writable can only change through a protection flip,
+     * e.g. by a W^X JIT, which doesn't fault and so is only caught by the
+     * snapshot comparison.
+     */
+    if ((tracked->protection & GUM_PAGE_WRITE) == 0 ||
+        !gum_try_mprotect (base, page_size,
+            tracked->protection & ~GUM_PAGE_WRITE))
+    {
+      is_tracked = FALSE;
+      break;
+    }
+
+    tracked->write_protected = TRUE;
+  }
+
+  gum_spinlock_release (&self->tracked_page_lock);
+
+  return is_tracked;
+}
+
+static void
+gum_stalker_unprotect_tracked_pages (GumStalker * self)
+{
+  GumMetalHashTableIter iter;
+  gpointer base;
+  GumTrackedPage * tracked;
+
+  gum_spinlock_acquire (&self->tracked_page_lock);
+
+  gum_metal_hash_table_iter_init (&iter, self->tracked_pages);
+  while (gum_metal_hash_table_iter_next (&iter, &base, (gpointer *) &tracked))
+  {
+    GumPageProtection prot;
+
+    /* Leave the page alone if it got remapped behind our back. */
+    if (tracked->write_protected &&
+        gum_memory_query_protection (base, &prot) &&
+        prot == (tracked->protection & ~GUM_PAGE_WRITE))
+    {
+      gum_try_mprotect (base, self->page_size, tracked->protection);
+    }
+  }
+  gum_metal_hash_table_remove_all (self->tracked_pages);
+
+  g_atomic_int_inc (&self->page_writes);
+
+  gum_spinlock_release (&self->tracked_page_lock);
+}
+
+static gboolean
+gum_stalker_on_tracked_page_write (GumExceptionDetails * details,
+                                   gpointer user_data)
+{
+  GumStalker * self = GUM_STALKER (user_data);
+  gpointer base;
+  GumTrackedPage * tracked;
+  gboolean handled = FALSE;
+
+  if (details->type != GUM_EXCEPTION_ACCESS_VIOLATION ||
+      details->memory.operation != GUM_MEMOP_WRITE)
+  {
+    return FALSE;
+  }
+
+  base = GSIZE_TO_POINTER (GPOINTER_TO_SIZE (details->memory.address) &
+      ~(self->page_size - 1));
+
+  gum_spinlock_acquire (&self->tracked_page_lock);
+
+  tracked = gum_metal_hash_table_lookup (self->tracked_pages, base);
+  if (tracked != NULL && tracked->write_protected)
+  {
+    gum_try_mprotect (base, self->page_size, tracked->protection);
+    tracked->write_protected = FALSE;
+    tracked->write_faults++;
+
+    g_atomic_int_inc (&self->page_writes);
+
+    handled = TRUE;
+  }
+
+  gum_spinlock_release (&self->tracked_page_lock);
+
+  return handled;
+}
+
 static GumExecCtx *
 gum_stalker_create_exec_ctx (GumStalker * self,
                              GumThreadId thread_id,
@@ -1731,6 +2477,11 @@ gum_exec_ctx_new (GumStalker * stalker,
   ctx->thunks = base + stalker->thunks_offset;
   ctx->infect_thunk = ctx->thunks;
 
+  ctx->ic_entries = stalker->ic_entries;
+  ctx->count_ic_hits = stalker->ic_hit_counting_enabled;
+  ctx->block_min_capacity = GUM_EXEC_BLOCK_MIN_CAPACITY +
+      ((ctx->ic_entries - 2) * GUM_IC_ENTRY_MAX_SIZE);
+
   gum_spinlock_init (&ctx->code_lock);
 
   code_slab = (GumCodeSlab *) (base + stalker->code_slab_offset);
@@ -1746,6 +2497,7 @@ gum_exec_ctx_new (GumStalker * stalker,
   gum_scratch_slab_init (ctx->scratch_slab, stalker->scratch_slab_size);
 
   ctx->mappings = gum_metal_hash_table_new (NULL, NULL);
+  gum_metal_array_init (&ctx->backpatches, sizeof (GumBackpatchRecord));
 
   gum_exec_ctx_ensure_inline_helpers_reachable (ctx);
 
@@ -1758,40 +2510,12 @@ static void
 gum_exec_ctx_free (GumExecCtx * ctx)
 {
   GumStalker * stalker = ctx->stalker;
-  GumDataSlab * data_slab;
-  GumCodeSlab * code_slab;
 
+  gum_metal_array_free (&ctx->backpatches);
   gum_metal_hash_table_unref (ctx->mappings);
 
-  data_slab = ctx->data_slab;
-  while (TRUE)
-  {
-    GumDataSlab * next = (GumDataSlab *) data_slab->slab.next;
-    gboolean is_initial;
-
-    is_initial = next == NULL;
-    if (is_initial)
-      break;
-
-    gum_data_slab_free (data_slab);
-
-    data_slab = next;
-  }
-
-  code_slab = ctx->code_slab;
-  while (TRUE)
-  {
-    GumCodeSlab * next = (GumCodeSlab *) code_slab->slab.next;
-    gboolean is_initial;
-
-    is_initial = next == NULL;
-    if (is_initial)
-      break;
-
-    gum_code_slab_free (code_slab);
-
-    code_slab = next;
-  }
+  gum_exec_ctx_free_retired_slabs (ctx);
+  gum_exec_ctx_free_slabs (ctx, ctx->code_slab, ctx->data_slab);
 
   g_object_unref (ctx->sink);
   g_object_unref (ctx->transformer);
@@ -1815,6 +2539,35 @@ gum_exec_ctx_dispose (GumExecCtx * ctx)
     gum_stalker_thaw (stalker, gum_slab_start (slab), slab->offset);
   }
 
+  gum_exec_ctx_clear_blocks (ctx);
+}
+
+static GumCodeSlab *
+gum_exec_ctx_add_code_slab (GumExecCtx * ctx,
+                            GumCodeSlab * code_slab)
+{
+  code_slab->slab.next = &ctx->code_slab->slab;
+  ctx->code_slab = code_slab;
+  ctx->cache_size += gum_slab_footprint (&code_slab->slab);
+  return code_slab;
+}
+
+static GumDataSlab *
+gum_exec_ctx_add_data_slab (GumExecCtx * ctx,
+                            GumDataSlab * data_slab)
+{
+  data_slab->slab.next = &ctx->data_slab->slab;
+  ctx->data_slab = data_slab;
+  ctx->cache_size += gum_slab_footprint (&data_slab->slab);
+  ctx->data_bytes += gum_slab_footprint (&data_slab->slab);
+  return data_slab;
+}
+
+static void
+gum_exec_ctx_clear_blocks (GumExecCtx * ctx)
+{
+  GumSlab * slab;
+
   for (slab = &ctx->data_slab->slab; slab != NULL; slab = slab->next)
   {
     GumExecBlock * blocks;
@@ -1833,22 +2586,162 @@ gum_exec_ctx_dispose (GumExecCtx * ctx)
   }
 }
 
-static GumCodeSlab *
-gum_exec_ctx_add_code_slab (GumExecCtx * ctx,
-                            GumCodeSlab * code_slab)
+static void
+gum_exec_ctx_free_slabs (GumExecCtx * ctx,
+                         GumCodeSlab * code_slab,
+                         GumDataSlab * data_slab)
 {
-  code_slab->slab.next = &ctx->code_slab->slab;
-  ctx->code_slab = code_slab;
-  return code_slab;
+  while (data_slab != NULL)
+  {
+    GumDataSlab * next = (GumDataSlab *) data_slab->slab.next;
+
+    if (!gum_exec_ctx_is_initial_slab (ctx, &data_slab->slab))
+      gum_data_slab_free (data_slab);
+
+    data_slab = next;
+  }
+
+  while (code_slab != NULL)
+  {
+    GumCodeSlab * next = (GumCodeSlab *) code_slab->slab.next;
+
+    if (!gum_exec_ctx_is_initial_slab (ctx, &code_slab->slab))
+      gum_code_slab_free (code_slab);
+
+    code_slab = next;
+  }
 }
 
-static GumDataSlab *
-gum_exec_ctx_add_data_slab (GumExecCtx * ctx,
-                            GumDataSlab * data_slab)
+static gboolean
+gum_exec_ctx_is_initial_slab (GumExecCtx * ctx,
+                              GumSlab * slab)
 {
-  data_slab->slab.next = &ctx->data_slab->slab;
-  ctx->data_slab = data_slab;
-  return data_slab;
+  GumStalker * stalker = ctx->stalker;
+  const guint8 * base = (const guint8 *) ctx;
+
+  /* The initial slabs live inside the GumExecCtx allocation. */
+  return (const guint8 *) slab == base + stalker->code_slab_offset ||
+      (const guint8 *) slab == base + stalker->data_slab_offset;
+}
+
+static void
+gum_exec_ctx_maybe_flush_code_cache (GumExecCtx * ctx,
+                                     gpointer real_address)
+{
+  GumStalker * stalker = ctx->stalker;
+  const gsize budget = stalker->cache_budget;
+  gboolean over_budget;
+
+  if (budget == 0)
+    return;
+
+  /*
+   * Only flush while no code from the current generation can be resumed
+   * later on, i.e. when not nested inside an excluded call or a callout.
+   */
+  if (ctx->pending_calls > 0)
+    return;
+
+  gum_spinlock_acquire (&ctx->code_lock);
+
+  over_budget =
+      gum_slab_available (&ctx->code_slab->slab) < ctx->block_min_capacity &&
+      ctx->cache_size + stalker->code_slab_size_dynamic > budget &&
+      gum_metal_hash_table_lookup (ctx->mappings, real_address) == NULL;
+  if (over_budget)
+    gum_exec_ctx_flush_code_cache (ctx);
+
+  gum_spinlock_release (&ctx->code_lock);
+}
+
+static void
+gum_exec_ctx_flush_code_cache (GumExecCtx * ctx)
+{
+  GumStalker * stalker = ctx->stalker;
+  GumCodeSlab * initial_code_slab;
+  GumDataSlab * initial_data_slab;
+  gboolean initial_slabs_in_use;
+  GumSlab * slab;
+
+  gum_exec_ctx_free_retired_slabs (ctx);
+
+  ctx->cache_flushes++;
+  ctx->evicted_blocks += gum_metal_hash_table_size (ctx->mappings);
+  ctx->evicted_bytes += ctx->cache_size;
+
+  gum_exec_ctx_clear_blocks (ctx);
+  gum_metal_hash_table_remove_all (ctx->mappings);
+  gum_metal_array_remove_all (&ctx->backpatches);
+
+  /*
+   * The caller is still executing code from the current generation, so we
+   * retire its slabs rather than freeing them right away. They get freed
+   * upon the next transition, once we are running code from the new one.
+   * Nothing links into them from the new generation, and the frames that
+   * refer to them are dropped so that returns get resolved dynamically.
+   */
+  ctx->retired_code_slab = ctx->code_slab;
+  ctx->retired_data_slab = ctx->data_slab;
+  ctx->code_slab = NULL;
+  ctx->data_slab = NULL;
+  ctx->cache_size = 0;
+  ctx->code_bytes = 0;
+  ctx->data_bytes = 0;
+
+  ctx->current_frame = ctx->first_frame;
+
+  initial_code_slab =
+      (GumCodeSlab *) ((guint8 *) ctx + stalker->code_slab_offset);
+  initial_data_slab =
+      (GumDataSlab *) ((guint8 *) ctx + stalker->data_slab_offset);
+  initial_slabs_in_use = FALSE;
+  for (slab = &ctx->retired_code_slab->slab; slab != NULL; slab = slab->next)
+  {
+    if (slab == &initial_code_slab->slab)
+      initial_slabs_in_use = TRUE;
+  }
+
+  if (initial_slabs_in_use)
+  {
+    gum_exec_ctx_add_code_slab (ctx, gum_code_slab_new (ctx));
+    gum_exec_ctx_add_data_slab (ctx, gum_data_slab_new (ctx));
+  }
+  else
+  {
+    gum_code_slab_init (initial_code_slab, stalker->code_slab_size_initial,
+        stalker->page_size);
+    gum_exec_ctx_add_code_slab (ctx, initial_code_slab);
+
+    /* Blocks expect to be carved out of zeroed memory. */
+    memset (gum_slab_start (&initial_data_slab->slab), 0,
+        initial_data_slab->slab.offset);
+    gum_data_slab_init (initial_data_slab, stalker->data_slab_size_initial);
+    gum_exec_ctx_add_data_slab (ctx, initial_data_slab);
+  }
+
+  ctx->last_prolog_minimal = NULL;
+  ctx->last_epilog_minimal = NULL;
+  ctx->last_prolog_full = NULL;
+  ctx->last_epilog_full = NULL;
+  ctx->last_stack_push = NULL;
+  ctx->last_stack_pop_and_go = NULL;
+  ctx->last_invalidator = NULL;
+  gum_exec_ctx_ensure_inline_helpers_reachable (ctx);
+
+  ctx->code_slab->invalidator = ctx->last_invalidator;
+}
+
+static void
+gum_exec_ctx_free_retired_slabs (GumExecCtx * ctx)
+{
+  if (ctx->retired_code_slab == NULL)
+    return;
+
+  gum_exec_ctx_free_slabs (ctx, ctx->retired_code_slab,
+      ctx->retired_data_slab);
+
+  ctx->retired_code_slab = NULL;
+  ctx->retired_data_slab = NULL;
 }
 
 static void
@@ -1914,34 +2807,46 @@ static gboolean
 gum_exec_ctx_contains (GumExecCtx * ctx,
                        gconstpointer address)
 {
-  GumSlab * cur = &ctx->code_slab->slab;
-
-  do {
-    if ((const guint8 *) address >= cur->data &&
-        (const guint8 *) address < (guint8 *) gum_slab_cursor (cur))
-    {
-      return TRUE;
-    }
+  return gum_slab_list_contains (&ctx->code_slab->slab, address);
+}
 
-    cur = cur->next;
-  } while (cur != NULL);
+static gboolean
+gum_exec_ctx_is_retired (GumExecCtx * ctx,
+                         gconstpointer address)
+{
+  if (ctx->retired_code_slab == NULL)
+    return FALSE;
 
-  return FALSE;
+  return gum_slab_list_contains (&ctx->retired_code_slab->slab, address);
 }
 
 static gboolean
 gum_exec_ctx_may_now_backpatch (GumExecCtx * ctx,
+                                gconstpointer code_start,
                                 GumExecBlock * target_block)
 {
   if (g_atomic_int_get (&ctx->state) != GUM_EXEC_CTX_ACTIVE)
     return FALSE;
 
+  if (gum_exec_ctx_is_retired (ctx, code_start))
+    return FALSE;
+
   if ((target_block->flags & GUM_EXEC_BLOCK_ACTIVATION_TARGET) != 0)
     return FALSE;
 
   if (target_block->recycle_count < ctx->stalker->trust_threshold)
     return FALSE;
 
+  /*
+   * Keep dispatching to blocks that are still being profiled, as that's the
+   * only place their executions get counted.
+   */
+  if (ctx->stalker->trace_formation_enabled &&
+      target_block->exec_count < ctx->stalker->trace_hotness_threshold)
+  {
+    return FALSE;
+  }
+
   return TRUE;
 }
 
@@ -1960,11 +2865,15 @@ static guint total_transitions = 0;
     { \
       if (counters_enabled) \
         total_##name##s++; \
+      ctx->entrygate_hits.name++; \
       \
       return gum_exec_ctx_switch_block (ctx, start_address); \
     }
 #define GUM_PRINT_ENTRYGATE_COUNTER(name) \
     g_printerr ("\t" G_STRINGIFY (name) "s: %u\n", total_##name##s)
+#define GUM_COLLECT_ENTRYGATE_HITS(name) \
+    gum_stalker_stats_add_entry_gate (stats, G_STRINGIFY (name), \
+        ctx->entrygate_hits.name)
 
 #if GLIB_SIZEOF_VOID_P == 4 && !defined (HAVE_QNX)
 GUM_DEFINE_ENTRYGATE (sysenter_slow_path)
@@ -1988,6 +2897,67 @@ GUM_DEFINE_ENTRYGATE (jmp_cond_jcxz)
 
 GUM_DEFINE_ENTRYGATE (jmp_continuation)
 
+static void
+gum_exec_ctx_query_stats (GumExecCtx * ctx,
+                          GumStalkerStats * stats)
+{
+  stats->thread_id = ctx->thread_id;
+
+  stats->blocks_compiled = ctx->blocks_compiled;
+  stats->blocks_recompiled = ctx->blocks_recompiled;
+  stats->traces_formed = ctx->traces_formed;
+  stats->snapshot_comparisons = ctx->snapshot_comparisons;
+
+  stats->code_bytes = ctx->code_bytes;
+  stats->data_bytes = ctx->data_bytes;
+
+  stats->ic_hits = ctx->ic_hits;
+  stats->ic_misses = ctx->ic_misses;
+  stats->backpatches = ctx->backpatches_applied;
+
+  stats->cache_flushes = ctx->cache_flushes;
+  stats->evicted_blocks = ctx->evicted_blocks;
+  stats->evicted_bytes = ctx->evicted_bytes;
+
+  stats->num_entry_gates = 0;
+
+#if GLIB_SIZEOF_VOID_P == 4 && !defined (HAVE_QNX)
+  GUM_COLLECT_ENTRYGATE_HITS (sysenter_slow_path);
+#endif
+
+  GUM_COLLECT_ENTRYGATE_HITS (call_imm);
+  GUM_COLLECT_ENTRYGATE_HITS (call_reg);
+  GUM_COLLECT_ENTRYGATE_HITS (call_mem);
+  GUM_COLLECT_ENTRYGATE_HITS (post_call_invoke);
+  GUM_COLLECT_ENTRYGATE_HITS (excluded_call_imm);
+  GUM_COLLECT_ENTRYGATE_HITS (ret_slow_path);
+
+  GUM_COLLECT_ENTRYGATE_HITS (jmp_imm);
+  GUM_COLLECT_ENTRYGATE_HITS (jmp_mem);
+  GUM_COLLECT_ENTRYGATE_HITS (jmp_reg);
+
+  GUM_COLLECT_ENTRYGATE_HITS (jmp_cond_imm);
+  GUM_COLLECT_ENTRYGATE_HITS (jmp_cond_mem);
+  GUM_COLLECT_ENTRYGATE_HITS (jmp_cond_reg);
+  GUM_COLLECT_ENTRYGATE_HITS (jmp_cond_jcxz);
+
+  GUM_COLLECT_ENTRYGATE_HITS (jmp_continuation);
+}
+
+static void
+gum_stalker_stats_add_entry_gate (GumStalkerStats * stats,
+                                  const gchar * name,
+                                  guint64 hits)
+{
+  GumStalkerEntryGateStats * gate;
+
+  g_assert (stats->num_entry_gates != GUM_STALKER_MAX_ENTRY_GATES);
+
+  gate = &stats->entry_gates[stats->num_entry_gates++];
+  gate->name = name;
+  gate->hits = hits;
+}
+
 static gpointer GUM_THUNK
 gum_exec_ctx_switch_block (GumExecCtx * ctx,
                            gpointer start_address)
@@ -1995,6 +2965,8 @@ gum_exec_ctx_switch_block (GumExecCtx * ctx,
   if (counters_enabled)
     total_transitions++;
 
+  gum_exec_ctx_free_retired_slabs (ctx);
+
   if (start_address == gum_stalker_unfollow_me ||
       start_address == gum_stalker_deactivate)
   {
@@ -2015,6 +2987,8 @@ gum_exec_ctx_switch_block (GumExecCtx * ctx,
   }
   else
   {
+    gum_exec_ctx_maybe_flush_code_cache (ctx, start_address);
+
     ctx->current_block = gum_exec_ctx_obtain_block_for (ctx, start_address,
         &ctx->resume_at);
 
@@ -2074,8 +3048,8 @@ gum_exec_ctx_obtain_block_for (GumExecCtx * ctx,
 
     still_up_to_date =
         (trust_threshold >= 0 && block->recycle_count >= trust_threshold) ||
-        memcmp (block->real_start, gum_exec_block_get_snapshot_start (block),
-            block->real_size) == 0;
+        (gum_exec_block_is_unmodified (block) &&
+            gum_exec_block_trace_is_unmodified (block));
 
     gum_spinlock_release (&ctx->code_lock);
 
@@ -2083,6 +3057,9 @@ gum_exec_ctx_obtain_block_for (GumExecCtx * ctx,
     {
       if (trust_threshold > 0)
         block->recycle_count++;
+
+      if (ctx->stalker->trace_formation_enabled)
+        gum_exec_ctx_count_execution (ctx, block);
     }
     else
     {
@@ -2094,8 +3071,10 @@ gum_exec_ctx_obtain_block_for (GumExecCtx * ctx,
     block = gum_exec_block_new (ctx);
     block->real_start = real_address;
     gum_exec_ctx_compile_block (ctx, block, real_address, block->code_start,
-        GUM_ADDRESS (block->code_start), &block->real_size, &block->code_size);
+        GUM_ADDRESS (block->code_start), NULL, &block->real_size,
+        &block->code_size);
     gum_exec_block_commit (block);
+    ctx->blocks_compiled++;
 
     gum_metal_hash_table_insert (ctx->mappings, real_address, block);
 
@@ -2122,18 +3101,30 @@ gum_exec_ctx_recompile_block (GumExecCtx * ctx,
 
   gum_spinlock_acquire (&ctx->code_lock);
 
+  ctx->blocks_recompiled++;
+
   gum_stalker_thaw (stalker, internal_code, block->capacity);
 
+  gum_exec_ctx_forget_backpatches_within (ctx, internal_code,
+      block->capacity);
   if (block->storage_block != NULL)
+  {
+    gum_exec_ctx_forget_backpatches_within (ctx,
+        block->storage_block->code_start, block->storage_block->capacity);
     gum_exec_block_clear (block->storage_block);
+  }
   gum_exec_block_clear (block);
 
+  /* The trace carries a copy of the old code, so it has to go as well. */
+  if (block->folded_into != NULL)
+    gum_exec_block_invalidate (block->folded_into);
+
   slab = block->code_slab;
   block->code_slab = ctx->scratch_slab;
   scratch_base = ctx->scratch_slab->slab.data;
 
   gum_exec_ctx_compile_block (ctx, block, block->real_start, scratch_base,
-      GUM_ADDRESS (internal_code), &input_size, &output_size);
+      GUM_ADDRESS (internal_code), NULL, &input_size, &output_size);
 
   block->code_slab = slab;
 
@@ -2162,24 +3153,289 @@ gum_exec_ctx_recompile_block (GumExecCtx * ctx,
     storage_block->real_start = block->real_start;
     gum_exec_ctx_compile_block (ctx, block, block->real_start,
         storage_block->code_start, GUM_ADDRESS (storage_block->code_start),
-        &storage_block->real_size, &storage_block->code_size);
+        NULL, &storage_block->real_size, &storage_block->code_size);
     gum_exec_block_commit (storage_block);
 
     block->storage_block = storage_block;
 
-    gum_stalker_thaw (stalker, internal_code, block->capacity);
-    gum_x86_writer_reset (cw, internal_code);
+    gum_stalker_thaw (stalker, internal_code, block->capacity);
+    gum_x86_writer_reset (cw, internal_code);
+
+    gum_x86_writer_put_jmp_address (cw,
+        GUM_ADDRESS (storage_block->code_start));
+
+    gum_x86_writer_flush (cw);
+    gum_stalker_freeze (stalker, internal_code, block->capacity);
+  }
+
+  gum_spinlock_release (&ctx->code_lock);
+
+  gum_exec_ctx_maybe_emit_compile_event (ctx, block);
+}
+
+static void
+gum_exec_ctx_count_execution (GumExecCtx * ctx,
+                              GumExecBlock * block)
+{
+  const gint trust_threshold = ctx->stalker->trust_threshold;
+  const guint hotness_threshold = ctx->stalker->trace_hotness_threshold;
+
+  /*
+   * Only trusted blocks are counted, as their edges would otherwise have been
+   * backpatched, and we stop once a block is hot so it gets linked as usual.
+   */
+  if (trust_threshold < 0 || block->recycle_count < trust_threshold ||
+      block->exec_count >= hotness_threshold)
+  {
+    return;
+  }
+
+  block->exec_count++;
+
+  if (block->exec_count == hotness_threshold)
+    gum_exec_ctx_maybe_form_trace (ctx, block);
+}
+
+static void
+gum_exec_ctx_maybe_form_trace (GumExecCtx * ctx,
+                               GumExecBlock * block)
+{
+  GumStalker * stalker = ctx->stalker;
+  GumX86Writer * cw = &ctx->code_writer;
+  GumExecBlock * storage_block;
+  GumTrace * trace;
+  guint i;
+
+  if (!stalker->trace_formation_enabled || stalker->any_probes_attached)
+    return;
+
+  if (block->storage_block != NULL ||
+      (block->flags & GUM_EXEC_BLOCK_ACTIVATION_TARGET) != 0 ||
+      g_atomic_int_get (&ctx->state) != GUM_EXEC_CTX_ACTIVE)
+  {
+    return;
+  }
+
+  gum_spinlock_acquire (&ctx->code_lock);
+
+  trace = gum_malloc (sizeof (GumTrace));
+
+  storage_block = gum_exec_block_new (ctx);
+  storage_block->real_start = block->real_start;
+  gum_exec_ctx_compile_block (ctx, storage_block, block->real_start,
+      storage_block->code_start, GUM_ADDRESS (storage_block->code_start),
+      trace, &storage_block->real_size, &storage_block->code_size);
+
+  /* Nothing to gain, so leave the code uncommitted for the next block. */
+  if (trace->num_segments == 1 && trace->num_internal_branches == 0)
+  {
+    gum_exec_block_clear (storage_block);
+    gum_free (trace);
+
+    gum_spinlock_release (&ctx->code_lock);
+
+    return;
+  }
+
+  gum_exec_block_commit (storage_block);
+
+  block->storage_block = storage_block;
+  block->trace = trace;
+  ctx->traces_formed++;
+
+  for (i = 1; i != trace->num_segments; i++)
+    trace->segments[i].block->folded_into = block;
+
+  gum_stalker_thaw (stalker, block->code_start, block->capacity);
+  gum_x86_writer_reset (cw, block->code_start);
+
+  gum_x86_writer_put_jmp_address (cw, GUM_ADDRESS (storage_block->code_start));
+
+  gum_x86_writer_flush (cw);
+  gum_stalker_freeze (stalker, block->code_start, block->capacity);
+
+  gum_spinlock_release (&ctx->code_lock);
+}
+
+static gboolean
+gum_exec_ctx_may_extend_trace (GumExecCtx * ctx,
+                               const GumTrace * trace,
+                               gconstpointer address)
+{
+  GumStalker * stalker = ctx->stalker;
+  GumExecBlock * successor;
+
+  if (trace->num_segments == GUM_MAX_TRACE_SEGMENTS)
+    return FALSE;
+
+  successor = gum_metal_hash_table_lookup (ctx->mappings, address);
+  if (successor == NULL)
+    return FALSE;
+
+  /* Each block is folded into at most one trace, to keep invalidation O(1). */
+  if (successor->folded_into != NULL ||
+      (successor->flags & GUM_EXEC_BLOCK_ACTIVATION_TARGET) != 0)
+  {
+    return FALSE;
+  }
+
+  /*
+   * The head just became hot, and as neither of them has been linked until
+   * then, a successor executed at least half as often is on the same path.
+   */
+  if (successor->exec_count < MAX (stalker->trace_hotness_threshold / 2, 1))
+    return FALSE;
+
+  /*
+   * We compile the successor from its live code, so make sure that is still
+   * what it was trusted with. Without a snapshot it is trusted regardless.
+   */
+  return stalker->trust_threshold == 0 ||
+      memcmp (successor->real_start,
+          gum_exec_block_get_snapshot_start (successor),
+          successor->real_size) == 0;
+}
+
+static const GumTraceSegment *
+gum_trace_find_segment (const GumTrace * trace,
+                        gconstpointer real_start)
+{
+  guint i;
+
+  for (i = 0; i != trace->num_segments; i++)
+  {
+    if (trace->segments[i].real_start == real_start)
+      return &trace->segments[i];
+  }
+
+  return NULL;
+}
+
+static void
+gum_exec_ctx_record_backpatch (GumExecCtx * ctx,
+                               GumBlockSetEntryType type,
+                               gpointer code_start,
+                               GumExecBlock * target,
+                               GumPrologType opened_prolog,
+                               gpointer ret_real_address,
+                               gpointer ret_code_address)
+{
+  GumBackpatchRecord * r;
+
+  ctx->backpatches_applied++;
+
+  /*
+   * The journal only serves as a hint for gum_stalker_export_blocks(), so
+   * once it is full we keep applying backpatches without recording them.
+   */
+  if (ctx->backpatches.length == GUM_BLOCK_SET_MAX_BACKPATCHES)
+    return;
+
+  r = gum_metal_array_append (&ctx->backpatches);
+  r->type = type;
+  r->opened_prolog = opened_prolog;
+  r->code_start = code_start;
+  r->target = target->real_start;
+  r->ret_real_address = ret_real_address;
+  r->ret_code_address = ret_code_address;
+}
+
+static void
+gum_exec_ctx_forget_backpatches_within (GumExecCtx * ctx,
+                                        gconstpointer start,
+                                        gsize size)
+{
+  GumBackpatchRecord * records = ctx->backpatches.data;
+  guint n, i;
+
+  n = 0;
+  for (i = 0; i != ctx->backpatches.length; i++)
+  {
+    GumBackpatchRecord * r = &records[i];
+
+    if (r->code_start >= (const guint8 *) start &&
+        r->code_start < (const guint8 *) start + size)
+    {
+      continue;
+    }
+
+    if (n != i)
+      records[n] = *r;
+    n++;
+  }
+  ctx->backpatches.length = n;
+}
+
+static void
+gum_exec_ctx_replay_backpatch (GumExecCtx * ctx,
+                               const GumBlockSetEntry * entry)
+{
+  GumExecBlock * from, * to;
+  guint8 * code_start;
+
+  gum_spinlock_acquire (&ctx->code_lock);
+  from = gum_metal_hash_table_lookup (ctx->mappings,
+      GSIZE_TO_POINTER (entry->from));
+  to = gum_metal_hash_table_lookup (ctx->mappings,
+      GSIZE_TO_POINTER (entry->to));
+  gum_spinlock_release (&ctx->code_lock);
+
+  if (from == NULL || to == NULL)
+    return;
+
+  /*
+   * Offsets are only meaningful if the block compiled to the same layout as
+   * in the session that exported them.
+   */
+  if (from->storage_block != NULL ||
+      from->code_size != entry->from_code_size ||
+      entry->code_offset >= from->code_size ||
+      entry->ret_code_offset > from->code_size)
+  {
+    return;
+  }
+
+  code_start = from->code_start + entry->code_offset;
+
+  switch (entry->type)
+  {
+    case GUM_BLOCK_SET_ENTRY_CALL:
+      if (entry->ret_code_offset <= entry->code_offset)
+        break;
+      gum_exec_block_backpatch_call (to, code_start, entry->opened_prolog,
+          GSIZE_TO_POINTER (entry->ret_real_address),
+          from->code_start + entry->ret_code_offset);
+      break;
+    case GUM_BLOCK_SET_ENTRY_JMP:
+      gum_exec_block_backpatch_jmp (to, code_start, entry->opened_prolog);
+      break;
+    case GUM_BLOCK_SET_ENTRY_RET:
+      gum_exec_block_backpatch_ret (to, code_start);
+      break;
+    case GUM_BLOCK_SET_ENTRY_INLINE_CACHE:
+    {
+      gpointer * ic_entries = (gpointer *) code_start;
+      guint offset;
+
+      /*
+       * The cache may already have been filled with this target since the
+       * block was compiled, and a second entry for it would only take up a
+       * slot.
+       */
+      for (offset = 0; offset != ctx->ic_entries * 2; offset += 2)
+      {
+        if (ic_entries[offset + 0] == to->real_start)
+          break;
+      }
 
-    gum_x86_writer_put_jmp_address (cw,
-        GUM_ADDRESS (storage_block->code_start));
+      if (offset == ctx->ic_entries * 2)
+        gum_exec_block_backpatch_inline_cache (to, ic_entries);
 
-    gum_x86_writer_flush (cw);
-    gum_stalker_freeze (stalker, internal_code, block->capacity);
+      break;
+    }
+    default:
+      break;
   }
-
-  gum_spinlock_release (&ctx->code_lock);
-
-  gum_exec_ctx_maybe_emit_compile_event (ctx, block);
 }
 
 static void
@@ -2188,6 +3444,7 @@ gum_exec_ctx_compile_block (GumExecCtx * ctx,
                             gconstpointer input_code,
                             gpointer output_code,
                             GumAddress output_pc,
+                            GumTrace * trace,
                             guint * input_size,
                             guint * output_size)
 {
@@ -2210,6 +3467,21 @@ gum_exec_ctx_compile_block (GumExecCtx * ctx,
   gc.continuation_real_address = NULL;
   gc.opened_prolog = GUM_PROLOG_NONE;
   gc.accumulated_stack_delta = 0;
+  gc.trace = trace;
+
+  if (trace != NULL)
+  {
+    GumTraceSegment * head = &trace->segments[0];
+
+    head->real_start = (guint8 *) input_code;
+    head->code_start = output_pc;
+    head->block = gum_metal_hash_table_lookup (ctx->mappings, input_code);
+
+    trace->num_segments = 1;
+    trace->num_internal_branches = 0;
+    trace->head_size = 0;
+    trace->next = NULL;
+  }
 
   iterator.exec_context = ctx;
   iterator.exec_block = block;
@@ -2229,6 +3501,58 @@ gum_exec_ctx_compile_block (GumExecCtx * ctx,
   ctx->transform_block_impl (ctx->transformer, &iterator, &output);
   ctx->pending_calls--;
 
+  *input_size = rl->input_cur - rl->input_start;
+
+  if (trace != NULL)
+    trace->head_size = *input_size;
+
+  while (trace != NULL && trace->next != NULL)
+  {
+    GumTraceSegment * segment;
+    guint8 * next = trace->next;
+    GumAddress pc;
+
+    trace->next = NULL;
+
+    /*
+     * The branch into the next segment was elided, so if we're out of space
+     * it is the one that needs a transfer.
+     */
+    if (gc.continuation_real_address != NULL ||
+        gum_stalker_iterator_is_out_of_space (&iterator))
+    {
+      gc.continuation_real_address = next;
+      break;
+    }
+
+    /* Segments may overlap, so keep their labels apart. */
+    if (!gum_x86_writer_flush (cw))
+      g_error ("Failed to resolve labels");
+    pc = cw->pc;
+    gum_x86_writer_reset (cw, cw->code);
+    cw->pc = pc;
+
+    segment = &trace->segments[trace->num_segments++];
+    segment->real_start = next;
+    segment->code_start = pc;
+    segment->block = gum_metal_hash_table_lookup (ctx->mappings, next);
+
+    gum_x86_relocator_reset (rl, next, cw);
+
+    gum_ensure_code_readable (next, ctx->stalker->page_size);
+
+    gc.instruction = NULL;
+
+    iterator.instruction.ci = NULL;
+    iterator.instruction.start = NULL;
+    iterator.instruction.end = NULL;
+    iterator.requirements = GUM_REQUIRE_NOTHING;
+
+    ctx->pending_calls++;
+    ctx->transform_block_impl (ctx->transformer, &iterator, &output);
+    ctx->pending_calls--;
+  }
+
   if (gc.continuation_real_address != NULL)
   {
     GumBranchTarget continue_target = { 0, };
@@ -2246,8 +3570,7 @@ gum_exec_ctx_compile_block (GumExecCtx * ctx,
   if (!all_labels_resolved)
     g_error ("Failed to resolve labels");
 
-  *input_size = rl->input_cur - rl->input_start;
-  *output_size = gum_x86_writer_offset (cw);
+  *output_size = (guint8 *) gum_x86_writer_cur (cw) - (guint8 *) output_code;
 }
 
 static void
@@ -2313,8 +3636,19 @@ gum_stalker_iterator_next (GumStalkerIterator * self,
 
   if (is_first_instruction && (self->exec_context->sink_mask & GUM_BLOCK) != 0)
   {
-    gum_exec_block_write_block_event_code (self->exec_block, gc,
-        GUM_CODE_INTERRUPTIBLE);
+    GumExecBlock * block = self->exec_block;
+
+    /* Within a trace, each segment reports the block it was folded from. */
+    if (gc->trace != NULL)
+    {
+      GumExecBlock * segment_block =
+          gc->trace->segments[gc->trace->num_segments - 1].block;
+
+      if (segment_block != NULL)
+        block = segment_block;
+    }
+
+    gum_exec_block_write_block_event_code (block, gc, GUM_CODE_INTERRUPTIBLE);
   }
 
   if (insn != NULL)
@@ -2327,17 +3661,24 @@ static gboolean
 gum_stalker_iterator_is_out_of_space (GumStalkerIterator * self)
 {
   GumExecBlock * block = self->exec_block;
+  GumGeneratorContext * gc = self->generator_context;
   GumSlab * slab = &block->code_slab->slab;
   gsize capacity, snapshot_size;
+  guint real_size;
 
   capacity = (guint8 *) gum_slab_end (slab) -
-      (guint8 *) gum_x86_writer_cur (self->generator_context->code_writer);
+      (guint8 *) gum_x86_writer_cur (gc->code_writer);
+
+  /* Only the head of a trace is snapshotted. */
+  if (gc->trace != NULL && gc->trace->num_segments > 1)
+    real_size = gc->trace->head_size;
+  else
+    real_size = gc->instruction->end - block->real_start;
 
   snapshot_size = gum_stalker_snapshot_space_needed_for (
-      self->exec_context->stalker,
-      self->generator_context->instruction->end - block->real_start);
+      self->exec_context->stalker, real_size);
 
-  return capacity < GUM_EXEC_BLOCK_MIN_CAPACITY + snapshot_size;
+  return capacity < self->exec_context->block_min_capacity + snapshot_size;
 }
 
 void
@@ -3292,7 +4633,7 @@ gum_exec_block_new (GumExecCtx * ctx)
   gsize code_available;
 
   code_available = gum_slab_available (&code_slab->slab);
-  if (code_available < GUM_EXEC_BLOCK_MIN_CAPACITY)
+  if (code_available < ctx->block_min_capacity)
   {
     GumAddressSpec data_spec;
 
@@ -3342,6 +4683,77 @@ gum_exec_block_clear (GumExecBlock * block)
   block->last_callout_offset = 0;
 
   block->storage_block = NULL;
+
+  if (block->trace != NULL)
+  {
+    GumTrace * trace = block->trace;
+    guint i;
+
+    for (i = 1; i != trace->num_segments; i++)
+    {
+      GumExecBlock * folded = trace->segments[i].block;
+
+      if (folded->folded_into == block)
+        folded->folded_into = NULL;
+    }
+
+    gum_free (trace);
+    block->trace = NULL;
+  }
+}
+
+static gboolean
+gum_exec_block_trace_is_unmodified (GumExecBlock * block)
+{
+  const GumTrace * trace = block->trace;
+  guint i;
+
+  if (trace == NULL)
+    return TRUE;
+
+  /* The head is only compared by our caller. */
+  for (i = 1; i != trace->num_segments; i++)
+  {
+    if (!gum_exec_block_is_unmodified (trace->segments[i].block))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+gum_exec_block_is_unmodified (GumExecBlock * block)
+{
+  GumExecCtx * ctx = block->ctx;
+  GumStalker * stalker = ctx->stalker;
+  gint page_writes;
+  gboolean is_tracked, is_unmodified;
+
+  if (!stalker->page_write_tracking_enabled)
+  {
+    ctx->snapshot_comparisons++;
+    return memcmp (block->real_start, gum_exec_block_get_snapshot_start (block),
+        block->real_size) == 0;
+  }
+
+  page_writes = g_atomic_int_get (&stalker->page_writes);
+  if (block->page_writes == page_writes)
+    return TRUE;
+
+  /*
+   * Write-protect before comparing, so that any write racing with us either
+   * shows up in the comparison or bumps the page write counter.
+   */
+  is_tracked = gum_stalker_write_protect (stalker, block->real_start,
+      block->real_size);
+
+  ctx->snapshot_comparisons++;
+  is_unmodified = memcmp (block->real_start,
+      gum_exec_block_get_snapshot_start (block), block->real_size) == 0;
+
+  block->page_writes = (is_tracked && is_unmodified) ? page_writes : 0;
+
+  return is_unmodified;
 }
 
 static void
@@ -3358,6 +4770,7 @@ gum_exec_block_commit (GumExecBlock * block)
   block->capacity = block->code_size + snapshot_size;
 
   gum_slab_reserve (&block->code_slab->slab, block->capacity);
+  block->ctx->code_bytes += block->capacity;
 
   gum_stalker_freeze (stalker, block->code_start, block->code_size);
 }
@@ -3427,7 +4840,7 @@ gum_exec_block_backpatch_call (GumExecBlock * block,
 
   ctx = block->ctx;
 
-  if (gum_exec_ctx_may_now_backpatch (ctx, block))
+  if (gum_exec_ctx_may_now_backpatch (ctx, code_start, block))
   {
     GumStalker * stalker = ctx->stalker;
     GumX86Writer * cw = &ctx->code_writer;
@@ -3477,6 +4890,9 @@ gum_exec_block_backpatch_call (GumExecBlock * block,
     g_assert (gum_x86_writer_offset (cw) <= code_max_size);
     gum_stalker_freeze (stalker, code_start, code_max_size);
 
+    gum_exec_ctx_record_backpatch (ctx, GUM_BLOCK_SET_ENTRY_CALL, code_start,
+        block, opened_prolog, ret_real_address, ret_code_address);
+
     gum_spinlock_release (&ctx->code_lock);
   }
 }
@@ -3495,7 +4911,7 @@ gum_exec_block_backpatch_jmp (GumExecBlock * block,
 
   ctx = block->ctx;
 
-  if (gum_exec_ctx_may_now_backpatch (ctx, block))
+  if (gum_exec_ctx_may_now_backpatch (ctx, code_start, block))
   {
     GumStalker * stalker = ctx->stalker;
     GumX86Writer * cw = &ctx->code_writer;
@@ -3516,6 +4932,9 @@ gum_exec_block_backpatch_jmp (GumExecBlock * block,
     gum_x86_writer_flush (cw);
     gum_stalker_freeze (stalker, code_start, code_max_size);
 
+    gum_exec_ctx_record_backpatch (ctx, GUM_BLOCK_SET_ENTRY_JMP, code_start,
+        block, opened_prolog, NULL, NULL);
+
     gum_spinlock_release (&ctx->code_lock);
   }
 }
@@ -3533,7 +4952,7 @@ gum_exec_block_backpatch_ret (GumExecBlock * block,
 
   ctx = block->ctx;
 
-  if (gum_exec_ctx_may_now_backpatch (ctx, block))
+  if (gum_exec_ctx_may_now_backpatch (ctx, code_start, block))
   {
     GumStalker * stalker = ctx->stalker;
     GumX86Writer * cw = &ctx->code_writer;
@@ -3550,28 +4969,45 @@ gum_exec_block_backpatch_ret (GumExecBlock * block,
     g_assert (gum_x86_writer_offset (cw) <= code_max_size);
     gum_stalker_freeze (stalker, code_start, code_max_size);
 
+    gum_exec_ctx_record_backpatch (ctx, GUM_BLOCK_SET_ENTRY_RET, code_start,
+        block, GUM_PROLOG_NONE, NULL, NULL);
+
     gum_spinlock_release (&ctx->code_lock);
   }
 }
 
 static void
-gum_exec_block_backpatch_inline_cache (GumExecBlock * block,
-                                       gpointer * ic_entries)
+gum_exec_block_handle_inline_cache_miss (GumExecBlock * block,
+                                         gpointer * ic_entries)
 {
   gboolean just_unfollowed;
-  GumExecCtx * ctx;
 
   just_unfollowed = block == NULL;
   if (just_unfollowed)
     return;
 
-  ctx = block->ctx;
+  block->ctx->ic_misses++;
+
+  gum_exec_block_backpatch_inline_cache (block, ic_entries);
+}
+
+static void
+gum_exec_block_backpatch_inline_cache (GumExecBlock * block,
+                                       gpointer * ic_entries)
+{
+  GumExecCtx * ctx = block->ctx;
 
-  if (gum_exec_ctx_may_now_backpatch (ctx, block))
+  if (gum_exec_ctx_may_now_backpatch (ctx, ic_entries, block))
   {
-    guint offset = (ic_entries[0] == NULL) ? 0 : 2;
+    guint offset;
+
+    for (offset = 0; offset != ctx->ic_entries * 2; offset += 2)
+    {
+      if (ic_entries[offset + 0] == NULL)
+        break;
+    }
 
-    if (ic_entries[offset + 0] == NULL)
+    if (offset != ctx->ic_entries * 2)
     {
       GumStalker * stalker = ctx->stalker;
       const gsize ic_slot_size = 2 * sizeof (gpointer);
@@ -3585,6 +5021,9 @@ gum_exec_block_backpatch_inline_cache (GumExecBlock * block,
 
       gum_stalker_freeze (stalker, ic_entries + offset, ic_slot_size);
 
+      gum_exec_ctx_record_backpatch (ctx, GUM_BLOCK_SET_ENTRY_INLINE_CACHE,
+          ic_entries, block, GUM_PROLOG_NONE, NULL, NULL);
+
       gum_spinlock_release (&ctx->code_lock);
     }
   }
@@ -3716,6 +5155,13 @@ gum_exec_block_virtualize_branch_insn (GumExecBlock * block,
     gum_x86_relocator_skip_one_no_label (gc->relocator);
     gum_exec_block_write_call_invoke_code (block, &target, gc);
   }
+  else if (gc->trace != NULL && insn->ci->id != X86_INS_JECXZ &&
+      insn->ci->id != X86_INS_JRCXZ && !target.is_indirect &&
+      target.base == X86_REG_INVALID)
+  {
+    gum_x86_relocator_skip_one_no_label (gc->relocator);
+    gum_exec_block_write_trace_branch_code (block, &target, gc);
+  }
   else if (insn->ci->id == X86_INS_JECXZ || insn->ci->id == X86_INS_JRCXZ)
   {
     gpointer is_true, is_false;
@@ -3932,10 +5378,7 @@ gum_exec_block_write_call_invoke_code (GumExecBlock * block,
   GumExecCtxReplaceCurrentBlockFunc entry_func;
   gconstpointer push_application_retaddr = cw->code + 1;
   gconstpointer perform_stack_push = cw->code + 2;
-  gconstpointer look_in_cache = cw->code + 3;
-  gconstpointer try_second = cw->code + 4;
-  gconstpointer resolve_dynamically = cw->code + 5;
-  gconstpointer beach = cw->code + 6;
+  gconstpointer beach = cw->code + 3;
   GumAddress ret_real_address, ret_code_address;
 
   can_backpatch_statically =
@@ -3945,10 +5388,6 @@ gum_exec_block_write_call_invoke_code (GumExecBlock * block,
 
   if (trust_threshold >= 0 && !can_backpatch_statically)
   {
-    gpointer null_ptr = NULL;
-    gpointer ic1_real, ic1_code;
-    gpointer ic2_real, ic2_code;
-
     if (opened_prolog == GUM_PROLOG_NONE)
     {
       gum_exec_block_open_prolog (block, GUM_PROLOG_IC, gc);
@@ -3973,43 +5412,11 @@ gum_exec_block_write_call_invoke_code (GumExecBlock * block,
       gc->accumulated_stack_delta += sizeof (gpointer);
     }
 
-    gum_x86_writer_put_jmp_short_label (cw, look_in_cache);
-
-    ic_entries = gum_x86_writer_cur (cw);
-    ic1_real = ic_entries;
-    gum_x86_writer_put_bytes (cw, (guint8 *) &null_ptr, sizeof (null_ptr));
-    ic1_code = gum_x86_writer_cur (cw);
-    gum_x86_writer_put_bytes (cw, (guint8 *) &null_ptr, sizeof (null_ptr));
-    ic2_real = gum_x86_writer_cur (cw);
-    gum_x86_writer_put_bytes (cw, (guint8 *) &null_ptr, sizeof (null_ptr));
-    ic2_code = gum_x86_writer_cur (cw);
-    gum_x86_writer_put_bytes (cw, (guint8 *) &null_ptr, sizeof (null_ptr));
-
-    gum_x86_writer_put_label (cw, look_in_cache);
+    ic_entries = gum_exec_block_write_inline_cache_entries (block, gc);
 
     gum_exec_ctx_write_push_branch_target_address (block->ctx, target, gc);
+    gum_exec_block_write_inline_cache_lookup (block, ic_entries, gc);
 
-    gum_x86_writer_put_mov_reg_near_ptr (cw, GUM_REG_XAX,
-        GUM_ADDRESS (ic1_real));
-    gum_x86_writer_put_cmp_reg_offset_ptr_reg (cw, GUM_REG_XSP, 0, GUM_REG_XAX);
-    gum_x86_writer_put_jcc_short_label (cw, X86_INS_JNE, try_second,
-        GUM_NO_HINT);
-    gum_x86_writer_put_pop_reg (cw, GUM_REG_XAX);
-    gum_exec_ctx_write_epilog (block->ctx, GUM_PROLOG_IC, cw);
-    gum_x86_writer_put_jmp_near_ptr (cw, GUM_ADDRESS (ic1_code));
-
-    gum_x86_writer_put_label (cw, try_second);
-    gum_x86_writer_put_mov_reg_near_ptr (cw, GUM_REG_XAX,
-        GUM_ADDRESS (ic2_real));
-    gum_x86_writer_put_cmp_reg_offset_ptr_reg (cw, GUM_REG_XSP, 0, GUM_REG_XAX);
-    gum_x86_writer_put_jcc_short_label (cw, X86_INS_JNE, resolve_dynamically,
-        GUM_NO_HINT);
-    gum_x86_writer_put_pop_reg (cw, GUM_REG_XAX);
-    gum_exec_ctx_write_epilog (block->ctx, GUM_PROLOG_IC, cw);
-    gum_x86_writer_put_jmp_near_ptr (cw, GUM_ADDRESS (ic2_code));
-
-    gum_x86_writer_put_label (cw, resolve_dynamically);
-    gum_x86_writer_put_pop_reg (cw, GUM_REG_XAX);
     gum_exec_block_close_prolog (block, gc);
   }
 
@@ -4123,7 +5530,7 @@ gum_exec_block_write_call_invoke_code (GumExecBlock * block,
   if (ic_entries != NULL)
   {
     gum_x86_writer_put_call_address_with_aligned_arguments (cw, GUM_CALL_CAPI,
-        GUM_ADDRESS (gum_exec_block_backpatch_inline_cache), 2,
+        GUM_ADDRESS (gum_exec_block_handle_inline_cache_miss), 2,
         GUM_ARG_REGISTER, GUM_REG_XAX,
         GUM_ARG_ADDRESS, GUM_ADDRESS (ic_entries));
   }
@@ -4146,9 +5553,6 @@ gum_exec_block_write_jmp_transfer_code (GumExecBlock * block,
   const GumPrologType opened_prolog = gc->opened_prolog;
   gboolean can_backpatch_statically;
   gpointer * ic_entries = NULL;
-  gconstpointer look_in_cache = cw->code + 1;
-  gconstpointer try_second = cw->code + 2;
-  gconstpointer resolve_dynamically = cw->code + 3;
 
   can_backpatch_statically =
       trust_threshold >= 0 &&
@@ -4157,50 +5561,14 @@ gum_exec_block_write_jmp_transfer_code (GumExecBlock * block,
 
   if (trust_threshold >= 0 && !can_backpatch_statically)
   {
-    gpointer null_ptr = NULL;
-    gpointer ic1_real, ic1_code;
-    gpointer ic2_real, ic2_code;
-
     gum_exec_block_close_prolog (block, gc);
 
-    gum_x86_writer_put_jmp_short_label (cw, look_in_cache);
-
-    ic_entries = gum_x86_writer_cur (cw);
-    ic1_real = ic_entries;
-    gum_x86_writer_put_bytes (cw, (guint8 *) &null_ptr, sizeof (null_ptr));
-    ic1_code = gum_x86_writer_cur (cw);
-    gum_x86_writer_put_bytes (cw, (guint8 *) &null_ptr, sizeof (null_ptr));
-    ic2_real = gum_x86_writer_cur (cw);
-    gum_x86_writer_put_bytes (cw, (guint8 *) &null_ptr, sizeof (null_ptr));
-    ic2_code = gum_x86_writer_cur (cw);
-    gum_x86_writer_put_bytes (cw, (guint8 *) &null_ptr, sizeof (null_ptr));
-
-    gum_x86_writer_put_label (cw, look_in_cache);
+    ic_entries = gum_exec_block_write_inline_cache_entries (block, gc);
     gum_exec_block_open_prolog (block, GUM_PROLOG_IC, gc);
 
     gum_exec_ctx_write_push_branch_target_address (block->ctx, target, gc);
+    gum_exec_block_write_inline_cache_lookup (block, ic_entries, gc);
 
-    gum_x86_writer_put_mov_reg_near_ptr (cw, GUM_REG_XAX,
-        GUM_ADDRESS (ic1_real));
-    gum_x86_writer_put_cmp_reg_offset_ptr_reg (cw, GUM_REG_XSP, 0, GUM_REG_XAX);
-    gum_x86_writer_put_jcc_short_label (cw, X86_INS_JNE, try_second,
-        GUM_NO_HINT);
-    gum_x86_writer_put_pop_reg (cw, GUM_REG_XAX);
-    gum_exec_ctx_write_epilog (block->ctx, GUM_PROLOG_IC, cw);
-    gum_x86_writer_put_jmp_near_ptr (cw, GUM_ADDRESS (ic1_code));
-
-    gum_x86_writer_put_label (cw, try_second);
-    gum_x86_writer_put_mov_reg_near_ptr (cw, GUM_REG_XAX,
-        GUM_ADDRESS (ic2_real));
-    gum_x86_writer_put_cmp_reg_offset_ptr_reg (cw, GUM_REG_XSP, 0, GUM_REG_XAX);
-    gum_x86_writer_put_jcc_short_label (cw, X86_INS_JNE, resolve_dynamically,
-        GUM_NO_HINT);
-    gum_x86_writer_put_pop_reg (cw, GUM_REG_XAX);
-    gum_exec_ctx_write_epilog (block->ctx, GUM_PROLOG_IC, cw);
-    gum_x86_writer_put_jmp_near_ptr (cw, GUM_ADDRESS (ic2_code));
-
-    gum_x86_writer_put_label (cw, resolve_dynamically);
-    gum_x86_writer_put_pop_reg (cw, GUM_REG_XAX);
     gum_exec_block_close_prolog (block, gc);
   }
 
@@ -4235,7 +5603,7 @@ gum_exec_block_write_jmp_transfer_code (GumExecBlock * block,
   if (ic_entries != NULL)
   {
     gum_x86_writer_put_call_address_with_aligned_arguments (cw, GUM_CALL_CAPI,
-        GUM_ADDRESS (gum_exec_block_backpatch_inline_cache), 2,
+        GUM_ADDRESS (gum_exec_block_handle_inline_cache_miss), 2,
         GUM_ARG_REGISTER, GUM_REG_XAX,
         GUM_ARG_ADDRESS, GUM_ADDRESS (ic_entries));
   }
@@ -4245,6 +5613,197 @@ gum_exec_block_write_jmp_transfer_code (GumExecBlock * block,
   gum_x86_writer_put_jmp_near_ptr (cw, GUM_ADDRESS (&block->ctx->resume_at));
 }
 
+static void
+gum_exec_block_write_trace_branch_code (GumExecBlock * block,
+                                        const GumBranchTarget * target,
+                                        GumGeneratorContext * gc)
+{
+  GumExecCtx * ctx = block->ctx;
+  GumTrace * trace = gc->trace;
+  GumX86Writer * cw = gc->code_writer;
+  GumInstruction * insn = gc->instruction;
+  const x86_insn id = insn->ci->id;
+  GumBranchTarget fall_through = { 0, };
+  const GumBranchTarget * first, * second;
+  const GumTraceSegment * taken_segment, * fall_through_segment;
+  const GumTraceSegment * first_segment;
+  GumExecBlock * taken_block, * fall_through_block;
+  gboolean prefer_taken;
+  x86_insn first_jcc;
+
+  gum_exec_block_close_prolog (block, gc);
+
+  if (id == X86_INS_JMP)
+  {
+    gum_exec_block_write_trace_edge_code (block, target,
+        GUM_ENTRYGATE (jmp_imm), TRUE, gc);
+    return;
+  }
+
+  fall_through.is_indirect = FALSE;
+  fall_through.absolute_address = insn->end;
+  fall_through.pfx_seg = X86_REG_INVALID;
+  fall_through.base = X86_REG_INVALID;
+  fall_through.index = X86_REG_INVALID;
+
+  /*
+   * Lay out the hotter edge last so the trace can carry straight on into it,
+   * favoring backward branches when there is no profile to go on.
+   */
+  taken_segment = gum_trace_find_segment (trace, target->absolute_address);
+  fall_through_segment = gum_trace_find_segment (trace, insn->end);
+  taken_block = gum_metal_hash_table_lookup (ctx->mappings,
+      target->absolute_address);
+  fall_through_block = gum_metal_hash_table_lookup (ctx->mappings, insn->end);
+
+  if (taken_segment != NULL)
+    prefer_taken = FALSE;
+  else if (fall_through_segment != NULL)
+    prefer_taken = TRUE;
+  else if (taken_block == NULL || fall_through_block == NULL)
+    prefer_taken = taken_block != NULL;
+  else if (taken_block->exec_count != fall_through_block->exec_count)
+    prefer_taken = taken_block->exec_count > fall_through_block->exec_count;
+  else
+    prefer_taken = (guint8 *) target->absolute_address < insn->start;
+
+  if (prefer_taken)
+  {
+    first = &fall_through;
+    first_segment = fall_through_segment;
+    first_jcc = gum_negate_jcc (id);
+    second = target;
+  }
+  else
+  {
+    first = target;
+    first_segment = taken_segment;
+    first_jcc = id;
+    second = &fall_through;
+  }
+
+  if (first_segment != NULL)
+  {
+    gum_x86_writer_put_jcc_near (cw, first_jcc,
+        GSIZE_TO_POINTER (first_segment->code_start), GUM_NO_HINT);
+    trace->num_internal_branches++;
+  }
+  else
+  {
+    gconstpointer take_second = cw->code + 1;
+
+    gum_x86_writer_put_jcc_near_label (cw, gum_negate_jcc (first_jcc),
+        take_second, GUM_NO_HINT);
+    gum_exec_block_write_jmp_transfer_code (block, first,
+        GUM_ENTRYGATE (jmp_cond_imm), gc);
+    gum_x86_writer_put_label (cw, take_second);
+  }
+
+  gum_exec_block_write_trace_edge_code (block, second,
+      GUM_ENTRYGATE (jmp_cond_imm), TRUE, gc);
+}
+
+static void
+gum_exec_block_write_trace_edge_code (GumExecBlock * block,
+                                      const GumBranchTarget * target,
+                                      GumExecCtxReplaceCurrentBlockFunc func,
+                                      gboolean may_extend,
+                                      GumGeneratorContext * gc)
+{
+  GumTrace * trace = gc->trace;
+  const GumTraceSegment * segment;
+
+  segment = gum_trace_find_segment (trace, target->absolute_address);
+  if (segment != NULL)
+  {
+    gum_x86_writer_put_jmp_address (gc->code_writer, segment->code_start);
+    trace->num_internal_branches++;
+    return;
+  }
+
+  if (may_extend &&
+      gum_exec_ctx_may_extend_trace (block->ctx, trace,
+          target->absolute_address))
+  {
+    trace->next = target->absolute_address;
+    return;
+  }
+
+  gum_exec_block_write_jmp_transfer_code (block, target, func, gc);
+}
+
+static gpointer *
+gum_exec_block_write_inline_cache_entries (GumExecBlock * block,
+                                           GumGeneratorContext * gc)
+{
+  GumX86Writer * cw = gc->code_writer;
+  const guint n = block->ctx->ic_entries;
+  gpointer * ic_entries;
+  gconstpointer look_in_cache = cw->code + 1;
+  gpointer null_ptr = NULL;
+  guint i;
+
+  if (2 * n * sizeof (gpointer) <= G_MAXINT8)
+    gum_x86_writer_put_jmp_short_label (cw, look_in_cache);
+  else
+    gum_x86_writer_put_jmp_near_label (cw, look_in_cache);
+
+  ic_entries = gum_x86_writer_cur (cw);
+  for (i = 0; i != 2 * n; i++)
+    gum_x86_writer_put_bytes (cw, (guint8 *) &null_ptr, sizeof (null_ptr));
+
+  gum_x86_writer_put_label (cw, look_in_cache);
+
+  return ic_entries;
+}
+
+static void
+gum_exec_block_write_inline_cache_lookup (GumExecBlock * block,
+                                          gpointer * ic_entries,
+                                          GumGeneratorContext * gc)
+{
+  GumExecCtx * ctx = block->ctx;
+  GumX86Writer * cw = gc->code_writer;
+  const guint n = ctx->ic_entries;
+  gconstpointer resolve_dynamically = cw->code + 1;
+  guint i;
+
+  /*
+   * The branch target is on the top of the stack, and XAX is free to use
+   * until we pop it back off.
+   */
+  for (i = 0; i != n; i++)
+  {
+    gconstpointer try_next = cw->code + 2;
+    const gboolean is_last = i == n - 1;
+    gpointer * ic_real = ic_entries + (2 * i) + 0;
+    gpointer * ic_code = ic_entries + (2 * i) + 1;
+
+    gum_x86_writer_put_mov_reg_near_ptr (cw, GUM_REG_XAX,
+        GUM_ADDRESS (ic_real));
+    gum_x86_writer_put_cmp_reg_offset_ptr_reg (cw, GUM_REG_XSP, 0, GUM_REG_XAX);
+    gum_x86_writer_put_jcc_short_label (cw, X86_INS_JNE,
+        is_last ? resolve_dynamically : try_next, GUM_NO_HINT);
+    if (ctx->count_ic_hits)
+    {
+      gum_x86_writer_put_mov_reg_address (cw, GUM_REG_XAX,
+          GUM_ADDRESS (&ctx->ic_hits));
+      gum_x86_writer_put_inc_reg_ptr (cw,
+          (GLIB_SIZEOF_VOID_P == 8) ? GUM_PTR_QWORD : GUM_PTR_DWORD,
+          GUM_REG_XAX);
+    }
+    gum_x86_writer_put_pop_reg (cw, GUM_REG_XAX);
+    gum_exec_ctx_write_epilog (ctx, GUM_PROLOG_IC, cw);
+    gum_x86_writer_put_jmp_near_ptr (cw, GUM_ADDRESS (ic_code));
+
+    if (!is_last)
+      gum_x86_writer_put_label (cw, try_next);
+  }
+
+  gum_x86_writer_put_label (cw, resolve_dynamically);
+  gum_x86_writer_put_pop_reg (cw, GUM_REG_XAX);
+}
+
 static void
 gum_exec_block_write_ret_transfer_code (GumExecBlock * block,
                                         GumGeneratorContext * gc)
@@ -4742,6 +6301,30 @@ gum_slab_cursor (GumSlab * self)
   return self->data + self->offset;
 }
 
+static gsize
+gum_slab_footprint (GumSlab * self)
+{
+  return (self->data - (guint8 *) self) + self->size;
+}
+
+static gboolean
+gum_slab_list_contains (GumSlab * self,
+                        gconstpointer address)
+{
+  GumSlab * cur;
+
+  for (cur = self; cur != NULL; cur = cur->next)
+  {
+    if ((const guint8 *) address >= cur->data &&
+        (const guint8 *) address < (guint8 *) gum_slab_cursor (cur))
+    {
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
 static gpointer
 gum_slab_reserve (GumSlab * self,
                   gsize size)
@@ -28,6 +28,7 @@
 #include <gum/gummemory.h>
 #include <gum/gummemoryaccessmonitor.h>
 #include <gum/gummemorymap.h>
+#include <gum/gummemorymapsnapshot.h>
 #include <gum/gummetalarray.h>
 #include <gum/gummetalhash.h>
 #include <gum/gummoduleapiresolver.h>
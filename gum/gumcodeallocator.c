@@ -48,6 +48,7 @@ struct _GumCodeSliceElement
 struct _GumCodePages
 {
   gint ref_count;
+  gsize metadata_size;
 
   GumCodeSegment * segment;
   gpointer data;
@@ -97,7 +98,7 @@ struct _GumInsertDeflectorContext
 };
 
 static GumCodeSlice * gum_code_allocator_try_alloc_batch_near (
-    GumCodeAllocator * self, const GumAddressSpec * spec);
+    GumCodeAllocator * self, const GumAddressSpec * spec, gsize size_in_pages);
 
 static void gum_code_pages_unref (GumCodePages * self);
 
@@ -188,7 +189,40 @@ gum_code_allocator_try_alloc_slice_near (GumCodeAllocator * self,
     }
   }
 
-  return gum_code_allocator_try_alloc_batch_near (self, spec);
+  return gum_code_allocator_try_alloc_batch_near (self, spec,
+      self->pages_per_batch);
+}
+
+/*
+ * Allocates a single batch large enough for n_slices, and puts all of its
+ * slices on the free list, so that a burst of allocations near spec can be
+ * served without a mapping per pages_per_batch slices.
+ */
+gboolean
+gum_code_allocator_try_reserve_slices_near (GumCodeAllocator * self,
+                                            const GumAddressSpec * spec,
+                                            guint n_slices)
+{
+  gsize page_size, size_in_pages;
+  GumCodeSlice * slice;
+  GList * link;
+
+  page_size = gum_query_page_size ();
+  size_in_pages = ((n_slices * self->slice_size) + page_size - 1) / page_size;
+  if (size_in_pages <= self->pages_per_batch)
+    return TRUE;
+
+  slice = gum_code_allocator_try_alloc_batch_near (self, spec, size_in_pages);
+  if (slice == NULL)
+    return FALSE;
+
+  link = &GUM_CODE_SLICE_ELEMENT_FROM_SLICE (slice)->parent;
+  if (self->free_slices != NULL)
+    self->free_slices->prev = link;
+  link->next = self->free_slices;
+  self->free_slices = link;
+
+  return TRUE;
 }
 
 void
@@ -239,11 +273,12 @@ gum_code_allocator_commit (GumCodeAllocator * self)
 
 static GumCodeSlice *
 gum_code_allocator_try_alloc_batch_near (GumCodeAllocator * self,
-                                         const GumAddressSpec * spec)
+                                         const GumAddressSpec * spec,
+                                         gsize size_in_pages)
 {
   GumCodeSlice * result = NULL;
   gboolean rwx_supported, code_segment_supported;
-  gsize page_size, size_in_pages, size_in_bytes;
+  gsize page_size, size_in_bytes, n_slices, metadata_size;
   GumCodeSegment * segment;
   gpointer data;
   GumCodePages * pages;
@@ -253,9 +288,20 @@ gum_code_allocator_try_alloc_batch_near (GumCodeAllocator * self,
   code_segment_supported = gum_code_segment_is_supported ();
 
   page_size = gum_query_page_size ();
-  size_in_pages = self->pages_per_batch;
   size_in_bytes = size_in_pages * page_size;
 
+  if (size_in_pages == self->pages_per_batch)
+  {
+    n_slices = self->slices_per_batch;
+    metadata_size = self->pages_metadata_size;
+  }
+  else
+  {
+    n_slices = size_in_bytes / self->slice_size;
+    metadata_size = sizeof (GumCodePages) +
+        ((n_slices - 1) * sizeof (GumCodeSliceElement));
+  }
+
   if (rwx_supported || !code_segment_supported)
   {
     GumPageProtection protection;
@@ -286,8 +332,9 @@ gum_code_allocator_try_alloc_batch_near (GumCodeAllocator * self,
     data = gum_code_segment_get_address (segment);
   }
 
-  pages = g_slice_alloc (self->pages_metadata_size);
-  pages->ref_count = self->slices_per_batch;
+  pages = g_slice_alloc (metadata_size);
+  pages->ref_count = n_slices;
+  pages->metadata_size = metadata_size;
 
   pages->segment = segment;
   pages->data = data;
@@ -295,7 +342,7 @@ gum_code_allocator_try_alloc_batch_near (GumCodeAllocator * self,
 
   pages->allocator = self;
 
-  for (i = self->slices_per_batch; i != 0; i--)
+  for (i = n_slices; i != 0; i--)
   {
     guint slice_index = i - 1;
     GumCodeSliceElement * element = &pages->elements[slice_index];
@@ -351,7 +398,7 @@ gum_code_pages_unref (GumCodePages * self)
       gum_cloak_remove_range (&range);
     }
 
-    g_slice_free1 (self->allocator->pages_metadata_size, self);
+    g_slice_free1 (self->metadata_size, self);
   }
 }
 
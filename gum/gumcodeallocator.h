@@ -46,6 +46,8 @@ void gum_code_allocator_free (GumCodeAllocator * allocator);
 GumCodeSlice * gum_code_allocator_alloc_slice (GumCodeAllocator * self);
 GumCodeSlice * gum_code_allocator_try_alloc_slice_near (GumCodeAllocator * self,
     const GumAddressSpec * spec, gsize alignment);
+gboolean gum_code_allocator_try_reserve_slices_near (GumCodeAllocator * self,
+    const GumAddressSpec * spec, guint n_slices);
 void gum_code_allocator_commit (GumCodeAllocator * self);
 void gum_code_slice_free (GumCodeSlice * slice);
 
@@ -6,6 +6,10 @@
 
 #include "gumeventsink.h"
 
+#include "gumspinlock.h"
+
+#include <string.h>
+
 struct _GumDefaultEventSink
 {
   GObject parent;
@@ -21,6 +25,28 @@ struct _GumCallbackEventSink
   GDestroyNotify data_destroy;
 };
 
+struct _GumCompactEventSink
+{
+  GObject parent;
+
+  GumEventType mask;
+  GumSpinlock lock;
+  guint8 * buffer;
+  guint8 * spare_buffer;
+  gsize buffer_size;
+  gsize offset;
+  GumAddress previous;
+  guint next_batch;
+
+  GMutex delivery_mutex;
+  GCond delivery_cond;
+  guint next_delivery;
+
+  GumCompactEventSinkCallback callback;
+  gpointer data;
+  GDestroyNotify data_destroy;
+};
+
 static void gum_default_event_sink_iface_init (gpointer g_iface,
     gpointer iface_data);
 static GumEventType gum_default_event_sink_query_mask (GumEventSink * sink);
@@ -34,6 +60,26 @@ static GumEventType gum_callback_event_sink_query_mask (GumEventSink * sink);
 static void gum_callback_event_sink_process (GumEventSink * sink,
     const GumEvent * event, GumCpuContext * cpu_context);
 
+static void gum_compact_event_sink_iface_init (gpointer g_iface,
+    gpointer iface_data);
+static void gum_compact_event_sink_finalize (GObject * object);
+static GumEventType gum_compact_event_sink_query_mask (GumEventSink * sink);
+static void gum_compact_event_sink_process (GumEventSink * sink,
+    const GumEvent * event, GumCpuContext * cpu_context);
+static void gum_compact_event_sink_flush (GumEventSink * sink);
+static guint8 * gum_compact_event_sink_take_batch (GumCompactEventSink * self,
+    gsize * size, guint * serial);
+static void gum_compact_event_sink_deliver (GumCompactEventSink * self,
+    guint8 * batch, gsize size, guint serial);
+
+static guint8 * gum_write_uleb128 (guint8 * output, guint64 value);
+static guint8 * gum_write_address_delta (guint8 * output, GumAddress address,
+    GumAddress * previous);
+static gboolean gum_read_uleb128 (const guint8 ** data, const guint8 * end,
+    guint64 * value);
+static gboolean gum_read_address_delta (const guint8 ** data,
+    const guint8 * end, GumAddress * previous, gpointer * address);
+
 G_DEFINE_INTERFACE (GumEventSink, gum_event_sink, G_TYPE_OBJECT)
 
 G_DEFINE_TYPE_EXTENDED (GumDefaultEventSink,
@@ -50,6 +96,13 @@ G_DEFINE_TYPE_EXTENDED (GumCallbackEventSink,
                         G_IMPLEMENT_INTERFACE (GUM_TYPE_EVENT_SINK,
                             gum_callback_event_sink_iface_init))
 
+G_DEFINE_TYPE_EXTENDED (GumCompactEventSink,
+                        gum_compact_event_sink,
+                        G_TYPE_OBJECT,
+                        0,
+                        G_IMPLEMENT_INTERFACE (GUM_TYPE_EVENT_SINK,
+                            gum_compact_event_sink_iface_init))
+
 static void
 gum_event_sink_default_init (GumEventSinkInterface * iface)
 {
@@ -127,6 +180,248 @@ gum_event_sink_make_from_callback (GumEventType mask,
   return GUM_EVENT_SINK (sink);
 }
 
+GumEventSink *
+gum_event_sink_make_compact (GumEventType mask,
+                             gsize buffer_size,
+                             GumCompactEventSinkCallback callback,
+                             gpointer data,
+                             GDestroyNotify data_destroy)
+{
+  GumCompactEventSink * sink;
+
+  sink = g_object_new (GUM_TYPE_COMPACT_EVENT_SINK, NULL);
+  sink->mask = mask;
+  sink->buffer_size = MAX (buffer_size, GUM_COMPACT_EVENT_MAX_SIZE);
+  sink->buffer = g_malloc (sink->buffer_size);
+  sink->callback = callback;
+  sink->data = data;
+  sink->data_destroy = data_destroy;
+
+  return GUM_EVENT_SINK (sink);
+}
+
+gsize
+gum_event_encode_compact (const GumEvent * event,
+                          GumAddress * previous,
+                          guint8 * output)
+{
+  guint8 * cursor = output;
+
+  switch (event->type)
+  {
+    case GUM_CALL:
+    case GUM_RET:
+    {
+      const GumCallEvent * call = &event->call;
+      gint64 depth = call->depth;
+
+      *cursor++ = (event->type == GUM_CALL)
+          ? GUM_COMPACT_EVENT_CALL
+          : GUM_COMPACT_EVENT_RET;
+      cursor = gum_write_address_delta (cursor, GUM_ADDRESS (call->location),
+          previous);
+      cursor = gum_write_address_delta (cursor, GUM_ADDRESS (call->target),
+          previous);
+      cursor = gum_write_uleb128 (cursor,
+          ((guint64) depth << 1) ^ (guint64) (depth >> 63));
+
+      break;
+    }
+    case GUM_EXEC:
+      *cursor++ = GUM_COMPACT_EVENT_EXEC;
+      cursor = gum_write_address_delta (cursor,
+          GUM_ADDRESS (event->exec.location), previous);
+      break;
+    case GUM_BLOCK:
+    case GUM_COMPILE:
+    {
+      const GumBlockEvent * block = &event->block;
+
+      *cursor++ = (event->type == GUM_BLOCK)
+          ? GUM_COMPACT_EVENT_BLOCK
+          : GUM_COMPACT_EVENT_COMPILE;
+      cursor = gum_write_address_delta (cursor, GUM_ADDRESS (block->start),
+          previous);
+      cursor = gum_write_uleb128 (cursor,
+          GUM_ADDRESS (block->end) - GUM_ADDRESS (block->start));
+      *previous = GUM_ADDRESS (block->end);
+
+      break;
+    }
+    default:
+      g_assert_not_reached ();
+  }
+
+  return cursor - output;
+}
+
+gsize
+gum_event_encode_compact_base (GumAddress base,
+                               guint8 * output)
+{
+  guint8 * cursor = output;
+
+  *cursor++ = GUM_COMPACT_EVENT_BASE;
+  cursor = gum_write_uleb128 (cursor, base);
+
+  return cursor - output;
+}
+
+gsize
+gum_event_decode_compact (const guint8 * data,
+                          gsize size,
+                          GumAddress * previous,
+                          GumEvent * event)
+{
+  const guint8 * cursor = data;
+  const guint8 * end = data + size;
+  guint8 tag;
+
+  if (size == 0)
+    return 0;
+
+  tag = *cursor++;
+  switch (tag)
+  {
+    case GUM_COMPACT_EVENT_BASE:
+    {
+      guint64 base;
+
+      if (!gum_read_uleb128 (&cursor, end, &base))
+        return 0;
+      *previous = base;
+
+      event->type = GUM_NOTHING;
+
+      break;
+    }
+    case GUM_COMPACT_EVENT_CALL:
+    case GUM_COMPACT_EVENT_RET:
+    {
+      GumCallEvent * call = &event->call;
+      guint64 depth;
+
+      if (!gum_read_address_delta (&cursor, end, previous, &call->location) ||
+          !gum_read_address_delta (&cursor, end, previous, &call->target) ||
+          !gum_read_uleb128 (&cursor, end, &depth))
+        return 0;
+
+      call->type = (tag == GUM_COMPACT_EVENT_CALL) ? GUM_CALL : GUM_RET;
+      call->depth = (gint) ((depth >> 1) ^ -(gint64) (depth & 1));
+
+      break;
+    }
+    case GUM_COMPACT_EVENT_EXEC:
+    {
+      GumExecEvent * exec = &event->exec;
+
+      if (!gum_read_address_delta (&cursor, end, previous, &exec->location))
+        return 0;
+
+      exec->type = GUM_EXEC;
+
+      break;
+    }
+    case GUM_COMPACT_EVENT_BLOCK:
+    case GUM_COMPACT_EVENT_COMPILE:
+    {
+      GumBlockEvent * block = &event->block;
+      guint64 block_size;
+
+      if (!gum_read_address_delta (&cursor, end, previous, &block->start) ||
+          !gum_read_uleb128 (&cursor, end, &block_size))
+        return 0;
+
+      *previous = GUM_ADDRESS (block->start) + block_size;
+
+      block->type = (tag == GUM_COMPACT_EVENT_BLOCK) ? GUM_BLOCK : GUM_COMPILE;
+      block->end = GSIZE_TO_POINTER (*previous);
+
+      break;
+    }
+    default:
+      return 0;
+  }
+
+  return cursor - data;
+}
+
+static guint8 *
+gum_write_uleb128 (guint8 * output,
+                   guint64 value)
+{
+  do
+  {
+    guint8 byte = value & 0x7f;
+
+    value >>= 7;
+    if (value != 0)
+      byte |= 0x80;
+
+    *output++ = byte;
+  }
+  while (value != 0);
+
+  return output;
+}
+
+static guint8 *
+gum_write_address_delta (guint8 * output,
+                         GumAddress address,
+                         GumAddress * previous)
+{
+  gint64 delta = (gint64) (address - *previous);
+
+  *previous = address;
+
+  return gum_write_uleb128 (output,
+      ((guint64) delta << 1) ^ (guint64) (delta >> 63));
+}
+
+static gboolean
+gum_read_uleb128 (const guint8 ** data,
+                  const guint8 * end,
+                  guint64 * value)
+{
+  const guint8 * cursor = *data;
+  guint64 result = 0;
+  guint shift = 0;
+
+  while (cursor != end && shift < 64)
+  {
+    guint8 byte = *cursor++;
+
+    result |= (guint64) (byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0)
+    {
+      *data = cursor;
+      *value = result;
+      return TRUE;
+    }
+
+    shift += 7;
+  }
+
+  return FALSE;
+}
+
+static gboolean
+gum_read_address_delta (const guint8 ** data,
+                        const guint8 * end,
+                        GumAddress * previous,
+                        gpointer * address)
+{
+  guint64 zigzag;
+
+  if (!gum_read_uleb128 (data, end, &zigzag))
+    return FALSE;
+
+  *previous += (zigzag >> 1) ^ -(gint64) (zigzag & 1);
+  *address = GSIZE_TO_POINTER (*previous);
+
+  return TRUE;
+}
+
 static void
 gum_default_event_sink_class_init (GumDefaultEventSinkClass * klass)
 {
@@ -209,3 +504,161 @@ gum_callback_event_sink_process (GumEventSink * sink,
 
   self->callback (event, cpu_context, self->data);
 }
+
+static void
+gum_compact_event_sink_class_init (GumCompactEventSinkClass * klass)
+{
+  GObjectClass * object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = gum_compact_event_sink_finalize;
+}
+
+static void
+gum_compact_event_sink_iface_init (gpointer g_iface,
+                                   gpointer iface_data)
+{
+  GumEventSinkInterface * iface = g_iface;
+
+  iface->query_mask = gum_compact_event_sink_query_mask;
+  iface->process = gum_compact_event_sink_process;
+  iface->flush = gum_compact_event_sink_flush;
+  iface->stop = gum_compact_event_sink_flush;
+}
+
+static void
+gum_compact_event_sink_init (GumCompactEventSink * self)
+{
+  gum_spinlock_init (&self->lock);
+
+  g_mutex_init (&self->delivery_mutex);
+  g_cond_init (&self->delivery_cond);
+}
+
+static void
+gum_compact_event_sink_finalize (GObject * object)
+{
+  GumCompactEventSink * self = GUM_COMPACT_EVENT_SINK (object);
+
+  g_cond_clear (&self->delivery_cond);
+  g_mutex_clear (&self->delivery_mutex);
+
+  g_free (self->spare_buffer);
+  g_free (self->buffer);
+
+  if (self->data_destroy != NULL)
+    self->data_destroy (self->data);
+
+  G_OBJECT_CLASS (gum_compact_event_sink_parent_class)->finalize (object);
+}
+
+static GumEventType
+gum_compact_event_sink_query_mask (GumEventSink * sink)
+{
+  return GUM_COMPACT_EVENT_SINK (sink)->mask;
+}
+
+static void
+gum_compact_event_sink_process (GumEventSink * sink,
+                                const GumEvent * event,
+                                GumCpuContext * cpu_context)
+{
+  GumCompactEventSink * self = (GumCompactEventSink *) sink;
+  guint8 * batch = NULL;
+  gsize size;
+  guint serial;
+
+  gum_spinlock_acquire (&self->lock);
+
+  if (self->buffer_size - self->offset < GUM_COMPACT_EVENT_MAX_SIZE)
+    batch = gum_compact_event_sink_take_batch (self, &size, &serial);
+
+  self->offset += gum_event_encode_compact (event, &self->previous,
+      self->buffer + self->offset);
+
+  gum_spinlock_release (&self->lock);
+
+  if (batch != NULL)
+    gum_compact_event_sink_deliver (self, batch, size, serial);
+}
+
+static void
+gum_compact_event_sink_flush (GumEventSink * sink)
+{
+  GumCompactEventSink * self = GUM_COMPACT_EVENT_SINK (sink);
+  guint8 * batch;
+  gsize size;
+  guint serial;
+
+  gum_spinlock_acquire (&self->lock);
+  batch = gum_compact_event_sink_take_batch (self, &size, &serial);
+  gum_spinlock_release (&self->lock);
+
+  if (batch != NULL)
+    gum_compact_event_sink_deliver (self, batch, size, serial);
+}
+
+/*
+ * Swaps in an empty buffer so that other threads can keep recording while the
+ * full one is handed to the callback. Must be called with the lock held.
+ */
+static guint8 *
+gum_compact_event_sink_take_batch (GumCompactEventSink * self,
+                                   gsize * size,
+                                   guint * serial)
+{
+  guint8 * batch;
+
+  if (self->offset == 0)
+    return NULL;
+
+  batch = self->buffer;
+  *size = self->offset;
+  *serial = self->next_batch++;
+
+  if (self->spare_buffer != NULL)
+  {
+    self->buffer = self->spare_buffer;
+    self->spare_buffer = NULL;
+  }
+  else
+  {
+    self->buffer = g_malloc (self->buffer_size);
+  }
+  self->offset = 0;
+  self->previous = 0;
+
+  return batch;
+}
+
+/*
+ * Batches taken by different threads are handed to the callback one at a
+ * time and in the order they were taken, without holding the lock.
+ */
+static void
+gum_compact_event_sink_deliver (GumCompactEventSink * self,
+                                guint8 * batch,
+                                gsize size,
+                                guint serial)
+{
+  g_mutex_lock (&self->delivery_mutex);
+
+  while (self->next_delivery != serial)
+    g_cond_wait (&self->delivery_cond, &self->delivery_mutex);
+
+  self->callback (batch, size, self->data);
+
+  self->next_delivery++;
+  g_cond_broadcast (&self->delivery_cond);
+
+  g_mutex_unlock (&self->delivery_mutex);
+
+  gum_spinlock_acquire (&self->lock);
+  if (self->spare_buffer == NULL)
+  {
+    self->spare_buffer = batch;
+    batch = NULL;
+  }
+  gum_spinlock_release (&self->lock);
+
+  g_free (batch);
+}
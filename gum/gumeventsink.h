@@ -24,8 +24,35 @@ G_DECLARE_FINAL_TYPE (GumDefaultEventSink, gum_default_event_sink, GUM,
 G_DECLARE_FINAL_TYPE (GumCallbackEventSink, gum_callback_event_sink, GUM,
     CALLBACK_EVENT_SINK, GObject)
 
+#define GUM_TYPE_COMPACT_EVENT_SINK (gum_compact_event_sink_get_type ())
+G_DECLARE_FINAL_TYPE (GumCompactEventSink, gum_compact_event_sink, GUM,
+    COMPACT_EVENT_SINK, GObject)
+
+/*
+ * Compact event encoding: each record starts with a one-byte tag, followed by
+ * LEB128 varints. Addresses are zigzag-encoded deltas against the previous
+ * address in the stream, which starts out as zero, and block/compile ends are
+ * encoded as their size. A record with tag GUM_COMPACT_EVENT_BASE carries an
+ * absolute address that the following deltas are relative to.
+ */
+#define GUM_COMPACT_EVENT_MAX_SIZE 32
+
+typedef guint GumCompactEventTag;
+
+enum _GumCompactEventTag
+{
+  GUM_COMPACT_EVENT_BASE,
+  GUM_COMPACT_EVENT_CALL,
+  GUM_COMPACT_EVENT_RET,
+  GUM_COMPACT_EVENT_EXEC,
+  GUM_COMPACT_EVENT_BLOCK,
+  GUM_COMPACT_EVENT_COMPILE,
+};
+
 typedef void (* GumEventSinkCallback) (const GumEvent * event,
     GumCpuContext * cpu_context, gpointer user_data);
+typedef void (* GumCompactEventSinkCallback) (const guint8 * data, gsize size,
+    gpointer user_data);
 
 struct _GumEventSinkInterface
 {
@@ -49,6 +76,15 @@ GUM_API void gum_event_sink_stop (GumEventSink * self);
 GUM_API GumEventSink * gum_event_sink_make_default (void);
 GUM_API GumEventSink * gum_event_sink_make_from_callback (GumEventType mask,
     GumEventSinkCallback callback, gpointer data, GDestroyNotify data_destroy);
+GUM_API GumEventSink * gum_event_sink_make_compact (GumEventType mask,
+    gsize buffer_size, GumCompactEventSinkCallback callback, gpointer data,
+    GDestroyNotify data_destroy);
+
+GUM_API gsize gum_event_encode_compact (const GumEvent * event,
+    GumAddress * previous, guint8 * output);
+GUM_API gsize gum_event_encode_compact_base (GumAddress base, guint8 * output);
+GUM_API gsize gum_event_decode_compact (const guint8 * data, gsize size,
+    GumAddress * previous, GumEvent * event);
 
 G_END_DECLS
 
@@ -47,6 +47,7 @@ struct _GumFunctionContext
   gpointer on_leave_trampoline;
 
   volatile GPtrArray * listener_entries;
+  volatile gpointer fast_listener_entry;
 
   gpointer replacement_function;
   gpointer replacement_data;
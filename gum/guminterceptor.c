@@ -22,6 +22,8 @@
 #define GUM_INTERCEPTOR_CODE_SLICE_SIZE 256
 #endif
 
+#define GUM_INTERCEPTOR_BATCH_MAX_DISTANCE (64 * 1024 * 1024)
+
 #define GUM_INTERCEPTOR_LOCK(o) g_rec_mutex_lock (&(o)->mutex)
 #define GUM_INTERCEPTOR_UNLOCK(o) g_rec_mutex_unlock (&(o)->mutex)
 
@@ -62,6 +64,8 @@ struct _GumInterceptor
   volatile guint selected_thread_id;
 
   GumInterceptorTransaction current_transaction;
+
+  guint commit_syscall_count;
 };
 
 enum _GumInstrumentationError
@@ -93,12 +97,14 @@ struct _ListenerEntry
 
 struct _InterceptorThreadContext
 {
-  GumInvocationBackend listener_backend;
-  GumInvocationBackend replacement_backend;
-
   gint ignore_level;
-
   GumInvocationStack * stack;
+  GumInvocationContext * fast_invocation;
+  gpointer fast_caller_ret_addr;
+  GumInvocationBackend fast_listener_backend;
+
+  GumInvocationBackend listener_backend;
+  GumInvocationBackend replacement_backend;
 
   GArray * listener_data_slots;
 };
@@ -135,6 +141,9 @@ static void gum_interceptor_finalize (GObject * object);
 static void the_interceptor_weak_notify (gpointer data,
     GObject * where_the_object_was);
 
+static GumAttachReturn gum_interceptor_attach_resolved (GumInterceptor * self,
+    gpointer function_address, GumInvocationListener * listener,
+    gpointer listener_function_data);
 static GumFunctionContext * gum_interceptor_instrument (GumInterceptor * self,
     gpointer function_address, GumInstrumentationError * error);
 static void gum_interceptor_activate (GumInterceptor * self,
@@ -170,6 +179,8 @@ static void gum_function_context_add_listener (
 static void gum_function_context_remove_listener (
     GumFunctionContext * function_ctx, GumInvocationListener * listener);
 static void listener_entry_free (ListenerEntry * entry);
+static void gum_function_context_update_fast_path (
+    GumFunctionContext * function_ctx);
 static gboolean gum_function_context_has_listener (
     GumFunctionContext * function_ctx, GumInvocationListener * listener);
 static ListenerEntry ** gum_function_context_find_listener (
@@ -204,6 +215,8 @@ static gboolean gum_interceptor_has (GumInterceptor * self,
 
 static gpointer gum_page_address_from_pointer (gpointer ptr);
 static gint gum_page_address_compare (gconstpointer a, gconstpointer b);
+static GArray * gum_page_runs_from_sorted_pages (GList * pages,
+    guint page_size);
 
 G_DEFINE_TYPE (GumInterceptor, gum_interceptor, G_TYPE_OBJECT)
 
@@ -337,9 +350,7 @@ gum_interceptor_attach (GumInterceptor * self,
                         GumInvocationListener * listener,
                         gpointer listener_function_data)
 {
-  GumAttachReturn result = GUM_ATTACH_OK;
-  GumFunctionContext * function_ctx;
-  GumInstrumentationError error;
+  GumAttachReturn result;
 
   gum_interceptor_ignore_current_thread (self);
   GUM_INTERCEPTOR_LOCK (self);
@@ -348,6 +359,109 @@ gum_interceptor_attach (GumInterceptor * self,
 
   function_address = gum_interceptor_resolve (self, function_address);
 
+  result = gum_interceptor_attach_resolved (self, function_address, listener,
+      listener_function_data);
+
+  gum_interceptor_transaction_end (&self->current_transaction);
+  GUM_INTERCEPTOR_UNLOCK (self);
+  gum_interceptor_unignore_current_thread (self);
+
+  return result;
+}
+
+/*
+ * Attaches listener to each of the n_functions addresses in one transaction,
+ * so the lock is taken once and all pages are patched in a single commit.
+ * Trampolines for targets close to each other are carved out of one
+ * reservation. Returns the number of functions attached; the outcome for each
+ * address is stored in results if not NULL.
+ */
+guint
+gum_interceptor_attach_many (GumInterceptor * self,
+                             const gpointer * function_addresses,
+                             guint n_functions,
+                             GumInvocationListener * listener,
+                             gpointer listener_function_data,
+                             GumAttachReturn * results)
+{
+  guint n_attached = 0;
+  gpointer * resolved;
+  GumAddress lowest, highest;
+  guint n_new, i;
+
+  if (n_functions == 0)
+    return 0;
+
+  gum_interceptor_ignore_current_thread (self);
+  GUM_INTERCEPTOR_LOCK (self);
+  gum_interceptor_transaction_begin (&self->current_transaction);
+  self->current_transaction.is_dirty = TRUE;
+
+  resolved = g_new (gpointer, n_functions);
+  lowest = G_MAXUINT64;
+  highest = 0;
+  n_new = 0;
+
+  for (i = 0; i != n_functions; i++)
+  {
+    gpointer address;
+
+    address = gum_interceptor_resolve (self, function_addresses[i]);
+    resolved[i] = address;
+
+    if (!gum_interceptor_has (self, address))
+    {
+      lowest = MIN (lowest, GUM_ADDRESS (address));
+      highest = MAX (highest, GUM_ADDRESS (address));
+      n_new++;
+    }
+  }
+
+  if (n_new > 1 && highest - lowest <= GUM_INTERCEPTOR_BATCH_MAX_DISTANCE &&
+      gum_process_get_code_signing_policy () != GUM_CODE_SIGNING_REQUIRED)
+  {
+    GumAddressSpec spec;
+
+    /* Keep every slice within reach of the targets at either end. */
+    spec.near_address = GSIZE_TO_POINTER (lowest + ((highest - lowest) / 2));
+    spec.max_distance =
+        GUM_INTERCEPTOR_BATCH_MAX_DISTANCE - ((highest - lowest) / 2);
+
+    gum_code_allocator_try_reserve_slices_near (&self->allocator, &spec,
+        n_new);
+  }
+
+  for (i = 0; i != n_functions; i++)
+  {
+    GumAttachReturn result;
+
+    result = gum_interceptor_attach_resolved (self, resolved[i], listener,
+        listener_function_data);
+    if (result == GUM_ATTACH_OK)
+      n_attached++;
+
+    if (results != NULL)
+      results[i] = result;
+  }
+
+  g_free (resolved);
+
+  gum_interceptor_transaction_end (&self->current_transaction);
+  GUM_INTERCEPTOR_UNLOCK (self);
+  gum_interceptor_unignore_current_thread (self);
+
+  return n_attached;
+}
+
+static GumAttachReturn
+gum_interceptor_attach_resolved (GumInterceptor * self,
+                                 gpointer function_address,
+                                 GumInvocationListener * listener,
+                                 gpointer listener_function_data)
+{
+  GumFunctionContext * function_ctx;
+  GumInstrumentationError error;
+
   function_ctx = gum_interceptor_instrument (self, function_address, &error);
   if (function_ctx == NULL)
     goto instrumentation_error;
@@ -358,35 +472,23 @@ gum_interceptor_attach (GumInterceptor * self,
   gum_function_context_add_listener (function_ctx, listener,
       listener_function_data);
 
-  goto beach;
+  return GUM_ATTACH_OK;
 
 instrumentation_error:
   {
     switch (error)
     {
       case GUM_INSTRUMENTATION_ERROR_WRONG_SIGNATURE:
-        result = GUM_ATTACH_WRONG_SIGNATURE;
-        break;
+        return GUM_ATTACH_WRONG_SIGNATURE;
       case GUM_INSTRUMENTATION_ERROR_POLICY_VIOLATION:
-        result = GUM_ATTACH_POLICY_VIOLATION;
-        break;
+        return GUM_ATTACH_POLICY_VIOLATION;
       default:
         g_assert_not_reached ();
     }
-    goto beach;
   }
 already_attached:
   {
-    result = GUM_ATTACH_ALREADY_ATTACHED;
-    goto beach;
-  }
-beach:
-  {
-    gum_interceptor_transaction_end (&self->current_transaction);
-    GUM_INTERCEPTOR_UNLOCK (self);
-    gum_interceptor_unignore_current_thread (self);
-
-    return result;
+    return GUM_ATTACH_ALREADY_ATTACHED;
   }
 }
 
@@ -456,6 +558,7 @@ gum_interceptor_replace (GumInterceptor * self,
 
   function_ctx->replacement_data = replacement_data;
   function_ctx->replacement_function = replacement_function;
+  gum_function_context_update_fast_path (function_ctx);
 
   goto beach;
 
@@ -507,6 +610,7 @@ gum_interceptor_revert (GumInterceptor * self,
 
   function_ctx->replacement_function = NULL;
   function_ctx->replacement_data = NULL;
+  gum_function_context_update_fast_path (function_ctx);
 
   if (gum_function_context_is_empty (function_ctx))
   {
@@ -555,6 +659,23 @@ gum_interceptor_flush (GumInterceptor * self)
   return flushed;
 }
 
+/*
+ * Number of protection changes, cache flushes and remappings issued while
+ * committing transactions. Contiguous pages are handled as a single range, so
+ * this grows with the number of distinct runs rather than pages.
+ */
+guint
+gum_interceptor_get_commit_syscall_count (GumInterceptor * self)
+{
+  guint count;
+
+  GUM_INTERCEPTOR_LOCK (self);
+  count = self->commit_syscall_count;
+  GUM_INTERCEPTOR_UNLOCK (self);
+
+  return count;
+}
+
 GumInvocationContext *
 gum_interceptor_get_current_invocation (void)
 {
@@ -562,6 +683,9 @@ gum_interceptor_get_current_invocation (void)
   GumInvocationStackEntry * entry;
 
   interceptor_ctx = get_interceptor_thread_context ();
+  if (interceptor_ctx->fast_invocation != NULL)
+    return interceptor_ctx->fast_invocation;
+
   entry = gum_invocation_stack_peek_top (interceptor_ctx->stack);
   if (entry == NULL)
     return NULL;
@@ -664,9 +788,14 @@ gum_interceptor_restore (GumInvocationState * state)
 gpointer
 _gum_interceptor_peek_top_caller_return_address (void)
 {
+  InterceptorThreadContext * context;
   GumInvocationStack * stack;
   GumInvocationStackEntry * entry;
 
+  context = g_private_get (&gum_interceptor_context_private);
+  if (context != NULL && context->fast_invocation != NULL)
+    return context->fast_caller_ret_addr;
+
   stack = gum_interceptor_get_current_stack ();
   if (stack->len == 0)
     return NULL;
@@ -876,8 +1005,11 @@ gum_interceptor_transaction_end (GumInterceptorTransaction * self)
   {
     guint page_size;
     gboolean rwx_supported, code_segment_supported;
+    GArray * runs;
+    guint r;
 
     page_size = gum_query_page_size ();
+    runs = gum_page_runs_from_sorted_pages (addresses, page_size);
 
     rwx_supported = gum_query_is_rwx_supported ();
     code_segment_supported = gum_code_segment_is_supported ();
@@ -888,12 +1020,14 @@ gum_interceptor_transaction_end (GumInterceptorTransaction * self)
 
       protection = rwx_supported ? GUM_PAGE_RWX : GUM_PAGE_RW;
 
-      for (cur = addresses; cur != NULL; cur = cur->next)
+      for (r = 0; r != runs->len; r++)
       {
-        gpointer target_page = cur->data;
+        GumMemoryRange * run = &g_array_index (runs, GumMemoryRange, r);
 
-        gum_mprotect (target_page, page_size, protection);
+        gum_mprotect (GSIZE_TO_POINTER (run->base_address), run->size,
+            protection);
       }
+      interceptor->commit_syscall_count += runs->len;
 
       for (cur = addresses; cur != NULL; cur = cur->next)
       {
@@ -918,20 +1052,23 @@ gum_interceptor_transaction_end (GumInterceptorTransaction * self)
 
       if (!rwx_supported)
       {
-        for (cur = addresses; cur != NULL; cur = cur->next)
+        for (r = 0; r != runs->len; r++)
         {
-          gpointer target_page = cur->data;
+          GumMemoryRange * run = &g_array_index (runs, GumMemoryRange, r);
 
-          gum_mprotect (target_page, page_size, GUM_PAGE_RX);
+          gum_mprotect (GSIZE_TO_POINTER (run->base_address), run->size,
+              GUM_PAGE_RX);
         }
+        interceptor->commit_syscall_count += runs->len;
       }
 
-      for (cur = addresses; cur != NULL; cur = cur->next)
+      for (r = 0; r != runs->len; r++)
       {
-        gpointer target_page = cur->data;
+        GumMemoryRange * run = &g_array_index (runs, GumMemoryRange, r);
 
-        gum_clear_cache (target_page, page_size);
+        gum_clear_cache (GSIZE_TO_POINTER (run->base_address), run->size);
       }
+      interceptor->commit_syscall_count += runs->len;
     }
     else
     {
@@ -982,19 +1119,23 @@ gum_interceptor_transaction_end (GumInterceptorTransaction * self)
       gum_code_segment_realize (segment);
 
       source_offset = 0;
-      for (cur = addresses; cur != NULL; cur = cur->next)
+      for (r = 0; r != runs->len; r++)
       {
-        gpointer target_page = cur->data;
+        GumMemoryRange * run = &g_array_index (runs, GumMemoryRange, r);
+        gpointer target = GSIZE_TO_POINTER (run->base_address);
 
-        gum_code_segment_map (segment, source_offset, page_size, target_page);
+        gum_code_segment_map (segment, source_offset, run->size, target);
 
-        gum_clear_cache (target_page, page_size);
+        gum_clear_cache (target, run->size);
 
-        source_offset += page_size;
+        source_offset += run->size;
       }
+      interceptor->commit_syscall_count += 2 * runs->len;
 
       gum_code_segment_free (segment);
     }
+
+    g_array_free (runs, TRUE);
   }
 
   g_list_free (addresses);
@@ -1181,6 +1322,8 @@ gum_function_context_add_listener (GumFunctionContext * function_ctx,
   {
     function_ctx->has_on_leave_listener = TRUE;
   }
+
+  gum_function_context_update_fast_path (function_ctx);
 }
 
 static void
@@ -1216,6 +1359,45 @@ gum_function_context_remove_listener (GumFunctionContext * function_ctx,
     }
   }
   function_ctx->has_on_leave_listener = has_on_leave_listener;
+
+  gum_function_context_update_fast_path (function_ctx);
+}
+
+/*
+ * A function with a single enter-only listener and no replacement never traps
+ * on leave, so its invocations can be dispatched without touching the
+ * invocation stack.
+ */
+static void
+gum_function_context_update_fast_path (GumFunctionContext * function_ctx)
+{
+  ListenerEntry * fast_entry = NULL;
+  GPtrArray * listener_entries;
+  guint i;
+
+  listener_entries =
+      (GPtrArray *) g_atomic_pointer_get (&function_ctx->listener_entries);
+
+  if (function_ctx->replacement_function == NULL &&
+      !function_ctx->has_on_leave_listener)
+  {
+    for (i = 0; i != listener_entries->len; i++)
+    {
+      ListenerEntry * entry = g_ptr_array_index (listener_entries, i);
+      if (entry == NULL)
+        continue;
+
+      if (fast_entry != NULL || entry->listener_interface->on_enter == NULL)
+      {
+        fast_entry = NULL;
+        break;
+      }
+
+      fast_entry = entry;
+    }
+  }
+
+  g_atomic_pointer_set (&function_ctx->fast_listener_entry, fast_entry);
 }
 
 static gboolean
@@ -1276,6 +1458,7 @@ _gum_function_context_begin_invocation (GumFunctionContext * function_ctx,
   GumInvocationStack * stack;
   GumInvocationStackEntry * stack_entry;
   GumInvocationContext * invocation_ctx = NULL;
+  ListenerEntry * fast_entry;
   gint system_error;
   gboolean invoke_listeners = TRUE;
   gboolean will_trap_on_leave;
@@ -1325,20 +1508,54 @@ _gum_function_context_begin_invocation (GumFunctionContext * function_ctx,
     invoke_listeners = (interceptor_ctx->ignore_level <= 0);
   }
 
+  fast_entry = g_atomic_pointer_get (&function_ctx->fast_listener_entry);
+  if (fast_entry != NULL)
+  {
+    gum_function_context_fixup_cpu_context (function_ctx, cpu_context);
+
+    if (invoke_listeners)
+    {
+      GumInvocationContext fast_ctx;
+      ListenerInvocationState state;
+      guint8 invocation_data[GUM_MAX_LISTENER_DATA];
+
+      fast_ctx.function = GUM_POINTER_TO_FUNCPTR (GCallback,
+          gum_sign_code_pointer (function_ctx->function_address));
+      fast_ctx.cpu_context = cpu_context;
+      fast_ctx.system_error = system_error;
+      fast_ctx.backend = &interceptor_ctx->fast_listener_backend;
+
+      state.point_cut = GUM_POINT_ENTER;
+      state.entry = fast_entry;
+      state.interceptor_ctx = interceptor_ctx;
+      state.invocation_data = invocation_data;
+      fast_ctx.backend->data = &state;
+
+      interceptor_ctx->fast_invocation = &fast_ctx;
+      interceptor_ctx->fast_caller_ret_addr = *caller_ret_addr;
+      fast_entry->listener_interface->on_enter (fast_entry->listener_instance,
+          &fast_ctx);
+      interceptor_ctx->fast_invocation = NULL;
+
+      system_error = fast_ctx.system_error;
+    }
+
+    gum_thread_set_system_error (system_error);
+
+    gum_tls_key_set_value (gum_interceptor_guard_key, NULL);
+
+    *next_hop = function_ctx->on_invoke_trampoline;
+    goto bypass;
+  }
+
   will_trap_on_leave = function_ctx->replacement_function != NULL ||
       (invoke_listeners && function_ctx->has_on_leave_listener);
-  if (will_trap_on_leave)
+  if (will_trap_on_leave || invoke_listeners)
   {
     stack_entry = gum_invocation_stack_push (stack, function_ctx,
         *caller_ret_addr);
     invocation_ctx = &stack_entry->invocation_context;
   }
-  else if (invoke_listeners)
-  {
-    stack_entry = gum_invocation_stack_push (stack, function_ctx,
-        function_ctx->function_address);
-    invocation_ctx = &stack_entry->invocation_context;
-  }
 
   if (invocation_ctx != NULL)
     invocation_ctx->system_error = system_error;
@@ -1584,6 +1801,15 @@ gum_interceptor_invocation_get_depth (GumInvocationContext * context)
   return interceptor_ctx->stack->len - 1;
 }
 
+static guint
+gum_interceptor_invocation_get_fast_depth (GumInvocationContext * context)
+{
+  InterceptorThreadContext * interceptor_ctx =
+      (InterceptorThreadContext *) context->backend->state;
+
+  return interceptor_ctx->stack->len;
+}
+
 static gpointer
 gum_interceptor_invocation_get_listener_thread_data (
     GumInvocationContext * context,
@@ -1643,6 +1869,24 @@ gum_interceptor_listener_invocation_backend =
   NULL
 };
 
+static const GumInvocationBackend
+gum_interceptor_fast_listener_invocation_backend =
+{
+  gum_interceptor_invocation_get_listener_point_cut,
+
+  gum_interceptor_invocation_get_thread_id,
+  gum_interceptor_invocation_get_fast_depth,
+
+  gum_interceptor_invocation_get_listener_thread_data,
+  gum_interceptor_invocation_get_listener_function_data,
+  gum_interceptor_invocation_get_listener_invocation_data,
+
+  NULL,
+
+  NULL,
+  NULL
+};
+
 static const GumInvocationBackend
 gum_interceptor_replacement_invocation_backend =
 {
@@ -1668,12 +1912,16 @@ interceptor_thread_context_new (void)
 
   context = g_slice_new0 (InterceptorThreadContext);
 
+  gum_memcpy (&context->fast_listener_backend,
+      &gum_interceptor_fast_listener_invocation_backend,
+      sizeof (GumInvocationBackend));
   gum_memcpy (&context->listener_backend,
       &gum_interceptor_listener_invocation_backend,
       sizeof (GumInvocationBackend));
   gum_memcpy (&context->replacement_backend,
       &gum_interceptor_replacement_invocation_backend,
       sizeof (GumInvocationBackend));
+  context->fast_listener_backend.state = context;
   context->listener_backend.state = context;
   context->replacement_backend.state = context;
 
@@ -1848,5 +2096,45 @@ static gint
 gum_page_address_compare (gconstpointer a,
                           gconstpointer b)
 {
-  return GPOINTER_TO_SIZE (a) - GPOINTER_TO_SIZE (b);
+  gsize page_a = GPOINTER_TO_SIZE (a);
+  gsize page_b = GPOINTER_TO_SIZE (b);
+
+  if (page_a < page_b)
+    return -1;
+  if (page_a > page_b)
+    return 1;
+  return 0;
+}
+
+static GArray *
+gum_page_runs_from_sorted_pages (GList * pages,
+                                 guint page_size)
+{
+  GArray * runs;
+  GList * cur;
+
+  runs = g_array_new (FALSE, FALSE, sizeof (GumMemoryRange));
+
+  for (cur = pages; cur != NULL; cur = cur->next)
+  {
+    GumAddress page = GUM_ADDRESS (cur->data);
+    GumMemoryRange * last;
+
+    last = (runs->len != 0)
+        ? &g_array_index (runs, GumMemoryRange, runs->len - 1)
+        : NULL;
+
+    if (last != NULL && last->base_address + last->size == page)
+    {
+      last->size += page_size;
+    }
+    else
+    {
+      GumMemoryRange run = { page, page_size };
+
+      g_array_append_val (runs, run);
+    }
+  }
+
+  return runs;
 }
@@ -42,6 +42,10 @@ GUM_API GumInterceptor * gum_interceptor_obtain (void);
 GUM_API GumAttachReturn gum_interceptor_attach (GumInterceptor * self,
     gpointer function_address, GumInvocationListener * listener,
     gpointer listener_function_data);
+GUM_API guint gum_interceptor_attach_many (GumInterceptor * self,
+    const gpointer * function_addresses, guint n_functions,
+    GumInvocationListener * listener, gpointer listener_function_data,
+    GumAttachReturn * results);
 GUM_API void gum_interceptor_detach (GumInterceptor * self,
     GumInvocationListener * listener);
 
@@ -54,6 +58,7 @@ GUM_API void gum_interceptor_revert (GumInterceptor * self,
 GUM_API void gum_interceptor_begin_transaction (GumInterceptor * self);
 GUM_API void gum_interceptor_end_transaction (GumInterceptor * self);
 GUM_API gboolean gum_interceptor_flush (GumInterceptor * self);
+GUM_API guint gum_interceptor_get_commit_syscall_count (GumInterceptor * self);
 
 GUM_API GumInvocationContext * gum_interceptor_get_current_invocation (void);
 GUM_API GumInvocationStack * gum_interceptor_get_current_stack (void);
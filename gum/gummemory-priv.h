@@ -40,6 +40,9 @@ G_GNUC_INTERNAL void _gum_memory_backend_deinit (void);
 G_GNUC_INTERNAL guint _gum_memory_backend_query_page_size (void);
 G_GNUC_INTERNAL gint _gum_page_protection_to_posix (GumPageProtection prot);
 
+G_GNUC_INTERNAL void _gum_memory_note_map_change (void);
+G_GNUC_INTERNAL guint _gum_memory_query_map_generation (void);
+
 G_GNUC_INTERNAL gpointer gum_internal_malloc (size_t size);
 G_GNUC_INTERNAL gpointer gum_internal_calloc (size_t count, size_t size);
 G_GNUC_INTERNAL gpointer gum_internal_realloc (gpointer mem, size_t size);
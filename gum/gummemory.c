@@ -8,13 +8,27 @@
 
 #include "gumcloak-priv.h"
 #include "gumcodesegment.h"
+#include "gumexceptor.h"
 #include "gumlibc.h"
 #include "gummemory-priv.h"
 
 #ifdef HAVE_PTRAUTH
 # include <ptrauth.h>
 #endif
+#include <stdlib.h>
 #include <string.h>
+#if defined (HAVE_I386) && (defined (__SSE2__) || defined (_M_X64) || \
+    (defined (_M_IX86_FP) && _M_IX86_FP >= 2))
+# define GUM_SCAN_USE_SSE2 1
+# include <emmintrin.h>
+#endif
+#if defined (HAVE_I386) && defined (__GNUC__)
+# define GUM_SCAN_USE_AVX2 1
+# include <immintrin.h>
+#endif
+#ifdef _MSC_VER
+# include <intrin.h>
+#endif
 
 #ifdef HAVE_ANDROID
 # include "backend-linux/gumandroid.h"
@@ -44,6 +58,137 @@
 # pragma warning (pop)
 #endif
 
+#define GUM_MEMORY_SCAN_CHUNK_SIZE (4 * 1024 * 1024)
+#define GUM_MATCH_PATTERN_SET_MAX_VARIANTS 256
+#define GUM_MATCH_STATE_NONE G_MAXUINT32
+
+typedef struct _GumExactScan GumExactScan;
+typedef struct _GumParallelScan GumParallelScan;
+typedef struct _GumMatchEdge GumMatchEdge;
+typedef struct _GumMatchKeyword GumMatchKeyword;
+typedef struct _GumParallelScanChunk GumParallelScanChunk;
+typedef struct _GumParallelScanMerge GumParallelScanMerge;
+
+struct _GumExactScan
+{
+  const GumMatchPattern * pattern;
+  const GumMatchToken * needle;
+
+  guint first_index;
+  guint8 first_byte;
+  guint second_index;
+  guint8 second_byte;
+
+  GumMemoryScanMatchFunc func;
+  gpointer user_data;
+};
+
+struct _GumParallelScan
+{
+  const GumMatchPattern * pattern;
+  GArray * chunks;
+  volatile gint next_chunk;
+  GumExceptor * exceptor;
+
+  guint pending_workers;
+  GMutex mutex;
+  GCond cond;
+};
+
+struct _GumMatchPatternSet
+{
+  GPtrArray * patterns;
+
+  guint32 root_transitions[256];
+
+  guint32 * edge_offsets;
+  GumMatchEdge * edges;
+  guint32 * fail;
+  guint n_states;
+
+  guint32 * output_offsets;
+  GumMatchKeyword * outputs;
+};
+
+struct _GumMatchEdge
+{
+  guint8 byte;
+  guint32 next;
+};
+
+struct _GumMatchKeyword
+{
+  guint pattern_index;
+  guint length;
+  guint offset;
+};
+
+struct _GumParallelScanChunk
+{
+  GumMemoryRange range;
+  GumAddress end;
+  gboolean starts_range;
+  GArray * matches;
+};
+
+struct _GumParallelScanMerge
+{
+  const GumMatchPattern * pattern;
+  GumMemoryScanMatchFunc func;
+  gpointer user_data;
+
+  GumAddress resume;
+
+  const GumParallelScanChunk * chunk;
+  guint next_match;
+  gboolean resynced;
+  GArray * rescanned;
+};
+
+static gint gum_memory_range_compare_base (const GumMemoryRange * a,
+    const GumMemoryRange * b);
+static void gum_parallel_scan_process (GumParallelScan * self);
+static void gum_parallel_scan_worker_process (GumParallelScan * scan,
+    gpointer user_data);
+static gboolean gum_parallel_scan_chunk_collect_match (GumAddress address,
+    gsize size, GumParallelScanChunk * chunk);
+static gboolean gum_parallel_scan_merge_chunk (GumParallelScanMerge * self,
+    const GumParallelScanChunk * chunk, GumExceptor * exceptor);
+static gboolean gum_parallel_scan_merge_rescanned_match (GumAddress address,
+    gsize size, GumParallelScanMerge * self);
+
+static void gum_match_pattern_set_add_keywords (GumMatchPatternSet * self,
+    guint pattern_index, GPtrArray * edges, GPtrArray * outputs);
+static void gum_match_pattern_set_insert_keyword (GPtrArray * edges,
+    GPtrArray * outputs, const guint8 * bytes, guint length,
+    const GumMatchKeyword * keyword);
+static void gum_match_pattern_set_resolve (GumMatchPatternSet * self,
+    GPtrArray * edges, GPtrArray * outputs);
+static guint32 gum_match_pattern_set_step (const GumMatchPatternSet * self,
+    guint32 state, guint8 byte);
+static guint32 gum_match_edges_find_child (GPtrArray * edges, guint32 state,
+    guint8 byte);
+static gboolean gum_match_edges_lookup (const GumMatchEdge * edges,
+    guint n_edges, guint8 byte, guint * index);
+
+static void gum_exact_scan_init (GumExactScan * scan,
+    const GumMatchPattern * pattern, const GumMatchToken * needle,
+    GumMemoryScanMatchFunc func, gpointer user_data);
+static guint gum_byte_commonness (guint8 byte);
+static gboolean gum_exact_scan_run_scalar (const GumExactScan * scan,
+    guint8 * cur, guint8 * end);
+#ifdef GUM_SCAN_USE_SSE2
+static gboolean gum_exact_scan_run_sse2 (const GumExactScan * scan,
+    guint8 * cur, guint8 * end);
+#endif
+#ifdef GUM_SCAN_USE_AVX2
+static gboolean gum_exact_scan_run_avx2 (const GumExactScan * scan,
+    guint8 * cur, guint8 * end);
+#endif
+static guint8 * gum_exact_scan_check (const GumExactScan * scan,
+    guint8 * candidate, gboolean * carry_on);
+static guint gum_count_trailing_zeros (guint32 value);
+
 static GumMatchPattern * gum_match_pattern_new (void);
 static void gum_match_pattern_update_computed_size (GumMatchPattern * self);
 static GumMatchToken * gum_match_pattern_get_longest_token (
@@ -66,6 +211,10 @@ static guint gum_heap_ref_count = 0;
 static mspace gum_mspace_main = NULL;
 static mspace gum_mspace_internal = NULL;
 static guint gum_cached_page_size;
+static gint gum_memory_map_generation = 0;
+
+G_LOCK_DEFINE_STATIC (gum_memory_scan_pool);
+static GThreadPool * gum_memory_scan_pool = NULL;
 
 #ifdef HAVE_ANDROID
 G_LOCK_DEFINE_STATIC (gum_softened_code_pages);
@@ -106,6 +255,12 @@ gum_internal_heap_unref (void)
 
   (void) DESTROY_LOCK (&malloc_global_mutex);
 
+  if (gum_memory_scan_pool != NULL)
+  {
+    g_thread_pool_free (gum_memory_scan_pool, FALSE, TRUE);
+    gum_memory_scan_pool = NULL;
+  }
+
   _gum_cloak_deinit ();
 
   _gum_memory_backend_deinit ();
@@ -299,26 +454,39 @@ gum_memory_scan (const GumMemoryRange * range,
   cur = GSIZE_TO_POINTER (range->base_address);
   end_address = cur + range->size - (pattern->size - needle->offset) + 1;
 
-  for (; cur < end_address; cur++)
+  if (mask_data == NULL)
   {
-    guint8 * start;
+    GumExactScan scan;
+
+    if (range->size < pattern->size)
+      return;
 
-    if (mask_data == NULL)
+    gum_exact_scan_init (&scan, pattern, needle, func, user_data);
+
+#ifdef GUM_SCAN_USE_AVX2
+    if (__builtin_cpu_supports ("avx2"))
     {
-      if (cur[0] != needle_data[0] ||
-          memcmp (cur, needle_data, needle_len) != 0)
-      {
-        continue;
-      }
+      gum_exact_scan_run_avx2 (&scan, cur, end_address);
+      return;
     }
-    else
+#endif
+#ifdef GUM_SCAN_USE_SSE2
+    gum_exact_scan_run_sse2 (&scan, cur, end_address);
+#else
+    gum_exact_scan_run_scalar (&scan, cur, end_address);
+#endif
+    return;
+  }
+
+  for (; cur < end_address; cur++)
+  {
+    guint8 * start;
+
+    if ((cur[0] & mask_data[0]) != (needle_data[0] & mask_data[0]) ||
+        gum_memcmp_mask ((guint8 *) cur, (guint8 *) needle_data,
+            (guint8 *) mask_data, needle_len) != 0)
     {
-      if ((cur[0] & mask_data[0]) != (needle_data[0] & mask_data[0]) ||
-          gum_memcmp_mask ((guint8 *) cur, (guint8 *) needle_data,
-              (guint8 *) mask_data, needle_len) != 0)
-      {
-        continue;
-      }
+      continue;
     }
 
     start = cur - needle->offset;
@@ -333,6 +501,587 @@ gum_memory_scan (const GumMemoryRange * range,
   }
 }
 
+/*
+ * Splits the ranges, in ascending address order, into chunks that are scanned
+ * concurrently by the calling thread and a pool of workers that is kept
+ * around for subsequent scans. Each chunk is extended by the pattern size
+ * minus one so that matches straddling a chunk boundary are found, and is
+ * only responsible for matches starting inside it. Matches are delivered on
+ * the calling thread in address order once all chunks have been scanned, and
+ * are the same as gum_memory_scan() would report for each range. When a
+ * match spills into the next chunk, that chunk is rescanned from the end of
+ * the match until its matches line up with the serial ones again. The
+ * callback is never invoked while memory is being accessed, so it may fault
+ * on its own terms. Chunks that fault while being scanned, e.g. due to
+ * concurrent unmapping, are skipped.
+ */
+void
+gum_memory_scan_ranges (const GumMemoryRange * ranges,
+                        guint n_ranges,
+                        const GumMatchPattern * pattern,
+                        guint n_threads,
+                        GumMemoryScanMatchFunc func,
+                        gpointer user_data)
+{
+  GumParallelScan scan;
+  GumMemoryRange * sorted_ranges;
+  GumParallelScanMerge merge;
+  guint i;
+
+  scan.pattern = pattern;
+  scan.chunks = g_array_new (FALSE, FALSE, sizeof (GumParallelScanChunk));
+  scan.next_chunk = 0;
+  scan.exceptor = gum_exceptor_obtain ();
+  scan.pending_workers = 0;
+  g_mutex_init (&scan.mutex);
+  g_cond_init (&scan.cond);
+
+  sorted_ranges = g_memdup (ranges, n_ranges * sizeof (GumMemoryRange));
+  qsort (sorted_ranges, n_ranges, sizeof (GumMemoryRange),
+      (GCompareFunc) gum_memory_range_compare_base);
+
+  for (i = 0; i != n_ranges; i++)
+  {
+    const GumMemoryRange * r = &sorted_ranges[i];
+    gsize offset;
+
+    for (offset = 0; offset < r->size; offset += GUM_MEMORY_SCAN_CHUNK_SIZE)
+    {
+      GumParallelScanChunk chunk;
+      gsize owned_size;
+
+      owned_size = MIN (r->size - offset, GUM_MEMORY_SCAN_CHUNK_SIZE);
+
+      chunk.range.base_address = r->base_address + offset;
+      chunk.range.size = MIN (r->size - offset,
+          owned_size + pattern->size - 1);
+      chunk.end = chunk.range.base_address + owned_size;
+      chunk.starts_range = offset == 0;
+      chunk.matches = g_array_new (FALSE, FALSE, sizeof (GumAddress));
+      g_array_append_val (scan.chunks, chunk);
+    }
+  }
+
+  g_free (sorted_ranges);
+
+  if (n_threads == 0)
+    n_threads = g_get_num_processors ();
+  n_threads = MAX (MIN (n_threads, scan.chunks->len), 1);
+
+  if (n_threads > 1)
+  {
+    G_LOCK (gum_memory_scan_pool);
+
+    if (gum_memory_scan_pool == NULL)
+    {
+      gum_memory_scan_pool = g_thread_pool_new (
+          (GFunc) gum_parallel_scan_worker_process,
+          NULL,
+          g_get_num_processors (),
+          FALSE,
+          NULL);
+    }
+
+    scan.pending_workers = n_threads - 1;
+    for (i = 0; i != n_threads - 1; i++)
+      g_thread_pool_push (gum_memory_scan_pool, &scan, NULL);
+
+    G_UNLOCK (gum_memory_scan_pool);
+  }
+
+  gum_parallel_scan_process (&scan);
+
+  g_mutex_lock (&scan.mutex);
+  while (scan.pending_workers != 0)
+    g_cond_wait (&scan.cond, &scan.mutex);
+  g_mutex_unlock (&scan.mutex);
+
+  merge.pattern = pattern;
+  merge.func = func;
+  merge.user_data = user_data;
+  merge.resume = 0;
+  merge.rescanned = g_array_new (FALSE, FALSE, sizeof (GumAddress));
+
+  for (i = 0; i != scan.chunks->len; i++)
+  {
+    if (!gum_parallel_scan_merge_chunk (&merge,
+        &g_array_index (scan.chunks, GumParallelScanChunk, i), scan.exceptor))
+      break;
+  }
+
+  g_array_free (merge.rescanned, TRUE);
+
+  for (i = 0; i != scan.chunks->len; i++)
+    g_array_free (g_array_index (scan.chunks, GumParallelScanChunk, i).matches,
+        TRUE);
+  g_cond_clear (&scan.cond);
+  g_mutex_clear (&scan.mutex);
+  g_object_unref (scan.exceptor);
+  g_array_free (scan.chunks, TRUE);
+}
+
+static gint
+gum_memory_range_compare_base (const GumMemoryRange * a,
+                               const GumMemoryRange * b)
+{
+  if (a->base_address < b->base_address)
+    return -1;
+  if (a->base_address > b->base_address)
+    return 1;
+  return 0;
+}
+
+#ifdef _MSC_VER
+# pragma warning (push)
+# pragma warning (disable: 4611)
+#endif
+
+static void
+gum_parallel_scan_process (GumParallelScan * self)
+{
+  guint n_chunks = self->chunks->len;
+  gint index;
+
+  while ((index = g_atomic_int_add (&self->next_chunk, 1)) < (gint) n_chunks)
+  {
+    GumParallelScanChunk * chunk;
+    GumExceptorScope scope;
+
+    chunk = &g_array_index (self->chunks, GumParallelScanChunk, index);
+
+    if (gum_exceptor_try (self->exceptor, &scope))
+    {
+      gum_memory_scan (&chunk->range, self->pattern,
+          (GumMemoryScanMatchFunc) gum_parallel_scan_chunk_collect_match,
+          chunk);
+    }
+
+    gum_exceptor_catch (self->exceptor, &scope);
+  }
+}
+
+static void
+gum_parallel_scan_worker_process (GumParallelScan * scan,
+                                  gpointer user_data)
+{
+  gum_parallel_scan_process (scan);
+
+  g_mutex_lock (&scan->mutex);
+  if (--scan->pending_workers == 0)
+    g_cond_signal (&scan->cond);
+  g_mutex_unlock (&scan->mutex);
+}
+
+static gboolean
+gum_parallel_scan_merge_chunk (GumParallelScanMerge * self,
+                               const GumParallelScanChunk * chunk,
+                               GumExceptor * exceptor)
+{
+  const GumMatchPattern * pattern = self->pattern;
+  GArray * matches = chunk->matches;
+  guint i;
+
+  if (chunk->starts_range)
+    self->resume = chunk->range.base_address;
+
+  if (self->resume >= chunk->end)
+    return TRUE;
+
+  self->chunk = chunk;
+  self->next_match = 0;
+
+  if (self->resume > chunk->range.base_address)
+  {
+    GumMemoryRange rest;
+    GumExceptorScope scope;
+
+    rest.base_address = self->resume;
+    rest.size = chunk->range.base_address + chunk->range.size - self->resume;
+
+    self->resynced = FALSE;
+    g_array_set_size (self->rescanned, 0);
+
+    if (gum_exceptor_try (exceptor, &scope))
+    {
+      gum_memory_scan (&rest, pattern,
+          (GumMemoryScanMatchFunc) gum_parallel_scan_merge_rescanned_match,
+          self);
+    }
+
+    gum_exceptor_catch (exceptor, &scope);
+
+    for (i = 0; i != self->rescanned->len; i++)
+    {
+      GumAddress address = g_array_index (self->rescanned, GumAddress, i);
+
+      if (!self->func (address, pattern->size, self->user_data))
+        return FALSE;
+
+      self->resume = address + pattern->size;
+    }
+
+    if (!self->resynced)
+      return TRUE;
+  }
+
+  for (i = self->next_match; i != matches->len; i++)
+  {
+    GumAddress address = g_array_index (matches, GumAddress, i);
+
+    if (!self->func (address, pattern->size, self->user_data))
+      return FALSE;
+
+    self->resume = address + pattern->size;
+  }
+
+  return TRUE;
+}
+
+#ifdef _MSC_VER
+# pragma warning (pop)
+#endif
+
+static gboolean
+gum_parallel_scan_chunk_collect_match (GumAddress address,
+                                       gsize size,
+                                       GumParallelScanChunk * chunk)
+{
+  if (address >= chunk->end)
+    return FALSE;
+
+  g_array_append_val (chunk->matches, address);
+
+  return TRUE;
+}
+
+/*
+ * Matches found while rescanning the part of a chunk that the serial scan
+ * would resume in. Once one of them is also among the chunk's own matches,
+ * both scans continue identically, so the rest can be taken from the chunk.
+ * The ones before that are only collected here, and delivered once the
+ * rescan has left the exceptor scope.
+ */
+static gboolean
+gum_parallel_scan_merge_rescanned_match (GumAddress address,
+                                         gsize size,
+                                         GumParallelScanMerge * self)
+{
+  GArray * matches = self->chunk->matches;
+
+  if (address >= self->chunk->end)
+    return FALSE;
+
+  while (self->next_match != matches->len &&
+      g_array_index (matches, GumAddress, self->next_match) < address)
+  {
+    self->next_match++;
+  }
+
+  if (self->next_match != matches->len &&
+      g_array_index (matches, GumAddress, self->next_match) == address)
+  {
+    self->resynced = TRUE;
+    return FALSE;
+  }
+
+  g_array_append_val (self->rescanned, address);
+
+  return TRUE;
+}
+
+void
+gum_memory_scan_pattern_set (const GumMemoryRange * range,
+                             const GumMatchPatternSet * set,
+                             GumMemoryScanPatternSetMatchFunc func,
+                             gpointer user_data)
+{
+  guint8 * begin, * end, * cur;
+  guint32 state;
+
+  begin = GSIZE_TO_POINTER (range->base_address);
+  end = begin + range->size;
+
+  state = 0;
+  for (cur = begin; cur != end; cur++)
+  {
+    guint32 i;
+
+    state = gum_match_pattern_set_step (set, state, *cur);
+
+    for (i = set->output_offsets[state];
+        i != set->output_offsets[state + 1];
+        i++)
+    {
+      const GumMatchKeyword * keyword = &set->outputs[i];
+      const GumMatchPattern * pattern;
+      gsize keyword_start;
+      guint8 * start;
+
+      pattern = g_ptr_array_index (set->patterns, keyword->pattern_index);
+
+      keyword_start = (cur - begin) + 1 - keyword->length;
+      if (keyword_start < keyword->offset)
+        continue;
+      start = begin + keyword_start - keyword->offset;
+      if ((gsize) (end - start) < pattern->size)
+        continue;
+
+      if (!gum_match_pattern_try_match_on (pattern, start))
+        continue;
+
+      if (!func (GUM_ADDRESS (start), pattern->size, keyword->pattern_index,
+          user_data))
+      {
+        return;
+      }
+    }
+  }
+}
+
+static void
+gum_exact_scan_init (GumExactScan * scan,
+                     const GumMatchPattern * pattern,
+                     const GumMatchToken * needle,
+                     GumMemoryScanMatchFunc func,
+                     gpointer user_data)
+{
+  const guint8 * data = (const guint8 *) needle->bytes->data;
+  guint len = needle->bytes->len;
+  guint i, first, second;
+
+  first = 0;
+  for (i = 1; i != len; i++)
+  {
+    if (gum_byte_commonness (data[i]) < gum_byte_commonness (data[first]))
+      first = i;
+  }
+
+  second = first;
+  for (i = 0; i != len; i++)
+  {
+    if (i == first)
+      continue;
+
+    if (second == first ||
+        gum_byte_commonness (data[i]) < gum_byte_commonness (data[second]))
+    {
+      second = i;
+    }
+  }
+
+  scan->pattern = pattern;
+  scan->needle = needle;
+
+  scan->first_index = first;
+  scan->first_byte = data[first];
+  scan->second_index = second;
+  scan->second_byte = data[second];
+
+  scan->func = func;
+  scan->user_data = user_data;
+}
+
+/*
+ * Rough ranking of how often a byte shows up in typical process memory, used
+ * to pick the anchors least likely to produce false candidates.
+ */
+static guint
+gum_byte_commonness (guint8 byte)
+{
+  if (byte == 0x00)
+    return 255;
+  if (byte == 0xff)
+    return 200;
+  if (byte < 0x10 || byte == 0xcc || byte == 0x90 || byte == 0x48 ||
+      byte == 0x89 || byte == 0x8b)
+    return 150;
+  if (byte == ' ' || (byte >= 'a' && byte <= 'z'))
+    return 120;
+  if ((byte >= 'A' && byte <= 'Z') || (byte >= '0' && byte <= '9'))
+    return 100;
+  if (byte < 0x80)
+    return 60;
+  return 20;
+}
+
+static gboolean
+gum_exact_scan_run_scalar (const GumExactScan * scan,
+                           guint8 * cur,
+                           guint8 * end)
+{
+  const guint first_index = scan->first_index;
+  const guint second_index = scan->second_index;
+  const guint8 second_byte = scan->second_byte;
+
+  while (cur < end)
+  {
+    guint8 * hit, * candidate;
+
+    hit = memchr (cur + first_index, scan->first_byte, end - cur);
+    if (hit == NULL)
+      break;
+    candidate = hit - first_index;
+
+    if (candidate[second_index] == second_byte)
+    {
+      gboolean carry_on;
+
+      cur = gum_exact_scan_check (scan, candidate, &carry_on);
+      if (!carry_on)
+        return FALSE;
+    }
+    else
+    {
+      cur = candidate + 1;
+    }
+  }
+
+  return TRUE;
+}
+
+#ifdef GUM_SCAN_USE_SSE2
+
+static gboolean
+gum_exact_scan_run_sse2 (const GumExactScan * scan,
+                         guint8 * cur,
+                         guint8 * end)
+{
+  const __m128i first = _mm_set1_epi8 ((char) scan->first_byte);
+  const __m128i second = _mm_set1_epi8 ((char) scan->second_byte);
+
+  while (end - cur >= 16)
+  {
+    __m128i a, b;
+    guint32 hits;
+    guint8 * next = cur + 16;
+
+    a = _mm_loadu_si128 ((const __m128i *) (cur + scan->first_index));
+    b = _mm_loadu_si128 ((const __m128i *) (cur + scan->second_index));
+    hits = _mm_movemask_epi8 (_mm_and_si128 (_mm_cmpeq_epi8 (a, first),
+        _mm_cmpeq_epi8 (b, second)));
+
+    while (hits != 0)
+    {
+      guint8 * candidate = cur + gum_count_trailing_zeros (hits);
+      gboolean carry_on;
+
+      next = gum_exact_scan_check (scan, candidate, &carry_on);
+      if (!carry_on)
+        return FALSE;
+
+      if (next != candidate + 1)
+        break;
+      next = cur + 16;
+
+      hits &= hits - 1;
+    }
+
+    cur = next;
+  }
+
+  return gum_exact_scan_run_scalar (scan, cur, end);
+}
+
+#endif
+
+#ifdef GUM_SCAN_USE_AVX2
+
+__attribute__ ((target ("avx2")))
+static gboolean
+gum_exact_scan_run_avx2 (const GumExactScan * scan,
+                         guint8 * cur,
+                         guint8 * end)
+{
+  const __m256i first = _mm256_set1_epi8 ((char) scan->first_byte);
+  const __m256i second = _mm256_set1_epi8 ((char) scan->second_byte);
+
+  while (end - cur >= 32)
+  {
+    __m256i a, b;
+    guint32 hits;
+    guint8 * next = cur + 32;
+
+    a = _mm256_loadu_si256 ((const __m256i *) (cur + scan->first_index));
+    b = _mm256_loadu_si256 ((const __m256i *) (cur + scan->second_index));
+    hits = _mm256_movemask_epi8 (_mm256_and_si256 (
+        _mm256_cmpeq_epi8 (a, first), _mm256_cmpeq_epi8 (b, second)));
+
+    while (hits != 0)
+    {
+      guint8 * candidate = cur + gum_count_trailing_zeros (hits);
+      gboolean carry_on;
+
+      next = gum_exact_scan_check (scan, candidate, &carry_on);
+      if (!carry_on)
+        return FALSE;
+
+      if (next != candidate + 1)
+        break;
+      next = cur + 32;
+
+      hits &= hits - 1;
+    }
+
+    cur = next;
+  }
+
+  return gum_exact_scan_run_scalar (scan, cur, end);
+}
+
+#endif
+
+static guint8 *
+gum_exact_scan_check (const GumExactScan * scan,
+                      guint8 * candidate,
+                      gboolean * carry_on)
+{
+  const GumMatchToken * needle = scan->needle;
+  const GumMatchPattern * pattern = scan->pattern;
+  guint8 * start;
+
+  *carry_on = TRUE;
+
+  if (memcmp (candidate, needle->bytes->data, needle->bytes->len) != 0)
+    return candidate + 1;
+
+  start = candidate - needle->offset;
+
+  if (!gum_match_pattern_try_match_on (pattern, start))
+    return candidate + 1;
+
+  if (!scan->func (GUM_ADDRESS (start), pattern->size, scan->user_data))
+  {
+    *carry_on = FALSE;
+    return NULL;
+  }
+
+  return start + pattern->size;
+}
+
+static guint
+gum_count_trailing_zeros (guint32 value)
+{
+#if defined (__GNUC__)
+  return __builtin_ctz (value);
+#elif defined (_MSC_VER)
+  unsigned long index;
+
+  _BitScanForward (&index, value);
+
+  return index;
+#else
+  guint n = 0;
+
+  while ((value & 1) == 0)
+  {
+    value >>= 1;
+    n++;
+  }
+
+  return n;
+#endif
+}
+
 GumMatchPattern *
 gum_match_pattern_new_from_string (const gchar * match_combined_str)
 {
@@ -440,6 +1189,371 @@ parse_error:
   }
 }
 
+/*
+ * Compiles the patterns into an Aho-Corasick automaton keyed on one keyword
+ * per pattern: its longest exact token, or, for patterns made up of masked
+ * tokens only, every value of a prefix of its longest masked token. Keyword
+ * hits are then verified against the full pattern.
+ *
+ * Only the root state has a full 256-entry row. Every other state keeps a
+ * sorted list of its trie edges and falls back along its failure link, so
+ * memory grows with the number of keyword bytes rather than 1 KiB per state.
+ */
+GumMatchPatternSet *
+gum_match_pattern_set_new_from_strings (
+    const gchar * const * match_combined_strs,
+    guint n)
+{
+  GumMatchPatternSet * set;
+  GPtrArray * edges;
+  GPtrArray * outputs;
+  guint i;
+
+  set = g_slice_new0 (GumMatchPatternSet);
+  set->patterns =
+      g_ptr_array_new_with_free_func ((GDestroyNotify) gum_match_pattern_free);
+
+  for (i = 0; i != n; i++)
+  {
+    GumMatchPattern * pattern;
+
+    pattern = gum_match_pattern_new_from_string (match_combined_strs[i]);
+    if (pattern == NULL)
+      goto parse_error;
+
+    g_ptr_array_add (set->patterns, pattern);
+  }
+
+  edges = g_ptr_array_new_with_free_func ((GDestroyNotify) g_array_unref);
+  outputs = g_ptr_array_new_with_free_func ((GDestroyNotify) g_array_unref);
+
+  g_ptr_array_add (edges, g_array_new (FALSE, FALSE, sizeof (GumMatchEdge)));
+  g_ptr_array_add (outputs,
+      g_array_new (FALSE, FALSE, sizeof (GumMatchKeyword)));
+
+  for (i = 0; i != n; i++)
+    gum_match_pattern_set_add_keywords (set, i, edges, outputs);
+
+  gum_match_pattern_set_resolve (set, edges, outputs);
+
+  g_ptr_array_unref (outputs);
+  g_ptr_array_unref (edges);
+
+  return set;
+
+  /* ERRORS */
+parse_error:
+  {
+    gum_match_pattern_set_free (set);
+
+    return NULL;
+  }
+}
+
+void
+gum_match_pattern_set_free (GumMatchPatternSet * set)
+{
+  g_free (set->outputs);
+  g_free (set->output_offsets);
+  g_free (set->fail);
+  g_free (set->edges);
+  g_free (set->edge_offsets);
+  g_ptr_array_unref (set->patterns);
+
+  g_slice_free (GumMatchPatternSet, set);
+}
+
+guint
+gum_match_pattern_set_get_size (const GumMatchPatternSet * set)
+{
+  return set->patterns->len;
+}
+
+static void
+gum_match_pattern_set_add_keywords (GumMatchPatternSet * self,
+                                    guint pattern_index,
+                                    GPtrArray * edges,
+                                    GPtrArray * outputs)
+{
+  GumMatchPattern * pattern;
+  GumMatchToken * token;
+  GumMatchKeyword keyword;
+  const guint8 * bytes, * masks;
+  guint length, n_variants, variant, i;
+  guint8 buffer[8];
+
+  pattern = g_ptr_array_index (self->patterns, pattern_index);
+
+  keyword.pattern_index = pattern_index;
+
+  token = gum_match_pattern_get_longest_token (pattern, GUM_MATCH_EXACT);
+  if (token != NULL)
+  {
+    keyword.length = token->bytes->len;
+    keyword.offset = token->offset;
+
+    gum_match_pattern_set_insert_keyword (edges, outputs,
+        (const guint8 *) token->bytes->data, token->bytes->len, &keyword);
+    return;
+  }
+
+  token = gum_match_pattern_get_longest_token (pattern, GUM_MATCH_MASK);
+  bytes = (const guint8 *) token->bytes->data;
+  masks = (const guint8 *) token->masks->data;
+
+  n_variants = 1;
+  for (length = 0; length != MIN (token->bytes->len, G_N_ELEMENTS (buffer));
+      length++)
+  {
+    guint8 mask;
+    guint n = 1;
+
+    for (mask = ~masks[length]; mask != 0; mask &= mask - 1)
+      n <<= 1;
+
+    if (length != 0 && n_variants * n > GUM_MATCH_PATTERN_SET_MAX_VARIANTS)
+      break;
+    n_variants *= n;
+  }
+
+  keyword.length = length;
+  keyword.offset = token->offset;
+
+  for (variant = 0; variant != n_variants; variant++)
+  {
+    guint remaining = variant;
+
+    for (i = 0; i != length; i++)
+    {
+      guint8 mask = masks[i];
+      guint8 value = bytes[i] & mask;
+      guint bit;
+
+      for (bit = 0; bit != 8; bit++)
+      {
+        if ((mask & (1 << bit)) == 0)
+        {
+          if ((remaining & 1) != 0)
+            value |= 1 << bit;
+          remaining >>= 1;
+        }
+      }
+
+      buffer[i] = value;
+    }
+
+    gum_match_pattern_set_insert_keyword (edges, outputs, buffer, length,
+        &keyword);
+  }
+}
+
+static void
+gum_match_pattern_set_insert_keyword (GPtrArray * edges,
+                                      GPtrArray * outputs,
+                                      const guint8 * bytes,
+                                      guint length,
+                                      const GumMatchKeyword * keyword)
+{
+  guint32 state;
+  guint i;
+
+  state = 0;
+  for (i = 0; i != length; i++)
+  {
+    GArray * children = g_ptr_array_index (edges, state);
+    guint index;
+
+    if (gum_match_edges_lookup ((GumMatchEdge *) children->data,
+        children->len, bytes[i], &index))
+    {
+      state = g_array_index (children, GumMatchEdge, index).next;
+    }
+    else
+    {
+      GumMatchEdge edge;
+
+      edge.byte = bytes[i];
+      edge.next = outputs->len;
+      g_array_insert_val (children, index, edge);
+
+      g_ptr_array_add (edges,
+          g_array_new (FALSE, FALSE, sizeof (GumMatchEdge)));
+      g_ptr_array_add (outputs,
+          g_array_new (FALSE, FALSE, sizeof (GumMatchKeyword)));
+
+      state = edge.next;
+    }
+  }
+
+  g_array_append_val (g_ptr_array_index (outputs, state), *keyword);
+}
+
+static void
+gum_match_pattern_set_resolve (GumMatchPatternSet * self,
+                               GPtrArray * edges,
+                               GPtrArray * outputs)
+{
+  guint n_states = outputs->len;
+  guint32 * fail, * queue;
+  guint head, tail, n_edges, n_outputs, i;
+  guint32 state;
+  GArray * children;
+
+  fail = g_new0 (guint32, n_states);
+  queue = g_new (guint32, n_states);
+  head = 0;
+  tail = 0;
+
+  memset (self->root_transitions, 0, sizeof (self->root_transitions));
+
+  children = g_ptr_array_index (edges, 0);
+  for (i = 0; i != children->len; i++)
+  {
+    const GumMatchEdge * edge = &g_array_index (children, GumMatchEdge, i);
+
+    self->root_transitions[edge->byte] = edge->next;
+    fail[edge->next] = 0;
+    queue[tail++] = edge->next;
+  }
+
+  while (head != tail)
+  {
+    state = queue[head++];
+    children = g_ptr_array_index (edges, state);
+
+    for (i = 0; i != children->len; i++)
+    {
+      const GumMatchEdge * edge = &g_array_index (children, GumMatchEdge, i);
+      guint32 fallback = fail[state];
+      guint32 target;
+      GArray * inherited;
+
+      while ((target = gum_match_edges_find_child (edges, fallback,
+          edge->byte)) == GUM_MATCH_STATE_NONE && fallback != 0)
+      {
+        fallback = fail[fallback];
+      }
+      if (target == GUM_MATCH_STATE_NONE)
+        target = 0;
+
+      fail[edge->next] = target;
+
+      inherited = g_ptr_array_index (outputs, target);
+      g_array_append_vals (g_ptr_array_index (outputs, edge->next),
+          inherited->data, inherited->len);
+
+      queue[tail++] = edge->next;
+    }
+  }
+
+  g_free (queue);
+
+  self->n_states = n_states;
+  self->fail = fail;
+
+  n_edges = 0;
+  n_outputs = 0;
+  for (state = 0; state != n_states; state++)
+  {
+    GArray * keywords = g_ptr_array_index (outputs, state);
+
+    children = g_ptr_array_index (edges, state);
+
+    n_edges += children->len;
+    n_outputs += keywords->len;
+  }
+
+  self->edge_offsets = g_new (guint32, n_states + 1);
+  self->edges = g_new (GumMatchEdge, MAX (n_edges, 1));
+  self->output_offsets = g_new (guint32, n_states + 1);
+  self->outputs = g_new (GumMatchKeyword, MAX (n_outputs, 1));
+
+  n_edges = 0;
+  n_outputs = 0;
+  for (state = 0; state != n_states; state++)
+  {
+    GArray * keywords = g_ptr_array_index (outputs, state);
+
+    children = g_ptr_array_index (edges, state);
+
+    self->edge_offsets[state] = n_edges;
+    memcpy (self->edges + n_edges, children->data,
+        children->len * sizeof (GumMatchEdge));
+    n_edges += children->len;
+
+    self->output_offsets[state] = n_outputs;
+    memcpy (self->outputs + n_outputs, keywords->data,
+        keywords->len * sizeof (GumMatchKeyword));
+    n_outputs += keywords->len;
+  }
+  self->edge_offsets[n_states] = n_edges;
+  self->output_offsets[n_states] = n_outputs;
+}
+
+static guint32
+gum_match_pattern_set_step (const GumMatchPatternSet * self,
+                            guint32 state,
+                            guint8 byte)
+{
+  while (state != 0)
+  {
+    guint32 first = self->edge_offsets[state];
+    guint index;
+
+    if (gum_match_edges_lookup (self->edges + first,
+        self->edge_offsets[state + 1] - first, byte, &index))
+    {
+      return self->edges[first + index].next;
+    }
+
+    state = self->fail[state];
+  }
+
+  return self->root_transitions[byte];
+}
+
+static guint32
+gum_match_edges_find_child (GPtrArray * edges,
+                            guint32 state,
+                            guint8 byte)
+{
+  GArray * children = g_ptr_array_index (edges, state);
+  guint index;
+
+  if (!gum_match_edges_lookup ((GumMatchEdge *) children->data, children->len,
+      byte, &index))
+  {
+    return GUM_MATCH_STATE_NONE;
+  }
+
+  return g_array_index (children, GumMatchEdge, index).next;
+}
+
+static gboolean
+gum_match_edges_lookup (const GumMatchEdge * edges,
+                        guint n_edges,
+                        guint8 byte,
+                        guint * index)
+{
+  guint lower, upper;
+
+  lower = 0;
+  upper = n_edges;
+  while (lower != upper)
+  {
+    guint middle = lower + ((upper - lower) / 2);
+
+    if (edges[middle].byte < byte)
+      lower = middle + 1;
+    else
+      upper = middle;
+  }
+
+  *index = lower;
+
+  return lower != n_edges && edges[lower].byte == byte;
+}
+
 static GumMatchPattern *
 gum_match_pattern_new (void)
 {
@@ -689,6 +1803,18 @@ gum_ensure_code_readable (gconstpointer address,
 #endif
 }
 
+void
+_gum_memory_note_map_change (void)
+{
+  g_atomic_int_inc (&gum_memory_map_generation);
+}
+
+guint
+_gum_memory_query_map_generation (void)
+{
+  return g_atomic_int_get (&gum_memory_map_generation);
+}
+
 void
 gum_mprotect (gpointer address,
               gsize size,
@@ -29,6 +29,7 @@ typedef guint GumPageProtection;
 typedef struct _GumAddressSpec GumAddressSpec;
 typedef struct _GumMemoryRange GumMemoryRange;
 typedef struct _GumMatchPattern GumMatchPattern;
+typedef struct _GumMatchPatternSet GumMatchPatternSet;
 
 typedef gboolean (* GumMemoryIsNearFunc) (gpointer memory, gpointer address);
 
@@ -77,6 +78,8 @@ struct _GumMemoryRange
 typedef void (* GumMemoryPatchApplyFunc) (gpointer mem, gpointer user_data);
 typedef gboolean (* GumMemoryScanMatchFunc) (GumAddress address, gsize size,
     gpointer user_data);
+typedef gboolean (* GumMemoryScanPatternSetMatchFunc) (GumAddress address,
+    gsize size, guint pattern_index, gpointer user_data);
 
 GUM_API void gum_internal_heap_ref (void);
 GUM_API void gum_internal_heap_unref (void);
@@ -90,6 +93,8 @@ GUM_API guint gum_query_page_size (void);
 GUM_API gboolean gum_query_is_rwx_supported (void);
 GUM_API GumRwxSupport gum_query_rwx_support (void);
 GUM_API gboolean gum_memory_is_readable (gconstpointer address, gsize len);
+GUM_API gboolean gum_memory_query_protection (gconstpointer address,
+    GumPageProtection * prot);
 GUM_API guint8 * gum_memory_read (gconstpointer address, gsize len,
     gsize * n_bytes_read);
 GUM_API gboolean gum_memory_write (gpointer address, const guint8 * bytes,
@@ -101,11 +106,22 @@ GUM_API gboolean gum_memory_mark_code (gpointer address, gsize size);
 GUM_API void gum_memory_scan (const GumMemoryRange * range,
     const GumMatchPattern * pattern, GumMemoryScanMatchFunc func,
     gpointer user_data);
+GUM_API void gum_memory_scan_ranges (const GumMemoryRange * ranges,
+    guint n_ranges, const GumMatchPattern * pattern, guint n_threads,
+    GumMemoryScanMatchFunc func, gpointer user_data);
+GUM_API void gum_memory_scan_pattern_set (const GumMemoryRange * range,
+    const GumMatchPatternSet * set, GumMemoryScanPatternSetMatchFunc func,
+    gpointer user_data);
 
 GUM_API GumMatchPattern * gum_match_pattern_new_from_string (
     const gchar * match_combined_str);
 GUM_API void gum_match_pattern_free (GumMatchPattern * pattern);
 
+GUM_API GumMatchPatternSet * gum_match_pattern_set_new_from_strings (
+    const gchar * const * match_combined_strs, guint n);
+GUM_API void gum_match_pattern_set_free (GumMatchPatternSet * set);
+GUM_API guint gum_match_pattern_set_get_size (const GumMatchPatternSet * set);
+
 GUM_API void gum_ensure_code_readable (gconstpointer address, gsize size);
 
 GUM_API void gum_mprotect (gpointer address, gsize size,
@@ -0,0 +1,357 @@
+/*
+ * Copyright (C) 2026 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "gummemorymapsnapshot.h"
+
+#include "gummemory-priv.h"
+#include "gumprocess-priv.h"
+
+typedef struct _GumMemoryMapData GumMemoryMapData;
+typedef struct _GumMemoryMapEntry GumMemoryMapEntry;
+
+struct _GumMemoryMapSnapshot
+{
+  GObject parent;
+
+  GMutex mutex;
+  GumMemoryMapData * data;
+};
+
+struct _GumMemoryMapData
+{
+  gint ref_count;
+
+  guint generation;
+  GArray * entries;
+  GStringChunk * paths;
+};
+
+struct _GumMemoryMapEntry
+{
+  GumMemoryRange range;
+  GumPageProtection protection;
+  GumFileMapping file;
+  gboolean has_file;
+};
+
+static void gum_memory_map_snapshot_finalize (GObject * object);
+
+static GumMemoryMapData * gum_memory_map_snapshot_get_data (
+    GumMemoryMapSnapshot * self);
+
+static GumMemoryMapData * gum_memory_map_data_new (guint generation);
+static GumMemoryMapData * gum_memory_map_data_ref (GumMemoryMapData * data);
+static void gum_memory_map_data_unref (GumMemoryMapData * data);
+static gboolean gum_memory_map_data_add_range (
+    const GumRangeDetails * details, gpointer user_data);
+static gint gum_memory_map_entry_compare (const GumMemoryMapEntry * a,
+    const GumMemoryMapEntry * b);
+static const GumMemoryMapEntry * gum_memory_map_data_find (
+    GumMemoryMapData * data, GumAddress address, guint * index);
+
+G_DEFINE_TYPE (GumMemoryMapSnapshot, gum_memory_map_snapshot, G_TYPE_OBJECT)
+
+static void
+gum_memory_map_snapshot_class_init (GumMemoryMapSnapshotClass * klass)
+{
+  GObjectClass * object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = gum_memory_map_snapshot_finalize;
+}
+
+static void
+gum_memory_map_snapshot_init (GumMemoryMapSnapshot * self)
+{
+  g_mutex_init (&self->mutex);
+}
+
+static void
+gum_memory_map_snapshot_finalize (GObject * object)
+{
+  GumMemoryMapSnapshot * self = GUM_MEMORY_MAP_SNAPSHOT (object);
+
+  g_clear_pointer (&self->data, gum_memory_map_data_unref);
+
+  g_mutex_clear (&self->mutex);
+
+  G_OBJECT_CLASS (gum_memory_map_snapshot_parent_class)->finalize (object);
+}
+
+GumMemoryMapSnapshot *
+gum_memory_map_snapshot_new (void)
+{
+  GumMemoryMapSnapshot * snapshot;
+
+  snapshot = g_object_new (GUM_TYPE_MEMORY_MAP_SNAPSHOT, NULL);
+
+  gum_memory_map_snapshot_refresh (snapshot);
+
+  return snapshot;
+}
+
+void
+gum_memory_map_snapshot_refresh (GumMemoryMapSnapshot * self)
+{
+  GumMemoryMapData * data, * old_data;
+
+  data = gum_memory_map_data_new (_gum_memory_query_map_generation ());
+
+  g_mutex_lock (&self->mutex);
+  old_data = self->data;
+  self->data = data;
+  g_mutex_unlock (&self->mutex);
+
+  if (old_data != NULL)
+    gum_memory_map_data_unref (old_data);
+}
+
+gboolean
+gum_memory_map_snapshot_find (GumMemoryMapSnapshot * self,
+                              GumAddress address,
+                              GumMemoryRange * range,
+                              GumPageProtection * prot)
+{
+  GumMemoryMapData * data;
+  const GumMemoryMapEntry * entry;
+
+  data = gum_memory_map_snapshot_get_data (self);
+
+  entry = gum_memory_map_data_find (data, address, NULL);
+  if (entry != NULL)
+  {
+    if (range != NULL)
+      *range = entry->range;
+    if (prot != NULL)
+      *prot = entry->protection;
+  }
+
+  gum_memory_map_data_unref (data);
+
+  return entry != NULL;
+}
+
+gboolean
+gum_memory_map_snapshot_query_protection (GumMemoryMapSnapshot * self,
+                                          gconstpointer address,
+                                          gsize size,
+                                          GumPageProtection * prot)
+{
+  gboolean success = FALSE;
+  GumMemoryMapData * data;
+  const GumMemoryMapEntry * entry;
+  GumAddress end;
+  guint i;
+
+  g_assert (size != 0);
+
+  data = gum_memory_map_snapshot_get_data (self);
+
+  entry = gum_memory_map_data_find (data, GUM_ADDRESS (address), &i);
+  if (entry == NULL)
+    goto beach;
+
+  *prot = entry->protection;
+  end = entry->range.base_address + entry->range.size;
+
+  for (i++; end < GUM_ADDRESS (address) + size; i++)
+  {
+    if (i == data->entries->len)
+      goto beach;
+
+    entry = &g_array_index (data->entries, GumMemoryMapEntry, i);
+    if (entry->range.base_address != end)
+      goto beach;
+
+    *prot &= entry->protection;
+    end += entry->range.size;
+  }
+
+  success = TRUE;
+
+beach:
+  gum_memory_map_data_unref (data);
+
+  return success;
+}
+
+void
+gum_memory_map_snapshot_enumerate_ranges (GumMemoryMapSnapshot * self,
+                                          GumPageProtection prot,
+                                          GumFoundRangeFunc func,
+                                          gpointer user_data)
+{
+  GumMemoryMapData * data;
+  guint i;
+  gboolean carry_on;
+
+  data = gum_memory_map_snapshot_get_data (self);
+
+  carry_on = TRUE;
+  for (i = 0; i != data->entries->len && carry_on; i++)
+  {
+    const GumMemoryMapEntry * entry =
+        &g_array_index (data->entries, GumMemoryMapEntry, i);
+    GumRangeDetails details;
+
+    if ((entry->protection & prot) != prot)
+      continue;
+
+    details.range = &entry->range;
+    details.protection = entry->protection;
+    details.file = entry->has_file ? &entry->file : NULL;
+
+    carry_on = func (&details, user_data);
+  }
+
+  gum_memory_map_data_unref (data);
+}
+
+static GumMemoryMapData *
+gum_memory_map_snapshot_get_data (GumMemoryMapSnapshot * self)
+{
+  GumMemoryMapData * data, * old_data;
+  guint generation;
+
+  generation = _gum_memory_query_map_generation ();
+
+  g_mutex_lock (&self->mutex);
+  data = (self->data->generation == generation)
+      ? gum_memory_map_data_ref (self->data)
+      : NULL;
+  g_mutex_unlock (&self->mutex);
+
+  if (data != NULL)
+    return data;
+
+  /* Parse without the lock so that readers of current data never wait. */
+  data = gum_memory_map_data_new (generation);
+
+  g_mutex_lock (&self->mutex);
+  if ((gint) (generation - self->data->generation) > 0)
+  {
+    old_data = self->data;
+    self->data = gum_memory_map_data_ref (data);
+  }
+  else
+  {
+    old_data = NULL;
+  }
+  g_mutex_unlock (&self->mutex);
+
+  if (old_data != NULL)
+    gum_memory_map_data_unref (old_data);
+
+  return data;
+}
+
+static GumMemoryMapData *
+gum_memory_map_data_new (guint generation)
+{
+  GumMemoryMapData * data;
+
+  data = g_slice_new (GumMemoryMapData);
+  data->ref_count = 1;
+  data->generation = generation;
+  data->entries = g_array_new (FALSE, FALSE, sizeof (GumMemoryMapEntry));
+  data->paths = g_string_chunk_new (4096);
+
+  _gum_process_enumerate_ranges (GUM_PAGE_NO_ACCESS,
+      gum_memory_map_data_add_range, data);
+  g_array_sort (data->entries, (GCompareFunc) gum_memory_map_entry_compare);
+
+  return data;
+}
+
+static GumMemoryMapData *
+gum_memory_map_data_ref (GumMemoryMapData * data)
+{
+  g_atomic_int_inc (&data->ref_count);
+
+  return data;
+}
+
+static void
+gum_memory_map_data_unref (GumMemoryMapData * data)
+{
+  if (!g_atomic_int_dec_and_test (&data->ref_count))
+    return;
+
+  g_string_chunk_free (data->paths);
+  g_array_free (data->entries, TRUE);
+
+  g_slice_free (GumMemoryMapData, data);
+}
+
+static gboolean
+gum_memory_map_data_add_range (const GumRangeDetails * details,
+                               gpointer user_data)
+{
+  GumMemoryMapData * data = user_data;
+  GumMemoryMapEntry entry;
+
+  entry.range = *details->range;
+  entry.protection = details->protection;
+  entry.has_file = details->file != NULL;
+  if (entry.has_file)
+  {
+    entry.file.path =
+        g_string_chunk_insert_const (data->paths, details->file->path);
+    entry.file.offset = details->file->offset;
+    entry.file.size = details->file->size;
+  }
+
+  g_array_append_val (data->entries, entry);
+
+  return TRUE;
+}
+
+static gint
+gum_memory_map_entry_compare (const GumMemoryMapEntry * a,
+                              const GumMemoryMapEntry * b)
+{
+  if (a->range.base_address < b->range.base_address)
+    return -1;
+  if (a->range.base_address > b->range.base_address)
+    return 1;
+  return 0;
+}
+
+static const GumMemoryMapEntry *
+gum_memory_map_data_find (GumMemoryMapData * data,
+                          GumAddress address,
+                          guint * index)
+{
+  guint lo, hi;
+
+  lo = 0;
+  hi = data->entries->len;
+
+  while (lo != hi)
+  {
+    guint mid;
+    const GumMemoryMapEntry * entry;
+
+    mid = lo + ((hi - lo) / 2);
+    entry = &g_array_index (data->entries, GumMemoryMapEntry, mid);
+
+    if (address < entry->range.base_address)
+    {
+      hi = mid;
+    }
+    else if (address >= entry->range.base_address + entry->range.size)
+    {
+      lo = mid + 1;
+    }
+    else
+    {
+      if (index != NULL)
+        *index = mid;
+      return entry;
+    }
+  }
+
+  return NULL;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2026 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#ifndef __GUM_MEMORY_MAP_SNAPSHOT_H__
+#define __GUM_MEMORY_MAP_SNAPSHOT_H__
+
+#include <glib-object.h>
+#include <gum/gummemory.h>
+#include <gum/gumprocess.h>
+
+G_BEGIN_DECLS
+
+/*
+ * Parsed copy of the process' memory map, kept sorted so that lookups are
+ * O(log n). It is reparsed lazily once Gum itself has mapped, unmapped or
+ * changed the protection of memory since it was taken. Changes made behind
+ * Gum's back are only picked up by gum_memory_map_snapshot_refresh(). Unlike
+ * gum_process_enumerate_ranges() it also includes cloaked ranges.
+ *
+ * Protection flips by Interceptor and Stalker invalidate it too, as they
+ * change what it reports. In a heavily instrumented process it thus mostly
+ * pays off between bursts of instrumentation.
+ */
+#define GUM_TYPE_MEMORY_MAP_SNAPSHOT (gum_memory_map_snapshot_get_type ())
+G_DECLARE_FINAL_TYPE (GumMemoryMapSnapshot, gum_memory_map_snapshot, GUM,
+    MEMORY_MAP_SNAPSHOT, GObject)
+
+GUM_API GumMemoryMapSnapshot * gum_memory_map_snapshot_new (void);
+
+GUM_API void gum_memory_map_snapshot_refresh (GumMemoryMapSnapshot * self);
+
+GUM_API gboolean gum_memory_map_snapshot_find (GumMemoryMapSnapshot * self,
+    GumAddress address, GumMemoryRange * range, GumPageProtection * prot);
+GUM_API gboolean gum_memory_map_snapshot_query_protection (
+    GumMemoryMapSnapshot * self, gconstpointer address, gsize size,
+    GumPageProtection * prot);
+GUM_API void gum_memory_map_snapshot_enumerate_ranges (
+    GumMemoryMapSnapshot * self, GumPageProtection prot,
+    GumFoundRangeFunc func, gpointer user_data);
+
+G_END_DECLS
+
+#endif
@@ -48,6 +48,11 @@ typedef void (* GumStalkerTransformerCallback) (GumStalkerIterator * iterator,
 typedef void (* GumStalkerCallout) (GumCpuContext * cpu_context,
     gpointer user_data);
 
+typedef struct _GumStalkerEntryGateStats GumStalkerEntryGateStats;
+typedef struct _GumStalkerStats GumStalkerStats;
+typedef gboolean (* GumFoundStalkerStatsFunc) (const GumStalkerStats * stats,
+    gpointer user_data);
+
 typedef guint GumProbeId;
 typedef struct _GumCallDetails GumCallDetails;
 typedef void (* GumCallProbeCallback) (GumCallDetails * details,
@@ -77,6 +82,38 @@ struct _GumStalkerOutput
   GumInstructionEncoding encoding;
 };
 
+#define GUM_STALKER_MAX_ENTRY_GATES 16
+
+struct _GumStalkerEntryGateStats
+{
+  const gchar * name;
+  guint64 hits;
+};
+
+struct _GumStalkerStats
+{
+  GumThreadId thread_id;
+
+  guint64 blocks_compiled;
+  guint64 blocks_recompiled;
+  guint64 traces_formed;
+  guint64 snapshot_comparisons;
+
+  gsize code_bytes;
+  gsize data_bytes;
+
+  guint64 ic_hits;
+  guint64 ic_misses;
+  guint64 backpatches;
+
+  guint64 cache_flushes;
+  guint64 evicted_blocks;
+  guint64 evicted_bytes;
+
+  guint num_entry_gates;
+  GumStalkerEntryGateStats entry_gates[GUM_STALKER_MAX_ENTRY_GATES];
+};
+
 struct _GumCallDetails
 {
   gpointer target_address;
@@ -96,6 +133,86 @@ GUM_API gint gum_stalker_get_trust_threshold (GumStalker * self);
 GUM_API void gum_stalker_set_trust_threshold (GumStalker * self,
     gint trust_threshold);
 
+/*
+ * When enabled, trusted blocks are not linked to until they have executed
+ * trace_hotness_threshold times, so that their executions can be counted. A
+ * block reaching that count is recompiled as a trace: already compiled
+ * successors executed at least half as often are compiled inline after it
+ * through direct jumps and conditional branches, up to a small number of
+ * blocks. Branches back into the trace stay inside it, and every other edge
+ * gets its own exit. Requires a non-negative trust threshold, and blocks with
+ * call probes are left alone. Implemented on x86 and arm64.
+ */
+GUM_API gboolean gum_stalker_get_trace_formation_enabled (GumStalker * self);
+GUM_API void gum_stalker_set_trace_formation_enabled (GumStalker * self,
+    gboolean enabled);
+GUM_API guint gum_stalker_get_trace_hotness_threshold (GumStalker * self);
+GUM_API void gum_stalker_set_trace_hotness_threshold (GumStalker * self,
+    guint threshold);
+
+/*
+ * When enabled, the writable pages backing compiled blocks are
+ * write-protected and writes to them are trapped, so untrusted blocks are only
+ * compared against their snapshot after their code may actually have changed.
+ * Blocks on pages that aren't writable, e.g. those of a W^X JIT, are always
+ * compared, as a write made after flipping the protection doesn't fault.
+ * Pages that are writable when tracked are assumed to only change through
+ * writes that fault. Note that writes made by the kernel don't fault either:
+ * a system call such as read() targeting a tracked page fails with EFAULT, so
+ * leave this off for code sharing its pages with such buffers. Currently only
+ * implemented on x86.
+ */
+GUM_API gboolean gum_stalker_get_page_write_tracking_enabled (
+    GumStalker * self);
+GUM_API void gum_stalker_set_page_write_tracking_enabled (GumStalker * self,
+    gboolean enabled);
+
+/*
+ * Number of (real, code) entries in the inline cache emitted at each indirect
+ * call and jump site. Defaults to 2 and may be set to between 2 and
+ * GUM_STALKER_MAX_IC_ENTRIES; larger caches help megamorphic sites such as
+ * virtual dispatch. Only affects threads followed after the change.
+ * Implemented on x86 and arm64.
+ */
+#define GUM_STALKER_MAX_IC_ENTRIES 32
+
+GUM_API guint gum_stalker_get_ic_entries (GumStalker * self);
+GUM_API void gum_stalker_set_ic_entries (GumStalker * self, guint ic_entries);
+
+/*
+ * Inline cache misses are always counted, as they already go through the
+ * resolver. Counting hits adds a load, an increment and a store to every
+ * cached indirect branch, so it is off by default and, like the entry count,
+ * only affects threads followed after the change. Both are reported by
+ * gum_stalker_query_stats().
+ */
+GUM_API gboolean gum_stalker_get_ic_hit_counting_enabled (GumStalker * self);
+GUM_API void gum_stalker_set_ic_hit_counting_enabled (GumStalker * self,
+    gboolean enabled);
+
+/*
+ * Soft limit, in bytes, on the code and data slabs each followed thread may
+ * accumulate. Once compiling a new block would grow a thread's cache past
+ * the budget, the whole cache is flushed and blocks are recompiled on demand.
+ * A budget of 0, the default, means unlimited. Flushes and evictions are
+ * reported by gum_stalker_query_stats(). Currently only implemented on x86.
+ */
+GUM_API gsize gum_stalker_get_cache_budget (GumStalker * self);
+GUM_API void gum_stalker_set_cache_budget (GumStalker * self, gsize budget);
+
+/*
+ * Reports counters for each thread currently being followed: blocks compiled
+ * and recompiled, code bytes reserved for blocks and their snapshots, the
+ * size of the data slabs holding block metadata, inline cache hits and
+ * misses, backpatches applied, cache flushes and evictions, and how often
+ * each entry gate was taken. Unlike gum_stalker_dump_counters() these are
+ * always collected. Counters are dropped along with the thread's context, so
+ * query them before unfollowing. Counters that a backend does not implement
+ * are reported as 0.
+ */
+GUM_API void gum_stalker_query_stats (GumStalker * self,
+    GumFoundStalkerStatsFunc func, gpointer user_data);
+
 GUM_API void gum_stalker_flush (GumStalker * self);
 GUM_API void gum_stalker_stop (GumStalker * self);
 GUM_API gboolean gum_stalker_garbage_collect (GumStalker * self);
@@ -225,6 +342,22 @@ GUM_API void gum_stalker_deactivate (GumStalker * self);
 GUM_API void gum_stalker_prefetch (GumStalker * self, gconstpointer address,
     gint recycle_count);
 
+/*
+ * Captures the blocks compiled for the given thread, together with the
+ * backpatches that linked them, so that a later session can warm up through
+ * gum_stalker_replay_blocks() instead of compiling and linking everything
+ * from scratch. Like gum_stalker_prefetch(), replaying applies to the calling
+ * thread, which must already be followed, ideally while deactivated.
+ *
+ * Addresses are stored as-is, so a set is only useful in processes with the
+ * same memory layout, e.g. workers forked from a common parent, and with the
+ * same transformer. Backpatches whose blocks compile to a different size are
+ * skipped. Currently only implemented on x86.
+ */
+GUM_API GBytes * gum_stalker_export_blocks (GumStalker * self,
+    GumThreadId thread_id);
+GUM_API gboolean gum_stalker_replay_blocks (GumStalker * self, GBytes * blocks);
+
 GUM_API void gum_stalker_invalidate (GumStalker * self, gconstpointer address);
 GUM_API void gum_stalker_invalidate_for_thread (GumStalker * self,
     GumThreadId thread_id, gconstpointer address);
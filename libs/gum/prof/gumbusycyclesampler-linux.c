@@ -6,6 +6,8 @@
 
 #include "gumbusycyclesampler.h"
 
+#include <time.h>
+
 struct _GumBusyCycleSampler
 {
   GObject parent;
@@ -50,12 +52,24 @@ gum_busy_cycle_sampler_new (void)
 gboolean
 gum_busy_cycle_sampler_is_available (GumBusyCycleSampler * self)
 {
-  return FALSE;
+  struct timespec ts;
+
+  return clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts) == 0;
 }
 
 static GumSample
 gum_busy_cycle_sampler_sample (GumSampler * sampler)
 {
-  /* TODO: implement */
-  return 0;
+  struct timespec ts;
+
+  /*
+   * Time spent blocked does not count towards the thread's CPU clock, and
+   * just like on other OSes we skip converting to cycles since GumSample is
+   * an abstract unit anyway.
+   */
+  if (clock_gettime (CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+    return 0;
+
+  return ((GumSample) ts.tv_sec * G_GUINT64_CONSTANT (1000000000)) +
+      ts.tv_nsec;
 }
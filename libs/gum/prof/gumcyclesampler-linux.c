@@ -7,19 +7,40 @@
 #include "gumcyclesampler.h"
 
 #include "gumlibc.h"
+#include "gummemory.h"
 
 #include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/syscall.h>
 
 # define PERF_TYPE_HARDWARE       0
 # define PERF_COUNT_HW_CPU_CYCLES 0
 
+#if defined (HAVE_ARM64)
+# define GUM_PERF_CONFIG1_USER_ACCESS (1 << 1)
+# define GUM_PMU_CYCLE_COUNTER_INDEX  31
+#endif
+
+#define GUM_COMPILER_BARRIER() __asm__ __volatile__ ("" : : : "memory")
+
+typedef struct _GumCycleCounter GumCycleCounter;
+
 struct _GumCycleSampler
 {
   GObject parent;
 
-  gint device;
+  GSList * counters;
+  gboolean disposed;
+
+  gboolean available;
+};
+
+struct _GumCycleCounter
+{
+  GumCycleSampler * sampler;
+  gint fd;
+  volatile struct perf_event_mmap_page * page;
 };
 
 struct perf_event_attr
@@ -60,14 +81,55 @@ struct perf_event_attr
     guint32 wakeup_watermark;
   };
 
-  guint32 __reserved_2;
-  guint64 __reserved_3;
+  guint32 bp_type;
+
+  union
+  {
+    guint64 bp_addr;
+    guint64 config1;
+  };
+};
+
+struct perf_event_mmap_page
+{
+  guint32 version;
+  guint32 compat_version;
+  guint32 lock;
+  guint32 index;
+  gint64 offset;
+  guint64 time_enabled;
+  guint64 time_running;
+
+  union
+  {
+    guint64 capabilities;
+
+    struct
+    {
+      guint64 cap_bit0               :  1,
+              cap_bit0_is_deprecated :  1,
+              cap_user_rdpmc         :  1,
+              cap_user_time          :  1,
+              cap_user_time_zero     :  1,
+              cap_____res            : 59;
+    };
+  };
+
+  guint16 pmc_width;
 };
 
 static void gum_cycle_sampler_iface_init (gpointer g_iface,
     gpointer iface_data);
 static void gum_cycle_sampler_dispose (GObject * object);
 static GumSample gum_cycle_sampler_sample (GumSampler * sampler);
+static GumCycleCounter * gum_cycle_sampler_get_counter (GumCycleSampler * self);
+static void gum_cycle_sampler_release_thread_counters (GSList * counters);
+
+static GumCycleCounter * gum_cycle_counter_new (GumCycleSampler * sampler);
+static void gum_cycle_counter_free (GumCycleCounter * counter);
+static void gum_cycle_counter_close (GumCycleCounter * counter);
+static GumSample gum_cycle_counter_read (GumCycleCounter * self);
+static gboolean gum_read_performance_counter (guint32 index, guint64 * value);
 
 G_DEFINE_TYPE_EXTENDED (GumCycleSampler,
                         gum_cycle_sampler,
@@ -76,6 +138,10 @@ G_DEFINE_TYPE_EXTENDED (GumCycleSampler,
                         G_IMPLEMENT_INTERFACE (GUM_TYPE_SAMPLER,
                                                gum_cycle_sampler_iface_init))
 
+G_LOCK_DEFINE_STATIC (gum_cycle_counters);
+static GPrivate gum_cycle_counters_key = G_PRIVATE_INIT (
+    (GDestroyNotify) gum_cycle_sampler_release_thread_counters);
+
 static void
 gum_cycle_sampler_class_init (GumCycleSamplerClass * klass)
 {
@@ -96,24 +162,30 @@ gum_cycle_sampler_iface_init (gpointer g_iface,
 static void
 gum_cycle_sampler_init (GumCycleSampler * self)
 {
-  struct perf_event_attr attr = { 0, };
-
-  attr.type = PERF_TYPE_HARDWARE;
-  attr.config = PERF_COUNT_HW_CPU_CYCLES;
-
-  self->device = syscall (__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  self->available = gum_cycle_sampler_get_counter (self)->fd != -1;
 }
 
 static void
 gum_cycle_sampler_dispose (GObject * object)
 {
   GumCycleSampler * self = GUM_CYCLE_SAMPLER (object);
+  GSList * cur;
 
-  if (self->device != -1)
+  /*
+   * The counters themselves belong to their threads, which may still look
+   * them up, so only release what they hold and orphan them.
+   */
+  G_LOCK (gum_cycle_counters);
+  for (cur = self->counters; cur != NULL; cur = cur->next)
   {
-    close (self->device);
-    self->device = -1;
+    GumCycleCounter * counter = cur->data;
+
+    gum_cycle_counter_close (counter);
+    counter->sampler = NULL;
   }
+  g_clear_pointer (&self->counters, g_slist_free);
+  self->disposed = TRUE;
+  G_UNLOCK (gum_cycle_counters);
 
   G_OBJECT_CLASS (gum_cycle_sampler_parent_class)->dispose (object);
 }
@@ -127,17 +199,214 @@ gum_cycle_sampler_new (void)
 gboolean
 gum_cycle_sampler_is_available (GumCycleSampler * self)
 {
-  return self->device != -1;
+  return self->available;
 }
 
 static GumSample
 gum_cycle_sampler_sample (GumSampler * sampler)
 {
   GumCycleSampler * self = (GumCycleSampler *) sampler;
+
+  return gum_cycle_counter_read (gum_cycle_sampler_get_counter (self));
+}
+
+/*
+ * Each counter only counts the thread that opened it, so every thread gets
+ * its own the first time it samples. A thread's counters are kept in a list
+ * that is freed when it exits, and the sampler releases their resources
+ * early if it goes away first.
+ */
+static GumCycleCounter *
+gum_cycle_sampler_get_counter (GumCycleSampler * self)
+{
+  GSList * counters, * cur, * next;
+  GumCycleCounter * counter;
+
+  counters = g_private_get (&gum_cycle_counters_key);
+
+  for (cur = counters; cur != NULL; cur = cur->next)
+  {
+    counter = cur->data;
+    if (counter->sampler == self)
+      return counter;
+  }
+
+  counter = gum_cycle_counter_new (self);
+
+  G_LOCK (gum_cycle_counters);
+
+  for (cur = counters; cur != NULL; cur = next)
+  {
+    GumCycleCounter * orphan = cur->data;
+
+    next = cur->next;
+
+    if (orphan->sampler == NULL)
+    {
+      gum_cycle_counter_free (orphan);
+      counters = g_slist_delete_link (counters, cur);
+    }
+  }
+
+  if (self->disposed)
+  {
+    gum_cycle_counter_close (counter);
+    counter->sampler = NULL;
+  }
+  else
+  {
+    self->counters = g_slist_prepend (self->counters, counter);
+  }
+
+  G_UNLOCK (gum_cycle_counters);
+
+  g_private_set (&gum_cycle_counters_key, g_slist_prepend (counters, counter));
+
+  return counter;
+}
+
+static void
+gum_cycle_sampler_release_thread_counters (GSList * counters)
+{
+  GSList * cur;
+
+  G_LOCK (gum_cycle_counters);
+  for (cur = counters; cur != NULL; cur = cur->next)
+  {
+    GumCycleCounter * counter = cur->data;
+    GumCycleSampler * sampler = counter->sampler;
+
+    if (sampler != NULL)
+      sampler->counters = g_slist_remove (sampler->counters, counter);
+  }
+  G_UNLOCK (gum_cycle_counters);
+
+  g_slist_free_full (counters, (GDestroyNotify) gum_cycle_counter_free);
+}
+
+static GumCycleCounter *
+gum_cycle_counter_new (GumCycleSampler * sampler)
+{
+  GumCycleCounter * counter;
+  struct perf_event_attr attr = { 0, };
+  gpointer page;
+
+  counter = g_slice_new (GumCycleCounter);
+  counter->sampler = sampler;
+
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof (attr);
+  attr.config = PERF_COUNT_HW_CPU_CYCLES;
+#ifdef GUM_PERF_CONFIG1_USER_ACCESS
+  attr.config1 = GUM_PERF_CONFIG1_USER_ACCESS;
+#endif
+
+  counter->fd = syscall (__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  counter->page = NULL;
+
+  if (counter->fd != -1)
+  {
+    page = mmap (NULL, gum_query_page_size (), PROT_READ, MAP_SHARED,
+        counter->fd, 0);
+    if (page != MAP_FAILED)
+      counter->page = page;
+  }
+
+  return counter;
+}
+
+static void
+gum_cycle_counter_free (GumCycleCounter * counter)
+{
+  gum_cycle_counter_close (counter);
+
+  g_slice_free (GumCycleCounter, counter);
+}
+
+static void
+gum_cycle_counter_close (GumCycleCounter * counter)
+{
+  if (counter->page != NULL)
+  {
+    munmap ((gpointer) counter->page, gum_query_page_size ());
+    counter->page = NULL;
+  }
+
+  if (counter->fd != -1)
+  {
+    close (counter->fd);
+    counter->fd = -1;
+  }
+}
+
+static GumSample
+gum_cycle_counter_read (GumCycleCounter * self)
+{
+  volatile struct perf_event_mmap_page * page = self->page;
   long long result = 0;
 
-  if (read (self->device, &result, sizeof (result)) < sizeof (result))
+  if (page != NULL)
+  {
+    guint32 seq, index;
+    gint64 count;
+    gboolean valid;
+
+    /*
+     * The kernel bumps the lock around updating the page, e.g. when we get
+     * scheduled out, so retry until we observe a stable snapshot.
+     */
+    do
+    {
+      seq = page->lock;
+      GUM_COMPILER_BARRIER ();
+
+      index = page->index;
+      count = page->offset;
+      valid = page->cap_user_rdpmc && index != 0;
+
+      if (valid)
+      {
+        guint64 pmc;
+        guint width;
+
+        valid = gum_read_performance_counter (index - 1, &pmc);
+        if (valid)
+        {
+          width = page->pmc_width;
+          count += ((gint64) (pmc << (64 - width))) >> (64 - width);
+        }
+      }
+
+      GUM_COMPILER_BARRIER ();
+    }
+    while (page->lock != seq);
+
+    if (valid)
+      return count;
+  }
+
+  if (read (self->fd, &result, sizeof (result)) < sizeof (result))
     return 0;
 
   return result;
 }
+
+static gboolean
+gum_read_performance_counter (guint32 index,
+                              guint64 * value)
+{
+#if defined (HAVE_ARM64)
+  guint64 v;
+
+  if (index != GUM_PMU_CYCLE_COUNTER_INDEX)
+    return FALSE;
+
+  __asm__ __volatile__ ("mrs %0, pmccntr_el0" : "=r" (v));
+
+  *value = v;
+
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
@@ -64,6 +64,9 @@ TESTLIST_BEGIN (stalker)
   TESTENTRY (self_modifying_code_should_be_detected_with_threshold_minus_one)
   TESTENTRY (self_modifying_code_should_not_be_detected_with_threshold_zero)
   TESTENTRY (self_modifying_code_should_be_detected_with_threshold_one)
+  TESTENTRY (inline_cache_should_serve_megamorphic_call_site)
+  TESTENTRY (inline_cache_overflow_should_fall_back_to_resolver)
+  TESTENTRY (trace_formation_should_preserve_semantics)
 
   /* EXTRA */
   TESTENTRY (pthread_create)
@@ -100,6 +103,15 @@ static void add_n_return_value_increments (GumStalkerIterator * iterator,
 static gpointer run_stalked_briefly (gpointer data);
 static gpointer run_stalked_into_termination (gpointer data);
 static void patch_instruction (gpointer code, guint offset, guint32 insn);
+static gint run_ic_targets (TestArm64StalkerFixture * fixture, guint rounds,
+    GumStalkerStats * stats);
+static gint invoke_ic_target (gint (* target) (gint value), gint value);
+static gint ic_target_add_one (gint value);
+static gint ic_target_add_two (gint value);
+static gint ic_target_add_three (gint value);
+static gint ic_target_add_four (gint value);
+static gboolean store_stats_of_current_thread (const GumStalkerStats * stats,
+    gpointer user_data);
 static void do_patch_instruction (gpointer mem, gpointer user_data);
 static gpointer increment_integer (gpointer data);
 static gboolean store_range_of_test_runner (const GumModuleDetails * details,
@@ -1682,6 +1694,189 @@ TESTCASE (self_modifying_code_should_be_detected_with_threshold_one)
   g_assert_cmpuint (fixture->sink->events->len, >, 0);
 }
 
+TESTCASE (inline_cache_should_serve_megamorphic_call_site)
+{
+  GumStalkerStats stats;
+
+  g_assert_cmpuint (gum_stalker_get_ic_entries (fixture->stalker), ==, 2);
+  gum_stalker_set_ic_entries (fixture->stalker, 4);
+  g_assert_cmpuint (gum_stalker_get_ic_entries (fixture->stalker), ==, 4);
+
+  g_assert_false (
+      gum_stalker_get_ic_hit_counting_enabled (fixture->stalker));
+  g_assert_cmpint (run_ic_targets (fixture, 100, &stats), ==,
+      100 * (1 + 2 + 3 + 4));
+  g_assert_cmpuint (stats.ic_hits, ==, 0);
+  g_assert_cmpuint (stats.ic_misses, >, 0);
+
+  gum_stalker_set_ic_hit_counting_enabled (fixture->stalker, TRUE);
+  g_assert_cmpint (run_ic_targets (fixture, 100, &stats), ==,
+      100 * (1 + 2 + 3 + 4));
+  g_assert_cmpuint (stats.ic_hits, >=, (100 - 10) * 4);
+  g_assert_cmpuint (stats.ic_misses, <, 10 * 4);
+}
+
+TESTCASE (inline_cache_overflow_should_fall_back_to_resolver)
+{
+  GumStalkerStats stats;
+
+  gum_stalker_set_ic_hit_counting_enabled (fixture->stalker, TRUE);
+
+  g_assert_cmpint (run_ic_targets (fixture, 100, &stats), ==,
+      100 * (1 + 2 + 3 + 4));
+  g_assert_cmpuint (stats.ic_hits, >=, (100 - 10) * 2);
+  g_assert_cmpuint (stats.ic_misses, >=, (100 - 10) * 2);
+}
+
+TESTCASE (trace_formation_should_preserve_semantics)
+{
+  const gchar * loop_lbl = "loop";
+  const gchar * even_lbl = "even";
+  const gchar * next_lbl = "next";
+  guint8 * code;
+  GumArm64Writer cw;
+  StalkerTestFunc func;
+  guint num_block_events;
+  GumStalkerStats stats;
+  gint ret;
+
+  code = gum_alloc_n_pages (1, GUM_PAGE_RW);
+  gum_arm64_writer_init (&cw, code);
+
+  gum_arm64_writer_put_ldr_reg_u64 (&cw, ARM64_REG_X2, 1000);
+  gum_arm64_writer_put_label (&cw, loop_lbl);
+  gum_arm64_writer_put_tbz_reg_imm_label (&cw, ARM64_REG_X2, 0, even_lbl);
+  gum_arm64_writer_put_add_reg_reg_imm (&cw, ARM64_REG_X0, ARM64_REG_X0, 3);
+  gum_arm64_writer_put_b_label (&cw, next_lbl);
+  gum_arm64_writer_put_label (&cw, even_lbl);
+  gum_arm64_writer_put_add_reg_reg_imm (&cw, ARM64_REG_X0, ARM64_REG_X0, 1);
+  gum_arm64_writer_put_label (&cw, next_lbl);
+  gum_arm64_writer_put_sub_reg_reg_imm (&cw, ARM64_REG_X2, ARM64_REG_X2, 1);
+  gum_arm64_writer_put_cbnz_reg_label (&cw, ARM64_REG_X2, loop_lbl);
+  gum_arm64_writer_put_ret (&cw);
+
+  gum_arm64_writer_flush (&cw);
+
+  func = GUM_POINTER_TO_FUNCPTR (StalkerTestFunc,
+      test_arm64_stalker_fixture_dup_code (fixture, code,
+          gum_arm64_writer_offset (&cw)));
+
+  gum_arm64_writer_clear (&cw);
+  gum_free_pages (code);
+
+  fixture->sink->mask = GUM_BLOCK;
+  gum_stalker_set_trust_threshold (fixture->stalker, 2);
+
+  ret = test_arm64_stalker_fixture_follow_and_invoke (fixture, func, 0);
+  g_assert_cmpint (ret, ==, (500 * 3) + (500 * 1));
+  num_block_events = fixture->sink->events->len;
+
+  gum_fake_event_sink_reset (fixture->sink);
+  while (gum_stalker_garbage_collect (fixture->stalker))
+    g_usleep (10000);
+
+  g_assert_false (gum_stalker_get_trace_formation_enabled (fixture->stalker));
+  gum_stalker_set_trace_formation_enabled (fixture->stalker, TRUE);
+  g_assert_true (gum_stalker_get_trace_formation_enabled (fixture->stalker));
+  g_assert_cmpuint (
+      gum_stalker_get_trace_hotness_threshold (fixture->stalker), ==, 32);
+  gum_stalker_set_trace_hotness_threshold (fixture->stalker, 16);
+
+  ret = test_arm64_stalker_fixture_follow_and_invoke (fixture, func, 0);
+  g_assert_cmpint (ret, ==, (500 * 3) + (500 * 1));
+  g_assert_cmpuint (fixture->sink->events->len, ==, num_block_events);
+
+  gum_fake_event_sink_reset (fixture->sink);
+  while (gum_stalker_garbage_collect (fixture->stalker))
+    g_usleep (10000);
+
+  memset (&stats, 0, sizeof (stats));
+
+  gum_stalker_follow_me (fixture->stalker, fixture->transformer,
+      GUM_EVENT_SINK (fixture->sink));
+  ret = func (0);
+  gum_stalker_query_stats (fixture->stalker, store_stats_of_current_thread,
+      &stats);
+  gum_stalker_unfollow_me (fixture->stalker);
+
+  g_assert_cmpint (ret, ==, (500 * 3) + (500 * 1));
+  g_assert_cmpuint (stats.traces_formed, >=, 1);
+}
+
+static gint
+run_ic_targets (TestArm64StalkerFixture * fixture,
+                guint rounds,
+                GumStalkerStats * stats)
+{
+  gint (* targets[]) (gint value) = {
+    ic_target_add_one,
+    ic_target_add_two,
+    ic_target_add_three,
+    ic_target_add_four,
+  };
+  gint sum;
+  guint round, i;
+
+  memset (stats, 0, sizeof (GumStalkerStats));
+
+  sum = 0;
+  gum_stalker_follow_me (fixture->stalker, fixture->transformer,
+      GUM_EVENT_SINK (fixture->sink));
+  for (round = 0; round != rounds; round++)
+  {
+    for (i = 0; i != G_N_ELEMENTS (targets); i++)
+      sum = invoke_ic_target (targets[i], sum);
+  }
+  gum_stalker_query_stats (fixture->stalker, store_stats_of_current_thread,
+      stats);
+  gum_stalker_unfollow_me (fixture->stalker);
+
+  return sum;
+}
+
+GUM_NOINLINE static gint
+invoke_ic_target (gint (* target) (gint value),
+                  gint value)
+{
+  return target (value);
+}
+
+GUM_NOINLINE static gint
+ic_target_add_one (gint value)
+{
+  return value + 1;
+}
+
+GUM_NOINLINE static gint
+ic_target_add_two (gint value)
+{
+  return value + 2;
+}
+
+GUM_NOINLINE static gint
+ic_target_add_three (gint value)
+{
+  return value + 3;
+}
+
+GUM_NOINLINE static gint
+ic_target_add_four (gint value)
+{
+  return value + 4;
+}
+
+static gboolean
+store_stats_of_current_thread (const GumStalkerStats * stats,
+                               gpointer user_data)
+{
+  if (stats->thread_id != gum_process_get_current_thread_id ())
+    return TRUE;
+
+  memcpy (user_data, stats, sizeof (GumStalkerStats));
+
+  return FALSE;
+}
+
 static void
 patch_instruction (gpointer code,
                    guint offset,
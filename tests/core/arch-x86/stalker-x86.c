@@ -80,6 +80,14 @@ TESTLIST_BEGIN (stalker)
   TESTENTRY (self_modifying_code_should_be_detected_with_threshold_minus_one)
   TESTENTRY (self_modifying_code_should_not_be_detected_with_threshold_zero)
   TESTENTRY (self_modifying_code_should_be_detected_with_threshold_one)
+  TESTENTRY (page_write_tracking_should_detect_modified_code)
+  TESTENTRY (page_write_tracking_should_detect_protection_flips)
+  TESTENTRY (page_write_tracking_should_skip_snapshot_comparisons)
+  TESTENTRY (trace_formation_should_preserve_semantics)
+  TESTENTRY (inline_cache_should_serve_megamorphic_call_site)
+  TESTENTRY (exported_blocks_should_be_replayable)
+  TESTENTRY (cache_budget_should_evict_and_recompile)
+  TESTENTRY (stats_should_be_reported_per_thread)
 #ifndef HAVE_WINDOWS
   TESTENTRY (performance)
 #endif
@@ -101,6 +109,16 @@ TESTLIST_END ()
 static gpointer run_stalked_briefly (gpointer data);
 static gpointer run_stalked_into_termination (gpointer data);
 static void patch_code (gpointer code, gconstpointer new_code, gsize size);
+static guint64 count_snapshot_comparisons (TestStalkerFixture * fixture,
+    FlatFunc f);
+static gint invoke_ic_target (gint (* target) (gint value), gint value);
+static gint ic_target_add_one (gint value);
+static gint ic_target_add_two (gint value);
+static gint ic_target_add_three (gint value);
+static gint ic_target_add_four (gint value);
+static void replay_activation_target (void);
+static gboolean store_stats_of_current_thread (const GumStalkerStats * stats,
+    gpointer user_data);
 static void do_patch_instruction (gpointer mem, gpointer user_data);
 #ifndef HAVE_WINDOWS
 static gboolean store_range_of_test_runner (const GumModuleDetails * details,
@@ -377,6 +395,478 @@ TESTCASE (self_modifying_code_should_be_detected_with_threshold_one)
   g_assert_cmpuint (fixture->sink->events->len, >, 0);
 }
 
+TESTCASE (page_write_tracking_should_detect_modified_code)
+{
+  FlatFunc f;
+  guint8 mov_eax_imm_plus_nop[] = {
+    0xb8, 0x00, 0x00, 0x00, 0x00, /* mov eax, <imm> */
+    0x90                          /* nop padding    */
+  };
+
+  if (!gum_query_is_rwx_supported ())
+  {
+    g_print ("<skipping, RWX pages not supported> ");
+    return;
+  }
+
+  f = GUM_POINTER_TO_FUNCPTR (FlatFunc,
+      test_stalker_fixture_dup_code (fixture, flat_code, sizeof (flat_code)));
+  gum_mprotect (f, gum_query_page_size (), GUM_PAGE_RWX);
+
+  fixture->sink->mask = GUM_EXEC | GUM_CALL | GUM_RET;
+
+  gum_stalker_set_trust_threshold (fixture->stalker, -1);
+  g_assert_false (
+      gum_stalker_get_page_write_tracking_enabled (fixture->stalker));
+  gum_stalker_set_page_write_tracking_enabled (fixture->stalker, TRUE);
+  g_assert_true (
+      gum_stalker_get_page_write_tracking_enabled (fixture->stalker));
+
+  gum_stalker_follow_me (fixture->stalker, fixture->transformer,
+      GUM_EVENT_SINK (fixture->sink));
+
+  g_assert_cmpuint (f (), ==, 2);
+  g_assert_cmpuint (f (), ==, 2);
+
+  *((guint32 *) (mov_eax_imm_plus_nop + 1)) = 42;
+  memcpy (f, mov_eax_imm_plus_nop, sizeof (mov_eax_imm_plus_nop));
+  g_assert_cmpuint (f (), ==, 42);
+  g_assert_cmpuint (f (), ==, 42);
+
+  *((guint32 *) (mov_eax_imm_plus_nop + 1)) = 1337;
+  memcpy (f, mov_eax_imm_plus_nop, sizeof (mov_eax_imm_plus_nop));
+  g_assert_cmpuint (f (), ==, 1337);
+
+  gum_stalker_unfollow_me (fixture->stalker);
+
+  gum_stalker_set_page_write_tracking_enabled (fixture->stalker, FALSE);
+
+  g_assert_cmpuint (fixture->sink->events->len, >, 0);
+}
+
+TESTCASE (page_write_tracking_should_detect_protection_flips)
+{
+  const gsize page_size = gum_query_page_size ();
+  FlatFunc f;
+  guint8 mov_eax_imm_plus_nop[] = {
+    0xb8, 0x00, 0x00, 0x00, 0x00, /* mov eax, <imm> */
+    0x90                          /* nop padding    */
+  };
+
+  f = GUM_POINTER_TO_FUNCPTR (FlatFunc,
+      test_stalker_fixture_dup_code (fixture, flat_code, sizeof (flat_code)));
+  gum_mprotect (f, page_size, GUM_PAGE_RX);
+
+  gum_stalker_set_trust_threshold (fixture->stalker, -1);
+  gum_stalker_set_page_write_tracking_enabled (fixture->stalker, TRUE);
+
+  gum_stalker_follow_me (fixture->stalker, fixture->transformer,
+      GUM_EVENT_SINK (fixture->sink));
+
+  g_assert_cmpuint (f (), ==, 2);
+  g_assert_cmpuint (f (), ==, 2);
+
+  *((guint32 *) (mov_eax_imm_plus_nop + 1)) = 42;
+  gum_mprotect (f, page_size, GUM_PAGE_RW);
+  memcpy (f, mov_eax_imm_plus_nop, sizeof (mov_eax_imm_plus_nop));
+  gum_mprotect (f, page_size, GUM_PAGE_RX);
+  g_assert_cmpuint (f (), ==, 42);
+  g_assert_cmpuint (f (), ==, 42);
+
+  gum_stalker_unfollow_me (fixture->stalker);
+
+  gum_stalker_set_page_write_tracking_enabled (fixture->stalker, FALSE);
+}
+
+TESTCASE (page_write_tracking_should_skip_snapshot_comparisons)
+{
+  FlatFunc f;
+  guint64 compared, tracked;
+
+  if (!gum_query_is_rwx_supported ())
+  {
+    g_print ("<skipping, RWX pages not supported> ");
+    return;
+  }
+
+  f = GUM_POINTER_TO_FUNCPTR (FlatFunc,
+      test_stalker_fixture_dup_code (fixture, flat_code, sizeof (flat_code)));
+  gum_mprotect (f, gum_query_page_size (), GUM_PAGE_RWX);
+
+  gum_stalker_set_trust_threshold (fixture->stalker, -1);
+
+  compared = count_snapshot_comparisons (fixture, f);
+
+  while (gum_stalker_garbage_collect (fixture->stalker))
+    g_usleep (10000);
+
+  gum_stalker_set_page_write_tracking_enabled (fixture->stalker, TRUE);
+  tracked = count_snapshot_comparisons (fixture, f);
+  gum_stalker_set_page_write_tracking_enabled (fixture->stalker, FALSE);
+
+  /* Each call dispatches to both f and the loop, and only f is tracked. */
+  g_assert_cmpuint (compared, >=, 2 * 10);
+  g_assert_cmpuint (compared - tracked, >=, 10 - 2);
+}
+
+static guint64
+count_snapshot_comparisons (TestStalkerFixture * fixture,
+                            FlatFunc f)
+{
+  GumStalkerStats before, after;
+  guint i;
+
+  memset (&before, 0, sizeof (before));
+  memset (&after, 0, sizeof (after));
+
+  gum_stalker_follow_me (fixture->stalker, fixture->transformer,
+      GUM_EVENT_SINK (fixture->sink));
+  gum_stalker_query_stats (fixture->stalker, store_stats_of_current_thread,
+      &before);
+  for (i = 0; i != 10; i++)
+    g_assert_cmpuint (f (), ==, 2);
+  gum_stalker_query_stats (fixture->stalker, store_stats_of_current_thread,
+      &after);
+  gum_stalker_unfollow_me (fixture->stalker);
+
+  return after.snapshot_comparisons - before.snapshot_comparisons;
+}
+
+TESTCASE (trace_formation_should_preserve_semantics)
+{
+  const gchar * loop_lbl = "loop";
+  const gchar * even_lbl = "even";
+  const gchar * next_lbl = "next";
+  guint8 * code;
+  GumX86Writer cw;
+  StalkerTestFunc func;
+  guint num_block_events;
+  GumStalkerStats stats;
+  gint ret;
+
+  code = gum_alloc_n_pages (1, GUM_PAGE_RW);
+  gum_x86_writer_init (&cw, code);
+
+  gum_x86_writer_put_xor_reg_reg (&cw, GUM_REG_EAX, GUM_REG_EAX);
+  gum_x86_writer_put_mov_reg_u32 (&cw, GUM_REG_EDX, 1000);
+  gum_x86_writer_put_label (&cw, loop_lbl);
+  gum_x86_writer_put_test_reg_u32 (&cw, GUM_REG_EDX, 1);
+  gum_x86_writer_put_jcc_short_label (&cw, X86_INS_JE, even_lbl, GUM_NO_HINT);
+  gum_x86_writer_put_add_reg_imm (&cw, GUM_REG_EAX, 3);
+  gum_x86_writer_put_jmp_short_label (&cw, next_lbl);
+  gum_x86_writer_put_label (&cw, even_lbl);
+  gum_x86_writer_put_inc_reg (&cw, GUM_REG_EAX);
+  gum_x86_writer_put_label (&cw, next_lbl);
+  gum_x86_writer_put_dec_reg (&cw, GUM_REG_EDX);
+  gum_x86_writer_put_jcc_short_label (&cw, X86_INS_JNE, loop_lbl,
+      GUM_NO_HINT);
+  gum_x86_writer_put_ret (&cw);
+
+  gum_x86_writer_flush (&cw);
+
+  func = GUM_POINTER_TO_FUNCPTR (StalkerTestFunc,
+      test_stalker_fixture_dup_code (fixture, code,
+          gum_x86_writer_offset (&cw)));
+
+  gum_x86_writer_clear (&cw);
+  gum_free_pages (code);
+
+  fixture->sink->mask = GUM_BLOCK;
+  gum_stalker_set_trust_threshold (fixture->stalker, 2);
+
+  ret = test_stalker_fixture_follow_and_invoke (fixture, func, 0);
+  g_assert_cmpint (ret, ==, (500 * 3) + (500 * 1));
+  num_block_events = fixture->sink->events->len;
+
+  gum_fake_event_sink_reset (fixture->sink);
+  while (gum_stalker_garbage_collect (fixture->stalker))
+    g_usleep (10000);
+
+  g_assert_false (gum_stalker_get_trace_formation_enabled (fixture->stalker));
+  gum_stalker_set_trace_formation_enabled (fixture->stalker, TRUE);
+  g_assert_true (gum_stalker_get_trace_formation_enabled (fixture->stalker));
+  g_assert_cmpuint (
+      gum_stalker_get_trace_hotness_threshold (fixture->stalker), ==, 32);
+  gum_stalker_set_trace_hotness_threshold (fixture->stalker, 16);
+
+  ret = test_stalker_fixture_follow_and_invoke (fixture, func, 0);
+  g_assert_cmpint (ret, ==, (500 * 3) + (500 * 1));
+  g_assert_cmpuint (fixture->sink->events->len, ==, num_block_events);
+
+  gum_fake_event_sink_reset (fixture->sink);
+  while (gum_stalker_garbage_collect (fixture->stalker))
+    g_usleep (10000);
+
+  memset (&stats, 0, sizeof (stats));
+
+  gum_stalker_follow_me (fixture->stalker, fixture->transformer,
+      GUM_EVENT_SINK (fixture->sink));
+  ret = func (0);
+  gum_stalker_query_stats (fixture->stalker, store_stats_of_current_thread,
+      &stats);
+  gum_stalker_unfollow_me (fixture->stalker);
+
+  g_assert_cmpint (ret, ==, (500 * 3) + (500 * 1));
+  g_assert_cmpuint (stats.traces_formed, >=, 1);
+}
+
+TESTCASE (inline_cache_should_serve_megamorphic_call_site)
+{
+  gint (* targets[]) (gint value) = {
+    ic_target_add_one,
+    ic_target_add_two,
+    ic_target_add_three,
+    ic_target_add_four,
+  };
+  GumStalkerStats stats;
+  gint sum;
+  guint round, i;
+
+  g_assert_cmpuint (gum_stalker_get_ic_entries (fixture->stalker), ==, 2);
+  gum_stalker_set_ic_entries (fixture->stalker, G_N_ELEMENTS (targets));
+  g_assert_cmpuint (gum_stalker_get_ic_entries (fixture->stalker), ==,
+      G_N_ELEMENTS (targets));
+
+  g_assert_false (
+      gum_stalker_get_ic_hit_counting_enabled (fixture->stalker));
+  gum_stalker_set_ic_hit_counting_enabled (fixture->stalker, TRUE);
+
+  memset (&stats, 0, sizeof (stats));
+
+  sum = 0;
+  gum_stalker_follow_me (fixture->stalker, fixture->transformer,
+      GUM_EVENT_SINK (fixture->sink));
+  for (round = 0; round != 100; round++)
+  {
+    for (i = 0; i != G_N_ELEMENTS (targets); i++)
+      sum = invoke_ic_target (targets[i], sum);
+  }
+  gum_stalker_query_stats (fixture->stalker, store_stats_of_current_thread,
+      &stats);
+  gum_stalker_unfollow_me (fixture->stalker);
+
+  g_assert_cmpint (sum, ==, 100 * (1 + 2 + 3 + 4));
+
+  g_assert_cmpuint (stats.ic_hits, >=, (100 - 10) * G_N_ELEMENTS (targets));
+  g_assert_cmpuint (stats.ic_misses, >, 0);
+}
+
+TESTCASE (exported_blocks_should_be_replayable)
+{
+  GBytes * blocks, * bogus;
+  const guint8 garbage[4] = { 0, };
+  GumStalkerStats before, after;
+  guint64 recorded_misses, replayed_misses;
+  gint sum;
+  guint i;
+
+  memset (&before, 0, sizeof (before));
+  memset (&after, 0, sizeof (after));
+
+  sum = 0;
+  gum_stalker_follow_me (fixture->stalker, fixture->transformer,
+      GUM_EVENT_SINK (fixture->sink));
+  gum_stalker_query_stats (fixture->stalker, store_stats_of_current_thread,
+      &before);
+  for (i = 0; i != 3; i++)
+  {
+    sum = invoke_ic_target (ic_target_add_one, sum);
+    sum = invoke_ic_target (ic_target_add_two, sum);
+  }
+  gum_stalker_query_stats (fixture->stalker, store_stats_of_current_thread,
+      &after);
+  recorded_misses = after.ic_misses - before.ic_misses;
+  blocks = gum_stalker_export_blocks (fixture->stalker,
+      gum_process_get_current_thread_id ());
+  gum_stalker_unfollow_me (fixture->stalker);
+
+  g_assert_cmpint (sum, ==, 3 * (1 + 2));
+  g_assert_nonnull (blocks);
+  g_assert_cmpuint (g_bytes_get_size (blocks), >, 16);
+
+  while (gum_stalker_garbage_collect (fixture->stalker))
+    g_usleep (10000);
+
+  bogus = g_bytes_new_static (garbage, sizeof (garbage));
+
+  sum = 0;
+  gum_stalker_follow_me (fixture->stalker, fixture->transformer,
+      GUM_EVENT_SINK (fixture->sink));
+  gum_stalker_deactivate (fixture->stalker);
+  g_assert_true (gum_stalker_replay_blocks (fixture->stalker, blocks));
+  g_assert_false (gum_stalker_replay_blocks (fixture->stalker, bogus));
+  gum_stalker_activate (fixture->stalker, replay_activation_target);
+  replay_activation_target ();
+  gum_stalker_query_stats (fixture->stalker, store_stats_of_current_thread,
+      &before);
+  for (i = 0; i != 3; i++)
+  {
+    sum = invoke_ic_target (ic_target_add_one, sum);
+    sum = invoke_ic_target (ic_target_add_two, sum);
+  }
+  gum_stalker_query_stats (fixture->stalker, store_stats_of_current_thread,
+      &after);
+  replayed_misses = after.ic_misses - before.ic_misses;
+  gum_stalker_unfollow_me (fixture->stalker);
+
+  g_assert_cmpint (sum, ==, 3 * (1 + 2));
+  g_assert_cmpuint (recorded_misses, >=, 2);
+  g_assert_cmpuint (replayed_misses, <, recorded_misses);
+
+  g_bytes_unref (bogus);
+  g_bytes_unref (blocks);
+}
+
+TESTCASE (cache_budget_should_evict_and_recompile)
+{
+  const guint block_count = 4096;
+  const guint8 add_and_jump_to_next[] = {
+    0x83, 0xc0, 0x01, /* add eax, 1   */
+    0xeb, 0x00        /* jmp short +0 */
+  };
+  const gchar * again_lbl = "again";
+  guint8 * code;
+  GumX86Writer cw;
+  guint i;
+  StalkerTestFunc func;
+  GumStalkerStats stats;
+  gint ret;
+
+  g_assert_cmpuint (gum_stalker_get_cache_budget (fixture->stalker), ==, 0);
+  gum_stalker_set_cache_budget (fixture->stalker, 1);
+
+  code = gum_alloc_n_pages (
+      (block_count * sizeof (add_and_jump_to_next) / gum_query_page_size ())
+      + 1, GUM_PAGE_RW);
+  gum_x86_writer_init (&cw, code);
+
+  gum_x86_writer_put_xor_reg_reg (&cw, GUM_REG_EAX, GUM_REG_EAX);
+  gum_x86_writer_put_mov_reg_u32 (&cw, GUM_REG_EDX, 2);
+  gum_x86_writer_put_label (&cw, again_lbl);
+  for (i = 0; i != block_count; i++)
+  {
+    gum_x86_writer_put_bytes (&cw, add_and_jump_to_next,
+        sizeof (add_and_jump_to_next));
+  }
+  gum_x86_writer_put_dec_reg (&cw, GUM_REG_EDX);
+  gum_x86_writer_put_jcc_near_label (&cw, X86_INS_JNE, again_lbl,
+      GUM_NO_HINT);
+  gum_x86_writer_put_ret (&cw);
+
+  gum_x86_writer_flush (&cw);
+
+  func = GUM_POINTER_TO_FUNCPTR (StalkerTestFunc,
+      test_stalker_fixture_dup_code (fixture, code,
+          gum_x86_writer_offset (&cw)));
+
+  gum_x86_writer_clear (&cw);
+  gum_free_pages (code);
+
+  memset (&stats, 0, sizeof (stats));
+
+  gum_stalker_follow_me (fixture->stalker, fixture->transformer,
+      GUM_EVENT_SINK (fixture->sink));
+  ret = func (0);
+  gum_stalker_query_stats (fixture->stalker, store_stats_of_current_thread,
+      &stats);
+  gum_stalker_unfollow_me (fixture->stalker);
+
+  g_assert_cmpint (ret, ==, 2 * block_count);
+  g_assert_cmpuint (stats.cache_flushes, >=, 1);
+  g_assert_cmpuint (stats.evicted_blocks, >, 0);
+  g_assert_cmpuint (stats.evicted_bytes, >, 0);
+}
+
+TESTCASE (stats_should_be_reported_per_thread)
+{
+  GumStalkerStats stats;
+  guint64 gate_hits;
+  gint sum;
+  guint i;
+
+  memset (&stats, 0, sizeof (stats));
+
+  sum = 0;
+  gum_stalker_follow_me (fixture->stalker, fixture->transformer,
+      GUM_EVENT_SINK (fixture->sink));
+  for (i = 0; i != 10; i++)
+  {
+    sum = invoke_ic_target (ic_target_add_one, sum);
+    sum = invoke_ic_target (ic_target_add_two, sum);
+  }
+  gum_stalker_query_stats (fixture->stalker, store_stats_of_current_thread,
+      &stats);
+  gum_stalker_unfollow_me (fixture->stalker);
+
+  g_assert_cmpint (sum, ==, 10 * (1 + 2));
+
+  g_assert_cmpuint (stats.thread_id, ==, gum_process_get_current_thread_id ());
+  g_assert_cmpuint (stats.blocks_compiled, >, 0);
+  g_assert_cmpuint (stats.code_bytes, >, 0);
+  g_assert_cmpuint (stats.data_bytes, >, 0);
+  g_assert_cmpuint (stats.backpatches, >, 0);
+  g_assert_cmpuint (stats.num_entry_gates, >, 0);
+
+  gate_hits = 0;
+  for (i = 0; i != stats.num_entry_gates; i++)
+  {
+    g_assert_nonnull (stats.entry_gates[i].name);
+    gate_hits += stats.entry_gates[i].hits;
+  }
+  g_assert_cmpuint (gate_hits, >, 0);
+}
+
+GUM_NOINLINE static gint
+invoke_ic_target (gint (* target) (gint value),
+                  gint value)
+{
+  return target (value);
+}
+
+GUM_NOINLINE static gint
+ic_target_add_one (gint value)
+{
+  return value + 1;
+}
+
+GUM_NOINLINE static gint
+ic_target_add_two (gint value)
+{
+  return value + 2;
+}
+
+GUM_NOINLINE static gint
+ic_target_add_three (gint value)
+{
+  return value + 3;
+}
+
+GUM_NOINLINE static gint
+ic_target_add_four (gint value)
+{
+  return value + 4;
+}
+
+GUM_NOINLINE static void
+replay_activation_target (void)
+{
+  static volatile gint calls = 0;
+
+  calls++;
+}
+
+static gboolean
+store_stats_of_current_thread (const GumStalkerStats * stats,
+                               gpointer user_data)
+{
+  if (stats->thread_id != gum_process_get_current_thread_id ())
+    return TRUE;
+
+  memcpy (user_data, stats, sizeof (GumStalkerStats));
+
+  return FALSE;
+}
+
 static void
 patch_code (gpointer code,
             gconstpointer new_code,
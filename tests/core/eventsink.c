@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2026 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+#include "testutil.h"
+
+#define TESTCASE(NAME) \
+    void test_event_sink_ ## NAME (void)
+#define TESTENTRY(NAME) \
+    TESTENTRY_SIMPLE ("Core/EventSink", test_event_sink, NAME)
+
+TESTLIST_BEGIN (event_sink)
+  TESTENTRY (compact_encoding_should_roundtrip)
+  TESTENTRY (compact_decoding_should_reject_truncated_records)
+  TESTENTRY (compact_sink_should_deliver_self_contained_batches)
+  TESTENTRY (compact_sink_should_not_be_locked_during_delivery)
+TESTLIST_END ()
+
+typedef struct _TestReentrantSinkContext TestReentrantSinkContext;
+
+struct _TestReentrantSinkContext
+{
+  GumEventSink * sink;
+  const GumEvent * event;
+  guint n_batches;
+};
+
+static guint make_test_events (GumEvent * events);
+static void assert_events_equal (const GumEvent * a, const GumEvent * b);
+static void append_compact_batch (const guint8 * data, gsize size,
+    gpointer user_data);
+static void process_event_during_delivery (const guint8 * data, gsize size,
+    gpointer user_data);
+
+TESTCASE (compact_encoding_should_roundtrip)
+{
+  GumEvent events[5], decoded;
+  guint8 buffer[5 * GUM_COMPACT_EVENT_MAX_SIZE + 16];
+  GumAddress previous;
+  gsize offset, size;
+  guint n, i;
+
+  n = make_test_events (events);
+
+  offset = gum_event_encode_compact_base (0x40001000, buffer);
+  previous = 0x40001000;
+  for (i = 0; i != n; i++)
+  {
+    size = gum_event_encode_compact (&events[i], &previous, buffer + offset);
+    g_assert_cmpuint (size, >, 0);
+    g_assert_cmpuint (size, <=, GUM_COMPACT_EVENT_MAX_SIZE);
+    offset += size;
+  }
+
+  previous = 0;
+  size = gum_event_decode_compact (buffer, offset, &previous, &decoded);
+  g_assert_cmpuint (size, >, 0);
+  g_assert_cmpuint (decoded.type, ==, GUM_NOTHING);
+  g_assert_cmphex (previous, ==, 0x40001000);
+
+  for (i = 0; i != n; i++)
+  {
+    gsize consumed;
+
+    consumed = gum_event_decode_compact (buffer + size, offset - size,
+        &previous, &decoded);
+    g_assert_cmpuint (consumed, >, 0);
+    assert_events_equal (&decoded, &events[i]);
+
+    size += consumed;
+  }
+  g_assert_cmpuint (size, ==, offset);
+}
+
+TESTCASE (compact_decoding_should_reject_truncated_records)
+{
+  GumEvent event, decoded;
+  guint8 buffer[GUM_COMPACT_EVENT_MAX_SIZE];
+  GumAddress previous;
+  gsize size, i;
+
+  event.call.type = GUM_CALL;
+  event.call.location = GSIZE_TO_POINTER (0x40123456);
+  event.call.target = GSIZE_TO_POINTER (0x40abcdef);
+  event.call.depth = 3;
+
+  previous = 0;
+  size = gum_event_encode_compact (&event, &previous, buffer);
+
+  for (i = 0; i != size; i++)
+  {
+    previous = 0;
+    g_assert_cmpuint (gum_event_decode_compact (buffer, i, &previous,
+        &decoded), ==, 0);
+  }
+
+  buffer[0] = 0xff;
+  previous = 0;
+  g_assert_cmpuint (gum_event_decode_compact (buffer, size, &previous,
+      &decoded), ==, 0);
+}
+
+TESTCASE (compact_sink_should_deliver_self_contained_batches)
+{
+  GumEvent events[5];
+  GPtrArray * batches;
+  GumEventSink * sink;
+  guint n, round, i, j, total;
+
+  n = make_test_events (events);
+
+  batches = g_ptr_array_new_with_free_func ((GDestroyNotify) g_bytes_unref);
+  sink = gum_event_sink_make_compact (GUM_CALL | GUM_RET | GUM_EXEC |
+      GUM_BLOCK | GUM_COMPILE, 2 * GUM_COMPACT_EVENT_MAX_SIZE,
+      append_compact_batch, batches, NULL);
+
+  for (round = 0; round != 4; round++)
+  {
+    for (i = 0; i != n; i++)
+      gum_event_sink_process (sink, &events[i], NULL);
+  }
+  gum_event_sink_flush (sink);
+
+  g_assert_cmpuint (batches->len, >, 1);
+
+  total = 0;
+  for (i = 0; i != batches->len; i++)
+  {
+    GBytes * batch = g_ptr_array_index (batches, i);
+    const guint8 * data;
+    gsize size, offset;
+    GumAddress previous = 0;
+
+    data = g_bytes_get_data (batch, &size);
+
+    for (offset = 0; offset != size; total++)
+    {
+      GumEvent decoded;
+      gsize consumed;
+
+      consumed = gum_event_decode_compact (data + offset, size - offset,
+          &previous, &decoded);
+      g_assert_cmpuint (consumed, >, 0);
+
+      j = total % n;
+      assert_events_equal (&decoded, &events[j]);
+
+      offset += consumed;
+    }
+  }
+  g_assert_cmpuint (total, ==, 4 * n);
+
+  g_object_unref (sink);
+  g_ptr_array_unref (batches);
+}
+
+TESTCASE (compact_sink_should_not_be_locked_during_delivery)
+{
+  GumEvent events[5];
+  TestReentrantSinkContext ctx;
+
+  make_test_events (events);
+
+  ctx.sink = gum_event_sink_make_compact (GUM_EXEC, 0,
+      process_event_during_delivery, &ctx, NULL);
+  ctx.event = &events[1];
+  ctx.n_batches = 0;
+
+  gum_event_sink_process (ctx.sink, &events[1], NULL);
+  gum_event_sink_flush (ctx.sink);
+  g_assert_cmpuint (ctx.n_batches, ==, 1);
+
+  gum_event_sink_flush (ctx.sink);
+  g_assert_cmpuint (ctx.n_batches, ==, 2);
+
+  gum_event_sink_flush (ctx.sink);
+  g_assert_cmpuint (ctx.n_batches, ==, 2);
+
+  g_object_unref (ctx.sink);
+}
+
+static guint
+make_test_events (GumEvent * events)
+{
+  events[0].call.type = GUM_CALL;
+  events[0].call.location = GSIZE_TO_POINTER (0x40001234);
+  events[0].call.target = GSIZE_TO_POINTER (0x40000100);
+  events[0].call.depth = 1;
+
+  events[1].exec.type = GUM_EXEC;
+  events[1].exec.location = GSIZE_TO_POINTER (0x40000104);
+
+  events[2].block.type = GUM_BLOCK;
+  events[2].block.start = GSIZE_TO_POINTER (0x40000100);
+  events[2].block.end = GSIZE_TO_POINTER (0x40000118);
+
+  events[3].block.type = GUM_COMPILE;
+  events[3].block.start = GSIZE_TO_POINTER (0x10000);
+  events[3].block.end = GSIZE_TO_POINTER (0x10040);
+
+  events[4].ret.type = GUM_RET;
+  events[4].ret.location = GSIZE_TO_POINTER (0x40000117);
+  events[4].ret.target = GSIZE_TO_POINTER (0x40001239);
+  events[4].ret.depth = -2;
+
+  return 5;
+}
+
+static void
+assert_events_equal (const GumEvent * a,
+                     const GumEvent * b)
+{
+  g_assert_cmpuint (a->type, ==, b->type);
+
+  switch (a->type)
+  {
+    case GUM_CALL:
+      g_assert_true (a->call.location == b->call.location);
+      g_assert_true (a->call.target == b->call.target);
+      g_assert_cmpint (a->call.depth, ==, b->call.depth);
+      break;
+    case GUM_RET:
+      g_assert_true (a->ret.location == b->ret.location);
+      g_assert_true (a->ret.target == b->ret.target);
+      g_assert_cmpint (a->ret.depth, ==, b->ret.depth);
+      break;
+    case GUM_EXEC:
+      g_assert_true (a->exec.location == b->exec.location);
+      break;
+    case GUM_BLOCK:
+    case GUM_COMPILE:
+      g_assert_true (a->block.start == b->block.start);
+      g_assert_true (a->block.end == b->block.end);
+      break;
+    default:
+      g_assert_not_reached ();
+  }
+}
+
+static void
+append_compact_batch (const guint8 * data,
+                      gsize size,
+                      gpointer user_data)
+{
+  GPtrArray * batches = user_data;
+
+  g_ptr_array_add (batches, g_bytes_new (data, size));
+}
+
+static void
+process_event_during_delivery (const guint8 * data,
+                               gsize size,
+                               gpointer user_data)
+{
+  TestReentrantSinkContext * ctx = user_data;
+  GumAddress previous = 0;
+  GumEvent decoded;
+
+  g_assert_cmpuint (gum_event_decode_compact (data, size, &previous,
+      &decoded), ==, size);
+  assert_events_equal (&decoded, ctx->event);
+
+  if (ctx->n_batches++ == 0)
+    gum_event_sink_process (ctx->sink, ctx->event, NULL);
+}
@@ -23,10 +23,14 @@ TESTLIST_BEGIN (interceptor)
 # if GLIB_SIZEOF_VOID_P == 8
   TESTENTRY (relocation_of_early_rip_relative_call)
 # endif
+  TESTENTRY (transaction_coalesces_contiguous_pages)
 #endif
 
   TESTENTRY (attach_one)
   TESTENTRY (attach_two)
+  TESTENTRY (attach_many)
+  TESTENTRY (attach_many_with_already_attached_and_unsupported)
+  TESTENTRY (attach_many_leaves_failed_targets_untouched)
   TESTENTRY (attach_to_recursive_function)
   TESTENTRY (attach_to_special_function)
 #ifdef G_OS_UNIX
@@ -79,6 +83,7 @@ static gpointer thread_calling_pthread_setspecific (gpointer data);
 #ifdef HAVE_WINDOWS
 static gpointer hit_target_function_repeatedly (gpointer data);
 #endif
+static void count_invocation (guint * count, GumInvocationContext * context);
 static gpointer replacement_malloc (gsize size);
 static gpointer replacement_target_function (GString * str);
 
@@ -97,6 +102,166 @@ TESTCASE (attach_two)
   g_assert_cmpstr (fixture->result->str, ==, "ac|bd");
 }
 
+TESTCASE (attach_many)
+{
+  TestCallbackListener * listener;
+  guint count = 0;
+  gpointer targets[3];
+  GumAttachReturn results[G_N_ELEMENTS (targets)];
+
+  listener = test_callback_listener_new ();
+  listener->on_enter = (TestCallbackListenerFunc) count_invocation;
+  listener->user_data = &count;
+
+  targets[0] = target_nop_function_a;
+  targets[1] = target_nop_function_b;
+  targets[2] = target_nop_function_c;
+
+  g_assert_cmpuint (gum_interceptor_attach_many (fixture->interceptor,
+      targets, G_N_ELEMENTS (targets), GUM_INVOCATION_LISTENER (listener),
+      NULL, results), ==, 3);
+  g_assert_cmpint (results[0], ==, GUM_ATTACH_OK);
+  g_assert_cmpint (results[1], ==, GUM_ATTACH_OK);
+  g_assert_cmpint (results[2], ==, GUM_ATTACH_OK);
+
+  target_nop_function_a (NULL);
+  target_nop_function_b (NULL);
+  target_nop_function_c (NULL);
+  g_assert_cmpuint (count, ==, 3);
+
+  gum_interceptor_detach (fixture->interceptor,
+      GUM_INVOCATION_LISTENER (listener));
+
+  target_nop_function_a (NULL);
+  target_nop_function_b (NULL);
+  target_nop_function_c (NULL);
+  g_assert_cmpuint (count, ==, 3);
+
+  g_object_unref (listener);
+}
+
+TESTCASE (attach_many_with_already_attached_and_unsupported)
+{
+  TestCallbackListener * listener;
+  guint count = 0;
+  UnsupportedFunction * unsupported_functions;
+  guint n_unsupported;
+  gpointer targets[4];
+  GumAttachReturn results[G_N_ELEMENTS (targets)];
+
+  unsupported_functions = unsupported_function_list_new (&n_unsupported);
+  if (n_unsupported == 0)
+  {
+    unsupported_function_list_free (unsupported_functions);
+    g_print ("<skipping, not available> ");
+    return;
+  }
+
+  listener = test_callback_listener_new ();
+  listener->on_enter = (TestCallbackListenerFunc) count_invocation;
+  listener->user_data = &count;
+
+  interceptor_fixture_attach (fixture, 0, target_nop_function_b, '>', '<');
+  g_assert_cmpint (gum_interceptor_attach (fixture->interceptor,
+      target_nop_function_c, GUM_INVOCATION_LISTENER (listener), NULL),
+      ==, GUM_ATTACH_OK);
+
+  targets[0] = target_nop_function_a;
+  targets[1] = target_nop_function_b;
+  targets[2] = target_nop_function_c;
+  targets[3] =
+      unsupported_functions[0].code + unsupported_functions[0].code_offset;
+
+  g_assert_cmpuint (gum_interceptor_attach_many (fixture->interceptor,
+      targets, G_N_ELEMENTS (targets), GUM_INVOCATION_LISTENER (listener),
+      NULL, results), ==, 2);
+  g_assert_cmpint (results[0], ==, GUM_ATTACH_OK);
+  g_assert_cmpint (results[1], ==, GUM_ATTACH_OK);
+  g_assert_cmpint (results[2], ==, GUM_ATTACH_ALREADY_ATTACHED);
+  g_assert_cmpint (results[3], ==, GUM_ATTACH_WRONG_SIGNATURE);
+
+  target_nop_function_a (NULL);
+  target_nop_function_b (NULL);
+  target_nop_function_c (NULL);
+  g_assert_cmpuint (count, ==, 3);
+  g_assert_cmpstr (fixture->result->str, ==, "><");
+
+  gum_interceptor_detach (fixture->interceptor,
+      GUM_INVOCATION_LISTENER (listener));
+  g_object_unref (listener);
+
+  unsupported_function_list_free (unsupported_functions);
+}
+
+TESTCASE (attach_many_leaves_failed_targets_untouched)
+{
+  TestCallbackListener * listener;
+  guint count = 0;
+  UnsupportedFunction * unsupported_functions;
+  guint n_unsupported;
+  UnsupportedFunction * unsupported;
+  guint8 original_code[sizeof (unsupported->code)];
+  gpointer targets[3];
+  GumAttachReturn results[G_N_ELEMENTS (targets)];
+
+  unsupported_functions = unsupported_function_list_new (&n_unsupported);
+  if (n_unsupported == 0)
+  {
+    unsupported_function_list_free (unsupported_functions);
+    g_print ("<skipping, not available> ");
+    return;
+  }
+  unsupported = &unsupported_functions[0];
+  memcpy (original_code, unsupported->code, sizeof (original_code));
+
+  listener = test_callback_listener_new ();
+  listener->on_enter = (TestCallbackListenerFunc) count_invocation;
+  listener->user_data = &count;
+
+  targets[0] = target_nop_function_a;
+  targets[1] = unsupported->code + unsupported->code_offset;
+  targets[2] = target_nop_function_b;
+
+  g_assert_cmpuint (gum_interceptor_attach_many (fixture->interceptor,
+      targets, G_N_ELEMENTS (targets), GUM_INVOCATION_LISTENER (listener),
+      NULL, results), ==, 2);
+  g_assert_cmpint (results[1], ==, GUM_ATTACH_WRONG_SIGNATURE);
+  g_assert_cmpint (memcmp (unsupported->code, original_code,
+      sizeof (original_code)), ==, 0);
+
+  /* A single detach undoes everything the batch attached. */
+  gum_interceptor_detach (fixture->interceptor,
+      GUM_INVOCATION_LISTENER (listener));
+
+  target_nop_function_a (NULL);
+  target_nop_function_b (NULL);
+  g_assert_cmpuint (count, ==, 0);
+
+  g_assert_cmpuint (gum_interceptor_attach_many (fixture->interceptor,
+      targets, G_N_ELEMENTS (targets), GUM_INVOCATION_LISTENER (listener),
+      NULL, results), ==, 2);
+  g_assert_cmpint (results[0], ==, GUM_ATTACH_OK);
+  g_assert_cmpint (results[1], ==, GUM_ATTACH_WRONG_SIGNATURE);
+  g_assert_cmpint (results[2], ==, GUM_ATTACH_OK);
+
+  target_nop_function_a (NULL);
+  target_nop_function_b (NULL);
+  g_assert_cmpuint (count, ==, 2);
+
+  gum_interceptor_detach (fixture->interceptor,
+      GUM_INVOCATION_LISTENER (listener));
+  g_object_unref (listener);
+
+  unsupported_function_list_free (unsupported_functions);
+}
+
+static void
+count_invocation (guint * count,
+                  GumInvocationContext * context)
+{
+  (*count)++;
+}
+
 void GUM_NOINLINE
 recursive_function (GString * str,
                     gint count)
@@ -572,6 +737,49 @@ TESTCASE (relocation_of_early_rip_relative_call)
 
 # endif
 
+TESTCASE (transaction_coalesces_contiguous_pages)
+{
+  const guint num_pages = 2;
+  guint page_size, count_before, i;
+  guint8 * pages;
+  ProxyFunc funcs[2];
+
+  page_size = gum_query_page_size ();
+
+  pages = gum_alloc_n_pages (num_pages, GUM_PAGE_RW);
+  for (i = 0; i != num_pages; i++)
+  {
+    guint8 * code = pages + (i * page_size);
+
+    memset (code, 0x90, 16);
+    code[16] = 0xc3;
+
+    funcs[i] = (ProxyFunc) code;
+  }
+  gum_mprotect (pages, num_pages * page_size, GUM_PAGE_RX);
+  gum_clear_cache (pages, num_pages * page_size);
+
+  count_before = gum_interceptor_get_commit_syscall_count (
+      fixture->interceptor);
+
+  gum_interceptor_begin_transaction (fixture->interceptor);
+  interceptor_fixture_attach (fixture, 0, funcs[0], '>', '<');
+  interceptor_fixture_attach (fixture, 1, funcs[1], 'a', 'b');
+  gum_interceptor_end_transaction (fixture->interceptor);
+
+  g_assert_cmpuint (gum_interceptor_get_commit_syscall_count (
+      fixture->interceptor) - count_before, <=, 3);
+
+  for (i = 0; i != num_pages; i++)
+    funcs[i] (fixture->result);
+  g_assert_cmpstr (fixture->result->str, ==, "><ab");
+
+  for (i = 0; i != num_pages; i++)
+    interceptor_fixture_detach (fixture, i);
+
+  gum_free_pages (pages);
+}
+
 #endif /* HAVE_I386 */
 
 #ifndef HAVE_ASAN
@@ -8,6 +8,10 @@
 
 #include "gummemory-priv.h"
 
+#ifdef HAVE_LINUX
+# include <sys/mman.h>
+#endif
+
 #define TESTCASE(NAME) \
     void test_memory_ ## NAME (void)
 #define TESTENTRY(NAME) \
@@ -19,13 +23,29 @@ TESTLIST_BEGIN (memory)
   TESTENTRY (read_from_unaligned_address_should_succeed)
   TESTENTRY (read_across_two_pages_should_return_correct_data)
   TESTENTRY (read_beyond_page_should_return_partial_data)
+  TESTENTRY (read_spanning_many_pages_should_return_partial_data)
+#ifdef HAVE_LINUX
+  TESTENTRY (read_with_oversized_length_should_return_partial_data)
+#endif
   TESTENTRY (write_to_valid_address_should_succeed)
   TESTENTRY (write_to_invalid_address_should_fail)
+  TESTENTRY (write_to_read_only_address_should_fail)
+  TESTENTRY (write_spanning_read_only_page_should_leave_memory_untouched)
   TESTENTRY (match_pattern_from_string_does_proper_validation)
   TESTENTRY (scan_range_finds_three_exact_matches)
   TESTENTRY (scan_range_finds_three_wildcarded_matches)
   TESTENTRY (scan_range_finds_three_masked_matches)
+  TESTENTRY (scan_range_finds_exact_matches_across_vector_boundaries)
+  TESTENTRY (scan_range_finds_matches_of_pattern_set)
+  TESTENTRY (scan_range_follows_failure_links_of_pattern_set)
+  TESTENTRY (scan_ranges_matches_serial_scan_across_chunk_boundaries)
+  TESTENTRY (scan_ranges_reports_matches_in_address_order)
   TESTENTRY (is_memory_readable_handles_mixed_page_protections)
+  TESTENTRY (query_protection_reports_page_protection)
+  TESTENTRY (memory_map_snapshot_tracks_own_mprotect)
+#ifdef HAVE_LINUX
+  TESTENTRY (protection_queries_see_foreign_changes)
+#endif
   TESTENTRY (alloc_n_pages_returns_aligned_rw_address)
   TESTENTRY (alloc_n_pages_near_returns_aligned_rw_address_within_range)
   TESTENTRY (allocate_handles_alignment)
@@ -41,8 +61,21 @@ typedef struct _TestForEachContext {
   guint expected_size;
 } TestForEachContext;
 
+typedef struct _TestPatternSetContext {
+  guint8 * base;
+  GString * log;
+} TestPatternSetContext;
+
 static gboolean match_found_cb (GumAddress address, gsize size,
     gpointer user_data);
+static gboolean append_match_cb (GumAddress address, gsize size,
+    gpointer user_data);
+static gboolean pattern_set_match_found_cb (GumAddress address, gsize size,
+    guint pattern_index, gpointer user_data);
+#ifdef HAVE_LINUX
+static gboolean ignore_range_cb (const GumRangeDetails * details,
+    gpointer user_data);
+#endif
 
 TESTCASE (read_from_valid_address_should_succeed)
 {
@@ -148,6 +181,62 @@ TESTCASE (read_beyond_page_should_return_partial_data)
   gum_free_pages (page);
 }
 
+TESTCASE (read_spanning_many_pages_should_return_partial_data)
+{
+  const guint n_pages = 200;
+  guint8 * pages;
+  guint page_size;
+  gsize n_bytes_read;
+  guint8 * data;
+
+  pages = gum_alloc_n_pages (n_pages, GUM_PAGE_RW);
+  page_size = gum_query_page_size ();
+  pages[0] = 0x13;
+  pages[((n_pages - 1) * page_size) - 1] = 0x37;
+  gum_mprotect (pages + ((n_pages - 1) * page_size), page_size,
+      GUM_PAGE_NO_ACCESS);
+
+  data = gum_memory_read (pages + 1, (n_pages * page_size) - 1,
+      &n_bytes_read);
+  g_assert_nonnull (data);
+  g_assert_cmpuint (n_bytes_read, ==, ((n_pages - 1) * page_size) - 1);
+  g_assert_cmphex (data[n_bytes_read - 1], ==, 0x37);
+  g_free (data);
+
+  data = gum_memory_read (pages, 1, &n_bytes_read);
+  g_assert_nonnull (data);
+  g_assert_cmpuint (n_bytes_read, ==, 1);
+  g_assert_cmphex (data[0], ==, 0x13);
+  g_free (data);
+
+  gum_free_pages (pages);
+}
+
+#ifdef HAVE_LINUX
+
+TESTCASE (read_with_oversized_length_should_return_partial_data)
+{
+  guint8 * pages;
+  gsize page_size, n_bytes_read;
+  guint8 * data;
+
+  page_size = gum_query_page_size ();
+
+  pages = gum_alloc_n_pages (2, GUM_PAGE_RW);
+  pages[page_size - 1] = 0x42;
+  gum_mprotect (pages + page_size, page_size, GUM_PAGE_NO_ACCESS);
+
+  data = gum_memory_read (pages, G_MAXSIZE / 4, &n_bytes_read);
+  g_assert_nonnull (data);
+  g_assert_cmpuint (n_bytes_read, ==, page_size);
+  g_assert_cmphex (data[page_size - 1], ==, 0x42);
+  g_free (data);
+
+  gum_free_pages (pages);
+}
+
+#endif
+
 TESTCASE (write_to_valid_address_should_succeed)
 {
   guint8 bytes[3] = { 0x00, 0x00, 0x12 };
@@ -167,6 +256,45 @@ TESTCASE (write_to_invalid_address_should_fail)
   g_assert_false (gum_memory_write (invalid_address, bytes, sizeof (bytes)));
 }
 
+TESTCASE (write_to_read_only_address_should_fail)
+{
+  guint8 * page;
+  guint8 magic[2] = { 0x13, 0x37 };
+
+  page = gum_alloc_n_pages (1, GUM_PAGE_RW);
+  gum_mprotect (page, gum_query_page_size (), GUM_PAGE_READ);
+
+  g_assert_false (gum_memory_write (page, magic, sizeof (magic)));
+  g_assert_cmphex (page[0], ==, 0x00);
+
+  gum_free_pages (page);
+}
+
+TESTCASE (write_spanning_read_only_page_should_leave_memory_untouched)
+{
+  guint8 * pages;
+  gsize page_size;
+  guint8 * bytes;
+
+  page_size = gum_query_page_size ();
+
+  pages = gum_alloc_n_pages (2, GUM_PAGE_RW);
+  memset (pages, 0x13, 2 * page_size);
+  gum_mprotect (pages + page_size, page_size, GUM_PAGE_READ);
+
+  bytes = g_malloc (page_size);
+  memset (bytes, 0x37, page_size);
+
+  g_assert_false (gum_memory_write (pages + (page_size / 2), bytes,
+      page_size));
+  g_assert_cmphex (pages[page_size / 2], ==, 0x13);
+  g_assert_cmphex (pages[page_size - 1], ==, 0x13);
+  g_assert_cmphex (pages[page_size], ==, 0x13);
+
+  g_free (bytes);
+  gum_free_pages (pages);
+}
+
 #define GUM_PATTERN_NTH_TOKEN(p, n) \
     ((GumMatchToken *) g_ptr_array_index (p->tokens, n))
 #define GUM_PATTERN_NTH_TOKEN_NTH_BYTE(p, n, b) \
@@ -376,6 +504,182 @@ TESTCASE (scan_range_finds_three_masked_matches)
   gum_match_pattern_free (pattern);
 }
 
+TESTCASE (scan_range_finds_exact_matches_across_vector_boundaries)
+{
+  guint8 buf[100];
+  GumMemoryRange range;
+  GumMatchPattern * pattern;
+  TestForEachContext ctx;
+
+  memset (buf, 0x13, sizeof (buf));
+  memcpy (buf + 14, "\x13\x37\xaa\xbb", 4);
+  memcpy (buf + 31, "\x13\x37\xaa\xbb", 4);
+  memcpy (buf + 96, "\x13\x37\xaa\xbb", 4);
+  buf[60] = 0xaa;
+  buf[61] = 0xbb;
+
+  range.base_address = GUM_ADDRESS (buf);
+  range.size = sizeof (buf);
+
+  pattern = gum_match_pattern_new_from_string ("13 37 aa bb");
+  g_assert_nonnull (pattern);
+
+  ctx.expected_address[0] = buf + 14;
+  ctx.expected_address[1] = buf + 31;
+  ctx.expected_address[2] = buf + 96;
+  ctx.expected_size = 4;
+
+  ctx.number_of_calls = 0;
+  ctx.value_to_return = TRUE;
+  gum_memory_scan (&range, pattern, match_found_cb, &ctx);
+  g_assert_cmpuint (ctx.number_of_calls, ==, 3);
+
+  gum_match_pattern_free (pattern);
+}
+
+TESTCASE (scan_ranges_matches_serial_scan_across_chunk_boundaries)
+{
+  const gsize size = 5 * 1024 * 1024;
+  const guint page_size = gum_query_page_size ();
+  guint8 * pages;
+  GumMemoryRange range;
+  const gchar * patterns[] = { "aa aa aa", "aa ?? aa aa", "aa aa" };
+  guint i;
+
+  pages = gum_alloc_n_pages ((size / page_size) + 1, GUM_PAGE_RW);
+  memset (pages, 0xaa, size);
+
+  /*
+   * A self-overlapping pattern over a run of identical bytes makes matches
+   * spill across every chunk boundary that is not a multiple of its size.
+   */
+  range.base_address = GUM_ADDRESS (pages + 1);
+  range.size = size - 1;
+
+  for (i = 0; i != G_N_ELEMENTS (patterns); i++)
+  {
+    GumMatchPattern * pattern;
+    GArray * serial, * parallel;
+
+    pattern = gum_match_pattern_new_from_string (patterns[i]);
+
+    serial = g_array_new (FALSE, FALSE, sizeof (GumAddress));
+    parallel = g_array_new (FALSE, FALSE, sizeof (GumAddress));
+
+    gum_memory_scan (&range, pattern, append_match_cb, serial);
+    gum_memory_scan_ranges (&range, 1, pattern, 4, append_match_cb, parallel);
+
+    g_assert_cmpuint (parallel->len, ==, serial->len);
+    g_assert_cmpint (memcmp (parallel->data, serial->data,
+        serial->len * sizeof (GumAddress)), ==, 0);
+
+    g_array_free (parallel, TRUE);
+    g_array_free (serial, TRUE);
+    gum_match_pattern_free (pattern);
+  }
+
+  gum_free_pages (pages);
+}
+
+TESTCASE (scan_ranges_reports_matches_in_address_order)
+{
+  guint8 haystack[] = { 0x01, 0x02, 0x13, 0x37, 0x03, 0x13, 0x37 };
+  GumMemoryRange ranges[2];
+  GumMatchPattern * pattern;
+  GArray * matches;
+
+  ranges[0].base_address = GUM_ADDRESS (haystack + 4);
+  ranges[0].size = 3;
+  ranges[1].base_address = GUM_ADDRESS (haystack);
+  ranges[1].size = 4;
+
+  pattern = gum_match_pattern_new_from_string ("13 37");
+  matches = g_array_new (FALSE, FALSE, sizeof (GumAddress));
+
+  gum_memory_scan_ranges (ranges, G_N_ELEMENTS (ranges), pattern, 2,
+      append_match_cb, matches);
+
+  g_assert_cmpuint (matches->len, ==, 2);
+  g_assert_cmphex (g_array_index (matches, GumAddress, 0), ==,
+      GUM_ADDRESS (haystack + 2));
+  g_assert_cmphex (g_array_index (matches, GumAddress, 1), ==,
+      GUM_ADDRESS (haystack + 5));
+
+  g_array_free (matches, TRUE);
+  gum_match_pattern_free (pattern);
+}
+
+TESTCASE (scan_range_finds_matches_of_pattern_set)
+{
+  guint8 buf[16] = {
+    0x00, 0x00, 0x13, 0x37, 0x00, 0x00, 0x00, 0x00,
+    0xaa, 0xbb, 0x00, 0x00, 0x13, 0x37, 0xaa, 0xbb
+  };
+  const gchar * patterns[] = {
+    "13 37",
+    "37 aa",
+    "aa bb:f0 0f",
+  };
+  const gchar * invalid_patterns[] = {
+    "13 37",
+    "1",
+  };
+  GumMemoryRange range;
+  GumMatchPatternSet * set;
+  TestPatternSetContext ctx;
+
+  g_assert_null (gum_match_pattern_set_new_from_strings (invalid_patterns,
+      G_N_ELEMENTS (invalid_patterns)));
+
+  set = gum_match_pattern_set_new_from_strings (patterns,
+      G_N_ELEMENTS (patterns));
+  g_assert_nonnull (set);
+  g_assert_cmpuint (gum_match_pattern_set_get_size (set), ==, 3);
+
+  range.base_address = GUM_ADDRESS (buf);
+  range.size = sizeof (buf);
+
+  ctx.base = buf;
+  ctx.log = g_string_new ("");
+  gum_memory_scan_pattern_set (&range, set, pattern_set_match_found_cb, &ctx);
+  g_assert_cmpstr (ctx.log->str, ==, "2:0/2 8:2/2 12:0/2 13:1/2 14:2/2 ");
+  g_string_free (ctx.log, TRUE);
+
+  gum_match_pattern_set_free (set);
+}
+
+TESTCASE (scan_range_follows_failure_links_of_pattern_set)
+{
+  guint8 buf[11] = {
+    0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0x01, 0x12, 0xbb, 0xcc, 0x03, 0x1f
+  };
+  const gchar * patterns[] = {
+    "aa bb cc dd",
+    "bb cc",
+    "cc dd ee",
+    "0? 1?",
+  };
+  GumMemoryRange range;
+  GumMatchPatternSet * set;
+  TestPatternSetContext ctx;
+
+  set = gum_match_pattern_set_new_from_strings (patterns,
+      G_N_ELEMENTS (patterns));
+  g_assert_nonnull (set);
+
+  range.base_address = GUM_ADDRESS (buf);
+  range.size = sizeof (buf);
+
+  ctx.base = buf;
+  ctx.log = g_string_new ("");
+  gum_memory_scan_pattern_set (&range, set, pattern_set_match_found_cb, &ctx);
+  g_assert_cmpstr (ctx.log->str, ==,
+      "1:1/2 0:0/4 2:2/3 5:3/2 7:1/2 9:3/2 ");
+  g_string_free (ctx.log, TRUE);
+
+  gum_match_pattern_set_free (set);
+}
+
 TESTCASE (is_memory_readable_handles_mixed_page_protections)
 {
   guint8 * pages;
@@ -411,6 +715,91 @@ TESTCASE (is_memory_readable_handles_mixed_page_protections)
   gum_free_pages (pages);
 }
 
+TESTCASE (query_protection_reports_page_protection)
+{
+  guint8 * pages;
+  guint page_size;
+  GumPageProtection prot;
+
+  pages = gum_alloc_n_pages (2, GUM_PAGE_RW);
+
+  page_size = gum_query_page_size ();
+
+  gum_mprotect (pages + page_size, page_size, GUM_PAGE_READ);
+
+  g_assert_true (gum_memory_query_protection (pages, &prot));
+  g_assert_cmpuint (prot, ==, GUM_PAGE_RW);
+
+  g_assert_true (gum_memory_query_protection (pages + page_size, &prot));
+  g_assert_cmpuint (prot, ==, GUM_PAGE_READ);
+
+  gum_free_pages (pages);
+}
+
+TESTCASE (memory_map_snapshot_tracks_own_mprotect)
+{
+  guint8 * pages;
+  guint page_size;
+  GumMemoryMapSnapshot * snapshot;
+  GumMemoryRange range;
+  GumPageProtection prot;
+
+  pages = gum_alloc_n_pages (2, GUM_PAGE_RW);
+  page_size = gum_query_page_size ();
+
+  snapshot = gum_memory_map_snapshot_new ();
+
+  g_assert_true (gum_memory_map_snapshot_find (snapshot,
+      GUM_ADDRESS (pages + page_size), &range, &prot));
+  g_assert_cmphex (range.base_address, <=, GUM_ADDRESS (pages + page_size));
+  g_assert_cmphex (range.base_address + range.size, >=,
+      GUM_ADDRESS (pages + (2 * page_size)));
+  g_assert_cmpuint (prot, ==, GUM_PAGE_RW);
+
+  gum_mprotect (pages + page_size, page_size, GUM_PAGE_READ);
+
+  g_assert_true (gum_memory_map_snapshot_find (snapshot,
+      GUM_ADDRESS (pages + page_size), NULL, &prot));
+  g_assert_cmpuint (prot, ==, GUM_PAGE_READ);
+
+  g_assert_true (gum_memory_map_snapshot_query_protection (snapshot, pages,
+      2 * page_size, &prot));
+  g_assert_cmpuint (prot, ==, GUM_PAGE_READ);
+
+  g_object_unref (snapshot);
+
+  gum_free_pages (pages);
+}
+
+#ifdef HAVE_LINUX
+
+TESTCASE (protection_queries_see_foreign_changes)
+{
+  gsize page_size;
+  guint8 * pages;
+
+  page_size = gum_query_page_size ();
+
+  pages = mmap (NULL, 2 * page_size, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  g_assert_true (pages != MAP_FAILED);
+
+  gum_process_enumerate_ranges (GUM_PAGE_RW, ignore_range_cb, NULL);
+  g_assert_true (gum_memory_is_readable (pages, 2 * page_size));
+
+  mprotect (pages + page_size, page_size, PROT_NONE);
+
+  g_assert_true (gum_memory_is_readable (pages, page_size));
+  g_assert_false (gum_memory_is_readable (pages + page_size, 1));
+  g_assert_false (gum_memory_is_readable (pages, 2 * page_size));
+
+  munmap (pages, 2 * page_size);
+
+  g_assert_false (gum_memory_is_readable (pages, 1));
+}
+
+#endif
+
 TESTCASE (alloc_n_pages_returns_aligned_rw_address)
 {
   gpointer page;
@@ -528,3 +917,41 @@ match_found_cb (GumAddress address,
 
   return ctx->value_to_return;
 }
+
+static gboolean
+append_match_cb (GumAddress address,
+                 gsize size,
+                 gpointer user_data)
+{
+  GArray * matches = user_data;
+
+  g_array_append_val (matches, address);
+
+  return TRUE;
+}
+
+static gboolean
+pattern_set_match_found_cb (GumAddress address,
+                            gsize size,
+                            guint pattern_index,
+                            gpointer user_data)
+{
+  TestPatternSetContext * ctx = (TestPatternSetContext *) user_data;
+
+  g_string_append_printf (ctx->log, "%u:%u/%u ",
+      (guint) (address - GUM_ADDRESS (ctx->base)), pattern_index,
+      (guint) size);
+
+  return TRUE;
+}
+
+#ifdef HAVE_LINUX
+
+static gboolean
+ignore_range_cb (const GumRangeDetails * details,
+                 gpointer user_data)
+{
+  return TRUE;
+}
+
+#endif
@@ -24,6 +24,7 @@
 
 #if defined (HAVE_LINUX)
 # include "backend-linux/gumlinux.h"
+# include <unistd.h>
 #endif
 
 #define TESTCASE(NAME) \
@@ -67,8 +68,12 @@ TESTLIST_BEGIN (process)
 #endif
 #if defined (HAVE_LINUX) && !defined (HAVE_ANDROID)
   TESTENTRY (linux_process_modules)
+  TESTENTRY (linux_named_ranges_cover_module)
+  TESTENTRY (linux_ranges_provide_file_offset_and_path)
 #endif
 #if defined (HAVE_LINUX) && defined (HAVE_SYS_AUXV_H)
+  TESTENTRY (linux_proc_maps_modules_include_vdso)
+  TESTENTRY (linux_named_ranges_include_vdso)
   TESTENTRY (linux_get_cpu_from_auxv_null_32bit)
   TESTENTRY (linux_get_cpu_from_auxv_null_64bit)
   TESTENTRY (linux_get_cpu_from_auxv_representative_32bit)
@@ -282,6 +287,10 @@ static gboolean find_module_bounds (const GumRangeDetails * details,
     gpointer user_data);
 static gboolean verify_module_bounds (const GumModuleDetails * details,
     gpointer user_data);
+static gboolean verify_file_mapping (const GumRangeDetails * details,
+    gpointer user_data);
+static const GumLinuxNamedRange * find_named_range (GHashTable * ranges,
+    const gchar * name);
 
 TESTCASE (linux_process_modules)
 {
@@ -306,6 +315,56 @@ TESTCASE (linux_process_modules)
   dlclose (lib);
 }
 
+TESTCASE (linux_named_ranges_cover_module)
+{
+  void * lib;
+  ModuleBounds bounds;
+  GHashTable * ranges;
+  const GumLinuxNamedRange * range;
+
+  lib = dlopen (TRICKY_MODULE_NAME, RTLD_NOW | RTLD_GLOBAL);
+  g_assert_nonnull (lib);
+
+  bounds.name = TRICKY_MODULE_NAME;
+  bounds.start = 0;
+  bounds.end = 0;
+
+  gum_process_enumerate_ranges (GUM_PAGE_NO_ACCESS, find_module_bounds,
+      &bounds);
+  g_assert_true (bounds.start != 0);
+
+  ranges = gum_linux_collect_named_ranges ();
+
+  range = find_named_range (ranges, TRICKY_MODULE_NAME);
+  g_assert_nonnull (range);
+  g_assert_cmphex (GUM_ADDRESS (range->base), ==, bounds.start);
+  g_assert_cmphex (GUM_ADDRESS (range->base) + range->size, ==, bounds.end);
+
+  g_hash_table_unref (ranges);
+
+  dlclose (lib);
+}
+
+TESTCASE (linux_ranges_provide_file_offset_and_path)
+{
+  void * lib;
+  ModuleBounds bounds;
+
+  lib = dlopen (TRICKY_MODULE_NAME, RTLD_NOW | RTLD_GLOBAL);
+  g_assert_nonnull (lib);
+
+  bounds.name = TRICKY_MODULE_NAME;
+  bounds.start = 0;
+  bounds.end = 0;
+
+  gum_linux_enumerate_ranges (getpid (), GUM_PAGE_NO_ACCESS,
+      verify_file_mapping, &bounds);
+  g_assert_true (bounds.start != 0);
+  g_assert_true (bounds.end != 0);
+
+  dlclose (lib);
+}
+
 static gboolean
 find_module_bounds (const GumRangeDetails * details,
                     gpointer user_data)
@@ -350,6 +409,137 @@ verify_module_bounds (const GumModuleDetails * details,
   return TRUE;
 }
 
+/*
+ * Executable mappings are not touched by relocation, so their contents must
+ * match the file at the reported offset. Uses start to flag that the first
+ * mapping was seen, and end to flag that an executable one was verified.
+ */
+static gboolean
+verify_file_mapping (const GumRangeDetails * details,
+                     gpointer user_data)
+{
+  ModuleBounds * bounds = user_data;
+  const GumMemoryRange * range = details->range;
+  const GumFileMapping * file = details->file;
+  gchar * name, * contents;
+  gsize length;
+  gboolean is_match;
+
+  if (file == NULL)
+    return TRUE;
+
+  name = g_path_get_basename (file->path);
+  is_match = strcmp (name, bounds->name) == 0;
+  g_free (name);
+
+  if (!is_match)
+    return TRUE;
+
+  g_assert_true (g_path_is_absolute (file->path));
+
+  if (bounds->start == 0)
+  {
+    g_assert_cmpuint (file->offset, ==, 0);
+    bounds->start = range->base_address;
+  }
+
+  if ((details->protection & GUM_PAGE_EXECUTE) == 0)
+    return TRUE;
+
+  g_assert_true (g_file_get_contents (file->path, &contents, &length, NULL));
+  g_assert_cmpuint (file->offset + 64, <=, length);
+  g_assert_cmpint (memcmp (GSIZE_TO_POINTER (range->base_address),
+      contents + file->offset, 64), ==, 0);
+  g_free (contents);
+
+  bounds->end = range->base_address + range->size;
+
+  return TRUE;
+}
+
+static const GumLinuxNamedRange *
+find_named_range (GHashTable * ranges,
+                  const gchar * name)
+{
+  GHashTableIter iter;
+  const GumLinuxNamedRange * range;
+
+  g_hash_table_iter_init (&iter, ranges);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &range))
+  {
+    gchar * basename;
+    gboolean is_match;
+
+    basename = g_path_get_basename (range->name);
+    is_match = strcmp (basename, name) == 0;
+    g_free (basename);
+
+    if (is_match)
+      return range;
+  }
+
+  return NULL;
+}
+
+#endif
+
+#if defined (HAVE_LINUX) && defined (HAVE_SYS_AUXV_H)
+
+static gboolean find_vdso_module (const GumModuleDetails * details,
+    gpointer user_data);
+
+TESTCASE (linux_proc_maps_modules_include_vdso)
+{
+  GumAddress vdso, base = 0;
+
+  vdso = getauxval (AT_SYSINFO_EHDR);
+  if (vdso == 0)
+  {
+    g_print ("<skipping, no vDSO> ");
+    return;
+  }
+
+  gum_linux_enumerate_modules_using_proc_maps (find_vdso_module, &base);
+
+  g_assert_cmphex (base, ==, vdso);
+}
+
+TESTCASE (linux_named_ranges_include_vdso)
+{
+  GumAddress vdso;
+  GHashTable * ranges;
+  const GumLinuxNamedRange * range;
+
+  vdso = getauxval (AT_SYSINFO_EHDR);
+  if (vdso == 0)
+  {
+    g_print ("<skipping, no vDSO> ");
+    return;
+  }
+
+  ranges = gum_linux_collect_named_ranges ();
+
+  range = g_hash_table_lookup (ranges, GSIZE_TO_POINTER (vdso));
+  g_assert_nonnull (range);
+  g_assert_cmpstr (range->name, ==, "linux-vdso.so.1");
+
+  g_hash_table_unref (ranges);
+}
+
+static gboolean
+find_vdso_module (const GumModuleDetails * details,
+                  gpointer user_data)
+{
+  GumAddress * base = user_data;
+
+  if (strcmp (details->name, "linux-vdso.so.1") != 0)
+    return TRUE;
+
+  *base = details->range->base_address;
+
+  return FALSE;
+}
+
 #endif
 
 #if defined (HAVE_LINUX) && defined (HAVE_SYS_AUXV_H)
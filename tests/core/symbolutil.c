@@ -11,6 +11,14 @@
 # include "tests/stubs/objc/dummyclass.h"
 # include <objc/runtime.h>
 #endif
+#if defined (HAVE_LINUX) && !defined (HAVE_ANDROID)
+# include "backend-elf/gumelfmodule.h"
+
+# include <dlfcn.h>
+# include <string.h>
+# include <glib/gstdio.h>
+# include <sys/mman.h>
+#endif
 
 #define TESTCASE(NAME) \
     void test_symbolutil_ ## NAME (void)
@@ -20,17 +28,62 @@
 TESTLIST_BEGIN (symbolutil)
   TESTENTRY (symbol_details_from_address)
   TESTENTRY (symbol_details_from_address_objc_fallback)
+  TESTENTRY (symbol_details_from_addresses)
+  TESTENTRY (symbol_details_can_be_resolved_concurrently)
   TESTENTRY (symbol_name_from_address)
   TESTENTRY (find_external_public_function)
   TESTENTRY (find_local_static_function)
   TESTENTRY (find_functions_named)
   TESTENTRY (find_functions_matching)
+  TESTENTRY (dlopened_module_symbols_are_found_until_dlclose)
+  TESTENTRY (reloaded_module_symbols_are_not_stale)
+  TESTENTRY (symbol_index_is_written_and_read_back)
+  TESTENTRY (symbol_index_is_rebuilt_when_corrupt)
+  TESTENTRY (elf_module_build_id_is_read_from_note)
 TESTLIST_END ()
 
+#if defined (HAVE_LINUX) && !defined (HAVE_ANDROID)
+# define SYMIDX_BETA_NAME "gum_test_symbol_index_beta"
+# define SYMIDX_RENAMED_BETA_NAME "gum_test_symbol_index_BETA"
+
+static gchar * get_symbol_index_module_path (void);
+static gchar * get_symbol_index_path (const gchar * index_dir,
+    const gchar * module_path);
+static gboolean find_function_while_loaded (const gchar * module_path,
+    const gchar * export_name, const gchar * symbol_name);
+static void rename_symbol_in_index (gchar * contents, gsize length);
+static gboolean function_list_contains (GArray * functions, gpointer address);
+static void wait_for_module_changes_to_be_noticed (void);
+#endif
+
+#if defined (HAVE_LINUX) && !defined (HAVE_ANDROID)
+# if defined (HAVE_I386)
+#  if GLIB_SIZEOF_VOID_P == 4
+#   define GUM_TEST_SHLIB_ARCH "x86"
+#  else
+#   define GUM_TEST_SHLIB_ARCH "x86_64"
+#  endif
+# elif defined (HAVE_ARM)
+#  ifdef __ARM_PCS_VFP
+#   define GUM_TEST_SHLIB_ARCH "armhf"
+#  else
+#   define GUM_TEST_SHLIB_ARCH "arm"
+#  endif
+# elif defined (HAVE_ARM64)
+#  define GUM_TEST_SHLIB_ARCH "arm64"
+# endif
+#endif
+
+#ifdef GUM_TEST_SHLIB_ARCH
+static gchar * copy_test_library (const gchar * name, const gchar * dir);
+#endif
+
 #ifdef HAVE_LINUX
 static guint gum_dummy_variable;
 #endif
 
+static gpointer resolve_symbols_repeatedly (gpointer data);
+
 static void GUM_CDECL gum_dummy_function_0 (void);
 static void GUM_STDCALL gum_dummy_function_1 (void);
 
@@ -71,6 +124,80 @@ TESTCASE (symbol_details_from_address_objc_fallback)
 #endif
 }
 
+TESTCASE (symbol_details_from_addresses)
+{
+  gpointer addresses[4];
+  GumDebugSymbolDetails details[G_N_ELEMENTS (addresses)];
+  GumDebugSymbolDetails expected;
+  guint i;
+
+  addresses[0] = gum_dummy_function_1;
+  addresses[1] = gum_dummy_function_0;
+  addresses[2] = gum_dummy_function_1;
+  addresses[3] = gum_dummy_function_0;
+
+  g_assert_cmpuint (gum_symbol_details_from_addresses (
+      (const gpointer *) addresses, G_N_ELEMENTS (addresses), details), ==,
+      G_N_ELEMENTS (addresses));
+
+  for (i = 0; i != G_N_ELEMENTS (addresses); i++)
+  {
+    g_assert_true (gum_symbol_details_from_address (addresses[i], &expected));
+
+    g_assert_cmphex (details[i].address, ==, expected.address);
+    g_assert_cmpstr (details[i].module_name, ==, expected.module_name);
+    g_assert_cmpstr (details[i].symbol_name, ==, expected.symbol_name);
+    g_assert_cmpstr (details[i].file_name, ==, expected.file_name);
+    g_assert_cmpuint (details[i].line_number, ==, expected.line_number);
+  }
+
+  g_assert_cmpstr (details[0].symbol_name, ==, "gum_dummy_function_1");
+  g_assert_cmpstr (details[1].symbol_name, ==, "gum_dummy_function_0");
+}
+
+TESTCASE (symbol_details_can_be_resolved_concurrently)
+{
+  GThread * threads[4];
+  guint i;
+
+  for (i = 0; i != G_N_ELEMENTS (threads); i++)
+  {
+    threads[i] = g_thread_new ("gum-test-symbolutil",
+        resolve_symbols_repeatedly, NULL);
+  }
+
+  for (i = 0; i != G_N_ELEMENTS (threads); i++)
+    g_assert_true (GPOINTER_TO_UINT (g_thread_join (threads[i])));
+}
+
+static gpointer
+resolve_symbols_repeatedly (gpointer data)
+{
+  gboolean success = TRUE;
+  guint i;
+
+  for (i = 0; i != 100; i++)
+  {
+    GumDebugSymbolDetails details;
+    gpointer function_address;
+
+    if (!gum_symbol_details_from_address (gum_dummy_function_0, &details) ||
+        strcmp (details.symbol_name, "gum_dummy_function_0") != 0)
+    {
+      success = FALSE;
+    }
+
+    function_address = gum_find_function ("gum_dummy_function_1");
+    if (GPOINTER_TO_SIZE (function_address) !=
+        GPOINTER_TO_SIZE (gum_dummy_function_1))
+    {
+      success = FALSE;
+    }
+  }
+
+  return GUINT_TO_POINTER (success);
+}
+
 TESTCASE (symbol_name_from_address)
 {
   gchar * symbol_name;
@@ -129,6 +256,433 @@ TESTCASE (find_functions_matching)
   g_array_free (functions, TRUE);
 }
 
+TESTCASE (dlopened_module_symbols_are_found_until_dlclose)
+{
+#ifdef GUM_TEST_SHLIB_ARCH
+  gchar * dir, * path;
+  void * lib;
+  gpointer special_function;
+  GArray * functions;
+  GumDebugSymbolDetails details;
+
+  dir = g_dir_make_tmp ("gum-symbolutil-XXXXXX", NULL);
+  g_assert_nonnull (dir);
+  path = copy_test_library ("specialfunctions", dir);
+
+  /* Populate the cache so the dlopen() below has to be noticed. */
+  functions = gum_find_functions_named ("gum_test_special_function");
+  g_array_free (functions, TRUE);
+
+  lib = dlopen (path, RTLD_NOW | RTLD_LOCAL);
+  g_assert_nonnull (lib);
+  special_function = dlsym (lib, "gum_test_special_function");
+  g_assert_nonnull (special_function);
+  wait_for_module_changes_to_be_noticed ();
+
+  functions = gum_find_functions_named ("gum_test_special_function");
+  g_assert_true (function_list_contains (functions, special_function));
+  g_array_free (functions, TRUE);
+
+  g_assert_true (gum_symbol_details_from_address (special_function,
+      &details));
+  g_assert_cmpstr (details.symbol_name, ==, "gum_test_special_function");
+
+  dlclose (lib);
+  wait_for_module_changes_to_be_noticed ();
+
+  functions = gum_find_functions_named ("gum_test_special_function");
+  g_assert_false (function_list_contains (functions, special_function));
+  g_array_free (functions, TRUE);
+
+  g_unlink (path);
+  g_rmdir (dir);
+  g_free (path);
+  g_free (dir);
+#else
+  g_print ("<skipping, not available> ");
+#endif
+}
+
+TESTCASE (reloaded_module_symbols_are_not_stale)
+{
+#ifdef GUM_TEST_SHLIB_ARCH
+  gchar * dir, * path, * target_path;
+  void * lib;
+  gpointer special_function, target_function;
+  Dl_info info;
+  gpointer reservation;
+  gsize page_size;
+  GArray * functions;
+  GumDebugSymbolDetails details;
+
+  dir = g_dir_make_tmp ("gum-symbolutil-XXXXXX", NULL);
+  g_assert_nonnull (dir);
+  path = copy_test_library ("specialfunctions", dir);
+
+  lib = dlopen (path, RTLD_NOW | RTLD_LOCAL);
+  g_assert_nonnull (lib);
+  special_function = dlsym (lib, "gum_test_special_function");
+  g_assert_nonnull (special_function);
+  g_assert_true (gum_symbol_details_from_address (special_function,
+      &details));
+  g_assert_cmpstr (details.symbol_name, ==, "gum_test_special_function");
+
+  g_assert_true (dladdr (special_function, &info) != 0);
+  dlclose (lib);
+
+  /*
+   * Keep the old base occupied so that the next load ends up elsewhere,
+   * and swap in a different library at the same path.
+   */
+  page_size = gum_query_page_size ();
+  reservation = mmap (info.dli_fbase, page_size, PROT_NONE,
+      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  g_assert_true (reservation != MAP_FAILED);
+
+  g_unlink (path);
+  target_path = copy_test_library ("targetfunctions", dir);
+  g_assert_true (g_rename (target_path, path) == 0);
+  g_free (target_path);
+
+  lib = dlopen (path, RTLD_NOW | RTLD_LOCAL);
+  g_assert_nonnull (lib);
+  target_function = dlsym (lib, "gum_test_target_function");
+  g_assert_nonnull (target_function);
+  wait_for_module_changes_to_be_noticed ();
+
+  g_assert_true (gum_symbol_details_from_address (target_function,
+      &details));
+  g_assert_cmpstr (details.symbol_name, ==, "gum_test_target_function");
+
+  functions = gum_find_functions_named ("gum_test_target_function");
+  g_assert_true (function_list_contains (functions, target_function));
+  g_array_free (functions, TRUE);
+
+  functions = gum_find_functions_named ("gum_test_special_function");
+  g_assert_false (function_list_contains (functions, special_function));
+  g_array_free (functions, TRUE);
+
+  dlclose (lib);
+  munmap (reservation, page_size);
+
+  g_unlink (path);
+  g_rmdir (dir);
+  g_free (path);
+  g_free (dir);
+#else
+  g_print ("<skipping, not available> ");
+#endif
+}
+
+TESTCASE (symbol_index_is_written_and_read_back)
+{
+#if defined (HAVE_LINUX) && !defined (HAVE_ANDROID)
+  gchar * index_dir, * module_path, * index_path, * contents;
+  gsize length;
+
+  index_dir = g_dir_make_tmp ("gum-symidx-XXXXXX", NULL);
+  g_assert_nonnull (index_dir);
+  module_path = get_symbol_index_module_path ();
+  index_path = get_symbol_index_path (index_dir, module_path);
+
+  gum_set_symbol_index_directory (index_dir);
+
+  g_assert_false (g_file_test (index_path, G_FILE_TEST_EXISTS));
+  g_assert_true (find_function_while_loaded (module_path, SYMIDX_BETA_NAME,
+      SYMIDX_BETA_NAME));
+  g_assert_true (g_file_test (index_path, G_FILE_TEST_IS_REGULAR));
+
+  /*
+   * Rename a symbol in the index, so that finding it under its new name
+   * proves the index was used instead of the ELF symbol tables.
+   */
+  g_assert_true (g_file_get_contents (index_path, &contents, &length, NULL));
+  rename_symbol_in_index (contents, length);
+  g_assert_true (g_file_set_contents (index_path, contents, length, NULL));
+  g_free (contents);
+
+  g_assert_true (find_function_while_loaded (module_path, SYMIDX_BETA_NAME,
+      SYMIDX_RENAMED_BETA_NAME));
+  g_assert_false (find_function_while_loaded (module_path, SYMIDX_BETA_NAME,
+      SYMIDX_BETA_NAME));
+
+  gum_set_symbol_index_directory (NULL);
+
+  g_unlink (index_path);
+  g_rmdir (index_dir);
+  g_free (index_path);
+  g_free (module_path);
+  g_free (index_dir);
+#else
+  g_print ("<skipping, not available> ");
+#endif
+}
+
+TESTCASE (symbol_index_is_rebuilt_when_corrupt)
+{
+#if defined (HAVE_LINUX) && !defined (HAVE_ANDROID)
+  gchar * index_dir, * module_path, * index_path, * valid, * contents;
+  gsize valid_length, length;
+  guint corruption;
+
+  index_dir = g_dir_make_tmp ("gum-symidx-XXXXXX", NULL);
+  g_assert_nonnull (index_dir);
+  module_path = get_symbol_index_module_path ();
+  index_path = get_symbol_index_path (index_dir, module_path);
+
+  gum_set_symbol_index_directory (index_dir);
+
+  g_assert_true (find_function_while_loaded (module_path, SYMIDX_BETA_NAME,
+      SYMIDX_BETA_NAME));
+  g_assert_true (g_file_get_contents (index_path, &valid, &valid_length,
+      NULL));
+
+  for (corruption = 0; corruption != 5; corruption++)
+  {
+    contents = g_memdup (valid, valid_length);
+    length = valid_length;
+
+    /*
+     * Start out from an index that would hide the original name if it was
+     * accepted, then break it in one way.
+     */
+    rename_symbol_in_index (contents, length);
+
+    switch (corruption)
+    {
+      case 0:
+        length--;
+        break;
+      case 1:
+        length = 8;
+        break;
+      case 2:
+        contents[0] ^= 0xff;
+        break;
+      case 3:
+        contents[4] ^= 0xff;
+        break;
+      case 4:
+        *((guint32 *) (contents + 8)) = G_MAXUINT32;
+        break;
+      default:
+        g_assert_not_reached ();
+    }
+
+    g_assert_true (g_file_set_contents (index_path, contents, length, NULL));
+    g_free (contents);
+
+    g_assert_true (find_function_while_loaded (module_path, SYMIDX_BETA_NAME,
+        SYMIDX_BETA_NAME));
+
+    g_assert_true (g_file_get_contents (index_path, &contents, &length,
+        NULL));
+    g_assert_cmpuint (length, ==, valid_length);
+    g_assert_true (memcmp (contents, valid, length) == 0);
+    g_free (contents);
+  }
+
+  gum_set_symbol_index_directory (NULL);
+
+  g_free (valid);
+  g_unlink (index_path);
+  g_rmdir (index_dir);
+  g_free (index_path);
+  g_free (module_path);
+  g_free (index_dir);
+#else
+  g_print ("<skipping, not available> ");
+#endif
+}
+
+TESTCASE (elf_module_build_id_is_read_from_note)
+{
+#if defined (HAVE_LINUX) && !defined (HAVE_ANDROID)
+  gchar * testdir, * path, * build_id;
+  GumElfModule * module;
+  guint i;
+
+  path = get_symbol_index_module_path ();
+  module = gum_elf_module_new_from_memory (path, 0);
+  g_assert_nonnull (module);
+  build_id = gum_elf_module_get_build_id (module);
+  g_assert_nonnull (build_id);
+  g_assert_cmpuint (strlen (build_id), ==, 40);
+  for (i = 0; build_id[i] != '\0'; i++)
+    g_assert_true (g_ascii_isxdigit (build_id[i]));
+  g_free (build_id);
+  g_object_unref (module);
+  g_free (path);
+
+  testdir = test_util_get_data_dir ();
+
+#if defined (HAVE_ARM64) && !defined (HAVE_PTRAUTH)
+  path = g_build_filename (testdir, "specialfunctions-linux-arm64.so", NULL);
+  module = gum_elf_module_new_from_memory (path, 0);
+  g_assert_nonnull (module);
+  build_id = gum_elf_module_get_build_id (module);
+  g_assert_cmpstr (build_id, ==, "d2d28c16dd585539f5aaca90f73c6e6161a5ee99");
+  g_free (build_id);
+  g_object_unref (module);
+  g_free (path);
+#elif defined (HAVE_ARM) && defined (__ARM_PCS_VFP)
+  path = g_build_filename (testdir, "specialfunctions-linux-armhf.so", NULL);
+  module = gum_elf_module_new_from_memory (path, 0);
+  g_assert_nonnull (module);
+  build_id = gum_elf_module_get_build_id (module);
+  g_assert_cmpstr (build_id, ==, "fe2ed81d836031d1dd03db53aa21400752c8f429");
+  g_free (build_id);
+  g_object_unref (module);
+  g_free (path);
+#endif
+
+  path = g_build_filename (testdir, "symbolindexmodule-nobuildid.so", NULL);
+  module = gum_elf_module_new_from_memory (path, 0);
+  g_assert_nonnull (module);
+  g_assert_null (gum_elf_module_get_build_id (module));
+  g_object_unref (module);
+  g_free (path);
+
+  g_free (testdir);
+#else
+  g_print ("<skipping, not available> ");
+#endif
+}
+
+#if defined (HAVE_LINUX) && !defined (HAVE_ANDROID)
+
+static gchar *
+get_symbol_index_module_path (void)
+{
+  gchar * testdir, * path;
+
+  testdir = test_util_get_data_dir ();
+  path = g_build_filename (testdir, "symbolindexmodule.so", NULL);
+  g_free (testdir);
+
+  return path;
+}
+
+static gchar *
+get_symbol_index_path (const gchar * index_dir,
+                       const gchar * module_path)
+{
+  GumElfModule * module;
+  gchar * build_id, * filename, * path;
+
+  module = gum_elf_module_new_from_memory (module_path, 0);
+  g_assert_nonnull (module);
+  build_id = gum_elf_module_get_build_id (module);
+  g_assert_nonnull (build_id);
+
+  filename = g_strconcat (build_id, ".symidx", NULL);
+  path = g_build_filename (index_dir, filename, NULL);
+
+  g_free (filename);
+  g_free (build_id);
+  g_object_unref (module);
+
+  return path;
+}
+
+static gboolean
+find_function_while_loaded (const gchar * module_path,
+                            const gchar * export_name,
+                            const gchar * symbol_name)
+{
+  gboolean found;
+  void * lib;
+  gpointer function;
+  GArray * functions;
+
+  lib = dlopen (module_path, RTLD_NOW | RTLD_LOCAL);
+  g_assert_nonnull (lib);
+  function = dlsym (lib, export_name);
+  g_assert_nonnull (function);
+  wait_for_module_changes_to_be_noticed ();
+
+  functions = gum_find_functions_named (symbol_name);
+  found = function_list_contains (functions, function);
+  g_array_free (functions, TRUE);
+
+  dlclose (lib);
+  wait_for_module_changes_to_be_noticed ();
+
+  /* Let the cache drop the module so the next load starts afresh. */
+  functions = gum_find_functions_named (symbol_name);
+  g_assert_false (function_list_contains (functions, function));
+  g_array_free (functions, TRUE);
+
+  return found;
+}
+
+static void
+rename_symbol_in_index (gchar * contents,
+                        gsize length)
+{
+  gchar * name;
+
+  name = memmem (contents, length, SYMIDX_BETA_NAME,
+      sizeof (SYMIDX_BETA_NAME));
+  g_assert_nonnull (name);
+  memcpy (name, SYMIDX_RENAMED_BETA_NAME, sizeof (SYMIDX_RENAMED_BETA_NAME));
+}
+
+static gboolean
+function_list_contains (GArray * functions,
+                        gpointer address)
+{
+  guint i;
+
+  for (i = 0; i != functions->len; i++)
+  {
+    if (g_array_index (functions, gpointer, i) == address)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+static void
+wait_for_module_changes_to_be_noticed (void)
+{
+  /*
+   * Lookups that find something only check for loaded and unloaded modules
+   * every so often.
+   */
+  g_usleep (100 * 1000);
+}
+
+#endif
+
+#ifdef GUM_TEST_SHLIB_ARCH
+
+static gchar *
+copy_test_library (const gchar * name,
+                   const gchar * dir)
+{
+  gchar * testdir, * filename, * source_path, * path, * contents;
+  gsize length;
+
+  testdir = test_util_get_data_dir ();
+  filename = g_strconcat (name, "-linux-" GUM_TEST_SHLIB_ARCH ".so", NULL);
+  source_path = g_build_filename (testdir, filename, NULL);
+
+  g_assert_true (g_file_get_contents (source_path, &contents, &length, NULL));
+
+  path = g_build_filename (dir, filename, NULL);
+  g_assert_true (g_file_set_contents (path, contents, length, NULL));
+
+  g_free (contents);
+  g_free (source_path);
+  g_free (filename);
+  g_free (testdir);
+
+  return path;
+}
+
+#endif
+
 static void GUM_CDECL
 gum_dummy_function_0 (void)
 {
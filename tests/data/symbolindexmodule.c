@@ -0,0 +1,11 @@
+int
+gum_test_symbol_index_alpha (void)
+{
+  return 1;
+}
+
+int
+gum_test_symbol_index_beta (void)
+{
+  return 2;
+}
@@ -0,0 +1,532 @@
+/*
+ * Copyright (C) 2026 Ole André Vadla Ravnås <oleavr@nowsecure.com>
+ *
+ * Licence: wxWindows Library Licence, Version 3.1
+ */
+
+/*
+ * Measures the per-call overhead of the Interceptor in a handful of
+ * configurations. Each scenario is run for a number of rounds and the median
+ * round is reported, in nanoseconds and, where the cycle sampler is
+ * available, in cycles per call.
+ *
+ * The phase breakdown is derived by differencing scenarios that take the
+ * same path through the Interceptor up to the phase being measured:
+ *
+ *   enter_trampoline    ignored - baseline
+ *                       thunk, guard and ignore checks, no listener work
+ *   invocation_stack    empty - ignored
+ *                       stack push/pop and the walk over listener entries
+ *   fast_on_enter       on_enter - ignored
+ *                       single on_enter-only listener, no stack entry
+ *   on_leave            on_leave - empty
+ *                       return trap, end_invocation and on_leave dispatch
+ *   slow_on_enter       on_enter+on_leave - on_leave
+ *                       on_enter dispatch on the stack-based path
+ *   extra_listener      (N listeners - on_enter+on_leave) / (N - 1)
+ */
+
+#include <gum/gum.h>
+#include <gum/gum-prof.h>
+
+#include <stdlib.h>
+
+#define BENCH_DEFAULT_ITERATIONS 1000000
+#define BENCH_DEFAULT_ROUNDS 7
+#define BENCH_DEFAULT_LISTENERS 4
+
+typedef struct _BenchResult BenchResult;
+typedef struct _BenchRound BenchRound;
+typedef gint (* BenchTargetFunc) (gint arg);
+
+struct _BenchResult
+{
+  const gchar * name;
+  gdouble ns_per_call;
+  gdouble cycles_per_call;
+};
+
+struct _BenchRound
+{
+  gdouble ns;
+  gdouble cycles;
+};
+
+#define BENCH_TYPE_EMPTY_LISTENER (bench_empty_listener_get_type ())
+G_DECLARE_FINAL_TYPE (BenchEmptyListener, bench_empty_listener, BENCH,
+    EMPTY_LISTENER, GObject)
+
+#define BENCH_TYPE_ENTER_LISTENER (bench_enter_listener_get_type ())
+G_DECLARE_FINAL_TYPE (BenchEnterListener, bench_enter_listener, BENCH,
+    ENTER_LISTENER, GObject)
+
+#define BENCH_TYPE_LEAVE_LISTENER (bench_leave_listener_get_type ())
+G_DECLARE_FINAL_TYPE (BenchLeaveListener, bench_leave_listener, BENCH,
+    LEAVE_LISTENER, GObject)
+
+#define BENCH_TYPE_CALL_LISTENER (bench_call_listener_get_type ())
+G_DECLARE_FINAL_TYPE (BenchCallListener, bench_call_listener, BENCH,
+    CALL_LISTENER, GObject)
+
+struct _BenchEmptyListener
+{
+  GObject parent;
+};
+
+struct _BenchEnterListener
+{
+  GObject parent;
+};
+
+struct _BenchLeaveListener
+{
+  GObject parent;
+};
+
+struct _BenchCallListener
+{
+  GObject parent;
+};
+
+static void bench_empty_listener_iface_init (gpointer g_iface,
+    gpointer iface_data);
+static void bench_enter_listener_iface_init (gpointer g_iface,
+    gpointer iface_data);
+static void bench_leave_listener_iface_init (gpointer g_iface,
+    gpointer iface_data);
+static void bench_call_listener_iface_init (gpointer g_iface,
+    gpointer iface_data);
+
+static void bench_run_unhooked (const gchar * name, BenchResult * result);
+static void bench_run_ignored (const gchar * name, BenchResult * result);
+static void bench_run_listeners (const gchar * name, GType listener_type,
+    guint n_listeners, BenchResult * result);
+static void bench_run_replaced (const gchar * name, BenchResult * result);
+static void bench_measure (const gchar * name, BenchResult * result);
+static gint bench_compare_rounds (const BenchRound * a, const BenchRound * b);
+static void bench_print_result (const BenchResult * result);
+static void bench_print_phase (const gchar * name, const BenchResult * minuend,
+    const BenchResult * subtrahend, guint divisor);
+
+static gint bench_target (gint arg);
+static gint bench_replacement (gint arg);
+
+static gint bench_iterations = BENCH_DEFAULT_ITERATIONS;
+static gint bench_rounds = BENCH_DEFAULT_ROUNDS;
+static gint bench_listeners = BENCH_DEFAULT_LISTENERS;
+
+static GumInterceptor * bench_interceptor;
+static GumSampler * bench_cycle_sampler;
+static BenchTargetFunc bench_target_impl = bench_target;
+static volatile gint bench_sink;
+
+static const GOptionEntry bench_options[] =
+{
+  { "iterations", 'i', 0, G_OPTION_ARG_INT, &bench_iterations,
+    "Calls per round", "N" },
+  { "rounds", 'r', 0, G_OPTION_ARG_INT, &bench_rounds,
+    "Rounds per scenario; the median is reported", "N" },
+  { "listeners", 'n', 0, G_OPTION_ARG_INT, &bench_listeners,
+    "Listeners in the multi-listener scenario", "N" },
+  { NULL }
+};
+
+G_DEFINE_TYPE_EXTENDED (BenchEmptyListener,
+                        bench_empty_listener,
+                        G_TYPE_OBJECT,
+                        0,
+                        G_IMPLEMENT_INTERFACE (GUM_TYPE_INVOCATION_LISTENER,
+                            bench_empty_listener_iface_init))
+
+G_DEFINE_TYPE_EXTENDED (BenchEnterListener,
+                        bench_enter_listener,
+                        G_TYPE_OBJECT,
+                        0,
+                        G_IMPLEMENT_INTERFACE (GUM_TYPE_INVOCATION_LISTENER,
+                            bench_enter_listener_iface_init))
+
+G_DEFINE_TYPE_EXTENDED (BenchLeaveListener,
+                        bench_leave_listener,
+                        G_TYPE_OBJECT,
+                        0,
+                        G_IMPLEMENT_INTERFACE (GUM_TYPE_INVOCATION_LISTENER,
+                            bench_leave_listener_iface_init))
+
+G_DEFINE_TYPE_EXTENDED (BenchCallListener,
+                        bench_call_listener,
+                        G_TYPE_OBJECT,
+                        0,
+                        G_IMPLEMENT_INTERFACE (GUM_TYPE_INVOCATION_LISTENER,
+                            bench_call_listener_iface_init))
+
+gint
+main (gint argc,
+      gchar * argv[])
+{
+  GOptionContext * context;
+  GError * error = NULL;
+  BenchResult baseline, ignored, empty, enter, leave, call, many, replaced;
+  gchar * many_name;
+
+  context = g_option_context_new ("- measure Interceptor overhead");
+  g_option_context_add_main_entries (context, bench_options, NULL);
+  if (!g_option_context_parse (context, &argc, &argv, &error))
+  {
+    g_printerr ("%s\n", error->message);
+    g_error_free (error);
+    g_option_context_free (context);
+    return 1;
+  }
+  g_option_context_free (context);
+
+  if (bench_iterations <= 0 || bench_rounds <= 0 || bench_listeners <= 0)
+  {
+    g_printerr ("iterations, rounds and listeners must be positive\n");
+    return 1;
+  }
+
+  gum_init_embedded ();
+
+  bench_interceptor = gum_interceptor_obtain ();
+
+  bench_cycle_sampler = gum_cycle_sampler_new ();
+  if (!gum_cycle_sampler_is_available (
+      GUM_CYCLE_SAMPLER (bench_cycle_sampler)))
+  {
+    g_clear_object (&bench_cycle_sampler);
+  }
+
+  g_print ("%d rounds of %d calls, median round reported\n\n",
+      bench_rounds, bench_iterations);
+  g_print ("%-24s %12s %14s\n", "scenario", "ns/call", "cycles/call");
+
+  many_name = g_strdup_printf ("%d listeners", bench_listeners);
+
+  bench_run_unhooked ("baseline", &baseline);
+  bench_run_ignored ("ignored", &ignored);
+  bench_run_listeners ("empty", BENCH_TYPE_EMPTY_LISTENER, 1, &empty);
+  bench_run_listeners ("on_enter", BENCH_TYPE_ENTER_LISTENER, 1, &enter);
+  bench_run_listeners ("on_leave", BENCH_TYPE_LEAVE_LISTENER, 1, &leave);
+  bench_run_listeners ("on_enter+on_leave", BENCH_TYPE_CALL_LISTENER, 1,
+      &call);
+  bench_run_listeners (many_name, BENCH_TYPE_CALL_LISTENER, bench_listeners,
+      &many);
+  bench_run_replaced ("replace", &replaced);
+
+  g_print ("\n%-24s %12s %14s\n", "phase", "ns/call", "cycles/call");
+  bench_print_phase ("enter_trampoline", &ignored, &baseline, 1);
+  bench_print_phase ("invocation_stack", &empty, &ignored, 1);
+  bench_print_phase ("fast_on_enter", &enter, &ignored, 1);
+  bench_print_phase ("on_leave", &leave, &empty, 1);
+  bench_print_phase ("slow_on_enter", &call, &leave, 1);
+  if (bench_listeners > 1)
+    bench_print_phase ("extra_listener", &many, &call, bench_listeners - 1);
+
+  g_free (many_name);
+
+  g_clear_object (&bench_cycle_sampler);
+  g_object_unref (bench_interceptor);
+
+  gum_deinit_embedded ();
+
+  return 0;
+}
+
+static void
+bench_run_unhooked (const gchar * name,
+                    BenchResult * result)
+{
+  bench_measure (name, result);
+}
+
+static void
+bench_run_ignored (const gchar * name,
+                   BenchResult * result)
+{
+  gpointer target = GUM_FUNCPTR_TO_POINTER (bench_target_impl);
+  GumInvocationListener * listener;
+
+  listener = g_object_new (BENCH_TYPE_EMPTY_LISTENER, NULL);
+  if (gum_interceptor_attach (bench_interceptor, target, listener, NULL) !=
+      GUM_ATTACH_OK)
+  {
+    g_printerr ("unable to attach to %p\n", target);
+    exit (1);
+  }
+
+  gum_interceptor_ignore_current_thread (bench_interceptor);
+  bench_measure (name, result);
+  gum_interceptor_unignore_current_thread (bench_interceptor);
+
+  gum_interceptor_detach (bench_interceptor, listener);
+  g_object_unref (listener);
+}
+
+static void
+bench_run_listeners (const gchar * name,
+                     GType listener_type,
+                     guint n_listeners,
+                     BenchResult * result)
+{
+  gpointer target = GUM_FUNCPTR_TO_POINTER (bench_target_impl);
+  GumInvocationListener ** listeners;
+  guint i;
+
+  listeners = g_new (GumInvocationListener *, n_listeners);
+
+  gum_interceptor_begin_transaction (bench_interceptor);
+  for (i = 0; i != n_listeners; i++)
+  {
+    listeners[i] = g_object_new (listener_type, NULL);
+    if (gum_interceptor_attach (bench_interceptor, target, listeners[i],
+        NULL) != GUM_ATTACH_OK)
+    {
+      g_printerr ("unable to attach to %p\n", target);
+      exit (1);
+    }
+  }
+  gum_interceptor_end_transaction (bench_interceptor);
+
+  bench_measure (name, result);
+
+  gum_interceptor_begin_transaction (bench_interceptor);
+  for (i = 0; i != n_listeners; i++)
+    gum_interceptor_detach (bench_interceptor, listeners[i]);
+  gum_interceptor_end_transaction (bench_interceptor);
+
+  for (i = 0; i != n_listeners; i++)
+    g_object_unref (listeners[i]);
+  g_free (listeners);
+}
+
+static void
+bench_run_replaced (const gchar * name,
+                    BenchResult * result)
+{
+  gpointer target = GUM_FUNCPTR_TO_POINTER (bench_target_impl);
+
+  if (gum_interceptor_replace (bench_interceptor, target,
+      GUM_FUNCPTR_TO_POINTER (bench_replacement), NULL) != GUM_REPLACE_OK)
+  {
+    g_printerr ("unable to replace %p\n", target);
+    exit (1);
+  }
+
+  bench_measure (name, result);
+
+  gum_interceptor_revert (bench_interceptor, target);
+}
+
+static void
+bench_measure (const gchar * name,
+               BenchResult * result)
+{
+  BenchRound * rounds;
+  GTimer * timer;
+  gint round, i;
+
+  rounds = g_new (BenchRound, bench_rounds);
+  timer = g_timer_new ();
+
+  for (i = 0; i != bench_iterations / 10; i++)
+    bench_sink = bench_target_impl (i);
+
+  for (round = 0; round != bench_rounds; round++)
+  {
+    GumSample cycles_start = 0, cycles_end = 0;
+
+    if (bench_cycle_sampler != NULL)
+      cycles_start = gum_sampler_sample (bench_cycle_sampler);
+    g_timer_start (timer);
+
+    for (i = 0; i != bench_iterations; i++)
+      bench_sink = bench_target_impl (i);
+
+    g_timer_stop (timer);
+    if (bench_cycle_sampler != NULL)
+      cycles_end = gum_sampler_sample (bench_cycle_sampler);
+
+    rounds[round].ns = (g_timer_elapsed (timer, NULL) * 1e9) /
+        bench_iterations;
+    rounds[round].cycles = (gdouble) (cycles_end - cycles_start) /
+        bench_iterations;
+  }
+
+  qsort (rounds, bench_rounds, sizeof (BenchRound),
+      (GCompareFunc) bench_compare_rounds);
+
+  result->name = name;
+  result->ns_per_call = rounds[bench_rounds / 2].ns;
+  result->cycles_per_call = (bench_cycle_sampler != NULL)
+      ? rounds[bench_rounds / 2].cycles
+      : -1;
+
+  bench_print_result (result);
+
+  g_timer_destroy (timer);
+  g_free (rounds);
+}
+
+static gint
+bench_compare_rounds (const BenchRound * a,
+                      const BenchRound * b)
+{
+  if (a->ns < b->ns)
+    return -1;
+  if (a->ns > b->ns)
+    return 1;
+  return 0;
+}
+
+static void
+bench_print_result (const BenchResult * result)
+{
+  if (result->cycles_per_call >= 0)
+  {
+    g_print ("%-24s %12.2f %14.1f\n", result->name, result->ns_per_call,
+        result->cycles_per_call);
+  }
+  else
+  {
+    g_print ("%-24s %12.2f %14s\n", result->name, result->ns_per_call, "n/a");
+  }
+}
+
+static void
+bench_print_phase (const gchar * name,
+                   const BenchResult * minuend,
+                   const BenchResult * subtrahend,
+                   guint divisor)
+{
+  BenchResult phase;
+
+  phase.name = name;
+  phase.ns_per_call =
+      (minuend->ns_per_call - subtrahend->ns_per_call) / divisor;
+  phase.cycles_per_call = (bench_cycle_sampler != NULL)
+      ? (minuend->cycles_per_call - subtrahend->cycles_per_call) / divisor
+      : -1;
+
+  bench_print_result (&phase);
+}
+
+GUM_NOINLINE static gint
+bench_target (gint arg)
+{
+  volatile gint value = arg;
+
+  value ^= 0x5a5a;
+  value += 42;
+
+  return value;
+}
+
+static gint
+bench_replacement (gint arg)
+{
+  return bench_target_impl (arg) + 1;
+}
+
+static void
+bench_empty_listener_iface_init (gpointer g_iface,
+                                 gpointer iface_data)
+{
+  GumInvocationListenerInterface * iface = g_iface;
+
+  iface->on_enter = NULL;
+  iface->on_leave = NULL;
+}
+
+static void
+bench_empty_listener_class_init (BenchEmptyListenerClass * klass)
+{
+}
+
+static void
+bench_empty_listener_init (BenchEmptyListener * self)
+{
+}
+
+static void
+bench_enter_listener_on_enter (GumInvocationListener * listener,
+                               GumInvocationContext * context)
+{
+}
+
+static void
+bench_enter_listener_iface_init (gpointer g_iface,
+                                 gpointer iface_data)
+{
+  GumInvocationListenerInterface * iface = g_iface;
+
+  iface->on_enter = bench_enter_listener_on_enter;
+  iface->on_leave = NULL;
+}
+
+static void
+bench_enter_listener_class_init (BenchEnterListenerClass * klass)
+{
+}
+
+static void
+bench_enter_listener_init (BenchEnterListener * self)
+{
+}
+
+static void
+bench_leave_listener_on_leave (GumInvocationListener * listener,
+                               GumInvocationContext * context)
+{
+}
+
+static void
+bench_leave_listener_iface_init (gpointer g_iface,
+                                 gpointer iface_data)
+{
+  GumInvocationListenerInterface * iface = g_iface;
+
+  iface->on_enter = NULL;
+  iface->on_leave = bench_leave_listener_on_leave;
+}
+
+static void
+bench_leave_listener_class_init (BenchLeaveListenerClass * klass)
+{
+}
+
+static void
+bench_leave_listener_init (BenchLeaveListener * self)
+{
+}
+
+static void
+bench_call_listener_on_enter (GumInvocationListener * listener,
+                              GumInvocationContext * context)
+{
+}
+
+static void
+bench_call_listener_on_leave (GumInvocationListener * listener,
+                              GumInvocationContext * context)
+{
+}
+
+static void
+bench_call_listener_iface_init (gpointer g_iface,
+                                gpointer iface_data)
+{
+  GumInvocationListenerInterface * iface = g_iface;
+
+  iface->on_enter = bench_call_listener_on_enter;
+  iface->on_leave = bench_call_listener_on_leave;
+}
+
+static void
+bench_call_listener_class_init (BenchCallListenerClass * klass)
+{
+}
+
+static void
+bench_call_listener_init (BenchCallListener * self)
+{
+}
@@ -74,9 +74,13 @@ TESTLIST_BEGIN (script)
     TESTENTRY (function_can_be_reverted)
     TESTENTRY (replaced_function_should_have_invocation_context)
     TESTENTRY (instructions_can_be_probed)
+    TESTENTRY (probes_provide_arguments_and_call_depth)
+    TESTENTRY (probes_provide_return_address)
+    TESTENTRY (probes_provide_return_address_alongside_other_probes)
     TESTENTRY (interceptor_should_support_native_pointer_values)
     TESTENTRY (interceptor_should_handle_bad_pointers)
     TESTENTRY (interceptor_should_refuse_to_attach_without_any_callbacks)
+    TESTENTRY (interceptor_can_attach_to_many_functions)
   TESTGROUP_END ()
   TESTGROUP_BEGIN ("Interceptor/Performance")
     TESTENTRY (interceptor_on_enter_performance)
@@ -150,6 +154,9 @@ TESTLIST_BEGIN (script)
     TESTENTRY (invalid_read_write_execute_results_in_exception)
     TESTENTRY (memory_can_be_scanned)
     TESTENTRY (memory_can_be_scanned_synchronously)
+    TESTENTRY (memory_can_be_scanned_for_multiple_patterns)
+    TESTENTRY (memory_can_be_scanned_for_multiple_patterns_asynchronously)
+    TESTENTRY (memory_ranges_can_be_scanned_in_parallel)
     TESTENTRY (memory_scan_should_be_interruptible)
     TESTENTRY (memory_scan_handles_unreadable_memory)
     TESTENTRY (memory_access_can_be_monitored)
@@ -360,6 +367,8 @@ TESTLIST_BEGIN (script)
     TESTENTRY (execution_can_be_traced)
     TESTENTRY (execution_can_be_traced_with_custom_transformer)
     TESTENTRY (execution_can_be_traced_with_faulty_transformer)
+    TESTENTRY (execution_can_be_traced_with_dropped_events_counted)
+    TESTENTRY (execution_can_be_traced_in_compact_form)
     TESTENTRY (execution_can_be_traced_during_immediate_native_function_call)
     TESTENTRY (execution_can_be_traced_during_scheduled_native_function_call)
     TESTENTRY (execution_can_be_traced_after_native_function_call_from_hook)
@@ -370,6 +379,8 @@ TESTLIST_BEGIN (script)
     TESTENTRY (call_can_be_probed)
 #endif
     TESTENTRY (stalker_events_can_be_parsed)
+    TESTENTRY (compact_stalker_events_can_be_parsed)
+    TESTENTRY (stalker_stats_can_be_queried)
   TESTGROUP_END ()
 
   TESTENTRY (script_can_be_compiled_to_bytecode)
@@ -3287,6 +3298,111 @@ TESTCASE (execution_can_be_traced)
   EXPECT_SEND_MESSAGE_WITH ("\"onReceive: true\"");
 }
 
+TESTCASE (execution_can_be_traced_in_compact_form)
+{
+  GumThreadId test_thread_id;
+
+#ifdef __ARM_PCS_VFP
+  if (!g_test_slow ())
+  {
+    g_print ("<skipping, run in slow mode> ");
+    return;
+  }
+#endif
+
+  test_thread_id = gum_process_get_current_thread_id ();
+
+  COMPILE_AND_LOAD_SCRIPT (
+      "Stalker.queueDrainInterval = 0;"
+      "const testsRange = Process.getModuleByName('%s');"
+      "Stalker.exclude(testsRange);"
+
+      "let parsed = 0;"
+      "let summarized = 0;"
+      "let wellFormed = true;"
+
+      "Stalker.follow(%" G_GSIZE_FORMAT ", {"
+      "  events: {"
+      "    call: true,"
+      "    ret: false,"
+      "    exec: false"
+      "  },"
+      "  compact: true,"
+      "  onReceive(events) {"
+      "    for (const ev of Stalker.parse(events, { compact: true })) {"
+      "      if (ev[0] !== 'call' || !(ev[2] instanceof NativePointer))"
+      "        wellFormed = false;"
+      "      parsed++;"
+      "    }"
+      "  },"
+      "  onCallSummary(summary) {"
+      "    for (const count of Object.values(summary))"
+      "      summarized += count;"
+      "  }"
+      "});"
+
+      "recv('stop', message => {"
+      "  Stalker.unfollow(%" G_GSIZE_FORMAT ");"
+      "  Stalker.flush();"
+      "  send([parsed > 0, wellFormed, parsed === summarized]);"
+      "});",
+
+      GUM_TESTS_MODULE_NAME,
+      test_thread_id,
+      test_thread_id);
+  EXPECT_NO_MESSAGES ();
+
+  POST_MESSAGE ("{\"type\":\"stop\"}");
+  EXPECT_SEND_MESSAGE_WITH ("[true,true,true]");
+}
+
+TESTCASE (execution_can_be_traced_with_dropped_events_counted)
+{
+  GumThreadId test_thread_id;
+
+#ifdef __ARM_PCS_VFP
+  if (!g_test_slow ())
+  {
+    g_print ("<skipping, run in slow mode> ");
+    return;
+  }
+#endif
+
+  test_thread_id = gum_process_get_current_thread_id ();
+
+  COMPILE_AND_LOAD_SCRIPT (
+      "Stalker.queueCapacity = 1;"
+      "Stalker.queueDrainInterval = 0;"
+      "const testsRange = Process.getModuleByName('%s');"
+      "Stalker.exclude(testsRange);"
+
+      "Stalker.follow(%" G_GSIZE_FORMAT ", {"
+      "  events: {"
+      "    call: true,"
+      "    ret: false,"
+      "    exec: false"
+      "  },"
+      "  onReceive(events) {"
+      "    send('onReceive: ' + events.byteLength + ' '"
+      "        + (Stalker.droppedEvents > 0));"
+      "  }"
+      "});"
+
+      "recv('stop', message => {"
+      "  Stalker.unfollow(%" G_GSIZE_FORMAT ");"
+      "  Stalker.flush();"
+      "});",
+
+      GUM_TESTS_MODULE_NAME,
+      test_thread_id,
+      test_thread_id);
+  EXPECT_NO_MESSAGES ();
+
+  POST_MESSAGE ("{\"type\":\"stop\"}");
+  EXPECT_SEND_MESSAGE_WITH ("\"onReceive: %u true\"",
+      (guint) sizeof (GumEvent));
+}
+
 TESTCASE (execution_can_be_traced_with_custom_transformer)
 {
   GumThreadId test_thread_id;
@@ -3806,6 +3922,76 @@ TESTCASE (stalker_events_can_be_parsed)
   EXPECT_ERROR_MESSAGE_WITH (ANY_LINE_NUMBER, "Error: invalid event type");
 }
 
+TESTCASE (compact_stalker_events_can_be_parsed)
+{
+  guint8 buffer[3 * GUM_COMPACT_EVENT_MAX_SIZE];
+  gsize size = 0;
+  GumAddress previous = 0;
+  GumEvent ev;
+
+  ev.type = GUM_CALL;
+  ev.call.location = GSIZE_TO_POINTER (7);
+  ev.call.target = GSIZE_TO_POINTER (12);
+  ev.call.depth = 42;
+  size += gum_event_encode_compact (&ev, &previous, buffer + size);
+
+  ev.type = GUM_EXEC;
+  ev.exec.location = GSIZE_TO_POINTER (5);
+  size += gum_event_encode_compact (&ev, &previous, buffer + size);
+
+  ev.type = GUM_BLOCK;
+  ev.block.start = GSIZE_TO_POINTER (0x1000);
+  ev.block.end = GSIZE_TO_POINTER (0x1010);
+  size += gum_event_encode_compact (&ev, &previous, buffer + size);
+
+  COMPILE_AND_LOAD_SCRIPT ("send(Stalker.parse(" GUM_PTR_CONST ".readByteArray("
+      "%" G_GSIZE_FORMAT "), { compact: true }));", buffer, size);
+  EXPECT_SEND_MESSAGE_WITH ("[[\"call\",\"0x7\",\"0xc\",42],"
+      "[\"exec\",\"0x5\"],[\"block\",\"0x1000\",\"0x1010\"]]");
+
+  COMPILE_AND_LOAD_SCRIPT ("send(Stalker.parse(new Uint8Array([0x7f]).buffer, "
+      "{ compact: true }));");
+  EXPECT_ERROR_MESSAGE_WITH (ANY_LINE_NUMBER,
+      "Error: invalid compact event stream");
+}
+
+TESTCASE (stalker_stats_can_be_queried)
+{
+#if defined (HAVE_I386) || defined (HAVE_ARM64)
+  COMPILE_AND_LOAD_SCRIPT (
+      "send(Stalker.queryStats());"
+
+      "const a = new NativeFunction(" GUM_PTR_CONST ", 'int', ['int'], "
+          "{ traps: 'all', exceptions: 'propagate' });"
+
+      "Stalker.follow();"
+      "a(42);"
+      "const threadId = Process.getCurrentThreadId();"
+      "const stats = Stalker.queryStats()"
+      "    .filter(s => s.threadId === threadId);"
+      "Stalker.unfollow();"
+      "Stalker.flush();"
+
+      "send(stats.length);"
+      "const [s] = stats;"
+      "send(s.blocksCompiled > 0);"
+      "send(s.codeBytes > 0);"
+      "send(s.dataBytes > 0);"
+      "send(Object.values(s.entryGates).some(hits => hits > 0));",
+      target_function_nested_a);
+  EXPECT_SEND_MESSAGE_WITH ("[]");
+  EXPECT_SEND_MESSAGE_WITH ("1");
+  EXPECT_SEND_MESSAGE_WITH ("true");
+  EXPECT_SEND_MESSAGE_WITH ("true");
+  EXPECT_SEND_MESSAGE_WITH ("true");
+  EXPECT_SEND_MESSAGE_WITH ("true");
+  EXPECT_NO_MESSAGES ();
+#else
+  COMPILE_AND_LOAD_SCRIPT ("send(Stalker.queryStats());");
+  EXPECT_SEND_MESSAGE_WITH ("[]");
+#endif
+}
+
 TESTCASE (frida_version_is_available)
 {
   COMPILE_AND_LOAD_SCRIPT ("send(typeof Frida.version);");
@@ -5928,6 +6114,78 @@ TESTCASE (instructions_can_be_probed)
   EXPECT_NO_MESSAGES ();
 }
 
+TESTCASE (probes_provide_arguments_and_call_depth)
+{
+  COMPILE_AND_LOAD_SCRIPT (
+      "Interceptor.attach(" GUM_PTR_CONST ", function (args) {"
+      "  send(`${args[0].toInt32()} ${this.depth}`);"
+      "});", target_function_int);
+
+  EXPECT_NO_MESSAGES ();
+
+  target_function_int (42);
+  EXPECT_SEND_MESSAGE_WITH ("\"42 0\"");
+  EXPECT_NO_MESSAGES ();
+
+  target_function_int (-7);
+  EXPECT_SEND_MESSAGE_WITH ("\"-7 0\"");
+  EXPECT_NO_MESSAGES ();
+}
+
+TESTCASE (probes_provide_return_address)
+{
+  COMPILE_AND_LOAD_SCRIPT (
+      "const target = " GUM_PTR_CONST ";"
+      "const f = new NativeFunction(target, 'int', ['int']);"
+      "let expected = null;"
+      "const listener = Interceptor.attach(target, {"
+      "  onEnter() {"
+      "    expected = this.returnAddress;"
+      "  },"
+      "  onLeave() {"
+      "  }"
+      "});"
+      "Interceptor.flush();"
+      "f(1);"
+      "listener.detach();"
+      "Interceptor.attach(target, function () {"
+      "  send(this.returnAddress.equals(expected));"
+      "});"
+      "Interceptor.flush();"
+      "f(2);",
+      target_function_int);
+
+  EXPECT_SEND_MESSAGE_WITH ("true");
+  EXPECT_NO_MESSAGES ();
+}
+
+TESTCASE (probes_provide_return_address_alongside_other_probes)
+{
+  COMPILE_AND_LOAD_SCRIPT (
+      "const target = " GUM_PTR_CONST ";"
+      "const f = new NativeFunction(target, 'int', ['int']);"
+      "let expected = null;"
+      "const listener = Interceptor.attach(target, function () {"
+      "  expected = this.returnAddress;"
+      "});"
+      "Interceptor.flush();"
+      "f(1);"
+      "listener.detach();"
+      "Interceptor.attach(target, function () {"
+      "  send(`a ${this.returnAddress.equals(expected)}`);"
+      "});"
+      "Interceptor.attach(target, function () {"
+      "  send(`b ${this.returnAddress.equals(expected)}`);"
+      "});"
+      "Interceptor.flush();"
+      "f(2);",
+      target_function_int);
+
+  EXPECT_SEND_MESSAGE_WITH ("\"a true\"");
+  EXPECT_SEND_MESSAGE_WITH ("\"b true\"");
+  EXPECT_NO_MESSAGES ();
+}
+
 TESTCASE (interceptor_should_support_native_pointer_values)
 {
   COMPILE_AND_LOAD_SCRIPT (
@@ -5979,6 +6237,44 @@ TESTCASE (interceptor_should_refuse_to_attach_without_any_callbacks)
       "Error: expected at least one callback");
 }
 
+TESTCASE (interceptor_can_attach_to_many_functions)
+{
+  COMPILE_AND_LOAD_SCRIPT (
+      "const listener = Interceptor.attachMany(["
+          GUM_PTR_CONST ", " GUM_PTR_CONST
+      "], {"
+      "  onEnter(args) {"
+      "    send('>');"
+      "  },"
+      "  onLeave(retval) {"
+      "    send('<');"
+      "  }"
+      "});"
+      "recv('detach', () => {"
+      "  listener.detach();"
+      "});",
+      target_function_int, target_function_string);
+
+  EXPECT_NO_MESSAGES ();
+  target_function_int (42);
+  EXPECT_SEND_MESSAGE_WITH ("\">\"");
+  EXPECT_SEND_MESSAGE_WITH ("\"<\"");
+  target_function_string ("foo");
+  EXPECT_SEND_MESSAGE_WITH ("\">\"");
+  EXPECT_SEND_MESSAGE_WITH ("\"<\"");
+
+  POST_MESSAGE ("{\"type\":\"detach\"}");
+  target_function_int (42);
+  target_function_string ("foo");
+  EXPECT_NO_MESSAGES ();
+
+  COMPILE_AND_LOAD_SCRIPT (
+      "Interceptor.attachMany([" GUM_PTR_CONST "], {});",
+      target_function_int);
+  EXPECT_ERROR_MESSAGE_WITH (ANY_LINE_NUMBER,
+      "Error: expected at least one callback");
+}
+
 TESTCASE (interceptor_on_enter_performance)
 {
   COMPILE_AND_LOAD_SCRIPT (
@@ -6116,6 +6412,90 @@ TESTCASE (memory_can_be_scanned)
   EXPECT_SEND_MESSAGE_WITH ("\"onComplete\"");
 }
 
+TESTCASE (memory_ranges_can_be_scanned_in_parallel)
+{
+  guint8 haystack[] = { 0x01, 0x02, 0x13, 0x37, 0x03, 0x13, 0x37 };
+
+  COMPILE_AND_LOAD_SCRIPT (
+      "const base = " GUM_PTR_CONST ";"
+      "Memory.scanRanges(["
+        "{ base: base.add(4), size: 3 },"
+        "{ base: base, size: 4 }"
+      "], '13 37', {"
+        "onMatch(address, size) {"
+        "  send('onMatch offset=' + address.sub(base).toInt32() +"
+        "      ' size=' + size);"
+        "},"
+        "onComplete() {"
+        "  send('onComplete');"
+        "}"
+      "}, 2);", haystack);
+  EXPECT_SEND_MESSAGE_WITH ("\"onMatch offset=2 size=2\"");
+  EXPECT_SEND_MESSAGE_WITH ("\"onMatch offset=5 size=2\"");
+  EXPECT_SEND_MESSAGE_WITH ("\"onComplete\"");
+}
+
+TESTCASE (memory_can_be_scanned_for_multiple_patterns)
+{
+  guint8 haystack[] = { 0x01, 0x02, 0x13, 0x37, 0x03, 0x13, 0x37, 0xaa };
+
+  COMPILE_AND_LOAD_SCRIPT (
+      "const base = " GUM_PTR_CONST ";"
+      "for (const m of Memory.scanPatternsSync(base, 8, ['13 37', '37 aa'])) {"
+      "  send(`match offset=${m.address.sub(base).toInt32()} "
+          "size=${m.size} pattern=${m.pattern}`);"
+      "}"
+      "send('done');",
+      haystack);
+  EXPECT_SEND_MESSAGE_WITH ("\"match offset=2 size=2 pattern=0\"");
+  EXPECT_SEND_MESSAGE_WITH ("\"match offset=5 size=2 pattern=0\"");
+  EXPECT_SEND_MESSAGE_WITH ("\"match offset=6 size=2 pattern=1\"");
+  EXPECT_SEND_MESSAGE_WITH ("\"done\"");
+
+  COMPILE_AND_LOAD_SCRIPT (
+      "try {"
+      "  Memory.scanPatternsSync(" GUM_PTR_CONST ", 8, ['13 37', 'x']);"
+      "} catch (e) {"
+      "  send(e.message);"
+      "}",
+      haystack);
+  EXPECT_SEND_MESSAGE_WITH ("\"invalid match pattern\"");
+}
+
+TESTCASE (memory_can_be_scanned_for_multiple_patterns_asynchronously)
+{
+  guint8 haystack[] = { 0x01, 0x02, 0x13, 0x37, 0x03, 0x13, 0x37, 0xaa };
+
+  COMPILE_AND_LOAD_SCRIPT (
+      "const base = " GUM_PTR_CONST ";"
+      "Memory.scanPatterns(base, 8, ['13 37', '37 aa'], {"
+        "onMatch(address, size, pattern) {"
+        "  send(`onMatch offset=${address.sub(base).toInt32()} "
+            "size=${size} pattern=${pattern}`);"
+        "},"
+        "onComplete() {"
+        "  send('onComplete');"
+        "}"
+      "});", haystack);
+  EXPECT_SEND_MESSAGE_WITH ("\"onMatch offset=2 size=2 pattern=0\"");
+  EXPECT_SEND_MESSAGE_WITH ("\"onMatch offset=5 size=2 pattern=0\"");
+  EXPECT_SEND_MESSAGE_WITH ("\"onMatch offset=6 size=2 pattern=1\"");
+  EXPECT_SEND_MESSAGE_WITH ("\"onComplete\"");
+
+  COMPILE_AND_LOAD_SCRIPT (
+      "Memory.scanPatterns(" GUM_PTR_CONST ", 8, ['13 37', '37 aa'], {"
+        "onMatch(address, size, pattern) {"
+        "  send('onMatch pattern=' + pattern);"
+        "  return 'stop';"
+        "},"
+        "onComplete() {"
+        "  send('onComplete');"
+        "}"
+      "});", haystack);
+  EXPECT_SEND_MESSAGE_WITH ("\"onMatch pattern=0\"");
+  EXPECT_SEND_MESSAGE_WITH ("\"onComplete\"");
+}
+
 TESTCASE (memory_can_be_scanned_synchronously)
 {
   guint8 haystack[] = { 0x01, 0x02, 0x13, 0x37, 0x03, 0x13, 0x37 };
@@ -171,6 +171,7 @@ main (gint argc, gchar * argv[])
   TESTLIST_REGISTER (testutil);
   TESTLIST_REGISTER (tls);
   TESTLIST_REGISTER (cloak);
+  TESTLIST_REGISTER (event_sink);
   TESTLIST_REGISTER (memory);
   TESTLIST_REGISTER (process);
 #if !defined (HAVE_QNX) && !(defined (HAVE_ANDROID) && defined (HAVE_ARM64))
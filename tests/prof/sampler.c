@@ -9,6 +9,10 @@
 
 TESTLIST_BEGIN (sampler)
   TESTENTRY (cycle)
+  TESTENTRY (cycle_should_be_sampled_from_other_threads)
+#if defined (HAVE_LINUX) && !defined (HAVE_I386)
+  TESTENTRY (cycle_counters_should_be_released_on_thread_exit)
+#endif
   TESTENTRY (busy_cycle)
 #if defined (HAVE_FRIDA_GLIB) && !defined (HAVE_ASAN)
   TESTENTRY (malloc_count)
@@ -18,20 +22,81 @@ TESTLIST_BEGIN (sampler)
 TESTLIST_END ()
 
 static void spin_for_one_tenth_second (void);
+static gpointer cycle_helper_thread (gpointer data);
+#if defined (HAVE_LINUX) && !defined (HAVE_I386)
+static guint count_open_fds (void);
+#endif
 static gpointer malloc_count_helper_thread (gpointer data);
 static void nop_function_a (void);
 static void nop_function_b (void);
 
 TESTCASE (cycle)
 {
-  GumSample sample_a, sample_b;
+  GumSample first, previous, sample;
+  guint i;
+
+  fixture->sampler = gum_cycle_sampler_new ();
+  if (gum_cycle_sampler_is_available (GUM_CYCLE_SAMPLER (fixture->sampler)))
+  {
+    first = gum_sampler_sample (fixture->sampler);
+    g_assert_cmpuint (first, !=, 0);
+
+    previous = first;
+    for (i = 0; i != 1000; i++)
+    {
+      sample = gum_sampler_sample (fixture->sampler);
+      g_assert_cmpuint (sample, >=, previous);
+      previous = sample;
+    }
+
+    spin_for_one_tenth_second ();
+
+    sample = gum_sampler_sample (fixture->sampler);
+    g_assert_cmpuint (sample, >, previous);
+  }
+  else
+  {
+    g_test_message ("skipping test because of unsupported OS");
+  }
+}
+
+TESTCASE (cycle_should_be_sampled_from_other_threads)
+{
+  GThread * helper_thread;
+  gboolean counted;
+
+  fixture->sampler = gum_cycle_sampler_new ();
+  if (gum_cycle_sampler_is_available (GUM_CYCLE_SAMPLER (fixture->sampler)))
+  {
+    helper_thread = g_thread_new ("sampler-test-cycle", cycle_helper_thread,
+        fixture->sampler);
+    counted = GPOINTER_TO_SIZE (g_thread_join (helper_thread));
+    g_assert_true (counted);
+  }
+  else
+  {
+    g_test_message ("skipping test because of unsupported OS");
+  }
+}
+
+#if defined (HAVE_LINUX) && !defined (HAVE_I386)
+
+TESTCASE (cycle_counters_should_be_released_on_thread_exit)
+{
+  guint fds_before, fds_after;
+  GThread * helper_thread;
 
   fixture->sampler = gum_cycle_sampler_new ();
   if (gum_cycle_sampler_is_available (GUM_CYCLE_SAMPLER (fixture->sampler)))
   {
-    sample_a = gum_sampler_sample (fixture->sampler);
-    sample_b = gum_sampler_sample (fixture->sampler);
-    g_assert_cmpuint (sample_a, !=, sample_b);
+    fds_before = count_open_fds ();
+
+    helper_thread = g_thread_new ("sampler-test-cycle", cycle_helper_thread,
+        fixture->sampler);
+    g_thread_join (helper_thread);
+
+    fds_after = count_open_fds ();
+    g_assert_cmpuint (fds_after, ==, fds_before);
   }
   else
   {
@@ -39,6 +104,8 @@ TESTCASE (cycle)
   }
 }
 
+#endif
+
 TESTCASE (busy_cycle)
 {
   GumSample spin_start, spin_diff;
@@ -176,6 +243,40 @@ spin_for_one_tenth_second (void)
   g_timer_destroy (timer);
 }
 
+static gpointer
+cycle_helper_thread (gpointer data)
+{
+  GumSampler * sampler = data;
+  GumSample sample_a, sample_b;
+
+  sample_a = gum_sampler_sample (sampler);
+  spin_for_one_tenth_second ();
+  sample_b = gum_sampler_sample (sampler);
+
+  return GSIZE_TO_POINTER (sample_b > sample_a);
+}
+
+#if defined (HAVE_LINUX) && !defined (HAVE_I386)
+
+static guint
+count_open_fds (void)
+{
+  guint count = 0;
+  GDir * dir;
+
+  dir = g_dir_open ("/proc/self/fd", 0, NULL);
+  g_assert_nonnull (dir);
+
+  while (g_dir_read_name (dir) != NULL)
+    count++;
+
+  g_dir_close (dir);
+
+  return count;
+}
+
+#endif
+
 static gpointer
 malloc_count_helper_thread (gpointer data)
 {